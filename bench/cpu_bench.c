@@ -0,0 +1,561 @@
+/*********************************************************************************************************************
+ * Measures simulator throughput                                                                                     *
+ *                                                                                                                   *
+ * Every instruction benchmark fills memory with a block of one instruction class closed by a jump back to the      *
+ * start, then runs it on each backend and reports the nanoseconds per executed instruction and MIPS. Mixed programs *
+ * measure the same for realistic loops, memory benchmarks the cost per operation of creating and copying memory.   *
+ * Device benchmarks time LD and ST going over the bus to a UART writing to /dev/null and a block device.            *
+ *                                                                                                                   *
+ * Results are printed as CSV, or one JSON object per line with --json, so runs can be compared across releases:     *
+ *     cpu_bench [--json] [--filter=substring] [--steps=instructions] [--repetitions=count]                           *
+ *********************************************************************************************************************/
+
+#include "../src/bit_utils.h"
+#include "../src/branch_predictor.h"
+#include "../src/bus.h"
+#include "../src/cache.h"
+#include "../src/cpu.h"
+#include "../src/decode_cache.h"
+#include "../src/devices.h"
+#include "../src/memory.h"
+#include "../src/mmu.h"
+#include "../src/profile.h"
+#include "../src/snapshot.h"
+#include "../src/timing.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Length of the block of repeated instructions, long enough for the closing jump to be noise */
+#define BENCH_BLOCK_INSTRUCTIONS 255
+
+#define BENCH_DEFAULT_STEPS       20000000
+#define BENCH_DEFAULT_REPETITIONS 3
+#define BENCH_MAX_PROGRAM_WORDS   256
+#define BENCH_DEVICE_BASE         MEMORY_SIZE_BYTES // Devices sit right past the end of memory
+
+/* Encodings shared by the programs below, R8 stays zero so it serves as the base of absolute addresses */
+#define JMPI(base, offset)                   (JMP_BITMASK | BITMASK_5 | (base) << 8 | (uint32_t)(offset) << 11)
+#define JMPIC(control, base, offset)         (JMPI(base, offset) | BITMASK_4 | (control) << 5)
+#define JMPR(base, offset)                   (JMP_BITMASK | (base) << 8 | (offset) << 11)
+#define MEMORY_OP(bitmask, data, base, size) ((bitmask) | (data) << 7 | (base) << 10 | (uint32_t)(size) << 13)
+#define ALU_OP(bitmask, dest, src1, src2)    ((bitmask) | (dest) << 7 | (src1) << 10 | (uint32_t)(src2) << 13)
+#define SHIFT_OP(bitmask, dest, src, value)  ((bitmask) | (dest) << 6 | (src) << 9 | (uint32_t)(value) << 12)
+
+typedef struct BenchOptions {
+    bool json;
+    const char *filter;
+    uint64_t steps;
+    uint32_t repetitions;
+} BenchOptions;
+
+typedef struct BenchProgram {
+    uint32_t words[BENCH_MAX_PROGRAM_WORDS];
+    uint32_t word_count;
+    uint32_t registers[8];
+} BenchProgram;
+
+typedef struct InstructionBench {
+    const char *name;
+    uint32_t word; // Repeated to fill the block, 0 when build builds the whole program
+    void (*build)(BenchProgram *program);
+} InstructionBench;
+
+typedef struct BackendConfig {
+    const char *name;
+    CpuBackend backend;
+    bool decode_cache;
+    bool profile;
+    bool timing;
+    bool cache;
+    bool branch_predictor;
+    bool mmu;
+} BackendConfig;
+
+static const BackendConfig BACKENDS[] = {
+    {"interpreter", CPU_BACKEND_INTERPRETER, false, false, false, false, false, false},
+    {"decode_cache", CPU_BACKEND_INTERPRETER, true, false, false, false, false, false},
+    {"threaded", CPU_BACKEND_THREADED, false, false, false, false, false, false},
+    {"jit", CPU_BACKEND_JIT, false, false, false, false, false, false},
+    {"profiled", CPU_BACKEND_INTERPRETER, true, true, false, false, false, false},
+    {"timed", CPU_BACKEND_INTERPRETER, true, false, true, false, false, false},
+    {"cached", CPU_BACKEND_INTERPRETER, true, false, false, true, false, false},
+    {"predicted", CPU_BACKEND_INTERPRETER, true, false, false, false, true, false},
+    {"translated", CPU_BACKEND_INTERPRETER, true, false, false, false, false, true},
+};
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> utils >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static bool is_selected(const BenchOptions *options, const char *name) {
+    return options->filter == NULL || strstr(name, options->filter) != NULL;
+}
+
+static void print_header(const BenchOptions *options) {
+    if (!options->json) {
+        printf("benchmark,backend,unit,count,seconds,ns_per_unit,millions_per_second\n");
+    }
+}
+
+/* Millions per second is MIPS when the unit is an instruction */
+static void print_result(const BenchOptions *options, const char *name, const char *backend, const char *unit,
+                         uint64_t count, double seconds) {
+    double ns_per_unit = count == 0 ? 0 : seconds * 1e9 / count;
+    double millions_per_second = seconds == 0 ? 0 : count / seconds / 1e6;
+    if (options->json) {
+        printf("{\"benchmark\":\"%s\",\"backend\":\"%s\",\"unit\":\"%s\",\"count\":%" PRIu64
+               ",\"seconds\":%.6f,\"ns_per_unit\":%.3f,\"millions_per_second\":%.3f}\n",
+               name, backend, unit, count, seconds, ns_per_unit, millions_per_second);
+    } else {
+        printf("%s,%s,%s,%" PRIu64 ",%.6f,%.3f,%.3f\n", name, backend, unit, count, seconds, ns_per_unit,
+               millions_per_second);
+    }
+    fflush(stdout);
+}
+
+static void store_program(Memory *memory, const BenchProgram *program) {
+    for (uint32_t i = 0; i < program->word_count; i++) {
+        memory->data[i * 4] = program->words[i] >> 24;
+        memory->data[i * 4 + 1] = program->words[i] >> 16;
+        memory->data[i * 4 + 2] = program->words[i] >> 8;
+        memory->data[i * 4 + 3] = program->words[i];
+    }
+}
+
+/* Maps the first 4MB of the address space onto itself with the page tables in the last two pages of memory */
+static Mmu *init_identity_mmu(Memory *memory) {
+    uint32_t directory = MEMORY_SIZE_BYTES - 2 * MMU_PAGE_BYTES;
+    uint32_t table = MEMORY_SIZE_BYTES - MMU_PAGE_BYTES;
+    store_memory_word(memory, directory, table | MMU_ENTRY_VALID);
+    for (uint32_t page = 0; page < 1024; page++) {
+        store_memory_word(memory, table + page * 4,
+                          page * MMU_PAGE_BYTES | MMU_ENTRY_VALID | MMU_ENTRY_WRITABLE | MMU_ENTRY_EXECUTE);
+    }
+    return init_mmu(directory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> programs >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* R1 and R2 hold operands that never divide by zero, R7 and R8 stay zero for jumps that are taken */
+static void init_bench_registers(BenchProgram *program) {
+    const uint32_t registers[8] = {12345, 7, 0, 0, 0, 0, 0, 0};
+    memcpy(program->registers, registers, sizeof(registers));
+}
+
+static void build_repeated(BenchProgram *program, uint32_t word) {
+    for (uint32_t i = 0; i < BENCH_BLOCK_INSTRUCTIONS; i++) {
+        program->words[i] = word;
+    }
+    program->words[BENCH_BLOCK_INSTRUCTIONS] = JMPI(7, 0);
+    program->word_count = BENCH_BLOCK_INSTRUCTIONS + 1;
+}
+
+/* Every jump lands on the next instruction, so each one is taken */
+static void build_jmpi_chain(BenchProgram *program) {
+    for (uint32_t i = 0; i < BENCH_BLOCK_INSTRUCTIONS; i++) {
+        program->words[i] = JMPI(7, (i + 1) * 4);
+    }
+    program->words[BENCH_BLOCK_INSTRUCTIONS] = JMPI(7, 0);
+    program->word_count = BENCH_BLOCK_INSTRUCTIONS + 1;
+}
+
+static void build_jmpic_taken_chain(BenchProgram *program) {
+    for (uint32_t i = 0; i < BENCH_BLOCK_INSTRUCTIONS; i++) {
+        program->words[i] = JMPIC(6, 7, (i + 1) * 4);
+    }
+    program->words[BENCH_BLOCK_INSTRUCTIONS] = JMPI(7, 0);
+    program->word_count = BENCH_BLOCK_INSTRUCTIONS + 1;
+}
+
+/* Two register jumps bouncing between each other */
+static void build_jmp_register_pair(BenchProgram *program) {
+    program->words[0] = JMPR(7, 2); // JMP R8 R3, R3 holds 4
+    program->words[1] = JMPR(7, 7); // JMP R8 R8
+    program->word_count = 2;
+    program->registers[2] = 4;
+}
+
+/* Adds up R1 down to zero and starts over, the loop of the unit tests */
+static void build_sum_loop(BenchProgram *program) {
+    const uint32_t words[] = {
+        ALU_OP(ADD_BITMASK, 1, 1, 0),     // ADD   R2 R2 R1
+        ALU_OP(SUBI_BITMASK, 0, 0, 1),    // SUBI  R1 R1 1
+        JMPIC(0, 7, 16),                  // JMPIC R8 16 R1
+        JMPI(7, 0),                       // JMPI  R8 0
+        SET_BITMASK | 0 << 4 | 1000 << 7, // SET   R1 1000
+        JMPI(7, 0),                       // JMPI  R8 0
+    };
+    memcpy(program->words, words, sizeof(words));
+    program->word_count = sizeof(words) / sizeof(words[0]);
+    program->registers[0] = 1000;
+}
+
+/* Copies 256 words from 8192 to 16384, one load and one store per word */
+static void build_copy_loop(BenchProgram *program) {
+    const uint32_t words[] = {
+        MEMORY_OP(LDWI_BITMASK, 2, 0, 8195),  // LDWI  R3 R1 8195
+        MEMORY_OP(STWI_BITMASK, 2, 0, 16387), // STWI  R3 R1 16387
+        ALU_OP(ADDI_BITMASK, 0, 0, 4),        // ADDI  R1 R1 4
+        ALU_OP(SUBI_BITMASK, 3, 0, 1024),     // SUBI  R4 R1 1024
+        JMPIC(3, 7, 24),                      // JMPIC R8 24 R4
+        JMPI(7, 0),                           // JMPI  R8 0
+        SET_BITMASK | 0 << 4 | 0 << 7,        // SET   R1 0
+        JMPI(7, 0),                           // JMPI  R8 0
+    };
+    memcpy(program->words, words, sizeof(words));
+    program->word_count = sizeof(words) / sizeof(words[0]);
+    program->registers[0] = 0;
+}
+
+/* Adds a 32 bit constant to 256 words at 8192, built of the idioms the threaded backend fuses */
+static void build_increment_loop(BenchProgram *program) {
+    const uint32_t words[] = {
+        SET_BITMASK | 1 << 4 | 3 << 7,       // SET   R2 3
+        SETU_BITMASK | 1 << 3 | 1 << 6,      // SETU  R2 1
+        MEMORY_OP(LDWI_BITMASK, 2, 0, 8195), // LDWI  R3 R1 8195
+        ALU_OP(ADD_BITMASK, 2, 2, 1),        // ADD   R3 R3 R2
+        MEMORY_OP(STWI_BITMASK, 2, 0, 8195), // STWI  R3 R1 8195
+        ALU_OP(ADDI_BITMASK, 0, 0, 4),       // ADDI  R1 R1 4
+        ALU_OP(SUBI_BITMASK, 3, 0, 1024),    // SUBI  R4 R1 1024
+        JMPIC(3, 7, 36),                     // JMPIC R8 36 R4
+        JMPI(7, 0),                          // JMPI  R8 0
+        SET_BITMASK | 0 << 4 | 0 << 7,       // SET   R1 0
+        JMPI(7, 0),                          // JMPI  R8 0
+    };
+    memcpy(program->words, words, sizeof(words));
+    program->word_count = sizeof(words) / sizeof(words[0]);
+    program->registers[0] = 0;
+}
+
+/* Roughly the instruction mix of compiled code: arithmetic, bit manipulation, memory traffic and branches */
+static void build_mixed_loop(BenchProgram *program) {
+    const uint32_t words[] = {
+        SETU_BITMASK | 3 << 3 | 5 << 6,      // SETU  R4 5
+        ALU_OP(MUL_BITMASK, 3, 3, 0),        // MUL   R4 R4 R1
+        ALU_OP(XORI_BITMASK, 4, 3, 0x1234),  // XORI  R5 R4 0x1234
+        SHIFT_OP(BSLRI_BITMASK, 5, 4, 7),    // BSLRI R6 R5 7
+        SHIFT_OP(BSRI_BITMASK, 6, 5, 3),     // BSRI  R7 R6 3
+        MEMORY_OP(STWI_BITMASK, 6, 7, 8195), // STWI  R7 R8 8195
+        MEMORY_OP(LDHI_BITMASK, 2, 7, 8193), // LDHI  R3 R8 8193
+        ALU_OP(DIV_BITMASK, 2, 2, 1),        // DIV   R3 R3 R2
+        ALU_OP(ANDI_BITMASK, 2, 2, 0xFF),    // ANDI  R3 R3 0xFF
+        ALU_OP(ADD_BITMASK, 0, 0, 2),        // ADD   R1 R1 R3
+        ALU_OP(SUBI_BITMASK, 1, 1, 1),       // SUBI  R2 R2 1
+        JMPIC(1, 7, 52),                     // JMPIC R8 52 R2
+        JMPI(7, 0),                          // JMPI  R8 0
+        SET_BITMASK | 1 << 4 | 7 << 7,       // SET   R2 7
+        JMPI(7, 0),                          // JMPI  R8 0
+    };
+    memcpy(program->words, words, sizeof(words));
+    program->word_count = sizeof(words) / sizeof(words[0]);
+}
+
+static const InstructionBench INSTRUCTION_BENCHES[] = {
+    {"jmpi", 0, build_jmpi_chain},
+    {"jmp_register", 0, build_jmp_register_pair},
+    {"jmpic_taken", 0, build_jmpic_taken_chain},
+    {"jmpic_not_taken", JMPIC(0, 7, 0), NULL},
+    {"stb", MEMORY_OP(STBI_BITMASK, 0, 7, 8192), NULL},
+    {"sth", MEMORY_OP(STHI_BITMASK, 0, 7, 8193), NULL},
+    {"stw", MEMORY_OP(STWI_BITMASK, 0, 7, 8195), NULL},
+    {"ldb", MEMORY_OP(LDBI_BITMASK, 2, 7, 8192), NULL},
+    {"ldh", MEMORY_OP(LDHI_BITMASK, 2, 7, 8193), NULL},
+    {"ldw", MEMORY_OP(LDWI_BITMASK, 2, 7, 8195), NULL},
+    {"set", SET_BITMASK | 2 << 4 | 1000 << 7, NULL},
+    {"setu", SETU_BITMASK | 2 << 3 | 5 << 6, NULL},
+    {"add", ALU_OP(ADD_BITMASK, 2, 0, 1), NULL},
+    {"addi", ALU_OP(ADDI_BITMASK, 2, 0, 99), NULL},
+    {"sub", ALU_OP(SUB_BITMASK, 2, 0, 1), NULL},
+    {"mul", ALU_OP(MUL_BITMASK, 2, 0, 1), NULL},
+    {"div", ALU_OP(DIV_BITMASK, 2, 0, 1), NULL},
+    {"mod", ALU_OP(MOD_BITMASK, 2, 0, 1), NULL},
+    {"and", ALU_OP(AND_BITMASK, 2, 0, 1), NULL},
+    {"or", ALU_OP(OR_BITMASK, 2, 0, 1), NULL},
+    {"xor", ALU_OP(XOR_BITMASK, 2, 0, 1), NULL},
+    {"bsr", SHIFT_OP(BSRI_BITMASK, 2, 0, 3), NULL},
+    {"bsrr", SHIFT_OP(BSRRI_BITMASK, 2, 0, 3), NULL},
+    {"bsl", SHIFT_OP(BSLI_BITMASK, 2, 0, 3), NULL},
+    {"bslr", SHIFT_OP(BSLRI_BITMASK, 2, 0, 3), NULL},
+    {"mixed_sum_loop", 0, build_sum_loop},
+    {"mixed_copy_loop", 0, build_copy_loop},
+    {"mixed_alu_memory_loop", 0, build_mixed_loop},
+    {"mixed_increment_loop", 0, build_increment_loop},
+};
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> instructions >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Returns the fastest of the repetitions, each one starting from a fresh CPU and memory */
+static double time_program(const BenchProgram *program, const BackendConfig *config, Bus *bus, uint64_t steps,
+                           uint32_t repetitions, uint64_t *executed) {
+    double best = -1;
+    for (uint32_t repetition = 0; repetition < repetitions; repetition++) {
+        Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+        if (memory == NULL) {
+            return -1;
+        }
+        store_program(memory, program);
+        Cpu cpu = init_cpu(config->backend);
+        memcpy(cpu.registers, program->registers, sizeof(cpu.registers));
+        if (config->decode_cache) {
+            cpu.decode_cache = init_decode_cache();
+        }
+        if (config->profile) {
+            cpu.profile = init_profile();
+        }
+        if (config->timing) {
+            cpu.timing = init_timing_model(NULL);
+        }
+        if (config->cache) {
+            cpu.cache = init_cache_hierarchy(NULL, 0);
+        }
+        if (config->branch_predictor) {
+            cpu.branch_predictor = init_branch_predictor(BRANCH_PREDICTOR_TAGE, 12);
+        }
+        if (config->mmu) {
+            cpu.mmu = init_identity_mmu(memory);
+        }
+        cpu.bus = bus;
+
+        double start = now_seconds();
+        RunResult result = run_cpu(&cpu, memory, steps);
+        double seconds = now_seconds() - start;
+
+        free_profile(cpu.profile);
+        free_timing_model(cpu.timing);
+        free_cache_hierarchy(cpu.cache);
+        free_branch_predictor(cpu.branch_predictor);
+        free_mmu(cpu.mmu);
+        free_cpu(&cpu);
+        free_memory(memory);
+        if (result.status != CPU_STATUS_STEP_LIMIT) {
+            fprintf(stderr, "%s stopped after %" PRIu64 " steps\n", config->name, result.steps);
+            return -1;
+        }
+        if (best < 0 || seconds < best) {
+            best = seconds;
+            *executed = result.steps;
+        }
+    }
+    return best;
+}
+
+static void run_instruction_benches(const BenchOptions *options) {
+    for (size_t i = 0; i < sizeof(INSTRUCTION_BENCHES) / sizeof(INSTRUCTION_BENCHES[0]); i++) {
+        const InstructionBench *bench = &INSTRUCTION_BENCHES[i];
+        if (!is_selected(options, bench->name)) {
+            continue;
+        }
+        BenchProgram program = {0};
+        init_bench_registers(&program);
+        if (bench->build != NULL) {
+            bench->build(&program);
+        } else {
+            build_repeated(&program, bench->word);
+        }
+
+        for (size_t j = 0; j < sizeof(BACKENDS) / sizeof(BACKENDS[0]); j++) {
+            uint64_t executed = 0;
+            double seconds =
+                time_program(&program, &BACKENDS[j], NULL, options->steps, options->repetitions, &executed);
+            if (seconds >= 0) {
+                print_result(options, bench->name, BACKENDS[j].name, "instruction", executed, seconds);
+            }
+        }
+    }
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> devices >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* R3 holds the base of the device the repeated instruction accesses */
+static void bench_device(const BenchOptions *options, const char *name, Bus *bus, uint32_t word) {
+    if (!is_selected(options, name)) {
+        return;
+    }
+    BenchProgram program = {0};
+    init_bench_registers(&program);
+    program.registers[2] = BENCH_DEVICE_BASE;
+    build_repeated(&program, word);
+    for (size_t j = 0; j < sizeof(BACKENDS) / sizeof(BACKENDS[0]); j++) {
+        uint64_t executed = 0;
+        /* Every access takes the bus lock, a sixteenth of the steps is plenty */
+        double seconds =
+            time_program(&program, &BACKENDS[j], bus, options->steps / 16, options->repetitions, &executed);
+        if (seconds >= 0) {
+            print_result(options, name, BACKENDS[j].name, "instruction", executed, seconds);
+        }
+    }
+}
+
+static void run_device_benches(const BenchOptions *options) {
+    Bus *bus = init_bus();
+    int output_fd = open("/dev/null", O_WRONLY);
+    Uart *uart = init_uart(-1, output_fd);
+    if (bus != NULL && uart != NULL &&
+        map_bus_device(bus, BENCH_DEVICE_BASE, UART_BYTES, uart, read_uart, write_uart)) {
+        bench_device(options, "mmio_uart_stb", bus, MEMORY_OP(STBI_BITMASK, 0, 2, UART_DATA + 3));
+    }
+    free_bus(bus);
+    free_uart(uart);
+    if (output_fd != -1) {
+        close(output_fd);
+    }
+
+    bus = init_bus();
+    FILE *file = tmpfile();
+    BlockDevice *block_device = NULL;
+    if (file != NULL && ftruncate(fileno(file), 64 * BLOCK_SECTOR_BYTES) == 0) {
+        block_device = init_block_device(fileno(file), true);
+    }
+    if (bus != NULL && block_device != NULL &&
+        map_bus_device(bus, BENCH_DEVICE_BASE, BLOCK_DEVICE_BYTES, block_device, read_block_device,
+                       write_block_device)) {
+        bench_device(options, "mmio_block_ldw", bus, MEMORY_OP(LDWI_BITMASK, 1, 2, BLOCK_WINDOW + 3));
+        bench_device(options, "mmio_block_stw", bus, MEMORY_OP(STWI_BITMASK, 0, 2, BLOCK_WINDOW + 3));
+    }
+    free_bus(bus);
+    free_block_device(block_device);
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> memory >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Mapping is lazy, so creating memory costs the same whatever its size until pages are touched */
+static void bench_init_memory(const BenchOptions *options, const char *name, uint32_t size_bytes, bool touch) {
+    const uint32_t iterations = 64;
+    double start = now_seconds();
+    for (uint32_t i = 0; i < iterations; i++) {
+        Memory *memory = init_memory(size_bytes);
+        if (memory == NULL) {
+            return;
+        }
+        if (touch) {
+            memset(memory->data, 1, size_bytes);
+        }
+        free_memory(memory);
+    }
+    print_result(options, name, "memory", "operation", iterations, now_seconds() - start);
+}
+
+static void bench_copy_memory(const BenchOptions *options, uint32_t size_bytes) {
+    const uint32_t iterations = 64;
+    Memory *source = init_memory(size_bytes);
+    Memory *destination = init_memory(size_bytes);
+    if (source != NULL && destination != NULL) {
+        memset(source->data, 1, size_bytes);
+        memset(destination->data, 0, size_bytes);
+
+        double start = now_seconds();
+        for (uint32_t i = 0; i < iterations; i++) {
+            memcpy(destination->data, source->data, size_bytes);
+        }
+        /* The unit is a byte here, so the rate is millions of bytes per second */
+        print_result(options, "memory_copy", "memory", "byte", (uint64_t)iterations * size_bytes,
+                     now_seconds() - start);
+    }
+    free_memory(source);
+    free_memory(destination);
+}
+
+/* Snapshots copy the image once, forks only map it, restores read back the pages a run dirtied */
+static void bench_snapshots(const BenchOptions *options, uint32_t size_bytes) {
+    const uint32_t iterations = 64;
+    Memory *memory = init_memory(size_bytes);
+    if (memory == NULL) {
+        return;
+    }
+    memset(memory->data, 1, size_bytes);
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+
+    if (is_selected(options, "snapshot_take")) {
+        double start = now_seconds();
+        for (uint32_t i = 0; i < iterations; i++) {
+            free_snapshot(take_snapshot(&cpu, memory));
+        }
+        print_result(options, "snapshot_take", "memory", "operation", iterations, now_seconds() - start);
+    }
+
+    Snapshot *snapshot = take_snapshot(&cpu, memory);
+    if (snapshot != NULL && is_selected(options, "snapshot_fork")) {
+        double start = now_seconds();
+        for (uint32_t i = 0; i < iterations; i++) {
+            free_memory(fork_memory(snapshot));
+        }
+        print_result(options, "snapshot_fork", "memory", "operation", iterations, now_seconds() - start);
+    }
+    if (snapshot != NULL && is_selected(options, "snapshot_restore_16_pages")) {
+        double start = now_seconds();
+        for (uint32_t i = 0; i < iterations; i++) {
+            for (uint32_t page = 0; page < 16; page++) {
+                mark_memory_dirty(memory, page * MEMORY_PAGE_BYTES);
+            }
+            restore_snapshot(snapshot, &cpu, memory);
+        }
+        print_result(options, "snapshot_restore_16_pages", "memory", "operation", iterations, now_seconds() - start);
+    }
+
+    free_snapshot(snapshot);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+static void run_memory_benches(const BenchOptions *options) {
+    if (is_selected(options, "memory_init_1mb")) {
+        bench_init_memory(options, "memory_init_1mb", MEMORY_SIZE_BYTES, false);
+    }
+    if (is_selected(options, "memory_init_64mb")) {
+        bench_init_memory(options, "memory_init_64mb", MEMORY_MAX_SIZE_BYTES, false);
+    }
+    if (is_selected(options, "memory_init_touch_1mb")) {
+        bench_init_memory(options, "memory_init_touch_1mb", MEMORY_SIZE_BYTES, true);
+    }
+    if (is_selected(options, "memory_copy")) {
+        bench_copy_memory(options, MEMORY_SIZE_BYTES);
+    }
+    bench_snapshots(options, MEMORY_SIZE_BYTES);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> main >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool parse_options(int argc, char **argv, BenchOptions *options) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            options->json = true;
+        } else if (strncmp(argv[i], "--filter=", 9) == 0) {
+            options->filter = argv[i] + 9;
+        } else if (strncmp(argv[i], "--steps=", 8) == 0) {
+            options->steps = strtoull(argv[i] + 8, NULL, 10);
+        } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+            options->repetitions = strtoul(argv[i] + 14, NULL, 10);
+        } else {
+            return false;
+        }
+    }
+    return options->steps > 0 && options->repetitions > 0;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options = {false, NULL, BENCH_DEFAULT_STEPS, BENCH_DEFAULT_REPETITIONS};
+    if (!parse_options(argc, argv, &options)) {
+        fprintf(stderr, "usage: %s [--json] [--filter=substring] [--steps=instructions] [--repetitions=count]\n",
+                argv[0]);
+        return 2;
+    }
+
+    print_header(&options);
+    run_instruction_benches(&options);
+    run_device_benches(&options);
+    run_memory_benches(&options);
+    return 0;
+}
@@ -0,0 +1,646 @@
+/*********************************************************************************************************************
+ * Static analysis of guest programs                                                                                 *
+ *                                                                                                                   *
+ * Decodes every word of an image the way the CPU would, follows the jumps whose target is known from the entries to *
+ * the reachable instructions, splits those into basic blocks, and finds loops as the blocks reaching back to a      *
+ * block still on the stack of a depth first search.                                                                 *
+ *********************************************************************************************************************/
+
+#include "analyzer.h"
+#include "assembler.h"
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const ISSUE_NAMES[ANALYSIS_ISSUE_KIND_COUNT] = {
+    [ANALYSIS_UNREACHABLE] = "unreachable",
+    [ANALYSIS_INVALID_INSTRUCTION] = "invalid instruction",
+    [ANALYSIS_DIVISION_BY_ZERO] = "division by zero",
+    [ANALYSIS_MISALIGNED_OFFSET] = "misaligned offset",
+    [ANALYSIS_INVALID_JUMP_TARGET] = "invalid jump target",
+    [ANALYSIS_FALLS_OFF_END] = "falls off the end",
+};
+
+const char *get_analysis_issue_name(AnalysisIssueKind kind) {
+    return kind < ANALYSIS_ISSUE_KIND_COUNT ? ISSUE_NAMES[kind] : "unknown";
+}
+
+/* Working state of analyze_program, the arrays are indexed by word */
+typedef struct Analyzer {
+    uint32_t word_count;
+    DecodedInstruction *instructions;
+    bool *reachable;
+    bool *leaders;              // First word of a basic block
+    uint32_t *block_indices;    // Block a reachable word belongs to
+    uint32_t written_registers; // Bit per register some reachable instruction writes
+    ProgramAnalysis *analysis;
+    uint32_t issue_capacity;
+} Analyzer;
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Instructions >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* The trap the instruction raises whatever the registers hold, TRAP_NONE when it may execute */
+static TrapKind get_certain_trap(const DecodedInstruction *decoded) {
+    switch (decoded->id) {
+    case INSTRUCTION_INVALID_REGISTER:
+        return TRAP_INVALID_REGISTER;
+    case INSTRUCTION_INVALID_BYTE_MODE:
+        return TRAP_INVALID_BYTE_MODE;
+    case INSTRUCTION_INVALID_ARITHMETIC_OPERATION:
+    case INSTRUCTION_INVALID_BITWISE_OPERATION:
+        return TRAP_INVALID_OPERATION;
+    case INSTRUCTION_UNUSED:
+        return TRAP_UNUSED_OP_CODE;
+    case INSTRUCTION_DIV:
+    case INSTRUCTION_MOD:
+        return decoded->use_immediate && decoded->value == 0 ? TRAP_DIVISION_BY_ZERO : TRAP_NONE;
+    default:
+        return TRAP_NONE;
+    }
+}
+
+/*
+ * LD and ST of half words and words with an immediate offset that is not aligned to their width. A location addresses
+ * the last byte of the access, so an aligned one leaves width - 1 in the low bits, see is_aligned_memory_access.
+ */
+static bool has_misaligned_offset(const DecodedInstruction *decoded) {
+    uint32_t last_byte_mask = (UINT32_C(1) << decoded->byte_mode) - 1;
+    return (decoded->id == INSTRUCTION_LD || decoded->id == INSTRUCTION_ST) && decoded->use_immediate &&
+           (decoded->value & last_byte_mask) != last_byte_mask;
+}
+
+static bool is_jump(const DecodedInstruction *decoded) {
+    return decoded->id == INSTRUCTION_JMP || decoded->id == INSTRUCTION_JMPC;
+}
+
+/* LD, SET, SETU and the arithmetic, bitwise and bitshift instructions replace their destination register */
+static bool writes_register(const DecodedInstruction *decoded) {
+    return decoded->id == INSTRUCTION_LD || (decoded->id >= INSTRUCTION_SET && decoded->id <= INSTRUCTION_BSLR);
+}
+
+/* Registers no reachable instruction writes hold 0 throughout, as init_cpu leaves them */
+static bool is_known_zero(const Analyzer *analyzer, uint32_t reg) {
+    return (analyzer->written_registers >> reg & 1) == 0;
+}
+
+/* Includes a misaligned access off a base register known to be 0 */
+static bool always_traps(const Analyzer *analyzer, const DecodedInstruction *decoded) {
+    return get_certain_trap(decoded) != TRAP_NONE ||
+           (has_misaligned_offset(decoded) && is_known_zero(analyzer, decoded->first_source_register));
+}
+
+/* Target of a JMP or JMPC when the analysis knows it, see ProgramAnalysis */
+static bool get_jump_target(const Analyzer *analyzer, const DecodedInstruction *decoded, uint32_t *target) {
+    if (!decoded->use_immediate || !is_known_zero(analyzer, decoded->first_source_register)) {
+        return false;
+    }
+    *target = decoded->value;
+    return true;
+}
+
+/*
+ * Addresses execution can continue at after the instruction, which may lie outside of the image. A jump onto its own
+ * address halts and continues nowhere.
+ */
+static uint32_t get_successors(const Analyzer *analyzer, uint32_t index, uint32_t successors[2]) {
+    const DecodedInstruction *decoded = &analyzer->instructions[index];
+    uint32_t address = index * 4;
+    uint32_t count = 0;
+    uint32_t target;
+    if (always_traps(analyzer, decoded)) {
+        return 0;
+    }
+    if (is_jump(decoded) && get_jump_target(analyzer, decoded, &target) && target != address) {
+        successors[count++] = target;
+    }
+    if (decoded->id != INSTRUCTION_JMP) {
+        successors[count++] = address + 4;
+    }
+    return count;
+}
+
+static bool is_in_image(const Analyzer *analyzer, uint32_t address) {
+    return address % 4 == 0 && address / 4 < analyzer->word_count;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Reachability >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static void push_reachable(Analyzer *analyzer, uint32_t *stack, uint32_t *stack_size, uint32_t address) {
+    if (is_in_image(analyzer, address) && !analyzer->reachable[address / 4]) {
+        analyzer->reachable[address / 4] = true;
+        stack[(*stack_size)++] = address / 4;
+    }
+}
+
+/*
+ * Starts out assuming every register holds 0, and whenever a register turns out to be written by a reachable
+ * instruction, forgets the targets it gave and searches again. Each search can only add registers, so this ends after
+ * at most one search per register.
+ */
+static bool find_reachable(Analyzer *analyzer, const uint32_t *entries, uint32_t entry_count) {
+    uint32_t *stack = malloc((analyzer->word_count > 0 ? analyzer->word_count : 1) * sizeof(uint32_t));
+    if (stack == NULL) {
+        return false;
+    }
+
+    uint32_t found_registers;
+    do {
+        memset(analyzer->reachable, 0, analyzer->word_count * sizeof(bool));
+        uint32_t stack_size = 0;
+        push_reachable(analyzer, stack, &stack_size, 0);
+        for (uint32_t i = 0; i < entry_count; i++) {
+            push_reachable(analyzer, stack, &stack_size, entries[i]);
+        }
+
+        found_registers = 0;
+        while (stack_size > 0) {
+            uint32_t index = stack[--stack_size];
+            const DecodedInstruction *decoded = &analyzer->instructions[index];
+            if (writes_register(decoded)) {
+                found_registers |= UINT32_C(1) << decoded->destination_register;
+            }
+            uint32_t successors[2];
+            uint32_t successor_count = get_successors(analyzer, index, successors);
+            for (uint32_t i = 0; i < successor_count; i++) {
+                push_reachable(analyzer, stack, &stack_size, successors[i]);
+            }
+        }
+        found_registers &= ~analyzer->written_registers;
+        analyzer->written_registers |= found_registers;
+    } while (found_registers != 0);
+
+    free(stack);
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Issues >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool add_issue(Analyzer *analyzer, AnalysisIssueKind kind, uint32_t address, uint32_t last_address,
+                      uint32_t value) {
+    ProgramAnalysis *analysis = analyzer->analysis;
+    if (analysis->issue_count == analyzer->issue_capacity) {
+        uint32_t capacity = analyzer->issue_capacity > 0 ? 2 * analyzer->issue_capacity : 16;
+        AnalysisIssue *issues = realloc(analysis->issues, capacity * sizeof(AnalysisIssue));
+        if (issues == NULL) {
+            return false;
+        }
+        analysis->issues = issues;
+        analyzer->issue_capacity = capacity;
+    }
+    analysis->issues[analysis->issue_count++] = (AnalysisIssue){kind, address, last_address, value};
+    return true;
+}
+
+/* Issues of one reachable instruction, in the order they would come up when it executes */
+static bool add_instruction_issues(Analyzer *analyzer, uint32_t index) {
+    const DecodedInstruction *decoded = &analyzer->instructions[index];
+    uint32_t address = index * 4;
+    TrapKind trap = get_certain_trap(decoded);
+    bool added = true;
+    if (trap == TRAP_DIVISION_BY_ZERO) {
+        added = add_issue(analyzer, ANALYSIS_DIVISION_BY_ZERO, address, address, 0);
+    } else if (trap != TRAP_NONE) {
+        added = add_issue(analyzer, ANALYSIS_INVALID_INSTRUCTION, address, address, trap);
+    } else if (has_misaligned_offset(decoded)) {
+        added = add_issue(analyzer, ANALYSIS_MISALIGNED_OFFSET, address, address, decoded->value);
+    }
+
+    uint32_t target;
+    if (is_jump(decoded) && get_jump_target(analyzer, decoded, &target) && !is_in_image(analyzer, target)) {
+        added = added && add_issue(analyzer, ANALYSIS_INVALID_JUMP_TARGET, address, address, target);
+    }
+    uint32_t successors[2];
+    uint32_t successor_count = get_successors(analyzer, index, successors);
+    if (successor_count > 0 && successors[successor_count - 1] == analyzer->word_count * 4 &&
+        decoded->id != INSTRUCTION_JMP) {
+        added = added && add_issue(analyzer, ANALYSIS_FALLS_OFF_END, address, address, 0);
+    }
+    return added;
+}
+
+/* One pass in address order, so the issues come out sorted */
+static bool find_issues(Analyzer *analyzer) {
+    for (uint32_t index = 0; index < analyzer->word_count; index++) {
+        if (analyzer->reachable[index]) {
+            if (!add_instruction_issues(analyzer, index)) {
+                return false;
+            }
+            continue;
+        }
+        uint32_t last = index;
+        while (last + 1 < analyzer->word_count && !analyzer->reachable[last + 1]) {
+            last++;
+        }
+        if (!add_issue(analyzer, ANALYSIS_UNREACHABLE, index * 4, last * 4, 0)) {
+            return false;
+        }
+        index = last;
+    }
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Blocks >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Entries, known jump targets, whatever follows a jump or a trap, and code after unreachable words start blocks */
+static void find_leaders(Analyzer *analyzer, const uint32_t *entries, uint32_t entry_count) {
+    for (uint32_t index = 0; index < analyzer->word_count; index++) {
+        const DecodedInstruction *decoded = &analyzer->instructions[index];
+        if (!analyzer->reachable[index]) {
+            continue;
+        }
+        if (index == 0 || !analyzer->reachable[index - 1]) {
+            analyzer->leaders[index] = true;
+        }
+        uint32_t target;
+        if (is_jump(decoded) && get_jump_target(analyzer, decoded, &target) && is_in_image(analyzer, target)) {
+            analyzer->leaders[target / 4] = true;
+        }
+        if ((is_jump(decoded) || always_traps(analyzer, decoded)) && index + 1 < analyzer->word_count) {
+            analyzer->leaders[index + 1] = true;
+        }
+    }
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (is_in_image(analyzer, entries[i])) {
+            analyzer->leaders[entries[i] / 4] = true;
+        }
+    }
+}
+
+static bool build_blocks(Analyzer *analyzer) {
+    ProgramAnalysis *analysis = analyzer->analysis;
+    uint32_t block_count = 0;
+    for (uint32_t index = 0; index < analyzer->word_count; index++) {
+        block_count += analyzer->reachable[index] && analyzer->leaders[index];
+    }
+    analysis->blocks = calloc(block_count > 0 ? block_count : 1, sizeof(BasicBlock));
+    if (analysis->blocks == NULL) {
+        return false;
+    }
+
+    for (uint32_t index = 0; index < analyzer->word_count; index++) {
+        if (!analyzer->reachable[index]) {
+            continue;
+        }
+        if (analyzer->leaders[index]) {
+            analysis->blocks[analysis->block_count++].first_address = index * 4;
+        }
+        BasicBlock *block = &analysis->blocks[analysis->block_count - 1];
+        block->last_address = index * 4;
+        analyzer->block_indices[index] = analysis->block_count - 1;
+
+        uint32_t successors[2];
+        uint32_t successor_count = get_successors(analyzer, index, successors);
+        block->successors[0] = ANALYSIS_NO_ADDRESS;
+        block->successors[1] = ANALYSIS_NO_ADDRESS;
+        for (uint32_t i = 0, j = 0; i < successor_count; i++) {
+            if (is_in_image(analyzer, successors[i])) {
+                block->successors[j++] = successors[i];
+            }
+        }
+    }
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Loops >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Depth first search state of one block */
+typedef struct BlockVisit {
+    uint32_t preorder;  // 0 until the search reaches the block
+    uint32_t postorder; // 0 while the block is still on the stack
+    uint32_t next_successor;
+    uint32_t loop;      // Last loop whose body the block was added to, plus one
+} BlockVisit;
+
+typedef struct BackEdge {
+    uint32_t latch;
+    uint32_t header;
+} BackEdge;
+
+static uint32_t get_successor_block(const Analyzer *analyzer, const BasicBlock *block, uint32_t slot) {
+    uint32_t address = block->successors[slot];
+    return address == ANALYSIS_NO_ADDRESS ? UINT32_MAX : analyzer->block_indices[address / 4];
+}
+
+static void search_blocks(const Analyzer *analyzer, uint32_t root, BlockVisit *visits, uint32_t *stack,
+                          uint32_t *order, BackEdge *back_edges, uint32_t *back_edge_count) {
+    const ProgramAnalysis *analysis = analyzer->analysis;
+    if (visits[root].preorder != 0) {
+        return;
+    }
+    uint32_t stack_size = 0;
+    stack[stack_size++] = root;
+    visits[root].preorder = ++order[0];
+    while (stack_size > 0) {
+        uint32_t current = stack[stack_size - 1];
+        BlockVisit *visit = &visits[current];
+        if (visit->next_successor == 2) {
+            visit->postorder = ++order[1];
+            stack_size--;
+            continue;
+        }
+        uint32_t successor = get_successor_block(analyzer, &analysis->blocks[current], visit->next_successor++);
+        if (successor == UINT32_MAX) {
+            continue;
+        }
+        if (visits[successor].preorder == 0) {
+            visits[successor].preorder = ++order[0];
+            stack[stack_size++] = successor;
+        } else if (visits[successor].postorder == 0) {
+            back_edges[(*back_edge_count)++] = (BackEdge){current, successor};
+        }
+    }
+}
+
+static bool is_descendant(const BlockVisit *visits, uint32_t block, uint32_t ancestor) {
+    return visits[ancestor].preorder <= visits[block].preorder && visits[block].postorder <= visits[ancestor].postorder;
+}
+
+/*
+ * The body of a loop is every block that reaches one of its back edges without passing through the header. Only
+ * blocks the search reached through the header count, so a second way into the middle of the loop does not drag the
+ * code in front of it along.
+ */
+static void fill_loop(Analyzer *analyzer, Loop *loop, uint32_t loop_number, const BackEdge *back_edges,
+                      uint32_t back_edge_count, BlockVisit *visits, const uint32_t *predecessor_offsets,
+                      const uint32_t *predecessors, uint32_t *stack) {
+    ProgramAnalysis *analysis = analyzer->analysis;
+    uint32_t header = analyzer->block_indices[loop->header / 4];
+    uint32_t stack_size = 0;
+    visits[header].loop = loop_number;
+    stack[stack_size++] = header;
+    for (uint32_t i = 0; i < back_edge_count; i++) {
+        uint32_t latch = back_edges[i].latch;
+        if (back_edges[i].header == header && visits[latch].loop != loop_number) {
+            visits[latch].loop = loop_number;
+            stack[stack_size++] = latch;
+        }
+    }
+
+    loop->first_address = UINT32_MAX;
+    while (stack_size > 0) {
+        uint32_t block_index = stack[--stack_size];
+        BasicBlock *block = &analysis->blocks[block_index];
+        block->loop_depth++;
+        loop->block_count++;
+        loop->instruction_count += (block->last_address - block->first_address) / 4 + 1;
+        loop->first_address = block->first_address < loop->first_address ? block->first_address : loop->first_address;
+        loop->last_address = block->last_address > loop->last_address ? block->last_address : loop->last_address;
+        if (block_index == header) {
+            continue;
+        }
+        for (uint32_t i = predecessor_offsets[block_index]; i < predecessor_offsets[block_index + 1]; i++) {
+            uint32_t predecessor = predecessors[i];
+            if (visits[predecessor].loop != loop_number && is_descendant(visits, predecessor, header)) {
+                visits[predecessor].loop = loop_number;
+                stack[stack_size++] = predecessor;
+            }
+        }
+    }
+}
+
+static bool find_loops(Analyzer *analyzer, const uint32_t *entries, uint32_t entry_count) {
+    ProgramAnalysis *analysis = analyzer->analysis;
+    uint32_t block_count = analysis->block_count > 0 ? analysis->block_count : 1;
+    BlockVisit *visits = calloc(block_count, sizeof(BlockVisit));
+    uint32_t *stack = malloc(block_count * sizeof(uint32_t));
+    BackEdge *back_edges = malloc(2 * block_count * sizeof(BackEdge));
+    uint32_t *predecessor_offsets = calloc(block_count + 1, sizeof(uint32_t));
+    uint32_t *predecessors = malloc(2 * block_count * sizeof(uint32_t));
+    analysis->loops = calloc(block_count, sizeof(Loop));
+    bool found = visits != NULL && stack != NULL && back_edges != NULL && predecessor_offsets != NULL &&
+                 predecessors != NULL && analysis->loops != NULL;
+
+    if (found) {
+        /* Predecessors of block i are predecessors[predecessor_offsets[i]] up to predecessor_offsets[i + 1] */
+        for (uint32_t i = 0; i < analysis->block_count; i++) {
+            for (uint32_t slot = 0; slot < 2; slot++) {
+                uint32_t successor = get_successor_block(analyzer, &analysis->blocks[i], slot);
+                if (successor != UINT32_MAX) {
+                    predecessor_offsets[successor + 1]++;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < analysis->block_count; i++) {
+            predecessor_offsets[i + 1] += predecessor_offsets[i];
+        }
+        for (uint32_t i = 0; i < analysis->block_count; i++) {
+            for (uint32_t slot = 0; slot < 2; slot++) {
+                uint32_t successor = get_successor_block(analyzer, &analysis->blocks[i], slot);
+                if (successor != UINT32_MAX) {
+                    predecessors[predecessor_offsets[successor] + visits[successor].next_successor++] = i;
+                }
+            }
+        }
+        memset(visits, 0, block_count * sizeof(BlockVisit));
+
+        uint32_t order[2] = {0, 0};
+        uint32_t back_edge_count = 0;
+        if (analyzer->word_count > 0 && analyzer->reachable[0]) {
+            search_blocks(analyzer, analyzer->block_indices[0], visits, stack, order, back_edges, &back_edge_count);
+        }
+        for (uint32_t i = 0; i < entry_count; i++) {
+            if (is_in_image(analyzer, entries[i])) {
+                search_blocks(analyzer, analyzer->block_indices[entries[i] / 4], visits, stack, order, back_edges,
+                              &back_edge_count);
+            }
+        }
+
+        for (uint32_t header = 0; header < analysis->block_count; header++) {
+            for (uint32_t i = 0; i < back_edge_count; i++) {
+                if (back_edges[i].header == header) {
+                    Loop *loop = &analysis->loops[analysis->loop_count++];
+                    loop->header = analysis->blocks[header].first_address;
+                    fill_loop(analyzer, loop, analysis->loop_count, back_edges, back_edge_count, visits,
+                              predecessor_offsets, predecessors, stack);
+                    break;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < analysis->loop_count; i++) {
+            Loop *loop = &analysis->loops[i];
+            loop->depth = analysis->blocks[analyzer->block_indices[loop->header / 4]].loop_depth;
+        }
+    }
+
+    free(visits);
+    free(stack);
+    free(back_edges);
+    free(predecessor_offsets);
+    free(predecessors);
+    return found;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+ProgramAnalysis *analyze_program(const Program *program, const uint32_t *entries, uint32_t entry_count) {
+    uint32_t word_count = program->word_count > 0 ? program->word_count : 1;
+    Analyzer analyzer = {
+        .word_count = program->word_count,
+        .instructions = malloc(word_count * sizeof(DecodedInstruction)),
+        .reachable = calloc(word_count, sizeof(bool)),
+        .leaders = calloc(word_count, sizeof(bool)),
+        .block_indices = calloc(word_count, sizeof(uint32_t)),
+        .analysis = calloc(1, sizeof(ProgramAnalysis)),
+    };
+    bool analyzed = analyzer.instructions != NULL && analyzer.reachable != NULL && analyzer.leaders != NULL &&
+                    analyzer.block_indices != NULL && analyzer.analysis != NULL;
+
+    if (analyzed) {
+        analyzer.analysis->word_count = program->word_count;
+        for (uint32_t index = 0; index < program->word_count; index++) {
+            decode_instruction(program->words[index], &analyzer.instructions[index]);
+        }
+        analyzed = find_reachable(&analyzer, entries, entry_count) && find_issues(&analyzer);
+    }
+    if (analyzed) {
+        find_leaders(&analyzer, entries, entry_count);
+        analyzed = build_blocks(&analyzer) && find_loops(&analyzer, entries, entry_count);
+    }
+    if (analyzed) {
+        for (uint32_t index = 0; index < program->word_count; index++) {
+            const DecodedInstruction *decoded = &analyzer.instructions[index];
+            uint32_t target;
+            analyzer.analysis->indirect_jumps +=
+                analyzer.reachable[index] && is_jump(decoded) && !get_jump_target(&analyzer, decoded, &target);
+        }
+    }
+
+    free(analyzer.instructions);
+    free(analyzer.reachable);
+    free(analyzer.leaders);
+    free(analyzer.block_indices);
+    if (!analyzed) {
+        free_program_analysis(analyzer.analysis);
+        return NULL;
+    }
+    return analyzer.analysis;
+}
+
+void free_program_analysis(ProgramAnalysis *analysis) {
+    if (analysis == NULL) {
+        return;
+    }
+    free(analysis->blocks);
+    free(analysis->loops);
+    free(analysis->issues);
+    free(analysis);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Output >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static const char *get_trap_description(uint32_t trap) {
+    switch (trap) {
+    case TRAP_INVALID_REGISTER:
+        return "register does not exist";
+    case TRAP_INVALID_BYTE_MODE:
+        return "byte mode 3";
+    case TRAP_INVALID_OPERATION:
+        return "unassigned operation";
+    case TRAP_UNUSED_OP_CODE:
+        return "op code 7";
+    default:
+        return "traps";
+    }
+}
+
+bool write_analysis_report(const ProgramAnalysis *analysis, FILE *file) {
+    fprintf(file,
+            "words          %10" PRIu32 "\nbasic blocks   %10" PRIu32 "\nloops          %10" PRIu32
+            "\nindirect jumps %10" PRIu32 "\n",
+            analysis->word_count, analysis->block_count, analysis->loop_count, analysis->indirect_jumps);
+
+    fprintf(file, "\nbasic blocks\n");
+    for (uint32_t i = 0; i < analysis->block_count; i++) {
+        const BasicBlock *block = &analysis->blocks[i];
+        fprintf(file, "  0x%08" PRIx32 "-0x%08" PRIx32 " ->", block->first_address, block->last_address);
+        for (uint32_t slot = 0; slot < 2 && block->successors[slot] != ANALYSIS_NO_ADDRESS; slot++) {
+            fprintf(file, " 0x%08" PRIx32, block->successors[slot]);
+        }
+        fprintf(file, block->successors[0] == ANALYSIS_NO_ADDRESS ? " none\n" : "\n");
+    }
+
+    fprintf(file, "\nloops\n");
+    for (uint32_t i = 0; i < analysis->loop_count; i++) {
+        const Loop *loop = &analysis->loops[i];
+        fprintf(file,
+                "  0x%08" PRIx32 "-0x%08" PRIx32 " header 0x%08" PRIx32 " depth %" PRIu32 ", %" PRIu32
+                " blocks, %" PRIu32 " instructions\n",
+                loop->first_address, loop->last_address, loop->header, loop->depth, loop->block_count,
+                loop->instruction_count);
+    }
+
+    fprintf(file, "\nissues\n");
+    for (uint32_t i = 0; i < analysis->issue_count; i++) {
+        const AnalysisIssue *issue = &analysis->issues[i];
+        fprintf(file, "  0x%08" PRIx32 "-0x%08" PRIx32 " %s", issue->address, issue->last_address,
+                get_analysis_issue_name(issue->kind));
+        switch (issue->kind) {
+        case ANALYSIS_INVALID_INSTRUCTION:
+            fprintf(file, ", %s\n", get_trap_description(issue->value));
+            break;
+        case ANALYSIS_MISALIGNED_OFFSET:
+            fprintf(file, ", offset 0x%" PRIx32 "\n", issue->value);
+            break;
+        case ANALYSIS_INVALID_JUMP_TARGET:
+            fprintf(file, ", target 0x%08" PRIx32 "\n", issue->value);
+            break;
+        default:
+            fprintf(file, "\n");
+            break;
+        }
+    }
+    return !ferror(file);
+}
+
+static int compare_hot_blocks(const void *first, const void *second) {
+    const BasicBlock *a = first;
+    const BasicBlock *b = second;
+    if (a->loop_depth != b->loop_depth) {
+        return a->loop_depth > b->loop_depth ? -1 : 1;
+    }
+    return (a->first_address > b->first_address) - (a->first_address < b->first_address);
+}
+
+bool write_analysis_hints(const ProgramAnalysis *analysis, FILE *file) {
+    BasicBlock *blocks = malloc((analysis->block_count > 0 ? analysis->block_count : 1) * sizeof(BasicBlock));
+    if (blocks == NULL) {
+        return false;
+    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < analysis->block_count; i++) {
+        if (analysis->blocks[i].loop_depth > 0) {
+            blocks[count++] = analysis->blocks[i];
+        }
+    }
+    qsort(blocks, count, sizeof(BasicBlock), compare_hot_blocks);
+
+    fprintf(file, "# first address, last address, loop depth\n");
+    for (uint32_t i = 0; i < count; i++) {
+        fprintf(file, "0x%08" PRIx32 " 0x%08" PRIx32 " %" PRIu32 "\n", blocks[i].first_address,
+                blocks[i].last_address, blocks[i].loop_depth);
+    }
+    free(blocks);
+    return !ferror(file);
+}
+
+bool apply_analysis_hints(Cpu *cpu, Memory *memory, FILE *file) {
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        uint32_t first_address;
+        uint32_t last_address;
+        uint32_t depth;
+        if (sscanf(line, "%" SCNx32 " %" SCNx32 " %" SCNu32, &first_address, &last_address, &depth) != 3) {
+            return false;
+        }
+        prepare_basic_block(cpu, memory, first_address, last_address);
+    }
+    return !ferror(file);
+}
@@ -0,0 +1,92 @@
+#ifndef _ANALYZER_H_
+#define _ANALYZER_H_
+
+#include "assembler.h"
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define ANALYSIS_NO_ADDRESS UINT32_MAX // Never a valid instruction address because instructions are word aligned
+
+typedef enum AnalysisIssueKind {
+    ANALYSIS_UNREACHABLE,         // No path from an entry reaches the words, which may also be data
+    ANALYSIS_INVALID_INSTRUCTION, // Always traps, value holds the TrapKind
+    ANALYSIS_DIVISION_BY_ZERO,    // DIVI or MODI by 0, always traps
+    ANALYSIS_MISALIGNED_OFFSET,   // LDH / LDW / STH / STW offset not on the last byte of a width, value holds it
+    ANALYSIS_INVALID_JUMP_TARGET, // Static target misaligned or past the end of the image, value holds the target
+    ANALYSIS_FALLS_OFF_END,       // Execution runs past the last word of the image
+    ANALYSIS_ISSUE_KIND_COUNT,
+} AnalysisIssueKind;
+
+typedef struct AnalysisIssue {
+    AnalysisIssueKind kind;
+    uint32_t address;      // Of the instruction, or the first word of an unreachable range
+    uint32_t last_address; // Last word of an unreachable range, the instruction address otherwise
+    uint32_t value;
+} AnalysisIssue;
+
+/* A run of reachable instructions only ever entered at its first one, ending at a jump or in front of the next block */
+typedef struct BasicBlock {
+    uint32_t first_address;
+    uint32_t last_address;
+    uint32_t successors[2]; // Start addresses of the blocks it can continue in, ANALYSIS_NO_ADDRESS for unused slots
+    uint32_t loop_depth;    // Number of loops the block is part of, 0 outside of any loop
+} BasicBlock;
+
+typedef struct Loop {
+    uint32_t header;            // Start of the block every iteration enters through
+    uint32_t first_address;     // Lowest instruction address of the blocks in the loop
+    uint32_t last_address;      // Highest instruction address of the blocks in the loop
+    uint32_t block_count;       // Blocks in the loop, including those of loops nested in it
+    uint32_t instruction_count; // Instructions of those blocks
+    uint32_t depth;             // 1 for an outermost loop, one more for each loop it is nested in
+} Loop;
+
+/*
+ * Shape of a program, recovered without running it. A jump's target is only known when its base register is one no
+ * reachable instruction writes, which then still holds the 0 init_cpu starts it with, and its offset is immediate, as
+ * in "JMPI R8 label". Other jumps are counted as indirect and their targets stay unknown, so code only they reach is
+ * reported as unreachable.
+ */
+typedef struct ProgramAnalysis {
+    uint32_t word_count;
+    uint32_t indirect_jumps; // Reachable JMP and JMPC whose target depends on a register
+
+    BasicBlock *blocks; // Ordered by address
+    uint32_t block_count;
+
+    Loop *loops; // Ordered by header
+    uint32_t loop_count;
+
+    AnalysisIssue *issues; // Ordered by address
+    uint32_t issue_count;
+} ProgramAnalysis;
+
+/*
+ * Analyzes the program as loaded at address 0 and entered at address 0, where a reset CPU starts, and at each of the
+ * entries, e.g. interrupt handlers, which no jump leads to. Returns NULL when it cannot be allocated.
+ */
+ProgramAnalysis *analyze_program(const Program *program, const uint32_t *entries, uint32_t entry_count);
+
+void free_program_analysis(ProgramAnalysis *analysis);
+
+const char *get_analysis_issue_name(AnalysisIssueKind kind);
+
+/* Writes the basic blocks with their successors, the loops and every issue */
+bool write_analysis_report(const ProgramAnalysis *analysis, FILE *file);
+
+/*
+ * Writes one "<first address> <last address> <loop depth>" line per basic block inside a loop, the most deeply nested
+ * first, so a simulator can translate the hot loops before it runs them. Lines starting with '#' are comments.
+ */
+bool write_analysis_hints(const ProgramAnalysis *analysis, FILE *file);
+
+/*
+ * Reads hints written by write_analysis_hints and prepares every block they list with prepare_basic_block. Returns
+ * false on a line that does not parse, the blocks before it are prepared.
+ */
+bool apply_analysis_hints(Cpu *cpu, Memory *memory, FILE *file);
+
+#endif
@@ -0,0 +1,469 @@
+/*********************************************************************************************************************
+ * Turns assembly source into program words                                                                          *
+ *                                                                                                                   *
+ * Two passes over the source: the first one gives every label the address of the word following it, the second one *
+ * encodes the instructions with every label known, so jumps may refer forward. Fields are placed where cpu.c       *
+ * decodes them from.                                                                                                *
+ *********************************************************************************************************************/
+
+#include "assembler.h"
+#include "bit_utils.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/* A label, a mnemonic and three operands, one more to tell a surplus operand apart */
+#define ASSEMBLER_MAX_TOKENS 6
+
+/* Widest immediate of each instruction group */
+#define JMP_IMMEDIATE_BITS    21
+#define MEMORY_IMMEDIATE_BITS 19
+#define SET_VALUE_BITS        25
+#define SETU_VALUE_BITS       6
+#define ALU_IMMEDIATE_BITS    19
+#define SHIFT_IMMEDIATE_BITS  5
+
+typedef enum InstructionFormat {
+    FORMAT_JMP,    // <base> <offset> [<control>]
+    FORMAT_MEMORY, // <source or destination> <base> <offset>
+    FORMAT_SET,    // <destination> <value>
+    FORMAT_SETN,   // <destination> <negative value>
+    FORMAT_SETU,   // <destination> <value>
+    FORMAT_ALU,    // <destination> <first source> <second source>, arithmetic and bitwise operations
+    FORMAT_SHIFT,  // <destination> <source> <number of bits>
+    FORMAT_WORD,   // <value>
+} InstructionFormat;
+
+typedef struct Mnemonic {
+    const char *name;
+    uint32_t bitmask;
+    InstructionFormat format;
+    bool use_immediate;
+    bool conditional;
+} Mnemonic;
+
+/* Control bits of JMP as cpu.c decodes them */
+#define JMP_CONDITIONAL_BITMASK BITMASK_4
+#define JMP_IMMEDIATE_BITMASK   BITMASK_5
+
+static const Mnemonic MNEMONICS[] = {
+    {"JMP", JMP_BITMASK, FORMAT_JMP, false, false},
+    {"JMPI", JMP_BITMASK | JMP_IMMEDIATE_BITMASK, FORMAT_JMP, true, false},
+    {"JMPC", JMP_BITMASK | JMP_CONDITIONAL_BITMASK, FORMAT_JMP, false, true},
+    {"JMPIC", JMP_BITMASK | JMP_IMMEDIATE_BITMASK | JMP_CONDITIONAL_BITMASK, FORMAT_JMP, true, true},
+    {"STB", STB_BITMASK, FORMAT_MEMORY, false, false},
+    {"STH", STH_BITMASK, FORMAT_MEMORY, false, false},
+    {"STW", STW_BITMASK, FORMAT_MEMORY, false, false},
+    {"STBI", STBI_BITMASK, FORMAT_MEMORY, true, false},
+    {"STHI", STHI_BITMASK, FORMAT_MEMORY, true, false},
+    {"STWI", STWI_BITMASK, FORMAT_MEMORY, true, false},
+    {"LDB", LDB_BITMASK, FORMAT_MEMORY, false, false},
+    {"LDH", LDH_BITMASK, FORMAT_MEMORY, false, false},
+    {"LDW", LDW_BITMASK, FORMAT_MEMORY, false, false},
+    {"LDBI", LDBI_BITMASK, FORMAT_MEMORY, true, false},
+    {"LDHI", LDHI_BITMASK, FORMAT_MEMORY, true, false},
+    {"LDWI", LDWI_BITMASK, FORMAT_MEMORY, true, false},
+    {"SET", SET_BITMASK, FORMAT_SET, true, false},
+    {"SETN", SETN_BITMASK, FORMAT_SETN, true, false},
+    {"SETU", SETU_BITMASK, FORMAT_SETU, true, false},
+    {"ADD", ADD_BITMASK, FORMAT_ALU, false, false},
+    {"ADDI", ADDI_BITMASK, FORMAT_ALU, true, false},
+    {"SUB", SUB_BITMASK, FORMAT_ALU, false, false},
+    {"SUBI", SUBI_BITMASK, FORMAT_ALU, true, false},
+    {"MUL", MUL_BITMASK, FORMAT_ALU, false, false},
+    {"MULI", MULI_BITMASK, FORMAT_ALU, true, false},
+    {"DIV", DIV_BITMASK, FORMAT_ALU, false, false},
+    {"DIVI", DIVI_BITMASK, FORMAT_ALU, true, false},
+    {"MOD", MOD_BITMASK, FORMAT_ALU, false, false},
+    {"MODI", MODI_BITMASK, FORMAT_ALU, true, false},
+    {"AND", AND_BITMASK, FORMAT_ALU, false, false},
+    {"ANDI", ANDI_BITMASK, FORMAT_ALU, true, false},
+    {"ANDF", ANDF_BITMASK, FORMAT_ALU, true, false},
+    {"OR", OR_BITMASK, FORMAT_ALU, false, false},
+    {"ORI", ORI_BITMASK, FORMAT_ALU, true, false},
+    {"ORF", ORF_BITMASK, FORMAT_ALU, true, false},
+    {"XOR", XOR_BITMASK, FORMAT_ALU, false, false},
+    {"XORI", XORI_BITMASK, FORMAT_ALU, true, false},
+    {"XORF", XORF_BITMASK, FORMAT_ALU, true, false},
+    {"BSR", BSR_BITMASK, FORMAT_SHIFT, false, false},
+    {"BSRI", BSRI_BITMASK, FORMAT_SHIFT, true, false},
+    {"BSRR", BSRR_BITMASK, FORMAT_SHIFT, false, false},
+    {"BSRRI", BSRRI_BITMASK, FORMAT_SHIFT, true, false},
+    {"BSL", BSL_BITMASK, FORMAT_SHIFT, false, false},
+    {"BSLI", BSLI_BITMASK, FORMAT_SHIFT, true, false},
+    {"BSLR", BSLR_BITMASK, FORMAT_SHIFT, false, false},
+    {"BSLRI", BSLRI_BITMASK, FORMAT_SHIFT, true, false},
+    {".WORD", 0, FORMAT_WORD, true, false},
+};
+
+typedef struct Token {
+    const char *text;
+    uint32_t length;
+} Token;
+
+typedef struct Label {
+    Token name;
+    uint32_t address;
+} Label;
+
+typedef struct Assembler {
+    AssemblyError *error;
+    uint32_t line;
+    bool failed;
+
+    Label *labels;
+    uint32_t label_count;
+    uint32_t label_capacity;
+
+    /* NULL during the first pass, which only counts words */
+    Program *program;
+    uint32_t word_count;
+} Assembler;
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> utils >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Only the first problem is reported, it is the one the rest most likely follow from */
+static bool fail(Assembler *assembler, const char *format, ...) {
+    if (!assembler->failed) {
+        assembler->failed = true;
+        assembler->error->line = assembler->line;
+        va_list arguments;
+        va_start(arguments, format);
+        vsnprintf(assembler->error->message, sizeof(assembler->error->message), format, arguments);
+        va_end(arguments);
+    }
+    return false;
+}
+
+static bool token_equals(Token token, const char *text) {
+    return strlen(text) == token.length && strncasecmp(token.text, text, token.length) == 0;
+}
+
+static bool is_identifier(Token token) {
+    if (token.length == 0 || !(isalpha((unsigned char)token.text[0]) || token.text[0] == '_')) {
+        return false;
+    }
+    for (uint32_t i = 1; i < token.length; i++) {
+        if (!(isalnum((unsigned char)token.text[i]) || token.text[i] == '_' || token.text[i] == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Splits a line at whitespace and commas, stopping at a comment */
+static uint32_t tokenize_line(const char *line, const char *end, Token *tokens) {
+    uint32_t count = 0;
+    const char *cursor = line;
+    while (cursor < end) {
+        if (isspace((unsigned char)*cursor) || *cursor == ',') {
+            cursor++;
+            continue;
+        }
+        if (*cursor == ';' || (*cursor == '/' && cursor + 1 < end && cursor[1] == '/')) {
+            break;
+        }
+        const char *start = cursor;
+        while (cursor < end && !isspace((unsigned char)*cursor) && *cursor != ',' && *cursor != ';') {
+            cursor++;
+        }
+        if (count == ASSEMBLER_MAX_TOKENS) {
+            return count + 1;
+        }
+        tokens[count++] = (Token){start, (uint32_t)(cursor - start)};
+    }
+    return count;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> operands >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool parse_register(Assembler *assembler, Token token, uint32_t *register_index) {
+    if (token.length == 2 && (token.text[0] == 'R' || token.text[0] == 'r') && token.text[1] >= '1' &&
+        token.text[1] <= '8') {
+        *register_index = token.text[1] - '1';
+        return true;
+    }
+    return fail(assembler, "expected a register R1 - R8, got '%.*s'", (int)token.length, token.text);
+}
+
+static const Label *find_label(const Assembler *assembler, Token name) {
+    for (uint32_t i = 0; i < assembler->label_count; i++) {
+        if (assembler->labels[i].name.length == name.length &&
+            memcmp(assembler->labels[i].name.text, name.text, name.length) == 0) {
+            return &assembler->labels[i];
+        }
+    }
+    return NULL;
+}
+
+/* Decimal, 0x hexadecimal or 0b binary, optionally negative */
+static bool parse_number(Token token, int64_t *value) {
+    uint32_t i = 0;
+    bool negative = token.length > 1 && token.text[0] == '-';
+    i += negative;
+    uint32_t base = 10;
+    if (token.length - i > 2 && token.text[i] == '0' && (token.text[i + 1] == 'x' || token.text[i + 1] == 'X')) {
+        base = 16;
+        i += 2;
+    } else if (token.length - i > 2 && token.text[i] == '0' && (token.text[i + 1] == 'b' || token.text[i + 1] == 'B')) {
+        base = 2;
+        i += 2;
+    }
+    if (i == token.length) {
+        return false;
+    }
+
+    int64_t magnitude = 0;
+    for (; i < token.length; i++) {
+        int digit = isdigit((unsigned char)token.text[i])    ? token.text[i] - '0'
+                    : isxdigit((unsigned char)token.text[i]) ? tolower((unsigned char)token.text[i]) - 'a' + 10
+                                                             : 16;
+        if (digit >= (int)base) {
+            return false;
+        }
+        magnitude = magnitude * base + digit;
+        if (magnitude > UINT32_MAX) {
+            return false;
+        }
+    }
+    *value = negative ? -magnitude : magnitude;
+    return true;
+}
+
+/* Labels are only known in the second pass, the first one counts them as zero */
+static bool parse_value(Assembler *assembler, Token token, int64_t minimum, int64_t maximum, uint32_t *value) {
+    int64_t parsed = 0;
+    if (is_identifier(token)) {
+        const Label *label = find_label(assembler, token);
+        if (label != NULL) {
+            parsed = label->address;
+        } else if (assembler->program != NULL) {
+            return fail(assembler, "undefined label '%.*s'", (int)token.length, token.text);
+        }
+    } else if (!parse_number(token, &parsed)) {
+        return fail(assembler, "expected a number or label, got '%.*s'", (int)token.length, token.text);
+    }
+    if (parsed < minimum || parsed > maximum) {
+        return fail(assembler, "'%.*s' is outside of %" PRId64 " - %" PRId64, (int)token.length, token.text, minimum,
+                    maximum);
+    }
+    *value = (uint32_t)parsed;
+    return true;
+}
+
+static bool parse_register_or_value(Assembler *assembler, Token token, bool use_immediate, uint32_t value_bits,
+                                    uint32_t *field) {
+    return use_immediate ? parse_value(assembler, token, 0, (INT64_C(1) << value_bits) - 1, field)
+                         : parse_register(assembler, token, field);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> encode >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static uint32_t operand_count(const Mnemonic *mnemonic) {
+    switch (mnemonic->format) {
+    case FORMAT_JMP:
+        return mnemonic->conditional ? 3 : 2;
+    case FORMAT_SET:
+    case FORMAT_SETN:
+    case FORMAT_SETU:
+        return 2;
+    case FORMAT_WORD:
+        return 1;
+    default:
+        return 3;
+    }
+}
+
+static bool encode_instruction(Assembler *assembler, const Mnemonic *mnemonic, const Token *operands,
+                               uint32_t *word) {
+    uint32_t first = 0;
+    uint32_t second = 0;
+    uint32_t third = 0;
+    bool parsed = false;
+    switch (mnemonic->format) {
+    case FORMAT_JMP:
+        parsed = parse_register(assembler, operands[0], &first) &&
+                 parse_register_or_value(assembler, operands[1], mnemonic->use_immediate, JMP_IMMEDIATE_BITS,
+                                         &second) &&
+                 (!mnemonic->conditional || parse_register(assembler, operands[2], &third));
+        *word = mnemonic->bitmask | third << 5 | first << 8 | second << 11;
+        break;
+    case FORMAT_MEMORY:
+        parsed = parse_register(assembler, operands[0], &first) && parse_register(assembler, operands[1], &second) &&
+                 parse_register_or_value(assembler, operands[2], mnemonic->use_immediate, MEMORY_IMMEDIATE_BITS,
+                                         &third);
+        *word = mnemonic->bitmask | first << 7 | second << 10 | third << 13;
+        break;
+    case FORMAT_SET:
+        parsed = parse_register(assembler, operands[0], &first) &&
+                 parse_value(assembler, operands[1], 0, (INT64_C(1) << SET_VALUE_BITS) - 1, &second);
+        *word = mnemonic->bitmask | first << 4 | second << 7;
+        break;
+    case FORMAT_SETN:
+        /* The upper bits are filled with ones when executed, only the lower ones are encoded */
+        parsed = parse_register(assembler, operands[0], &first) &&
+                 parse_value(assembler, operands[1], -(INT64_C(1) << SET_VALUE_BITS), -1, &second);
+        *word = mnemonic->bitmask | first << 4 | (second & ((UINT32_C(1) << SET_VALUE_BITS) - 1)) << 7;
+        break;
+    case FORMAT_SETU:
+        parsed = parse_register(assembler, operands[0], &first) &&
+                 parse_value(assembler, operands[1], 0, (INT64_C(1) << SETU_VALUE_BITS) - 1, &second);
+        *word = mnemonic->bitmask | first << 3 | second << 6;
+        break;
+    case FORMAT_ALU:
+        parsed = parse_register(assembler, operands[0], &first) && parse_register(assembler, operands[1], &second) &&
+                 parse_register_or_value(assembler, operands[2], mnemonic->use_immediate, ALU_IMMEDIATE_BITS, &third);
+        *word = mnemonic->bitmask | first << 7 | second << 10 | third << 13;
+        break;
+    case FORMAT_SHIFT:
+        parsed = parse_register(assembler, operands[0], &first) && parse_register(assembler, operands[1], &second) &&
+                 parse_register_or_value(assembler, operands[2], mnemonic->use_immediate, SHIFT_IMMEDIATE_BITS,
+                                         &third);
+        *word = mnemonic->bitmask | first << 6 | second << 9 | third << 12;
+        break;
+    case FORMAT_WORD:
+        parsed = parse_value(assembler, operands[0], INT32_MIN, UINT32_MAX, word);
+        break;
+    }
+    return parsed;
+}
+
+static bool define_label(Assembler *assembler, Token name) {
+    if (!is_identifier(name) || (name.length == 2 && (name.text[0] == 'R' || name.text[0] == 'r') &&
+                                 isdigit((unsigned char)name.text[1]))) {
+        return fail(assembler, "'%.*s' is not a valid label", (int)name.length, name.text);
+    }
+    if (find_label(assembler, name) != NULL) {
+        return fail(assembler, "label '%.*s' is defined twice", (int)name.length, name.text);
+    }
+    if (assembler->label_count == assembler->label_capacity) {
+        uint32_t capacity = assembler->label_capacity == 0 ? 16 : assembler->label_capacity * 2;
+        Label *labels = realloc(assembler->labels, capacity * sizeof(Label));
+        if (labels == NULL) {
+            return fail(assembler, "out of memory");
+        }
+        assembler->labels = labels;
+        assembler->label_capacity = capacity;
+    }
+    assembler->labels[assembler->label_count++] = (Label){name, assembler->word_count * 4};
+    return true;
+}
+
+static bool assemble_line(Assembler *assembler, const char *line, const char *end) {
+    Token tokens[ASSEMBLER_MAX_TOKENS];
+    uint32_t token_count = tokenize_line(line, end, tokens);
+    Token *cursor = tokens;
+    if (token_count > 0 && cursor->text[cursor->length - 1] == ':') {
+        /* Labels are collected in the first pass only */
+        if (assembler->program == NULL && !define_label(assembler, (Token){cursor->text, cursor->length - 1})) {
+            return false;
+        }
+        cursor++;
+        token_count--;
+    }
+    if (token_count == 0) {
+        return true;
+    }
+
+    const Mnemonic *mnemonic = NULL;
+    for (size_t i = 0; i < sizeof(MNEMONICS) / sizeof(MNEMONICS[0]); i++) {
+        if (token_equals(*cursor, MNEMONICS[i].name)) {
+            mnemonic = &MNEMONICS[i];
+        }
+    }
+    if (mnemonic == NULL) {
+        return fail(assembler, "unknown mnemonic '%.*s'", (int)cursor->length, cursor->text);
+    }
+    if (token_count - 1 != operand_count(mnemonic)) {
+        return fail(assembler, "%s takes %" PRIu32 " operands", mnemonic->name, operand_count(mnemonic));
+    }
+
+    uint32_t word = 0;
+    if (!encode_instruction(assembler, mnemonic, cursor + 1, &word)) {
+        return false;
+    }
+    if (assembler->program != NULL) {
+        assembler->program->words[assembler->word_count] = word;
+    }
+    assembler->word_count++;
+    return true;
+}
+
+static bool assemble_pass(Assembler *assembler, const char *source) {
+    assembler->line = 0;
+    assembler->word_count = 0;
+    const char *line = source;
+    while (*line != '\0') {
+        const char *end = strchr(line, '\n');
+        if (end == NULL) {
+            end = line + strlen(line);
+        }
+        assembler->line++;
+        if (!assemble_line(assembler, line, end)) {
+            return false;
+        }
+        line = *end == '\0' ? end : end + 1;
+    }
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> program >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+Program *assemble_program(const char *source, AssemblyError *error) {
+    Assembler assembler = {.error = error};
+    Program *program = NULL;
+    if (assemble_pass(&assembler, source)) {
+        program = malloc(sizeof(Program) + assembler.word_count * sizeof(uint32_t));
+        if (program == NULL) {
+            fail(&assembler, "out of memory");
+        } else {
+            program->word_count = assembler.word_count;
+            assembler.program = program;
+        }
+    }
+    if (program != NULL && !assemble_pass(&assembler, source)) {
+        free(program);
+        program = NULL;
+    }
+    free(assembler.labels);
+    return program;
+}
+
+void free_program(Program *program) {
+    free(program);
+}
+
+static bool write_all(int fd, const uint8_t *buffer, uint32_t length) {
+    for (uint32_t written = 0; written < length;) {
+        ssize_t result = write(fd, buffer + written, length - written);
+        if (result <= 0) {
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+bool write_program_image(const Program *program, int fd) {
+    uint8_t buffer[4096];
+    uint32_t buffered = 0;
+    for (uint32_t i = 0; i < program->word_count; i++) {
+        if (buffered == sizeof(buffer)) {
+            if (!write_all(fd, buffer, buffered)) {
+                return false;
+            }
+            buffered = 0;
+        }
+        buffer[buffered++] = program->words[i] >> 24;
+        buffer[buffered++] = program->words[i] >> 16;
+        buffer[buffered++] = program->words[i] >> 8;
+        buffer[buffered++] = program->words[i];
+    }
+    return write_all(fd, buffer, buffered);
+}
@@ -0,0 +1,36 @@
+#ifndef _ASSEMBLER_H_
+#define _ASSEMBLER_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Words in the order they are placed in memory, starting at address 0 */
+typedef struct Program {
+    uint32_t word_count;
+    uint32_t words[];
+} Program;
+
+typedef struct AssemblyError {
+    uint32_t line; // Starting at 1
+    char message[96];
+} AssemblyError;
+
+/*
+ * Assembles the mnemonics of ARCHITECTURE_SPECIFICATIONS.md, one instruction per line:
+ *
+ *     loop:   SUBI  R1 R1 1        ; Comments start with ';' or '//'
+ *             JMPIC R8 done R1     ; Labels stand for their byte address, operands may be separated by commas
+ *             JMPI  R8 loop
+ *     done:   JMPI  R8 done
+ *     data:   .word 0xCAFE         ; Places a literal word
+ *
+ * Returns NULL and describes the first problem in error when the source does not assemble.
+ */
+Program *assemble_program(const char *source, AssemblyError *error);
+
+void free_program(Program *program);
+
+/* Writes the program as the raw big endian image load_program_image maps, returns false on a failed write */
+bool write_program_image(const Program *program, int fd);
+
+#endif
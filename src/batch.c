@@ -0,0 +1,213 @@
+/*********************************************************************************************************************
+ * Runs batches of independent machines on a work stealing thread pool                                               *
+ *                                                                                                                   *
+ * Every worker owns a deque of job indices. It takes work from the bottom of its own deque and, once that is empty, *
+ * steals from the top of the others'. A job still running at the end of its slice goes back on the top of its      *
+ * worker's deque, the end thieves take from, so idle workers pick up stragglers first while the owner moves on to  *
+ * fresh jobs. A worker which finds every deque empty sleeps until a job is put back or the last one finishes.       *
+ *********************************************************************************************************************/
+
+#include "batch.h"
+#include "cpu.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BATCH_MAX_THREADS 256
+
+typedef struct JobDeque {
+    pthread_mutex_t lock;
+    uint32_t *jobs; // Ring buffer, large enough to hold every job of the batch
+    uint32_t top;   // Index of the oldest job, where thieves take from
+    uint32_t count;
+} JobDeque;
+
+typedef struct Batch {
+    BatchJob *jobs;
+    uint32_t job_count;
+    uint32_t thread_count;
+    uint64_t slice_steps;
+    uint32_t remaining_jobs; // Accessed atomically, workers stop once it reaches zero
+    JobDeque deques[BATCH_MAX_THREADS];
+
+    /* Idle workers sleep on work_changed until work_generation moves, which is only stored under idle_lock */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t work_changed;
+    uint64_t work_generation;
+} Batch;
+
+typedef struct Worker {
+    Batch *batch;
+    uint32_t index;
+} Worker;
+
+static void push_bottom(Batch *batch, JobDeque *deque, uint32_t job) {
+    pthread_mutex_lock(&deque->lock);
+    deque->jobs[(deque->top + deque->count) % batch->job_count] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+/* Wakes one idle worker for a job put back, or every one of them once the batch is done */
+static void announce_work(Batch *batch, bool done) {
+    pthread_mutex_lock(&batch->idle_lock);
+    __atomic_store_n(&batch->work_generation, batch->work_generation + 1, __ATOMIC_RELEASE);
+    if (done) {
+        pthread_cond_broadcast(&batch->work_changed);
+    } else {
+        pthread_cond_signal(&batch->work_changed);
+    }
+    pthread_mutex_unlock(&batch->idle_lock);
+}
+
+static void push_top(Batch *batch, JobDeque *deque, uint32_t job) {
+    pthread_mutex_lock(&deque->lock);
+    deque->top = (deque->top + batch->job_count - 1) % batch->job_count;
+    deque->jobs[deque->top] = job;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    announce_work(batch, false);
+}
+
+static bool pop_bottom(Batch *batch, JobDeque *deque, uint32_t *job) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        deque->count--;
+        *job = deque->jobs[(deque->top + deque->count) % batch->job_count];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+static bool pop_top(Batch *batch, JobDeque *deque, uint32_t *job) {
+    pthread_mutex_lock(&deque->lock);
+    bool found = deque->count > 0;
+    if (found) {
+        *job = deque->jobs[deque->top];
+        deque->top = (deque->top + 1) % batch->job_count;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+/* Tries every other worker once, starting after this one so thieves spread out over the victims */
+static bool steal(Batch *batch, uint32_t thief, uint32_t *job) {
+    for (uint32_t i = 1; i < batch->thread_count; i++) {
+        if (pop_top(batch, &batch->deques[(thief + i) % batch->thread_count], job)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Runs one slice of the job, returns true once it is finished */
+static bool run_slice(BatchJob *job, uint64_t slice_steps) {
+    uint64_t remaining = job->max_steps - job->result.steps;
+    RunResult slice = run_cpu(job->cpu, job->memory, remaining < slice_steps ? remaining : slice_steps);
+    job->result.steps += slice.steps;
+    job->result.status = slice.status;
+    job->result.trap = slice.trap;
+    return slice.status != CPU_STATUS_STEP_LIMIT || job->result.steps >= job->max_steps;
+}
+
+static void *run_worker(void *argument) {
+    Worker *worker = argument;
+    Batch *batch = worker->batch;
+    JobDeque *own = &batch->deques[worker->index];
+
+    while (__atomic_load_n(&batch->remaining_jobs, __ATOMIC_ACQUIRE) > 0) {
+        /* Read before looking at the deques, so a job put back after they were found empty still wakes this worker */
+        uint64_t generation = __atomic_load_n(&batch->work_generation, __ATOMIC_ACQUIRE);
+        uint32_t job;
+        if (!pop_bottom(batch, own, &job) && !steal(batch, worker->index, &job)) {
+            /* Everything left is being run by other workers, one of them may still put a job back */
+            pthread_mutex_lock(&batch->idle_lock);
+            while (batch->work_generation == generation) {
+                pthread_cond_wait(&batch->work_changed, &batch->idle_lock);
+            }
+            pthread_mutex_unlock(&batch->idle_lock);
+            continue;
+        }
+
+        if (run_slice(&batch->jobs[job], batch->slice_steps)) {
+            if (__atomic_sub_fetch(&batch->remaining_jobs, 1, __ATOMIC_ACQ_REL) == 0) {
+                announce_work(batch, true);
+            }
+        } else {
+            push_top(batch, own, job);
+        }
+    }
+    return NULL;
+}
+
+void run_batch(BatchJob *jobs, uint32_t job_count, uint32_t thread_count, uint64_t slice_steps) {
+    if (job_count == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < job_count; i++) {
+        jobs[i].result = (RunResult){CPU_STATUS_STEP_LIMIT, 0};
+    }
+    if (thread_count == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? online : 1;
+    }
+    thread_count = thread_count < BATCH_MAX_THREADS ? thread_count : BATCH_MAX_THREADS;
+    thread_count = thread_count < job_count ? thread_count : job_count;
+
+    Batch *batch = calloc(1, sizeof(Batch));
+    uint32_t *storage = batch != NULL ? malloc((size_t)thread_count * job_count * sizeof(uint32_t)) : NULL;
+    if (storage == NULL) {
+        /* Still gets the work done, just without any help */
+        for (uint32_t i = 0; i < job_count; i++) {
+            while (!run_slice(&jobs[i], UINT64_MAX)) {
+            }
+        }
+        free(batch);
+        return;
+    }
+
+    batch->jobs = jobs;
+    batch->job_count = job_count;
+    batch->thread_count = thread_count;
+    batch->slice_steps = slice_steps != 0 ? slice_steps : BATCH_SLICE_STEPS;
+    batch->remaining_jobs = job_count;
+    pthread_mutex_init(&batch->idle_lock, NULL);
+    pthread_cond_init(&batch->work_changed, NULL);
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pthread_mutex_init(&batch->deques[i].lock, NULL);
+        batch->deques[i].jobs = &storage[(size_t)i * job_count];
+    }
+    /* Deals the jobs out round robin, neighbouring jobs tend to be alike so this spreads the heavy ones */
+    for (uint32_t i = 0; i < job_count; i++) {
+        push_bottom(batch, &batch->deques[i % thread_count], i);
+    }
+
+    Worker workers[BATCH_MAX_THREADS];
+    pthread_t threads[BATCH_MAX_THREADS];
+    bool started[BATCH_MAX_THREADS] = {false};
+    for (uint32_t i = 0; i < thread_count; i++) {
+        workers[i] = (Worker){batch, i};
+        if (i > 0) {
+            started[i] = pthread_create(&threads[i], NULL, run_worker, &workers[i]) == 0;
+        }
+    }
+    /* Jobs dealt to a worker whose thread did not start get stolen by the others */
+    run_worker(&workers[0]);
+    for (uint32_t i = 1; i < thread_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        pthread_mutex_destroy(&batch->deques[i].lock);
+    }
+    pthread_cond_destroy(&batch->work_changed);
+    pthread_mutex_destroy(&batch->idle_lock);
+    free(storage);
+    free(batch);
+}
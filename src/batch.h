@@ -0,0 +1,27 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+
+/* Steps a machine runs before it goes back on the queue, so a long runner cannot hold a thread for the whole batch */
+#define BATCH_SLICE_STEPS 1048576
+
+/* One independent machine, every job needs its own Cpu and Memory */
+typedef struct BatchJob {
+    Cpu *cpu;
+    Memory *memory;
+    uint64_t max_steps;
+    RunResult result; // Steps add up over every slice the job ran for
+} BatchJob;
+
+/*
+ * Runs every job until it halts, faults, blocks or uses up its max_steps, spread over thread_count threads which
+ * steal work from each other once their own queue runs dry. A thread_count of 0 uses one thread per online host core
+ * and a slice_steps of 0 uses BATCH_SLICE_STEPS. The calling thread takes part and the call returns once every job is
+ * done.
+ */
+void run_batch(BatchJob *jobs, uint32_t job_count, uint32_t thread_count, uint64_t slice_steps);
+
+#endif
@@ -0,0 +1,288 @@
+/*********************************************************************************************************************
+ * Branch predictors                                                                                                 *
+ *                                                                                                                   *
+ * Predictors of the conditional jumps, JMPC and JMPIC, which hardware would have to guess before the control        *
+ * register is known. Every one of them predicts and trains in the same call, after the jump executed.               *
+ *********************************************************************************************************************/
+
+#include "branch_predictor.h"
+#include "cpu.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_TABLE_BITS          24
+#define INITIAL_BRANCH_CAPACITY 64
+#define TAGE_TAG_BITS           10
+
+static const char *const KIND_NAMES[BRANCH_PREDICTOR_KIND_COUNT] = {
+    [BRANCH_PREDICTOR_STATIC] = "static",
+    [BRANCH_PREDICTOR_BIMODAL] = "bimodal",
+    [BRANCH_PREDICTOR_GSHARE] = "gshare",
+    [BRANCH_PREDICTOR_TAGE] = "TAGE",
+};
+
+static const uint32_t TAGE_HISTORY_LENGTHS[TAGE_TABLE_COUNT] = {4, 8, 16, 32};
+
+const char *get_branch_predictor_name(BranchPredictorKind kind) {
+    return kind < BRANCH_PREDICTOR_KIND_COUNT ? KIND_NAMES[kind] : "unknown";
+}
+
+BranchPredictor *init_branch_predictor(BranchPredictorKind kind, uint32_t table_bits) {
+    if (kind >= BRANCH_PREDICTOR_KIND_COUNT || table_bits == 0 || table_bits > MAX_TABLE_BITS) {
+        return NULL;
+    }
+    BranchPredictor *predictor = calloc(1, sizeof(BranchPredictor));
+    if (predictor == NULL) {
+        return NULL;
+    }
+    predictor->kind = kind;
+    predictor->table_bits = table_bits;
+    predictor->branch_capacity = INITIAL_BRANCH_CAPACITY;
+    predictor->branches = calloc(INITIAL_BRANCH_CAPACITY, sizeof(BranchStats));
+    uint32_t entries = UINT32_C(1) << table_bits;
+    predictor->counters = malloc(entries);
+    if (kind == BRANCH_PREDICTOR_TAGE) {
+        predictor->tagged = calloc((size_t)TAGE_TABLE_COUNT * entries, sizeof(TageEntry));
+    }
+    if (predictor->branches == NULL || predictor->counters == NULL ||
+        (kind == BRANCH_PREDICTOR_TAGE && predictor->tagged == NULL)) {
+        free_branch_predictor(predictor);
+        return NULL;
+    }
+    /* Weakly not taken */
+    for (uint32_t i = 0; i < entries; i++) {
+        predictor->counters[i] = 1;
+    }
+    return predictor;
+}
+
+void free_branch_predictor(BranchPredictor *predictor) {
+    if (predictor == NULL) {
+        return;
+    }
+    free(predictor->counters);
+    free(predictor->tagged);
+    free(predictor->branches);
+    free(predictor);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> predictors >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static uint32_t get_table_mask(const BranchPredictor *predictor) {
+    return (UINT32_C(1) << predictor->table_bits) - 1;
+}
+
+/* Predicts with the 2 bit counter at index and moves it towards the outcome */
+static bool predict_with_counter(BranchPredictor *predictor, uint32_t index, bool taken) {
+    uint8_t *counter = &predictor->counters[index];
+    bool prediction = *counter >= 2;
+    if (taken && *counter < 3) {
+        (*counter)++;
+    } else if (!taken && *counter > 0) {
+        (*counter)--;
+    }
+    return prediction;
+}
+
+/* The last length outcomes xor folded down to bits bits */
+static uint32_t fold_history(uint64_t history, uint32_t length, uint32_t bits) {
+    if (length < 64) {
+        history &= (UINT64_C(1) << length) - 1;
+    }
+    uint32_t folded = 0;
+    for (; history != 0; history >>= bits) {
+        folded ^= history & ((UINT64_C(1) << bits) - 1);
+    }
+    return folded;
+}
+
+static TageEntry *get_tage_entry(BranchPredictor *predictor, uint32_t table, uint32_t word_index, uint16_t *tag) {
+    uint32_t length = TAGE_HISTORY_LENGTHS[table];
+    uint32_t index = (word_index ^ word_index >> predictor->table_bits ^
+                      fold_history(predictor->history, length, predictor->table_bits)) &
+                     get_table_mask(predictor);
+    uint32_t hash = word_index ^ fold_history(predictor->history, length, TAGE_TAG_BITS - 1) << 1;
+    *tag = hash % ((UINT32_C(1) << TAGE_TAG_BITS) - 1) + 1;
+    return &predictor->tagged[(size_t)table << predictor->table_bits | index];
+}
+
+/*
+ * The longest history table with a matching tag provides the prediction, the bimodal base when none does. A
+ * misprediction allocates an entry in one of the longer tables, so branches only use long histories once short ones
+ * were shown not to be enough.
+ */
+static bool predict_with_tage(BranchPredictor *predictor, uint32_t word_index, bool taken) {
+    TageEntry *entries[TAGE_TABLE_COUNT];
+    uint16_t tags[TAGE_TABLE_COUNT];
+    int provider = -1;
+    int alternate = -1;
+    for (int table = TAGE_TABLE_COUNT - 1; table >= 0; table--) {
+        entries[table] = get_tage_entry(predictor, table, word_index, &tags[table]);
+        if (entries[table]->tag == tags[table]) {
+            if (provider < 0) {
+                provider = table;
+            } else if (alternate < 0) {
+                alternate = table;
+            }
+        }
+    }
+
+    uint32_t base_index = word_index & get_table_mask(predictor);
+    bool base_prediction = predictor->counters[base_index] >= 2;
+    bool alternate_prediction = alternate >= 0 ? entries[alternate]->counter >= 0 : base_prediction;
+    bool prediction = base_prediction;
+    if (provider >= 0) {
+        TageEntry *entry = entries[provider];
+        prediction = entry->counter >= 0;
+        if (prediction != alternate_prediction) {
+            if (prediction == taken && entry->useful < 3) {
+                entry->useful++;
+            } else if (prediction != taken && entry->useful > 0) {
+                entry->useful--;
+            }
+        }
+        if (taken && entry->counter < 3) {
+            entry->counter++;
+        } else if (!taken && entry->counter > -4) {
+            entry->counter--;
+        }
+    } else {
+        predict_with_counter(predictor, base_index, taken);
+    }
+
+    if (prediction != taken && provider < TAGE_TABLE_COUNT - 1) {
+        bool allocated = false;
+        for (int table = provider + 1; table < TAGE_TABLE_COUNT && !allocated; table++) {
+            if (entries[table]->useful == 0) {
+                *entries[table] = (TageEntry){tags[table], (int8_t)(taken ? 0 : -1), 0};
+                allocated = true;
+            }
+        }
+        /* Age the entries in the way, so one of them can be replaced next time */
+        for (int table = provider + 1; table < TAGE_TABLE_COUNT && !allocated; table++) {
+            entries[table]->useful--;
+        }
+    }
+    return prediction;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> statistics >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static BranchStats *find_branch_slot(BranchStats *branches, uint32_t capacity, uint32_t address) {
+    uint32_t slot = (address / 4 * UINT32_C(0x9E3779B1)) & (capacity - 1);
+    while (branches[slot].executed != 0 && branches[slot].address != address) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return &branches[slot];
+}
+
+/* Keeps the table at most half full, returns NULL if it has to grow and cannot */
+static BranchStats *get_branch_stats(BranchPredictor *predictor, uint32_t address) {
+    BranchStats *stats = find_branch_slot(predictor->branches, predictor->branch_capacity, address);
+    if (stats->executed != 0) {
+        return stats;
+    }
+    if (2 * (predictor->branch_count + 1) > predictor->branch_capacity) {
+        uint32_t capacity = 2 * predictor->branch_capacity;
+        BranchStats *branches = calloc(capacity, sizeof(BranchStats));
+        if (branches == NULL) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < predictor->branch_capacity; i++) {
+            if (predictor->branches[i].executed != 0) {
+                *find_branch_slot(branches, capacity, predictor->branches[i].address) = predictor->branches[i];
+            }
+        }
+        free(predictor->branches);
+        predictor->branches = branches;
+        predictor->branch_capacity = capacity;
+        stats = find_branch_slot(branches, capacity, address);
+    }
+    predictor->branch_count++;
+    stats->address = address;
+    return stats;
+}
+
+bool record_branch(BranchPredictor *predictor, const DecodedInstruction *decoded, const Cpu *cpu, uint32_t address,
+                   bool taken) {
+    bool prediction = false;
+    uint32_t word_index = address / 4;
+    switch (predictor->kind) {
+    case BRANCH_PREDICTOR_STATIC: {
+        /* A jump never writes registers, so its target is the same after it executed */
+        uint32_t offset = decoded->use_immediate ? decoded->value : cpu->registers[decoded->second_source_register];
+        prediction = cpu->registers[decoded->first_source_register] + offset <= address;
+        break;
+    }
+    case BRANCH_PREDICTOR_BIMODAL:
+        prediction = predict_with_counter(predictor, word_index & get_table_mask(predictor), taken);
+        break;
+    case BRANCH_PREDICTOR_GSHARE:
+        prediction = predict_with_counter(predictor, (word_index ^ (uint32_t)predictor->history) &
+                                                         get_table_mask(predictor), taken);
+        break;
+    default:
+        prediction = predict_with_tage(predictor, word_index, taken);
+        break;
+    }
+    predictor->history = predictor->history << 1 | taken;
+
+    bool correct = prediction == taken;
+    predictor->predictions++;
+    predictor->mispredictions += !correct;
+    BranchStats *stats = get_branch_stats(predictor, address);
+    if (stats != NULL) {
+        stats->executed++;
+        stats->taken += taken;
+        stats->mispredicted += !correct;
+    }
+    return correct;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> report >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static double percent(uint64_t count, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * count / total;
+}
+
+/* Most mispredictions first, then by address so the order is stable */
+static int compare_branch_stats(const void *a, const void *b) {
+    const BranchStats *first = a;
+    const BranchStats *second = b;
+    if (first->mispredicted != second->mispredicted) {
+        return first->mispredicted < second->mispredicted ? 1 : -1;
+    }
+    return first->address < second->address ? -1 : first->address > second->address;
+}
+
+bool write_branch_report(const BranchPredictor *predictor, FILE *file, uint32_t top_branches) {
+    fprintf(file, "predictor      %s, %" PRIu32 " entries\n", get_branch_predictor_name(predictor->kind),
+            UINT32_C(1) << predictor->table_bits);
+    fprintf(file, "predictions    %14" PRIu64 "\nmispredictions %14" PRIu64 "\naccuracy       %13.2f%%\n",
+            predictor->predictions, predictor->mispredictions,
+            100.0 - percent(predictor->mispredictions, predictor->predictions));
+
+    uint32_t count = predictor->branch_count;
+    BranchStats *branches = malloc((count > 0 ? count : 1) * sizeof(BranchStats));
+    if (branches == NULL) {
+        return false;
+    }
+    for (uint32_t i = 0, j = 0; i < predictor->branch_capacity; i++) {
+        if (predictor->branches[i].executed != 0) {
+            branches[j++] = predictor->branches[i];
+        }
+    }
+    qsort(branches, count, sizeof(BranchStats), compare_branch_stats);
+
+    fprintf(file, "\nmost mispredicted conditional jumps\n");
+    for (uint32_t i = 0; i < count && i < top_branches; i++) {
+        fprintf(file, "  0x%08" PRIx32 " executed %14" PRIu64 " %6.2f%% taken %6.2f%% accuracy\n", branches[i].address,
+                branches[i].executed, percent(branches[i].taken, branches[i].executed),
+                100.0 - percent(branches[i].mispredicted, branches[i].executed));
+    }
+    free(branches);
+    return !ferror(file);
+}
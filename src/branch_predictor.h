@@ -0,0 +1,72 @@
+#ifndef _BRANCH_PREDICTOR_H_
+#define _BRANCH_PREDICTOR_H_
+
+#include "cpu.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define TAGE_TABLE_COUNT 4 // Tagged tables, using 4, 8, 16 and 32 outcomes of history
+
+typedef enum BranchPredictorKind {
+    BRANCH_PREDICTOR_STATIC,  // Backward jumps taken, forward jumps not taken
+    BRANCH_PREDICTOR_BIMODAL, // A 2 bit counter per address
+    BRANCH_PREDICTOR_GSHARE,  // A 2 bit counter per address xor global history
+    BRANCH_PREDICTOR_TAGE,    // Bimodal base with tagged tables of geometrically growing history lengths
+    BRANCH_PREDICTOR_KIND_COUNT,
+} BranchPredictorKind;
+
+typedef struct TageEntry {
+    uint16_t tag;   // Never 0, so a zeroed entry matches nothing
+    int8_t counter; // -4 to 3, taken when not negative
+    uint8_t useful; // 0 to 3, entries only get replaced at 0
+} TageEntry;
+
+/* Counts of one conditional jump */
+typedef struct BranchStats {
+    uint32_t address;
+    uint64_t executed; // 0 for free slots of the table
+    uint64_t taken;
+    uint64_t mispredicted;
+} BranchStats;
+
+/*
+ * Predicts the conditional jumps of a CPU, JMPC and JMPIC, while attached to Cpu.branch_predictor. Like the profile it
+ * runs on the recording copy of the interpreter. An attached timing model then only charges its jump penalty for
+ * mispredicted conditional jumps, rather than for every taken one.
+ */
+typedef struct BranchPredictor {
+    BranchPredictorKind kind;
+    uint32_t table_bits;
+    uint64_t history;  // Outcomes of the last conditional jumps, the newest in bit 0
+    uint8_t *counters; // 2 bit counters of bimodal and gshare, and the base predictor of TAGE
+    TageEntry *tagged; // TAGE_TABLE_COUNT tables one after the other, TAGE only
+
+    uint64_t predictions;
+    uint64_t mispredictions;
+    BranchStats *branches; // Open addressing on the address
+    uint32_t branch_capacity;
+    uint32_t branch_count;
+} BranchPredictor;
+
+/*
+ * Tables have 1 << table_bits entries, 1 to 24 bits, and every counter starts weakly not taken. Returns NULL for an
+ * invalid kind or size, or when the tables cannot be allocated.
+ */
+BranchPredictor *init_branch_predictor(BranchPredictorKind kind, uint32_t table_bits);
+
+void free_branch_predictor(BranchPredictor *predictor);
+
+const char *get_branch_predictor_name(BranchPredictorKind kind);
+
+/*
+ * Called by the run loop after a conditional jump executed, with whether it was taken. Predicts it, trains the
+ * predictor with the outcome and returns whether the prediction was right.
+ */
+bool record_branch(BranchPredictor *predictor, const DecodedInstruction *decoded, const Cpu *cpu, uint32_t address,
+                   bool taken);
+
+/* Writes the overall accuracy and the top_branches conditional jumps with the most mispredictions */
+bool write_branch_report(const BranchPredictor *predictor, FILE *file, uint32_t top_branches);
+
+#endif
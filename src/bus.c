@@ -0,0 +1,88 @@
+/*********************************************************************************************************************
+ * Address decoded device bus                                                                                        *
+ *                                                                                                                   *
+ * Only reached from the slow path of LD and ST, once a location turned out not to be RAM. Ranges are few, so a      *
+ * linear scan over them costs less than anything smarter.                                                           *
+ *********************************************************************************************************************/
+
+#include "bus.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+Bus *init_bus(void) {
+    Bus *bus = calloc(1, sizeof(Bus));
+    if (bus != NULL && pthread_mutex_init(&bus->lock, NULL) != 0) {
+        free(bus);
+        return NULL;
+    }
+    return bus;
+}
+
+void free_bus(Bus *bus) {
+    if (bus == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&bus->lock);
+    free(bus);
+}
+
+bool map_bus_device(Bus *bus, uint32_t base, uint32_t size_bytes, void *device, DeviceRead read, DeviceWrite write) {
+    if (size_bytes == 0 || base % 4 != 0 || size_bytes % 4 != 0 || base + (size_bytes - 1) < base ||
+        bus->range_count == BUS_MAX_RANGES) {
+        return false;
+    }
+
+    uint32_t index = 0;
+    while (index < bus->range_count && bus->ranges[index].base < base) {
+        index++;
+    }
+    const BusRange *previous = index > 0 ? &bus->ranges[index - 1] : NULL;
+    const BusRange *next = index < bus->range_count ? &bus->ranges[index] : NULL;
+    if ((previous != NULL && previous->base + (previous->size_bytes - 1) >= base) ||
+        (next != NULL && base + (size_bytes - 1) >= next->base)) {
+        return false;
+    }
+
+    for (uint32_t i = bus->range_count; i > index; i--) {
+        bus->ranges[i] = bus->ranges[i - 1];
+    }
+    bus->ranges[index] = (BusRange){base, size_bytes, device, read, write};
+    bus->range_count++;
+    return true;
+}
+
+static const BusRange *find_bus_range(const Bus *bus, uint32_t address) {
+    for (uint32_t i = 0; i < bus->range_count && bus->ranges[i].base <= address; i++) {
+        if (address - bus->ranges[i].base < bus->ranges[i].size_bytes) {
+            return &bus->ranges[i];
+        }
+    }
+    return NULL;
+}
+
+bool read_bus(Bus *bus, uint32_t address, uint32_t width, uint32_t *value) {
+    const BusRange *range = find_bus_range(bus, address);
+    if (range == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&bus->lock);
+    *value = range->read(range->device, address - range->base, width);
+    pthread_mutex_unlock(&bus->lock);
+    return true;
+}
+
+bool write_bus(Bus *bus, uint32_t address, uint32_t width, uint32_t value) {
+    const BusRange *range = find_bus_range(bus, address);
+    if (range == NULL) {
+        return false;
+    }
+    if (range->write != NULL) {
+        pthread_mutex_lock(&bus->lock);
+        range->write(range->device, address - range->base, width, value);
+        pthread_mutex_unlock(&bus->lock);
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef _BUS_H_
+#define _BUS_H_
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#define BUS_MAX_RANGES 16
+
+/*
+ * Called with the offset of the first byte into the device's range and the access width in bytes, 1, 2 or 4. The CPU
+ * only issues naturally aligned accesses, so an access never crosses a word of the device.
+ */
+typedef uint32_t (*DeviceRead)(void *device, uint32_t offset, uint32_t width);
+typedef void (*DeviceWrite)(void *device, uint32_t offset, uint32_t width, uint32_t value);
+
+typedef struct BusRange {
+    uint32_t base;
+    uint32_t size_bytes;
+    void *device;
+    DeviceRead read;
+    DeviceWrite write;
+} BusRange;
+
+/*
+ * Devices addressed by LD and ST while the bus is attached to Cpu.bus. The CPU only asks the bus about locations past
+ * the end of its memory, so accesses to RAM never see it and ranges below the memory size are shadowed by RAM.
+ * Accesses are serialized by the bus, cores sharing one need no locking in their devices.
+ */
+typedef struct Bus {
+    pthread_mutex_t lock;
+    uint32_t range_count;
+    BusRange ranges[BUS_MAX_RANGES]; // Sorted by base
+} Bus;
+
+Bus *init_bus(void);
+
+/* The devices are not owned by the bus, free them after it */
+void free_bus(Bus *bus);
+
+/*
+ * Maps the device to base up to base + size_bytes - 1, a NULL write ignores stores. Map every device before running a
+ * CPU on the bus. Returns false when the range is empty, not a whole number of words, wraps around the address space,
+ * overlaps another range or the bus is full.
+ */
+bool map_bus_device(Bus *bus, uint32_t base, uint32_t size_bytes, void *device, DeviceRead read, DeviceWrite write);
+
+/* The address is that of the first byte, returns false when no device is mapped there */
+bool read_bus(Bus *bus, uint32_t address, uint32_t width, uint32_t *value);
+
+bool write_bus(Bus *bus, uint32_t address, uint32_t width, uint32_t value);
+
+/*
+ * Device registers are big endian words like memory. Narrower reads return the bytes of the register they cover, so
+ * LDB of a register's last byte reads its low byte.
+ */
+static inline uint32_t read_register_bytes(uint32_t value, uint32_t offset, uint32_t width) {
+    if (width == 4) {
+        return value;
+    }
+    return value >> (8 * (4 - width - offset % 4)) & ((UINT32_C(1) << (8 * width)) - 1);
+}
+
+#endif
@@ -0,0 +1,238 @@
+/*********************************************************************************************************************
+ * Set associative cache hierarchy                                                                                   *
+ *                                                                                                                   *
+ * Every level keeps tags only. Memory stays the single copy of the data, so the model can count hits, misses and    *
+ * writebacks without ever being able to change what a program computes.                                            *
+ *********************************************************************************************************************/
+
+#include "cache.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_RANDOM_SEED 0x9E3779B9
+
+static const char *const REPLACEMENT_NAMES[] = {
+    [CACHE_REPLACEMENT_LRU] = "LRU",
+    [CACHE_REPLACEMENT_FIFO] = "FIFO",
+    [CACHE_REPLACEMENT_RANDOM] = "random",
+};
+
+void get_default_cache_config(uint32_t level, CacheConfig *config) {
+    *config = (CacheConfig){
+        .size_bytes = level == 0 ? 32 * 1024 : 256 * 1024,
+        .associativity = 8,
+        .line_bytes = 64,
+        .replacement = CACHE_REPLACEMENT_LRU,
+        .write_policy = CACHE_WRITE_BACK,
+    };
+}
+
+static bool is_power_of_two(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static bool is_valid_cache_config(const CacheConfig *config) {
+    return is_power_of_two(config->size_bytes) && is_power_of_two(config->associativity) &&
+           is_power_of_two(config->line_bytes) && config->line_bytes >= 4 &&
+           config->size_bytes / config->line_bytes >= config->associativity &&
+           config->replacement <= CACHE_REPLACEMENT_RANDOM && config->write_policy <= CACHE_WRITE_THROUGH;
+}
+
+static void free_cache_level(CacheLevel *level) {
+    free(level->lines);
+    free(level->stamps);
+    free(level->flags);
+}
+
+static bool init_cache_level(CacheLevel *level, const CacheConfig *config) {
+    uint32_t way_count = config->size_bytes / config->line_bytes;
+    level->config = *config;
+    level->set_count = way_count / config->associativity;
+    level->line_shift = __builtin_ctz(config->line_bytes);
+    level->lines = calloc(way_count, sizeof(uint32_t));
+    level->stamps = calloc(way_count, sizeof(uint64_t));
+    level->flags = calloc(way_count, sizeof(uint8_t));
+    level->random = CACHE_RANDOM_SEED;
+    if (level->lines == NULL || level->stamps == NULL || level->flags == NULL) {
+        free_cache_level(level);
+        return false;
+    }
+    return true;
+}
+
+CacheHierarchy *init_cache_hierarchy(const CacheConfig *configs, uint32_t level_count) {
+    CacheConfig defaults[CACHE_MAX_LEVELS];
+    if (configs == NULL) {
+        for (uint32_t i = 0; i < CACHE_MAX_LEVELS; i++) {
+            get_default_cache_config(i, &defaults[i]);
+        }
+        configs = defaults;
+        level_count = CACHE_MAX_LEVELS;
+    }
+    if (level_count == 0 || level_count > CACHE_MAX_LEVELS) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < level_count; i++) {
+        if (!is_valid_cache_config(&configs[i])) {
+            return NULL;
+        }
+    }
+
+    CacheHierarchy *cache = calloc(1, sizeof(CacheHierarchy));
+    if (cache == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < level_count; i++) {
+        if (!init_cache_level(&cache->levels[i], &configs[i])) {
+            free_cache_hierarchy(cache);
+            return NULL;
+        }
+        cache->level_count++;
+    }
+    return cache;
+}
+
+void free_cache_hierarchy(CacheHierarchy *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < cache->level_count; i++) {
+        free_cache_level(&cache->levels[i]);
+    }
+    free(cache);
+}
+
+void reset_cache_hierarchy(CacheHierarchy *cache) {
+    for (uint32_t i = 0; i < cache->level_count; i++) {
+        CacheLevel *level = &cache->levels[i];
+        uint32_t way_count = level->set_count * level->config.associativity;
+        memset(level->flags, 0, way_count * sizeof(uint8_t));
+        level->clock = 0;
+        level->random = CACHE_RANDOM_SEED;
+        level->stats = (CacheStats){0};
+    }
+    cache->memory_reads = 0;
+    cache->memory_writes = 0;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> access >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* An invalid way if the set has one, otherwise the one the replacement policy picks */
+static uint32_t choose_victim(CacheLevel *level, uint32_t first_way) {
+    uint32_t associativity = level->config.associativity;
+    uint32_t victim = first_way;
+    for (uint32_t way = first_way; way < first_way + associativity; way++) {
+        if ((level->flags[way] & CACHE_LINE_VALID) == 0) {
+            return way;
+        }
+        if (level->stamps[way] < level->stamps[victim]) {
+            victim = way;
+        }
+    }
+    if (level->config.replacement == CACHE_REPLACEMENT_RANDOM) {
+        /* xorshift32 */
+        level->random ^= level->random << 13;
+        level->random ^= level->random >> 17;
+        level->random ^= level->random << 5;
+        victim = first_way + (level->random & (associativity - 1));
+    }
+    return victim;
+}
+
+static void access_level(CacheHierarchy *cache, uint32_t index, uint32_t address, bool store);
+
+static void access_next_level(CacheHierarchy *cache, uint32_t index, uint32_t address, bool store) {
+    if (index + 1 < cache->level_count) {
+        access_level(cache, index + 1, address, store);
+    } else if (store) {
+        cache->memory_writes++;
+    } else {
+        cache->memory_reads++;
+    }
+}
+
+static void access_level(CacheHierarchy *cache, uint32_t index, uint32_t address, bool store) {
+    CacheLevel *level = &cache->levels[index];
+    bool write_back = level->config.write_policy == CACHE_WRITE_BACK;
+    uint32_t line = address >> level->line_shift;
+    uint32_t first_way = (line & (level->set_count - 1)) * level->config.associativity;
+    level->clock++;
+    if (store) {
+        level->stats.writes++;
+    } else {
+        level->stats.reads++;
+    }
+
+    for (uint32_t way = first_way; way < first_way + level->config.associativity; way++) {
+        if ((level->flags[way] & CACHE_LINE_VALID) != 0 && level->lines[way] == line) {
+            if (level->config.replacement == CACHE_REPLACEMENT_LRU) {
+                level->stamps[way] = level->clock;
+            }
+            if (store && write_back) {
+                level->flags[way] |= CACHE_LINE_DIRTY;
+            } else if (store) {
+                access_next_level(cache, index, address, true);
+            }
+            return;
+        }
+    }
+
+    if (store) {
+        level->stats.write_misses++;
+        if (!write_back) {
+            access_next_level(cache, index, address, true);
+            return;
+        }
+    } else {
+        level->stats.read_misses++;
+    }
+
+    uint32_t victim = choose_victim(level, first_way);
+    if ((level->flags[victim] & CACHE_LINE_VALID) != 0) {
+        level->stats.evictions++;
+        if ((level->flags[victim] & CACHE_LINE_DIRTY) != 0) {
+            level->stats.writebacks++;
+            access_next_level(cache, index, level->lines[victim] << level->line_shift, true);
+        }
+    }
+    access_next_level(cache, index, address, false);
+    level->lines[victim] = line;
+    level->stamps[victim] = level->clock;
+    level->flags[victim] = CACHE_LINE_VALID | (store ? CACHE_LINE_DIRTY : 0);
+}
+
+void access_cache(CacheHierarchy *cache, uint32_t address, bool store) {
+    access_level(cache, 0, address, store);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> report >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static double percent(uint64_t count, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * count / total;
+}
+
+bool write_cache_report(const CacheHierarchy *cache, FILE *file) {
+    for (uint32_t i = 0; i < cache->level_count; i++) {
+        const CacheLevel *level = &cache->levels[i];
+        const CacheStats *stats = &level->stats;
+        uint64_t accesses = stats->reads + stats->writes;
+        uint64_t misses = stats->read_misses + stats->write_misses;
+        fprintf(file, "L%" PRIu32 " %" PRIu32 " bytes %" PRIu32 " way %" PRIu32 " byte lines %s %s\n", i + 1,
+                level->config.size_bytes, level->config.associativity, level->config.line_bytes,
+                REPLACEMENT_NAMES[level->config.replacement],
+                level->config.write_policy == CACHE_WRITE_BACK ? "write back" : "write through");
+        fprintf(file, "  reads      %14" PRIu64 "  misses %14" PRIu64 " %6.2f%%\n", stats->reads, stats->read_misses,
+                percent(stats->read_misses, stats->reads));
+        fprintf(file, "  writes     %14" PRIu64 "  misses %14" PRIu64 " %6.2f%%\n", stats->writes, stats->write_misses,
+                percent(stats->write_misses, stats->writes));
+        fprintf(file, "  hits       %14" PRIu64 " %6.2f%%\n", accesses - misses, percent(accesses - misses, accesses));
+        fprintf(file, "  evictions  %14" PRIu64 "\n  writebacks %14" PRIu64 "\n", stats->evictions, stats->writebacks);
+    }
+    fprintf(file, "memory reads  %14" PRIu64 "\nmemory writes %14" PRIu64 "\n", cache->memory_reads,
+            cache->memory_writes);
+    return !ferror(file);
+}
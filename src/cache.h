@@ -0,0 +1,88 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define CACHE_MAX_LEVELS 2
+
+#define CACHE_LINE_VALID 0x1
+#define CACHE_LINE_DIRTY 0x2
+
+/* Which line of a full set a miss evicts */
+typedef enum CacheReplacement {
+    CACHE_REPLACEMENT_LRU,    // Least recently accessed
+    CACHE_REPLACEMENT_FIFO,   // Least recently filled
+    CACHE_REPLACEMENT_RANDOM, // Any, from a fixed seed so runs repeat
+} CacheReplacement;
+
+typedef enum CacheWritePolicy {
+    CACHE_WRITE_BACK,    // Stores allocate the line and mark it dirty, the next level sees it when it is evicted
+    CACHE_WRITE_THROUGH, // Every store goes on to the next level, a store miss does not allocate
+} CacheWritePolicy;
+
+/* Sizes are powers of two, a level holds at least one set and a line at least a word */
+typedef struct CacheConfig {
+    uint32_t size_bytes;
+    uint32_t associativity;
+    uint32_t line_bytes;
+    CacheReplacement replacement;
+    CacheWritePolicy write_policy;
+} CacheConfig;
+
+typedef struct CacheStats {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t read_misses;
+    uint64_t write_misses;
+    uint64_t evictions;  // Valid lines replaced by a fill
+    uint64_t writebacks; // Evicted lines which were dirty
+} CacheStats;
+
+/* Tags only, the data stays in Memory, which is always up to date */
+typedef struct CacheLevel {
+    CacheConfig config;
+    uint32_t set_count;
+    uint32_t line_shift;
+    uint32_t *lines;  // Line number held by each way, set after set
+    uint64_t *stamps; // Clock of the last access or fill of each way, depending on the replacement
+    uint8_t *flags;   // CACHE_LINE_VALID and CACHE_LINE_DIRTY of each way
+    uint64_t clock;
+    uint32_t random;
+    CacheStats stats;
+} CacheLevel;
+
+/*
+ * Data caches between LD / ST and Memory, attached to Cpu.cache. Like the profile it runs on the recording copy of the
+ * interpreter. Only accesses to memory go through the caches, the bus and the interrupt controller are uncached, and
+ * instructions which trap access nothing.
+ */
+typedef struct CacheHierarchy {
+    uint32_t level_count;
+    CacheLevel levels[CACHE_MAX_LEVELS];
+    uint64_t memory_reads;  // Line fills which missed every level
+    uint64_t memory_writes; // Writebacks and write through stores leaving the last level
+} CacheHierarchy;
+
+/* Fills in level 0 as a 32KB 8 way L1 and level 1 as a 256KB 8 way L2, both LRU, write back and with 64 byte lines */
+void get_default_cache_config(uint32_t level, CacheConfig *config);
+
+/*
+ * Starts with every line invalid, uses the default two levels when configs is NULL. Returns NULL when a configuration
+ * is invalid or the hierarchy cannot be allocated.
+ */
+CacheHierarchy *init_cache_hierarchy(const CacheConfig *configs, uint32_t level_count);
+
+void free_cache_hierarchy(CacheHierarchy *cache);
+
+/* Invalidates every line and clears the counts, the configuration is kept */
+void reset_cache_hierarchy(CacheHierarchy *cache);
+
+/* Called by the run loop after a LD or ST of memory executed, address is any byte of the access */
+void access_cache(CacheHierarchy *cache, uint32_t address, bool store);
+
+/* Writes the accesses, misses, evictions and writebacks of every level, and the traffic to memory */
+bool write_cache_report(const CacheHierarchy *cache, FILE *file);
+
+#endif
@@ -6,7 +6,17 @@
 
 #include "cpu.h"
 #include "bit_utils.h"
+#include "branch_predictor.h"
+#include "bus.h"
+#include "cache.h"
+#include "decode_cache.h"
+#include "interrupts.h"
+#include "jit.h"
 #include "memory.h"
+#include "mmu.h"
+#include "profile.h"
+#include "timing.h"
+#include "trace.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,59 +24,228 @@
 
 static const char NUM_REGISTERS = 8;
 
-Cpu init_cpu() {
+typedef struct ThreadedInstruction {
+    const void *label; // Handler label the threaded backend jumps to, or a fused one for an idiom starting here
+    DecodedInstruction decoded;
+} ThreadedInstruction;
+
+/* Idioms the threaded backend runs as one handler, from the slot of their first word */
+typedef enum ThreadedFusion {
+    THREADED_FUSION_NONE,
+    THREADED_FUSION_SET_SETU,  // SET then SETU, a full 32 bit constant
+    THREADED_FUSION_LD_ADD,    // LD then ADD, e.g. summing an array
+    THREADED_FUSION_SUB_JMPC,  // SUB then JMPC or JMPIC, a compare and branch
+    THREADED_FUSION_LD_ADD_ST, // LD, ADD then ST, a load-modify-store
+    THREADED_FUSION_COUNT,
+} ThreadedFusion;
+
+#define THREADED_FUSION_MAX_WORDS 3
+
+/*
+ * One slot per word of memory, a slot whose handler is NULL has not been decoded yet. One more slot past the last word
+ * is never decoded, so running off the end of memory reaches the decoder, which raises the trap.
+ */
+typedef struct ThreadedProgram {
+    uint32_t word_count;
+    ThreadedInstruction instructions[];
+} ThreadedProgram;
+
+Cpu init_cpu(CpuBackend backend) {
     Cpu cpu = {
-        0,                       // Program counter
-        {0, 0, 0, 0, 0, 0, 0, 0} // Registers
+        0,                        // Program counter
+        {0, 0, 0, 0, 0, 0, 0, 0}, // Registers
+        backend,                  // Backend
+        {TRAP_NONE, 0, 0, 0},     // Trap
+        NULL,                     // Decode cache
+        NULL,                     // Threaded program
+        NULL,                     // JIT
+        NULL,                     // Profile
+        NULL,                     // Trace
+        NULL,                     // Bus
+        NULL,                     // Interrupt controller
+        NULL,                     // Timing model
+        NULL,                     // Cache hierarchy
+        NULL,                     // Branch predictor
+        NULL                      // MMU
     };
     return cpu;
 }
 
+/* Releases the threaded program, the JIT and any attached decode cache */
+void free_cpu(Cpu *cpu) {
+    free_decode_cache(cpu->decode_cache);
+    cpu->decode_cache = NULL;
+    free(cpu->threaded_program);
+    cpu->threaded_program = NULL;
+    free_jit(cpu->jit);
+    cpu->jit = NULL;
+}
+
 static char get_op_code(uint32_t word) {
     return word & OP_CODE_BITMASK;
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Utils >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void fail_if_invalid_register(uint32_t register_number) {
-    if (register_number >= NUM_REGISTERS) {
-        fprintf(stderr, "Invalid register access, register %d does not exist.", register_number);
-        exit(EXIT_FAILURE);
+#if defined(__GNUC__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#define ALWAYS_INLINE       inline __attribute__((always_inline))
+#else
+#define UNLIKELY(condition) (condition)
+#define ALWAYS_INLINE       inline
+#endif
+
+/* Records the trap, whoever dispatched the instruction fills in its address and stops execution */
+static void raise_trap(Cpu *cpu, TrapKind kind, uint32_t address, uint32_t value) {
+    cpu->trap.kind = kind;
+    cpu->trap.program_counter = cpu->program_counter;
+    cpu->trap.address = address;
+    cpu->trap.value = value;
+}
+
+static bool is_aligned_memory_access(Cpu *cpu, uint32_t location, uint32_t byte_mode) {
+    if (UNLIKELY((byte_mode == 1 && location % 2 != 1) || (byte_mode == 2 && location % 4 != 3))) {
+        raise_trap(cpu, TRAP_MISALIGNED_MEMORY_ACCESS, location, byte_mode);
+        return false;
     }
+    return true;
 }
 
-static void fail_if_invalid_memory_location(uint32_t location) {
-    if (location >= MEMORY_SIZE_BYTES) {
-        fprintf(stderr, "Invalid memory access, memory locatiom %d does not exist.\n", location);
-        exit(EXIT_FAILURE);
+/* This looks a bit awkward but this is because our address space starts at 0 */
+static bool is_valid_memory_access(Cpu *cpu, const Memory *memory, uint32_t location, uint32_t byte_mode) {
+    if (UNLIKELY(location >= memory->size_bytes)) {
+        raise_trap(cpu, TRAP_INVALID_MEMORY_LOCATION, location, byte_mode);
+        return false;
     }
+    if (UNLIKELY((location < 3 && byte_mode == 2) || (location < 1 && byte_mode == 1))) {
+        raise_trap(cpu, TRAP_MEMORY_UNDERFLOW, location, byte_mode);
+        return false;
+    }
+    return is_aligned_memory_access(cpu, location, byte_mode);
 }
 
-static void fail_if_invalid_byte_mode(uint32_t byte_mode) {
-    if (byte_mode > 2) {
-        fprintf(stderr, "Invalid byte mode %d\n", byte_mode);
-        exit(EXIT_FAILURE);
+/*
+ * Slow path of LD and ST for locations past the end of memory, which only exist where the interrupt controller or the
+ * bus maps a device. Stores pass the value truncated to their width, loads return the value read.
+ */
+static uint32_t access_bus(Cpu *cpu, uint32_t location, uint32_t byte_mode, bool store, uint32_t value) {
+    if (!is_aligned_memory_access(cpu, location, byte_mode)) {
+        return 0;
+    }
+    uint32_t width = UINT32_C(1) << byte_mode;
+    uint32_t address = location - (width - 1);
+    if (store) {
+        value &= width == 4 ? UINT32_MAX : (UINT32_C(1) << (8 * width)) - 1;
+    }
+
+    InterruptController *interrupts = cpu->interrupts;
+    if (interrupts != NULL && address - interrupts->base < INTERRUPT_CONTROLLER_BYTES) {
+        if (interrupts->exit_on_access) {
+            raise_trap(cpu, TRAP_INTERRUPT_CONTROLLER, location, byte_mode);
+        } else if (store) {
+            write_interrupt_controller(interrupts, address - interrupts->base, width, value);
+        } else {
+            value = read_interrupt_controller(interrupts, address - interrupts->base, width);
+        }
+        return value;
+    }
+    if (cpu->bus == NULL ||
+        !(store ? write_bus(cpu->bus, address, width, value) : read_bus(cpu->bus, address, width, &value))) {
+        raise_trap(cpu, TRAP_INVALID_MEMORY_LOCATION, location, byte_mode);
     }
+    return value;
 }
 
-/* This looks a bit awkward but this is because our address space starts at 0 */
-static void fail_if_invalid_memory_alignment(uint32_t location, uint32_t byte_mode) {
-    if ((byte_mode == 1 && location % 2 != 1) || (byte_mode == 2 && location % 4 != 3)) {
-        fprintf(stderr, "Invalid memory alignment, byte mode %d and location %d\n", byte_mode, location);
-        exit(EXIT_FAILURE);
+/*
+ * A fused slot runs the words after its own, so the slots of the words just before the range are cleared too. An idiom
+ * is only fused while every word of it is decoded, so when no word of the range is, no slot runs it and stores to data
+ * only read their slots, never dirtying them.
+ */
+static void invalidate_threaded_program(ThreadedProgram *program, uint32_t first_location, uint32_t last_location) {
+    uint32_t first_word = first_location / 4;
+    uint32_t end_word = last_location / 4 < program->word_count ? last_location / 4 + 1 : program->word_count;
+    bool decoded = false;
+    for (uint32_t word = first_word; word < end_word; word++) {
+        decoded |= program->instructions[word].decoded.handler != NULL;
+    }
+    if (!decoded) {
+        return;
+    }
+    first_word -= first_word < THREADED_FUSION_MAX_WORDS - 1 ? first_word : THREADED_FUSION_MAX_WORDS - 1;
+    for (uint32_t word = first_word; word < end_word; word++) {
+        program->instructions[word].decoded.handler = NULL;
     }
 }
 
-static void fail_if_memory_underflow(uint32_t location, uint32_t byte_mode) {
-    if ((location < 3 && byte_mode == 2) || (location < 1 && byte_mode == 1)) {
-        fprintf(stderr, "Memory underflow, location %d and byte mode %d\n", location, byte_mode);
-        exit(EXIT_FAILURE);
+void invalidate_decoded_instructions(Cpu *cpu, uint32_t first_location, uint32_t last_location) {
+    if (cpu->decode_cache != NULL) {
+        invalidate_decode_cache(cpu->decode_cache, first_location, last_location);
+    }
+    if (cpu->threaded_program != NULL) {
+        invalidate_threaded_program(cpu->threaded_program, first_location, last_location);
+    }
+    if (cpu->jit != NULL) {
+        invalidate_jit(cpu->jit, first_location, last_location);
     }
 }
 
+/* The threaded backend decodes each word once, the first time it runs it, which is all predecoding would save */
+void prepare_basic_block(Cpu *cpu, Memory *memory, uint32_t first_location, uint32_t last_location) {
+    if (cpu->mmu != NULL || first_location % 4 != 0 || last_location < first_location ||
+        last_location > memory->size_bytes - 4) {
+        return;
+    }
+    if (cpu->backend == CPU_BACKEND_JIT) {
+        if (cpu->jit == NULL) {
+            cpu->jit = init_jit();
+        }
+        if (cpu->jit != NULL) {
+            translate_jit_block(cpu->jit, memory, first_location);
+        }
+    }
+    if (cpu->decode_cache != NULL) {
+        for (uint32_t address = first_location; address <= last_location && address >= first_location; address += 4) {
+            DecodeCacheEntry *entry = get_decode_cache_entry(cpu->decode_cache, address);
+            decode_instruction(read_word(memory, address), &entry->instruction);
+            entry->address = address;
+        }
+    }
+}
+
+/* The last operand of JMP, ST, LD and the ALU instructions, a register or the immediate value */
+static ALWAYS_INLINE uint32_t get_operand(const DecodedInstruction *decoded, const Cpu *cpu, bool use_immediate) {
+    return use_immediate ? decoded->value : cpu->registers[decoded->second_source_register];
+}
+
+/*
+ * Every instruction with a register and an immediate form gets a handler for each, e.g. execute_add for ADD and
+ * execute_add_immediate for ADDI, so the immediate control bit is a constant rather than tested on every execution.
+ * The decoder picks the handler from the bits ARCHITECTURE_SPECIFICATIONS.md lays out, see HANDLERS. The body is an
+ * ALWAYS_INLINE function taking the bit as its last parameter.
+ */
+#define DEFINE_OPERAND_HANDLERS(name, body)                                                                            \
+    static void execute_##name(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {                         \
+        body(decoded, cpu, memory, false);                                                                             \
+    }                                                                                                                  \
+    static void execute_##name##_immediate(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {              \
+        body(decoded, cpu, memory, true);                                                                              \
+    }
+
+/* Like DEFINE_OPERAND_HANDLERS, with the byte mode of LD and ST a constant as well */
+#define DEFINE_MEMORY_HANDLERS(name, body, byte_mode)                                                                  \
+    static void execute_##name(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {                         \
+        body(decoded, cpu, memory, byte_mode, false);                                                                  \
+    }                                                                                                                  \
+    static void execute_##name##_immediate(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {              \
+        body(decoded, cpu, memory, byte_mode, true);                                                                   \
+    }
+
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> JMP >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void execute_jmp_instruction(uint32_t word, Cpu *cpu) {
+/* Forward declare functions so they are logically ordered and easier to read */
+static void execute_invalid_register(const DecodedInstruction *, Cpu *, Memory *);
+
+static void decode_jmp_instruction(uint32_t word, DecodedInstruction *decoded) {
     /* Bitmasks for the instruction */
     const uint32_t maybe_skip_instruction_bitmask = BITMASK_4;
     const uint32_t use_higher_order_bits_as_offset_value_bitmask = BITMASK_5;
@@ -81,27 +260,49 @@ static void execute_jmp_instruction(uint32_t word, Cpu *cpu) {
     uint32_t base_register = (word & base_register_bitmask) >> 8;
     uint32_t offset_register_or_value = (word & offset_register_or_value_bitmask) >> 11;
 
-    /* Determine if the instruction should be skipped */
-    if (maybe_skip_instruction && cpu->registers[maybe_skip_instruction_register]) {
-        return;
-    }
-
-    /* Determine the new program counter value */
+    decoded->id = maybe_skip_instruction ? INSTRUCTION_JMPC : INSTRUCTION_JMP;
+    decoded->operation = maybe_skip_instruction;
+    decoded->control_register = maybe_skip_instruction_register;
+    decoded->first_source_register = base_register;
+    decoded->use_immediate = use_higher_order_bits_as_offset_value;
     if (use_higher_order_bits_as_offset_value) {
-        cpu->program_counter = cpu->registers[base_register] + offset_register_or_value;
+        decoded->value = offset_register_or_value;
+    } else if (offset_register_or_value >= NUM_REGISTERS) {
+        decoded->id = INSTRUCTION_INVALID_REGISTER;
+        decoded->value = offset_register_or_value;
     } else {
-        cpu->program_counter = cpu->registers[base_register] + cpu->registers[offset_register_or_value];
+        decoded->second_source_register = offset_register_or_value;
     }
 }
 
+static ALWAYS_INLINE void jmp_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->program_counter = cpu->registers[decoded->first_source_register] + get_operand(decoded, cpu, use_immediate);
+}
+
+/* The jump is skipped when the control register holds a non zero value */
+static ALWAYS_INLINE void conditional_jmp_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                                       bool use_immediate) {
+    if (cpu->registers[decoded->control_register]) {
+        return;
+    }
+    jmp_with_operand(decoded, cpu, memory, use_immediate);
+}
+
+DEFINE_OPERAND_HANDLERS(jmp, jmp_with_operand)
+DEFINE_OPERAND_HANDLERS(conditional_jmp, conditional_jmp_with_operand)
+
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> ST / LD >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Forward declare functions so they are logically ordered and easier to read */
-static uint32_t get_offset(uint32_t, uint32_t, bool, Cpu *);
+static void execute_invalid_byte_mode(const DecodedInstruction *, Cpu *, Memory *);
+static void store_at_location(const DecodedInstruction *, Cpu *, Memory *, uint32_t);
+static void load_from_location(const DecodedInstruction *, Cpu *, Memory *, uint32_t);
+static uint32_t get_offset(const DecodedInstruction *, Cpu *);
 static void store_value_in_memory(uint32_t, uint32_t, uint32_t, Memory *);
-static uint32_t load_value_from_memory(uint32_t, uint32_t, Cpu *, Memory *);
+static uint32_t load_value_from_memory(uint32_t, uint32_t, Memory *);
 
-static void execute_memory_management_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+static void decode_memory_management_instruction(uint32_t word, DecodedInstruction *decoded) {
     const uint32_t operation_bitmask = BITMASK_4;
     const uint32_t byte_mode_bitmask = BITMASK_6 | BITMASK_5;
     const uint32_t use_upper_bits_as_offset_bitmask = BITMASK_7;
@@ -113,68 +314,170 @@ static void execute_memory_management_instruction(uint32_t word, Cpu *cpu, Memor
     uint32_t operation = (word & operation_bitmask) >> 3;
 
     uint32_t byte_mode = (word & byte_mode_bitmask) >> 4;
-    fail_if_invalid_byte_mode(byte_mode);
     bool use_upper_bits_as_offset = (word & use_upper_bits_as_offset_bitmask) >> 6;
     uint32_t destination_or_source_register = (word & destination_or_source_register_bitmask) >> 7;
     uint32_t base_register = (word & base_register_bitmask) >> 10;
-    uint32_t offset = get_offset(word, offset_register_or_value_bitmask, use_upper_bits_as_offset, cpu);
-    uint32_t location = cpu->registers[base_register] + offset;
-    fail_if_invalid_memory_location(location);
+    uint32_t offset_register_or_value = (word & offset_register_or_value_bitmask) >> 13;
 
-    if (operation == 0) {
-        store_value_in_memory(cpu->registers[destination_or_source_register], location, byte_mode, memory);
+    decoded->id = operation == 0 ? INSTRUCTION_ST : INSTRUCTION_LD;
+    decoded->operation = operation;
+    decoded->byte_mode = byte_mode;
+    decoded->destination_register = destination_or_source_register;
+    decoded->first_source_register = base_register;
+    decoded->use_immediate = use_upper_bits_as_offset;
+    if (use_upper_bits_as_offset) {
+        decoded->value = offset_register_or_value;
+    } else if (offset_register_or_value >= NUM_REGISTERS) {
+        decoded->id = INSTRUCTION_INVALID_REGISTER;
+        decoded->value = offset_register_or_value;
     } else {
-        cpu->registers[destination_or_source_register] = load_value_from_memory(location, byte_mode, cpu, memory);
+        decoded->second_source_register = offset_register_or_value;
+    }
+
+    if (byte_mode > 2) {
+        decoded->id = INSTRUCTION_INVALID_BYTE_MODE;
     }
 }
 
-static uint32_t get_offset(uint32_t word, uint32_t offset_register_or_value_bitmask, bool use_upper_bits_as_offset, Cpu *cpu) {
-    uint32_t offset_register_or_value = (word & offset_register_or_value_bitmask) >> 13;
-    uint32_t offset;
-    if (use_upper_bits_as_offset) {
-        offset = offset_register_or_value;
+/*
+ * An aligned access can neither underflow nor reach past the end of memory from below it, so these two compares cover
+ * every check of the slow path. Whatever fails them goes there, to reach the bus or find out which trap to raise.
+ */
+static ALWAYS_INLINE bool is_fast_memory_access(const Memory *memory, uint32_t location, uint32_t byte_mode) {
+    uint32_t last_byte_mask = (UINT32_C(1) << byte_mode) - 1;
+    return (location & last_byte_mask) == last_byte_mask && location < memory->size_bytes;
+}
+
+/* LD and ST get a handler per byte mode when decoded, so the width is a constant in their one native access */
+static ALWAYS_INLINE void store_with_byte_mode(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                               uint32_t byte_mode, bool use_immediate) {
+    uint32_t location = cpu->registers[decoded->first_source_register] + get_operand(decoded, cpu, use_immediate);
+    if (UNLIKELY(!is_fast_memory_access(memory, location, byte_mode))) {
+        store_at_location(decoded, cpu, memory, location);
+        return;
+    }
+    store_value_in_memory(cpu->registers[decoded->destination_register], location, byte_mode, memory);
+    invalidate_decoded_instructions(cpu, location - ((UINT32_C(1) << byte_mode) - 1), location);
+}
+
+static ALWAYS_INLINE void load_with_byte_mode(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                              uint32_t byte_mode, bool use_immediate) {
+    uint32_t location = cpu->registers[decoded->first_source_register] + get_operand(decoded, cpu, use_immediate);
+    if (UNLIKELY(!is_fast_memory_access(memory, location, byte_mode))) {
+        load_from_location(decoded, cpu, memory, location);
+        return;
+    }
+    cpu->registers[decoded->destination_register] = load_value_from_memory(location, byte_mode, memory);
+}
+
+DEFINE_MEMORY_HANDLERS(store_byte, store_with_byte_mode, 0)
+DEFINE_MEMORY_HANDLERS(store_half_word, store_with_byte_mode, 1)
+DEFINE_MEMORY_HANDLERS(store_word, store_with_byte_mode, 2)
+DEFINE_MEMORY_HANDLERS(load_byte, load_with_byte_mode, 0)
+DEFINE_MEMORY_HANDLERS(load_half_word, load_with_byte_mode, 1)
+DEFINE_MEMORY_HANDLERS(load_word, load_with_byte_mode, 2)
+
+/* The slow path of every LD and ST, validating each check on its own */
+static void store_at_location(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory, uint32_t location) {
+    if (UNLIKELY(location >= memory->size_bytes) && (cpu->bus != NULL || cpu->interrupts != NULL)) {
+        access_bus(cpu, location, decoded->byte_mode, true, cpu->registers[decoded->destination_register]);
+        return;
+    }
+    if (!is_valid_memory_access(cpu, memory, location, decoded->byte_mode)) {
+        return;
+    }
+    store_value_in_memory(cpu->registers[decoded->destination_register], location, decoded->byte_mode, memory);
+
+    /* Anything decoded from the bytes just written is now stale */
+    uint32_t width = UINT32_C(1) << decoded->byte_mode;
+    invalidate_decoded_instructions(cpu, location - (width - 1), location);
+}
+
+static void load_from_location(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory, uint32_t location) {
+    if (UNLIKELY(location >= memory->size_bytes) && (cpu->bus != NULL || cpu->interrupts != NULL)) {
+        uint32_t value = access_bus(cpu, location, decoded->byte_mode, false, 0);
+        if (cpu->trap.kind == TRAP_NONE) {
+            cpu->registers[decoded->destination_register] = value;
+        }
+        return;
+    }
+    if (!is_valid_memory_access(cpu, memory, location, decoded->byte_mode)) {
+        return;
+    }
+    cpu->registers[decoded->destination_register] = load_value_from_memory(location, decoded->byte_mode, memory);
+}
+
+/*
+ * LD and ST while an MMU is attached, the location is virtual. An aligned access never straddles a page, so
+ * translating its last byte translates all of it.
+ */
+static void execute_translated_memory_access(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory, Mmu *mmu) {
+    uint32_t location = cpu->registers[decoded->first_source_register] + get_offset(decoded, cpu);
+    if (!is_aligned_memory_access(cpu, location, decoded->byte_mode)) {
+        return;
+    }
+    uint32_t physical_location;
+    if (decoded->id == INSTRUCTION_ST) {
+        if (!translate_address(mmu, memory, location, MMU_ACCESS_WRITE, &physical_location)) {
+            raise_trap(cpu, TRAP_PAGE_FAULT, location, MMU_ACCESS_WRITE);
+            return;
+        }
+        store_at_location(decoded, cpu, memory, physical_location);
     } else {
-        fail_if_invalid_register(offset_register_or_value);
-        offset = cpu->registers[offset_register_or_value];
+        if (!translate_address(mmu, memory, location, MMU_ACCESS_READ, &physical_location)) {
+            raise_trap(cpu, TRAP_PAGE_FAULT, location, MMU_ACCESS_READ);
+            return;
+        }
+        load_from_location(decoded, cpu, memory, physical_location);
     }
-    return offset;
 }
 
-/* Uses deliberate fallthrough */
-static void store_value_in_memory(uint32_t value, uint32_t location, uint32_t byte_mode, Memory *memory) {
+static void execute_invalid_byte_mode(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    raise_trap(cpu, TRAP_INVALID_BYTE_MODE, 0, decoded->byte_mode);
+}
+
+/* For the paths which do not have a handler per form, such as translated accesses */
+static uint32_t get_offset(const DecodedInstruction *decoded, Cpu *cpu) {
+    return get_operand(decoded, cpu, decoded->use_immediate);
+}
+
+/* Inlined wherever the byte mode is a constant, which leaves only the access itself */
+static ALWAYS_INLINE void store_value_in_memory(uint32_t value, uint32_t location, uint32_t byte_mode,
+                                                Memory *memory) {
+    /* Aligned stores never straddle a page */
+    mark_memory_dirty(memory, location);
     switch (byte_mode) {
     case 2:
-        memory->data[location - 3] = (value & 0xFF000000) >> 24;
-        memory->data[location - 2] = (value & 0x00FF0000) >> 16;
+        store_memory_word(memory, location - 3, value);
+        break;
     case 1:
-        memory->data[location - 1] = (value & 0x0000FF00) >> 8;
+        store_memory_half_word(memory, location - 1, value);
+        break;
     case 0:
-        memory->data[location] = value & 0x000000FF;
+        store_memory_byte(memory, location, value);
+        break;
     }
 }
 
-/* Loads a value from memory, given the location and byte mode */
-static uint32_t load_value_from_memory(uint32_t location, uint32_t byte_mode, Cpu *cpu, Memory *memory) {
-    fail_if_invalid_memory_location(location);
-    fail_if_memory_underflow(location, byte_mode);
-    fail_if_invalid_memory_alignment(location, byte_mode);
-
-    uint32_t value = 0;
+/* Loads a value from memory, given an already validated location and byte mode */
+static ALWAYS_INLINE uint32_t load_value_from_memory(uint32_t location, uint32_t byte_mode, Memory *memory) {
     switch (byte_mode) {
     case 2:
-        value |= memory->data[location - 3] << 24;
-        value |= memory->data[location - 2] << 16;
+        return load_memory_word(memory, location - 3);
     case 1:
-        value |= memory->data[location - 1] << 8;
-    case 0:
-        value |= memory->data[location];
+        return load_memory_half_word(memory, location - 1);
+    default:
+        return load_memory_byte(memory, location);
     }
-    return value;
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> SET / SETU >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void execute_set_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+/* Forward declare functions so they are logically ordered and easier to read */
+static void execute_set(const DecodedInstruction *, Cpu *, Memory *);
+static void execute_setu(const DecodedInstruction *, Cpu *, Memory *);
+
+static void decode_set_instruction(uint32_t word, DecodedInstruction *decoded) {
     /* Bitmasks for the instruction */
     const uint32_t set_negative_value_bitmask = BITMASK_4;
     const uint32_t destination_register_bitmask = BITMASK_7 | BITMASK_6 | BITMASK_5;
@@ -188,24 +491,44 @@ static void execute_set_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
     if (set_negative_value) {
         value |= BITMASK_32_TO_29 | BITMASK_28 | BITMASK_27 | BITMASK_26;
     }
-    cpu->registers[destination_register] = value;
+
+    decoded->id = INSTRUCTION_SET;
+    decoded->operation = set_negative_value;
+    decoded->destination_register = destination_register;
+    decoded->value = value;
+    decoded->use_immediate = true;
+}
+
+static void execute_set(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    cpu->registers[decoded->destination_register] = decoded->value;
 }
 
-static void execute_setu_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+static void decode_setu_instruction(uint32_t word, DecodedInstruction *decoded) {
     const uint32_t destination_register_bitmask = BITMASK_6 | BITMASK_5 | BITMASK_4;
     const uint32_t value_bitmask = BITMASK_12 | BITMASK_11 | BITMASK_10 | BITMASK_9 | BITMASK_8 | BITMASK_7;
-    const uint32_t clear_upper_bits_bitmask = BITMASK_32 | BITMASK_25 | BITMASK_24_TO_1;
 
     uint32_t destination_register = (word & destination_register_bitmask) >> 3;
     uint32_t value = (word & value_bitmask) << 19;
 
-    cpu->registers[destination_register] &= clear_upper_bits_bitmask;
-    cpu->registers[destination_register] |= value;
+    decoded->id = INSTRUCTION_SETU;
+    decoded->destination_register = destination_register;
+    decoded->value = value;
+    decoded->use_immediate = true;
+}
+
+static void execute_setu(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    const uint32_t clear_upper_bits_bitmask = BITMASK_32 | BITMASK_25 | BITMASK_24_TO_1;
+
+    cpu->registers[decoded->destination_register] &= clear_upper_bits_bitmask;
+    cpu->registers[decoded->destination_register] |= decoded->value;
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> ADD / SUB / MUL / DIV / MOD >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void execute_arithmetic_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+/* Forward declare functions so they are logically ordered and easier to read */
+static void execute_invalid_arithmetic_operation(const DecodedInstruction *, Cpu *, Memory *);
+
+static void decode_arithmetic_instruction(uint32_t word, DecodedInstruction *decoded) {
     const uint32_t arithmetic_op_code_bitmask = BITMASK_6 | BITMASK_5 | BITMASK_4;
     const uint32_t use_upper_bits_as_value_bitmask = BITMASK_7;
     const uint32_t destination_register_bitmask = BITMASK_10 | BITMASK_9 | BITMASK_8;
@@ -218,73 +541,149 @@ static void execute_arithmetic_instruction(uint32_t word, Cpu *cpu, Memory *memo
     uint32_t first_source_register = (word & first_source_register_bitmask) >> 10;
     uint32_t value_or_second_source_register = (word & value_or_second_source_register_bitmask) >> 13;
 
-    uint32_t value =
-        use_upper_bits_as_value ? value_or_second_source_register : cpu->registers[value_or_second_source_register];
-    uint32_t return_value;
-    switch (arithmetic_op_code) {
-    case 0:
-        return_value = cpu->registers[first_source_register] + value;
-        break;
-    case 1:
-        return_value = cpu->registers[first_source_register] - value;
-        break;
-    case 2:
-        return_value = cpu->registers[first_source_register] * value;
-        break;
-    case 3:
-        return_value = cpu->registers[first_source_register] / value;
-        break;
-    case 4:
-        return_value = cpu->registers[first_source_register] % value;
-        break;
-    default:
-        fprintf(stderr, "Invalid arithmetic operation %d\n", arithmetic_op_code);
-        exit(EXIT_FAILURE);
+    static const InstructionId ids[8] = {
+        INSTRUCTION_ADD,
+        INSTRUCTION_SUB,
+        INSTRUCTION_MUL,
+        INSTRUCTION_DIV,
+        INSTRUCTION_MOD,
+        INSTRUCTION_INVALID_ARITHMETIC_OPERATION,
+        INSTRUCTION_INVALID_ARITHMETIC_OPERATION,
+        INSTRUCTION_INVALID_ARITHMETIC_OPERATION,
+    };
+
+    decoded->id = ids[arithmetic_op_code];
+    decoded->operation = arithmetic_op_code;
+    decoded->destination_register = destination_register;
+    decoded->first_source_register = first_source_register;
+    decoded->use_immediate = use_upper_bits_as_value;
+    if (use_upper_bits_as_value) {
+        decoded->value = value_or_second_source_register;
+    } else if (value_or_second_source_register >= NUM_REGISTERS) {
+        decoded->id = INSTRUCTION_INVALID_REGISTER;
+        decoded->value = value_or_second_source_register;
+    } else {
+        decoded->second_source_register = value_or_second_source_register;
+    }
+}
+
+static ALWAYS_INLINE void add_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] + get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void sub_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] - get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void mul_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] * get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void div_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    uint32_t divisor = get_operand(decoded, cpu, use_immediate);
+    if (UNLIKELY(divisor == 0)) {
+        raise_trap(cpu, TRAP_DIVISION_BY_ZERO, 0, 0);
+        return;
+    }
+    cpu->registers[decoded->destination_register] = cpu->registers[decoded->first_source_register] / divisor;
+}
+
+static ALWAYS_INLINE void mod_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    uint32_t divisor = get_operand(decoded, cpu, use_immediate);
+    if (UNLIKELY(divisor == 0)) {
+        raise_trap(cpu, TRAP_DIVISION_BY_ZERO, 0, 0);
+        return;
     }
-    cpu->registers[destination_register] = return_value;
+    cpu->registers[decoded->destination_register] = cpu->registers[decoded->first_source_register] % divisor;
+}
+
+DEFINE_OPERAND_HANDLERS(add, add_with_operand)
+DEFINE_OPERAND_HANDLERS(sub, sub_with_operand)
+DEFINE_OPERAND_HANDLERS(mul, mul_with_operand)
+DEFINE_OPERAND_HANDLERS(div, div_with_operand)
+DEFINE_OPERAND_HANDLERS(mod, mod_with_operand)
+
+static void execute_invalid_arithmetic_operation(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    raise_trap(cpu, TRAP_INVALID_OPERATION, 0, decoded->operation);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> AND / OR / XOR >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void execute_bitwise_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+/* Forward declare functions so they are logically ordered and easier to read */
+static void execute_invalid_bitwise_operation(const DecodedInstruction *, Cpu *, Memory *);
+
+static void decode_bitwise_instruction(uint32_t word, DecodedInstruction *decoded) {
     const uint32_t bitwise_op_code_bitmask = BITMASK_5 | BITMASK_4;
     const uint32_t use_upper_bits_as_value_bitmask = BITMASK_6;
-    const uint32_t fill_unset_bits_bitmask = BITMASK_7;
     const uint32_t destination_register_bitmask = BITMASK_10 | BITMASK_9 | BITMASK_8;
     const uint32_t first_source_register_bitmask = BITMASK_13 | BITMASK_12 | BITMASK_11;
     const uint32_t value_or_second_source_register_bitmask = BITMASK_32_TO_17 | BITMASK_16 | BITMASK_15 | BITMASK_14;
 
     uint32_t bitwise_op_code = (word & bitwise_op_code_bitmask) >> 3;
     bool use_upper_bits_as_value = (word & use_upper_bits_as_value_bitmask) >> 5;
-    bool fill_upper_bits = (word & fill_unset_bits_bitmask) >> 6;
     uint32_t destination_register = (word & destination_register_bitmask) >> 7;
     uint32_t first_source_register = (word & first_source_register_bitmask) >> 10;
     uint32_t value_or_second_source_register = (word & value_or_second_source_register_bitmask) >> 13;
 
-    uint32_t value =
-        use_upper_bits_as_value ? value_or_second_source_register : cpu->registers[value_or_second_source_register];
-    uint32_t return_value;
-    switch (bitwise_op_code) {
-    case 0:
-        return_value = cpu->registers[first_source_register] & value;
-        break;
-    case 1:
-        return_value = cpu->registers[first_source_register] | value;
-        break;
-    case 2:
-        return_value = cpu->registers[first_source_register] ^ value;
-        break;
-    default:
-        fprintf(stderr, "Invalid bitwise operation %d\n", bitwise_op_code);
-        exit(EXIT_FAILURE);
+    static const InstructionId ids[4] = {
+        INSTRUCTION_AND,
+        INSTRUCTION_OR,
+        INSTRUCTION_XOR,
+        INSTRUCTION_INVALID_BITWISE_OPERATION,
+    };
+
+    decoded->id = ids[bitwise_op_code];
+    decoded->operation = bitwise_op_code;
+    decoded->destination_register = destination_register;
+    decoded->first_source_register = first_source_register;
+    decoded->use_immediate = use_upper_bits_as_value;
+    if (use_upper_bits_as_value) {
+        decoded->value = value_or_second_source_register;
+    } else if (value_or_second_source_register >= NUM_REGISTERS) {
+        decoded->id = INSTRUCTION_INVALID_REGISTER;
+        decoded->value = value_or_second_source_register;
+    } else {
+        decoded->second_source_register = value_or_second_source_register;
     }
+}
+
+static ALWAYS_INLINE void and_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] & get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void or_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                          bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] | get_operand(decoded, cpu, use_immediate);
+}
 
-    cpu->registers[destination_register] = return_value;
+static ALWAYS_INLINE void xor_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] ^ get_operand(decoded, cpu, use_immediate);
+}
+
+DEFINE_OPERAND_HANDLERS(and, and_with_operand)
+DEFINE_OPERAND_HANDLERS(or, or_with_operand)
+DEFINE_OPERAND_HANDLERS(xor, xor_with_operand)
+
+static void execute_invalid_bitwise_operation(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    raise_trap(cpu, TRAP_INVALID_OPERATION, 0, decoded->operation);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BSR / BSL >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static void execute_bitshift_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+static void decode_bitshift_instruction(uint32_t word, DecodedInstruction *decoded) {
     const uint32_t bitshift_op_code_bitmask = BITMASK_4;
     const uint32_t use_upper_bits_as_value_bitmask = BITMASK_5;
     const uint32_t rotate_bits_bitmask = BITMASK_6;
@@ -299,51 +698,773 @@ static void execute_bitshift_instruction(uint32_t word, Cpu *cpu, Memory *memory
     uint32_t first_source_register = (word & first_source_register_bitmask) >> 9;
     uint32_t value_or_second_register = (word & value_or_second_register_bitmask) >> 12;
 
-    uint32_t value = use_upper_bits_as_value ? value_or_second_register : cpu->registers[value_or_second_register];
-    if (bitshift_op_code) {
-        /* BSL */
-        if (rotate_bits) {
-            value =
-                cpu->registers[first_source_register] << value | cpu->registers[first_source_register] >> (32 - value);
-        } else {
-            value = cpu->registers[first_source_register] << value;
-        }
+    /* Indexed by the rotate bit and then the direction bit, 0 = right, 1 = left */
+    static const InstructionId ids[2][2] = {
+        {INSTRUCTION_BSR, INSTRUCTION_BSL},
+        {INSTRUCTION_BSRR, INSTRUCTION_BSLR},
+    };
+
+    decoded->id = ids[rotate_bits][bitshift_op_code];
+    decoded->operation = bitshift_op_code | rotate_bits << 1;
+    decoded->destination_register = destination_register;
+    decoded->first_source_register = first_source_register;
+    decoded->use_immediate = use_upper_bits_as_value;
+    if (use_upper_bits_as_value) {
+        decoded->value = value_or_second_register;
+    } else if (value_or_second_register >= NUM_REGISTERS) {
+        decoded->id = INSTRUCTION_INVALID_REGISTER;
+        decoded->value = value_or_second_register;
     } else {
-        if (rotate_bits) {
-            value = cpu->registers[first_source_register] >> value | 
-                cpu->registers[first_source_register] << (32 - value);
-        } else {
-            value = cpu->registers[first_source_register] >> value;
-        }
+        decoded->second_source_register = value_or_second_register;
     }
-    cpu->registers[destination_register] = value;
 }
 
+static ALWAYS_INLINE void bsr_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] >> get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void bsrr_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                            bool use_immediate) {
+    uint32_t value = get_operand(decoded, cpu, use_immediate);
+    uint32_t source = cpu->registers[decoded->first_source_register];
+    cpu->registers[decoded->destination_register] = source >> value | source << (32 - value);
+}
+
+static ALWAYS_INLINE void bsl_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                           bool use_immediate) {
+    cpu->registers[decoded->destination_register] =
+        cpu->registers[decoded->first_source_register] << get_operand(decoded, cpu, use_immediate);
+}
+
+static ALWAYS_INLINE void bslr_with_operand(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory,
+                                            bool use_immediate) {
+    uint32_t value = get_operand(decoded, cpu, use_immediate);
+    uint32_t source = cpu->registers[decoded->first_source_register];
+    cpu->registers[decoded->destination_register] = source << value | source >> (32 - value);
+}
+
+DEFINE_OPERAND_HANDLERS(bsr, bsr_with_operand)
+DEFINE_OPERAND_HANDLERS(bsrr, bsrr_with_operand)
+DEFINE_OPERAND_HANDLERS(bsl, bsl_with_operand)
+DEFINE_OPERAND_HANDLERS(bslr, bslr_with_operand)
+
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-void execute_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
-    uint32_t op_code = get_op_code(word);
-    switch (op_code) {
+static void execute_invalid_register(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    raise_trap(cpu, TRAP_INVALID_REGISTER, 0, decoded->value);
+}
+
+/* Op code 7 is unused, the run loops trap before executing it and execute_instruction traps the same way here */
+static void execute_unused(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    raise_trap(cpu, TRAP_UNUSED_OP_CODE, cpu->program_counter, decoded->op_code);
+}
+
+/*
+ * Indexed by InstructionId and whether the last operand is immediate. SET and SETU only have the immediate form and
+ * the handlers raising traps ignore the operand, so both columns hold the same handler for them. ST and LD are
+ * replaced according to the byte mode, see MEMORY_HANDLERS.
+ */
+static const InstructionHandler HANDLERS[INSTRUCTION_COUNT][2] = {
+    [INSTRUCTION_JMP] = {execute_jmp, execute_jmp_immediate},
+    [INSTRUCTION_JMPC] = {execute_conditional_jmp, execute_conditional_jmp_immediate},
+    [INSTRUCTION_ST] = {execute_store_word, execute_store_word_immediate},
+    [INSTRUCTION_LD] = {execute_load_word, execute_load_word_immediate},
+    [INSTRUCTION_SET] = {execute_set, execute_set},
+    [INSTRUCTION_SETU] = {execute_setu, execute_setu},
+    [INSTRUCTION_ADD] = {execute_add, execute_add_immediate},
+    [INSTRUCTION_SUB] = {execute_sub, execute_sub_immediate},
+    [INSTRUCTION_MUL] = {execute_mul, execute_mul_immediate},
+    [INSTRUCTION_DIV] = {execute_div, execute_div_immediate},
+    [INSTRUCTION_MOD] = {execute_mod, execute_mod_immediate},
+    [INSTRUCTION_AND] = {execute_and, execute_and_immediate},
+    [INSTRUCTION_OR] = {execute_or, execute_or_immediate},
+    [INSTRUCTION_XOR] = {execute_xor, execute_xor_immediate},
+    [INSTRUCTION_BSR] = {execute_bsr, execute_bsr_immediate},
+    [INSTRUCTION_BSRR] = {execute_bsrr, execute_bsrr_immediate},
+    [INSTRUCTION_BSL] = {execute_bsl, execute_bsl_immediate},
+    [INSTRUCTION_BSLR] = {execute_bslr, execute_bslr_immediate},
+    [INSTRUCTION_INVALID_REGISTER] = {execute_invalid_register, execute_invalid_register},
+    [INSTRUCTION_INVALID_BYTE_MODE] = {execute_invalid_byte_mode, execute_invalid_byte_mode},
+    [INSTRUCTION_INVALID_ARITHMETIC_OPERATION] = {execute_invalid_arithmetic_operation,
+                                                  execute_invalid_arithmetic_operation},
+    [INSTRUCTION_INVALID_BITWISE_OPERATION] = {execute_invalid_bitwise_operation, execute_invalid_bitwise_operation},
+    [INSTRUCTION_UNUSED] = {execute_unused, execute_unused},
+};
+
+/* Indexed by whether the instruction loads, by its byte mode and by whether the offset is immediate */
+static const InstructionHandler MEMORY_HANDLERS[2][3][2] = {
+    {
+        {execute_store_byte, execute_store_byte_immediate},
+        {execute_store_half_word, execute_store_half_word_immediate},
+        {execute_store_word, execute_store_word_immediate},
+    },
+    {
+        {execute_load_byte, execute_load_byte_immediate},
+        {execute_load_half_word, execute_load_half_word_immediate},
+        {execute_load_word, execute_load_word_immediate},
+    },
+};
+
+void decode_instruction(uint32_t word, DecodedInstruction *decoded) {
+    *decoded = (DecodedInstruction){0};
+    decoded->op_code = get_op_code(word);
+    switch (decoded->op_code) {
     case 0:
-        execute_jmp_instruction(word, cpu);
+        decode_jmp_instruction(word, decoded);
         break;
     case 1:
-        execute_memory_management_instruction(word, cpu, memory);
+        decode_memory_management_instruction(word, decoded);
         break;
     case 2:
-        execute_set_instruction(word, cpu, memory);
+        decode_set_instruction(word, decoded);
         break;
     case 3:
-        execute_setu_instruction(word, cpu, memory);
+        decode_setu_instruction(word, decoded);
         break;
     case 4:
-        execute_arithmetic_instruction(word, cpu, memory);
+        decode_arithmetic_instruction(word, decoded);
         break;
     case 5:
-        execute_bitwise_instruction(word, cpu, memory);
+        decode_bitwise_instruction(word, decoded);
         break;
     case 6:
-        execute_bitshift_instruction(word, cpu, memory);
+        decode_bitshift_instruction(word, decoded);
+        break;
+    default:
+        decoded->id = INSTRUCTION_UNUSED;
         break;
     }
+    decoded->handler = HANDLERS[decoded->id][decoded->use_immediate];
+    if (decoded->id == INSTRUCTION_ST || decoded->id == INSTRUCTION_LD) {
+        decoded->handler = MEMORY_HANDLERS[decoded->id == INSTRUCTION_LD][decoded->byte_mode][decoded->use_immediate];
+    }
+}
+
+static RunResult run_threaded(Cpu *, Memory *, uint64_t, const uint32_t *);
+
+/* Like run_cpu_backend, an attached MMU takes precedence over the backend */
+Trap execute_instruction(uint32_t word, Cpu *cpu, Memory *memory) {
+    cpu->trap.kind = TRAP_NONE;
+    DecodedInstruction decoded;
+    decode_instruction(word, &decoded);
+    if (UNLIKELY(cpu->mmu != NULL) && (decoded.id == INSTRUCTION_LD || decoded.id == INSTRUCTION_ST)) {
+        execute_translated_memory_access(&decoded, cpu, memory, cpu->mmu);
+        return cpu->trap;
+    }
+    if (cpu->backend == CPU_BACKEND_THREADED) {
+        run_threaded(cpu, memory, 1, &word);
+        return cpu->trap;
+    }
+
+    decoded.handler(&decoded, cpu, memory);
+    return cpu->trap;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Run loop >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static const uint32_t WORD_SIZE_BYTES = 4;
+static const uint32_t UNUSED_OP_CODE = 7;
+
+static bool is_valid_instruction_address(uint32_t location, const Memory *memory) {
+    return location % WORD_SIZE_BYTES == 0 && location <= memory->size_bytes - WORD_SIZE_BYTES;
+}
+
+/* Rewinds the program counter onto the instruction which raised the trap and reports it as a fault */
+static RunResult take_trap(Cpu *cpu, RunResult result, uint32_t instruction_address) {
+    cpu->trap.program_counter = instruction_address;
+    cpu->program_counter = instruction_address;
+    result.status = CPU_STATUS_FAULT;
+    result.trap = cpu->trap;
+    return result;
+}
+
+/* Looks the instruction up in the decode cache when the CPU has one, otherwise decodes it into the scratch space */
+static const DecodedInstruction *fetch_decoded_instruction(uint32_t address, Cpu *cpu, Memory *memory,
+                                                           DecodedInstruction *scratch) {
+    if (cpu->decode_cache == NULL) {
+        decode_instruction(read_word(memory, address), scratch);
+        return scratch;
+    }
+
+    DecodeCacheEntry *entry = get_decode_cache_entry(cpu->decode_cache, address);
+    if (entry->address != address) {
+        decode_instruction(read_word(memory, address), &entry->instruction);
+        entry->address = address;
+    }
+    return &entry->instruction;
+}
+
+/*
+ * Repeatedly fetches the word at the program counter, advances the program counter past it and executes it, so a jump
+ * simply overwrites the advanced value. A jump back onto its own address can never make progress and is treated as a
+ * halt. On a fault the program counter is left pointing at the offending instruction, the faulting instruction is not
+ * counted as a step and the trap describing it is returned alongside the status.
+ *
+ * Always inlined with a constant profile, trace, timing model, cache hierarchy, branch predictor and MMU, so the copy
+ * run_interpreter uses carries no recording or translation code at all.
+ */
+static ALWAYS_INLINE RunResult interpret(Cpu *cpu, Memory *memory, uint64_t max_steps, Profile *profile,
+                                         TraceRecorder *trace, TimingModel *timing, CacheHierarchy *cache,
+                                         BranchPredictor *predictor, Mmu *mmu) {
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    DecodedInstruction scratch;
+    cpu->trap.kind = TRAP_NONE;
+    if (trace != NULL) {
+        begin_trace_run(trace, cpu);
+    }
+    while (result.steps < max_steps) {
+        uint32_t instruction_address = cpu->program_counter;
+        uint32_t fetch_address = instruction_address;
+        if (mmu != NULL && !translate_address(mmu, memory, instruction_address, MMU_ACCESS_EXECUTE, &fetch_address)) {
+            raise_trap(cpu, TRAP_PAGE_FAULT, instruction_address, MMU_ACCESS_EXECUTE);
+            return take_trap(cpu, result, instruction_address);
+        }
+        if (!is_valid_instruction_address(fetch_address, memory)) {
+            raise_trap(cpu, TRAP_INVALID_INSTRUCTION_ADDRESS, instruction_address, 0);
+            return take_trap(cpu, result, instruction_address);
+        }
+
+        const DecodedInstruction *decoded = fetch_decoded_instruction(fetch_address, cpu, memory, &scratch);
+        if (decoded->op_code == UNUSED_OP_CODE) {
+            raise_trap(cpu, TRAP_UNUSED_OP_CODE, instruction_address, UNUSED_OP_CODE);
+            return take_trap(cpu, result, instruction_address);
+        }
+
+        /* A conditional jump is taken when its control register is zero, read before the jump could change it */
+        bool taken = (profile != NULL || predictor != NULL) && cpu->registers[decoded->control_register] == 0;
+        /* The word as executed, a store may overwrite it */
+        uint32_t word = trace != NULL ? read_word(memory, fetch_address) : 0;
+        /* The location a LD or ST accesses, computed before a load can overwrite its base register */
+        bool accesses_memory = cache != NULL && (decoded->id == INSTRUCTION_LD || decoded->id == INSTRUCTION_ST);
+        uint32_t location =
+            accesses_memory ? cpu->registers[decoded->first_source_register] + get_offset(decoded, cpu) : 0;
+        cpu->program_counter = instruction_address + WORD_SIZE_BYTES;
+        if (mmu != NULL && (decoded->id == INSTRUCTION_LD || decoded->id == INSTRUCTION_ST)) {
+            execute_translated_memory_access(decoded, cpu, memory, mmu);
+        } else {
+            decoded->handler(decoded, cpu, memory);
+        }
+        if (UNLIKELY(cpu->trap.kind != TRAP_NONE)) {
+            return take_trap(cpu, result, instruction_address);
+        }
+        result.steps++;
+        if (profile != NULL) {
+            record_profile(profile, decoded, instruction_address, taken);
+        }
+        if (trace != NULL) {
+            record_trace(trace, cpu, memory, decoded, instruction_address, word);
+        }
+        /* Without a predictor every jump which changed the program counter stalls the pipeline */
+        bool redirected = cpu->program_counter != instruction_address + WORD_SIZE_BYTES;
+        if (predictor != NULL && decoded->id == INSTRUCTION_JMPC) {
+            redirected = !record_branch(predictor, decoded, cpu, instruction_address, taken);
+        }
+        if (timing != NULL) {
+            record_timing(timing, decoded, redirected);
+        }
+        if (accesses_memory && location < memory->size_bytes) {
+            access_cache(cache, location, decoded->id == INSTRUCTION_ST);
+        }
+
+        if (cpu->program_counter == instruction_address) {
+            result.status = CPU_STATUS_HALTED;
+            break;
+        }
+    }
+    return result;
+}
+
+RunResult run_interpreter(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    return interpret(cpu, memory, max_steps, NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+static RunResult run_instrumented(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    Profile *profile = cpu->profile != NULL && fit_profile_to_memory(cpu->profile, memory) ? cpu->profile : NULL;
+    return interpret(cpu, memory, max_steps, profile, cpu->trace, cpu->timing, cpu->cache, cpu->branch_predictor,
+                     NULL);
+}
+
+/*
+ * Addresses are virtual while an MMU is attached. The timing model and the branch predictor are recorded, the profile,
+ * trace and cache hierarchy are not, as they are indexed by physical address.
+ */
+static RunResult run_translated(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    return interpret(cpu, memory, max_steps, NULL, NULL, cpu->timing, NULL, cpu->branch_predictor, cpu->mmu);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Threaded backend >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Sizes the program to the memory it runs from, a CPU moved onto a memory of another size starts over */
+static bool ensure_threaded_program(Cpu *cpu, const Memory *memory) {
+    uint32_t word_count = memory->size_bytes / WORD_SIZE_BYTES;
+    if (cpu->threaded_program != NULL && cpu->threaded_program->word_count != word_count) {
+        free(cpu->threaded_program);
+        cpu->threaded_program = NULL;
+    }
+    if (cpu->threaded_program == NULL) {
+        /* Pages of the zeroed allocation are only backed once the slot for their words is decoded */
+        cpu->threaded_program = calloc(1, sizeof(ThreadedProgram) + (word_count + 1) * sizeof(ThreadedInstruction));
+        if (cpu->threaded_program != NULL) {
+            cpu->threaded_program->word_count = word_count;
+        }
+    }
+    return cpu->threaded_program != NULL;
+}
+
+/* Labels are indexed like HANDLERS, and those of LD and ST like MEMORY_HANDLERS */
+static void decode_threaded_instruction(ThreadedInstruction *instruction, uint32_t word,
+                                        const void *const (*labels)[2], const void *const (*memory_labels)[3][2]) {
+    const DecodedInstruction *decoded = &instruction->decoded;
+    decode_instruction(word, &instruction->decoded);
+    if (labels == NULL) {
+        instruction->label = NULL;
+    } else if (decoded->id == INSTRUCTION_ST || decoded->id == INSTRUCTION_LD) {
+        instruction->label = memory_labels[decoded->id == INSTRUCTION_LD][decoded->byte_mode][decoded->use_immediate];
+    } else {
+        instruction->label = labels[decoded->id][decoded->use_immediate];
+    }
+}
+
+#if defined(__GNUC__)
+
+/* Only decoded slots are looked at, the id of a missing one is left INSTRUCTION_UNUSED, which no idiom contains */
+static ThreadedFusion find_threaded_fusion(const ThreadedInstruction *instructions, uint32_t word_count) {
+    uint8_t ids[THREADED_FUSION_MAX_WORDS] = {INSTRUCTION_UNUSED, INSTRUCTION_UNUSED, INSTRUCTION_UNUSED};
+    for (uint32_t i = 0; i < THREADED_FUSION_MAX_WORDS && i < word_count && instructions[i].decoded.handler != NULL;
+         i++) {
+        ids[i] = instructions[i].decoded.id;
+    }
+
+    if (ids[0] == INSTRUCTION_LD && ids[1] == INSTRUCTION_ADD) {
+        return ids[2] == INSTRUCTION_ST ? THREADED_FUSION_LD_ADD_ST : THREADED_FUSION_LD_ADD;
+    }
+    if (ids[0] == INSTRUCTION_SET && ids[1] == INSTRUCTION_SETU) {
+        return THREADED_FUSION_SET_SETU;
+    }
+    if (ids[0] == INSTRUCTION_SUB && ids[1] == INSTRUCTION_JMPC) {
+        return THREADED_FUSION_SUB_JMPC;
+    }
+    return THREADED_FUSION_NONE;
+}
+
+/*
+ * Called once the slot at index is decoded, which can complete an idiom starting at it or at one of the slots before
+ * it. Slots are decoded as execution first reaches them, so a loop runs its idioms fused from the second iteration on,
+ * and a jump into the middle of an idiom still finds the plain handler in the slot it lands on.
+ */
+static void fuse_threaded_instructions(ThreadedProgram *program, uint32_t index, const void *const *fused_labels) {
+    uint32_t start = index < THREADED_FUSION_MAX_WORDS - 1 ? 0 : index - (THREADED_FUSION_MAX_WORDS - 1);
+    for (; start <= index; start++) {
+        ThreadedFusion fusion = find_threaded_fusion(&program->instructions[start], program->word_count - start);
+        if (fusion != THREADED_FUSION_NONE) {
+            program->instructions[start].label = fused_labels[fusion];
+        }
+    }
+}
+
+/*
+ * Ends every handler label which leaves the program counter on the next word, it either returns from run_threaded or
+ * jumps to the next instruction's label. That word is aligned and at most one past the last one, so its slot exists
+ * without checking the address, and the decoder checks it once the slot turns out not to be decoded.
+ */
+#define THREADED_DISPATCH()                                                                                            \
+    do {                                                                                                               \
+        if (result.steps >= max_steps) {                                                                               \
+            return result;                                                                                             \
+        }                                                                                                              \
+        instruction_address = cpu->program_counter;                                                                    \
+        instruction = &program[instruction_address / WORD_SIZE_BYTES];                                                 \
+        if (UNLIKELY(instruction->decoded.handler == NULL)) {                                                          \
+            goto decode;                                                                                               \
+        }                                                                                                              \
+        cpu->program_counter = instruction_address + WORD_SIZE_BYTES;                                                  \
+        result.steps++;                                                                                                \
+        goto *instruction->label;                                                                                      \
+    } while (0)
+
+/* Used after the handlers which can raise a trap, the others dispatch without looking at it */
+#define THREADED_DISPATCH_OR_TRAP()                                                                                    \
+    do {                                                                                                               \
+        if (UNLIKELY(cpu->trap.kind != TRAP_NONE)) {                                                                   \
+            goto trap;                                                                                                 \
+        }                                                                                                              \
+        THREADED_DISPATCH();                                                                                           \
+    } while (0)
+
+/*
+ * Direct threaded interpreter using computed goto. Every handler label ends with its own copy of the dispatch sequence,
+ * so the host branch predictor sees one indirect branch per handler rather than one shared by every instruction. When
+ * single_word is given only that word is executed and the program counter is not advanced, like execute_instruction.
+ */
+static RunResult run_threaded(Cpu *cpu, Memory *memory, uint64_t max_steps, const uint32_t *single_word) {
+    static const void *const labels[INSTRUCTION_COUNT][2] = {
+        [INSTRUCTION_JMP] = {&&jmp, &&jmpi},
+        [INSTRUCTION_JMPC] = {&&jmpc, &&jmpic},
+        [INSTRUCTION_ST] = {&&stw, &&stwi},
+        [INSTRUCTION_LD] = {&&ldw, &&ldwi},
+        [INSTRUCTION_SET] = {&&set, &&set},
+        [INSTRUCTION_SETU] = {&&setu, &&setu},
+        [INSTRUCTION_ADD] = {&&add, &&addi},
+        [INSTRUCTION_SUB] = {&&sub, &&subi},
+        [INSTRUCTION_MUL] = {&&mul, &&muli},
+        [INSTRUCTION_DIV] = {&&div, &&divi},
+        [INSTRUCTION_MOD] = {&&mod, &&modi},
+        [INSTRUCTION_AND] = {&&and, &&andi},
+        [INSTRUCTION_OR] = {&&or, &&ori},
+        [INSTRUCTION_XOR] = {&&xor, &&xori},
+        [INSTRUCTION_BSR] = {&&bsr, &&bsri},
+        [INSTRUCTION_BSRR] = {&&bsrr, &&bsrri},
+        [INSTRUCTION_BSL] = {&&bsl, &&bsli},
+        [INSTRUCTION_BSLR] = {&&bslr, &&bslri},
+        [INSTRUCTION_INVALID_REGISTER] = {&&invalid_register, &&invalid_register},
+        [INSTRUCTION_INVALID_BYTE_MODE] = {&&invalid_byte_mode, &&invalid_byte_mode},
+        [INSTRUCTION_INVALID_ARITHMETIC_OPERATION] = {&&invalid_arithmetic_operation, &&invalid_arithmetic_operation},
+        [INSTRUCTION_INVALID_BITWISE_OPERATION] = {&&invalid_bitwise_operation, &&invalid_bitwise_operation},
+        [INSTRUCTION_UNUSED] = {&&unused, &&unused},
+    };
+    static const void *const memory_labels[2][3][2] = {
+        {{&&stb, &&stbi}, {&&sth, &&sthi}, {&&stw, &&stwi}},
+        {{&&ldb, &&ldbi}, {&&ldh, &&ldhi}, {&&ldw, &&ldwi}},
+    };
+    static const void *const fused_labels[THREADED_FUSION_COUNT] = {
+        [THREADED_FUSION_SET_SETU] = &&set_setu,
+        [THREADED_FUSION_LD_ADD] = &&ld_add,
+        [THREADED_FUSION_SUB_JMPC] = &&sub_jmpc,
+        [THREADED_FUSION_LD_ADD_ST] = &&ld_add_st,
+    };
+
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    ThreadedInstruction *program = cpu->threaded_program != NULL ? cpu->threaded_program->instructions : NULL;
+    cpu->trap.kind = TRAP_NONE;
+    ThreadedInstruction single_instruction;
+    ThreadedInstruction *instruction;
+    uint32_t instruction_address;
+
+    if (single_word != NULL) {
+        decode_threaded_instruction(&single_instruction, *single_word, labels, memory_labels);
+        instruction = &single_instruction;
+        instruction_address = cpu->program_counter;
+        max_steps = 1;
+        result.steps = 1;
+        goto *instruction->label;
+    }
+    goto dispatch_jump;
+
+jmp:
+    execute_jmp(&instruction->decoded, cpu, memory);
+    goto check_halt;
+jmpi:
+    execute_jmp_immediate(&instruction->decoded, cpu, memory);
+    goto check_halt;
+jmpc:
+    execute_conditional_jmp(&instruction->decoded, cpu, memory);
+    goto check_halt;
+jmpic:
+    execute_conditional_jmp_immediate(&instruction->decoded, cpu, memory);
+    goto check_halt;
+stb:
+    execute_store_byte(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+stbi:
+    execute_store_byte_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+sth:
+    execute_store_half_word(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+sthi:
+    execute_store_half_word_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+stw:
+    execute_store_word(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+stwi:
+    execute_store_word_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldb:
+    execute_load_byte(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldbi:
+    execute_load_byte_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldh:
+    execute_load_half_word(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldhi:
+    execute_load_half_word_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldw:
+    execute_load_word(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+ldwi:
+    execute_load_word_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+set:
+    execute_set(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+setu:
+    execute_setu(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+add:
+    execute_add(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+addi:
+    execute_add_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+sub:
+    execute_sub(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+subi:
+    execute_sub_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+mul:
+    execute_mul(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+muli:
+    execute_mul_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+div:
+    execute_div(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+divi:
+    execute_div_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+mod:
+    execute_mod(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+modi:
+    execute_mod_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+and:
+    execute_and(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+andi:
+    execute_and_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+or:
+    execute_or(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+ori:
+    execute_or_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+xor:
+    execute_xor(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+xori:
+    execute_xor_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsr:
+    execute_bsr(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsri:
+    execute_bsr_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsrr:
+    execute_bsrr(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsrri:
+    execute_bsrr_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsl:
+    execute_bsl(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bsli:
+    execute_bsl_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bslr:
+    execute_bslr(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+bslri:
+    execute_bslr_immediate(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH();
+invalid_register:
+    execute_invalid_register(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+invalid_byte_mode:
+    execute_invalid_byte_mode(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+invalid_arithmetic_operation:
+    execute_invalid_arithmetic_operation(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+invalid_bitwise_operation:
+    execute_invalid_bitwise_operation(&instruction->decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+
+/*
+ * Fused idioms. The dispatch into them counted the first instruction, and each one falls back to it alone when the
+ * step budget has no room for the rest. Later instructions run from the slots after the first, and advance the program
+ * counter, steps and instruction address as their own dispatch would have, so traps and halts report the right one.
+ * An idiom covers both forms of its instructions, which test the immediate bit themselves.
+ */
+set_setu:
+    if (UNLIKELY(result.steps >= max_steps)) {
+        goto *labels[instruction->decoded.id][instruction->decoded.use_immediate];
+    }
+    execute_set(&instruction[0].decoded, cpu, memory);
+    execute_setu(&instruction[1].decoded, cpu, memory);
+    cpu->program_counter += WORD_SIZE_BYTES;
+    result.steps++;
+    THREADED_DISPATCH();
+ld_add:
+    if (UNLIKELY(result.steps >= max_steps)) {
+        goto *memory_labels[1][instruction->decoded.byte_mode][instruction->decoded.use_immediate];
+    }
+    instruction[0].decoded.handler(&instruction[0].decoded, cpu, memory);
+    if (UNLIKELY(cpu->trap.kind != TRAP_NONE)) {
+        goto trap;
+    }
+    add_with_operand(&instruction[1].decoded, cpu, memory, instruction[1].decoded.use_immediate);
+    cpu->program_counter += WORD_SIZE_BYTES;
+    result.steps++;
+    THREADED_DISPATCH();
+sub_jmpc:
+    if (UNLIKELY(result.steps >= max_steps)) {
+        goto *labels[instruction->decoded.id][instruction->decoded.use_immediate];
+    }
+    sub_with_operand(&instruction[0].decoded, cpu, memory, instruction[0].decoded.use_immediate);
+    instruction_address += WORD_SIZE_BYTES;
+    cpu->program_counter = instruction_address + WORD_SIZE_BYTES;
+    result.steps++;
+    conditional_jmp_with_operand(&instruction[1].decoded, cpu, memory, instruction[1].decoded.use_immediate);
+    goto check_halt;
+ld_add_st:
+    if (UNLIKELY(max_steps - result.steps < 2)) {
+        goto *memory_labels[1][instruction->decoded.byte_mode][instruction->decoded.use_immediate];
+    }
+    instruction[0].decoded.handler(&instruction[0].decoded, cpu, memory);
+    if (UNLIKELY(cpu->trap.kind != TRAP_NONE)) {
+        goto trap;
+    }
+    add_with_operand(&instruction[1].decoded, cpu, memory, instruction[1].decoded.use_immediate);
+    instruction_address += 2 * WORD_SIZE_BYTES;
+    cpu->program_counter = instruction_address + WORD_SIZE_BYTES;
+    result.steps += 2;
+    instruction[2].decoded.handler(&instruction[2].decoded, cpu, memory);
+    THREADED_DISPATCH_OR_TRAP();
+
+/* The unused op code is never executed, so it does not count as a step */
+unused:
+    raise_trap(cpu, TRAP_UNUSED_OP_CODE, instruction_address, UNUSED_OP_CODE);
+    goto trap;
+
+/* Neither does an instruction which raised a trap */
+trap:
+    result.steps--;
+    return take_trap(cpu, result, instruction_address);
+
+check_halt:
+    if (cpu->program_counter == instruction_address) {
+        result.status = CPU_STATUS_HALTED;
+        return result;
+    }
+/* A jump can land anywhere, the address is checked before its slot is looked up */
+dispatch_jump:
+    if (UNLIKELY(!is_valid_instruction_address(cpu->program_counter, memory)) && result.steps < max_steps) {
+        instruction_address = cpu->program_counter;
+        goto invalid_address;
+    }
+    THREADED_DISPATCH();
+
+decode:
+    if (!is_valid_instruction_address(instruction_address, memory)) {
+        goto invalid_address;
+    }
+    decode_threaded_instruction(instruction, read_word(memory, instruction_address), labels, memory_labels);
+    fuse_threaded_instructions(cpu->threaded_program, instruction_address / WORD_SIZE_BYTES, fused_labels);
+    cpu->program_counter = instruction_address + WORD_SIZE_BYTES;
+    result.steps++;
+    goto *instruction->label;
+
+invalid_address:
+    raise_trap(cpu, TRAP_INVALID_INSTRUCTION_ADDRESS, instruction_address, 0);
+    return take_trap(cpu, result, instruction_address);
+}
+
+#undef THREADED_DISPATCH_OR_TRAP
+#undef THREADED_DISPATCH
+
+#else
+
+/* Compilers without computed goto call the handler of each predecoded instruction through its function pointer */
+static RunResult run_threaded(Cpu *cpu, Memory *memory, uint64_t max_steps, const uint32_t *single_word) {
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    cpu->trap.kind = TRAP_NONE;
+    if (single_word != NULL) {
+        ThreadedInstruction single_instruction;
+        decode_threaded_instruction(&single_instruction, *single_word, NULL, NULL);
+        single_instruction.decoded.handler(&single_instruction.decoded, cpu, memory);
+        result.steps = 1;
+        return result;
+    }
+
+    ThreadedInstruction *program = cpu->threaded_program->instructions;
+    while (result.steps < max_steps) {
+        uint32_t instruction_address = cpu->program_counter;
+        if (!is_valid_instruction_address(instruction_address, memory)) {
+            raise_trap(cpu, TRAP_INVALID_INSTRUCTION_ADDRESS, instruction_address, 0);
+            return take_trap(cpu, result, instruction_address);
+        }
+
+        ThreadedInstruction *instruction = &program[instruction_address / WORD_SIZE_BYTES];
+        if (instruction->decoded.handler == NULL) {
+            decode_threaded_instruction(instruction, read_word(memory, instruction_address), NULL, NULL);
+        }
+        if (instruction->decoded.id == INSTRUCTION_UNUSED) {
+            raise_trap(cpu, TRAP_UNUSED_OP_CODE, instruction_address, UNUSED_OP_CODE);
+            return take_trap(cpu, result, instruction_address);
+        }
+
+        cpu->program_counter = instruction_address + WORD_SIZE_BYTES;
+        instruction->decoded.handler(&instruction->decoded, cpu, memory);
+        if (UNLIKELY(cpu->trap.kind != TRAP_NONE)) {
+            return take_trap(cpu, result, instruction_address);
+        }
+        result.steps++;
+
+        if (cpu->program_counter == instruction_address) {
+            result.status = CPU_STATUS_HALTED;
+            break;
+        }
+    }
+    return result;
+}
+
+#endif
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/*
+ * Falls back to the interpreter backend if the threaded program or the JIT cannot be allocated, and to running without
+ * profiling if the counters of an attached profile cannot be. An attached timing model or branch predictor is always
+ * recorded, an attached trace or cache hierarchy only while no MMU is.
+ */
+RunResult run_cpu_backend(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    if (UNLIKELY(cpu->mmu != NULL)) {
+        return run_translated(cpu, memory, max_steps);
+    }
+    if (UNLIKELY(cpu->trace != NULL) || UNLIKELY(cpu->timing != NULL) || UNLIKELY(cpu->cache != NULL) ||
+        UNLIKELY(cpu->branch_predictor != NULL) ||
+        (UNLIKELY(cpu->profile != NULL) && fit_profile_to_memory(cpu->profile, memory))) {
+        return run_instrumented(cpu, memory, max_steps);
+    }
+    if (cpu->backend == CPU_BACKEND_THREADED && ensure_threaded_program(cpu, memory)) {
+        return run_threaded(cpu, memory, max_steps, NULL);
+    }
+    if (cpu->backend == CPU_BACKEND_JIT) {
+        if (cpu->jit == NULL) {
+            cpu->jit = init_jit();
+        }
+        if (cpu->jit != NULL) {
+            return run_jit(cpu, memory, max_steps);
+        }
+    }
+    return run_interpreter(cpu, memory, max_steps);
+}
+
+RunResult run_cpu(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    if (UNLIKELY(cpu->interrupts != NULL)) {
+        return run_interruptible(cpu, memory, max_steps);
+    }
+    return run_cpu_backend(cpu, memory, max_steps);
 }
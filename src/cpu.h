@@ -3,16 +3,198 @@
 
 #include "memory.h"
 #include <inttypes.h>
+#include <stdbool.h>
+
+struct DecodeCache;
+
+/* Selects how run_cpu and execute_instruction dispatch instructions */
+typedef enum CpuBackend {
+    CPU_BACKEND_INTERPRETER, // Calls the handler of each decoded instruction from a dispatch loop
+    CPU_BACKEND_THREADED,    // Jumps directly from one handler to the next over a predecoded copy of memory
+    CPU_BACKEND_JIT,         // Translates basic blocks to native code, only available on x86-64
+} CpuBackend;
+
+struct ThreadedProgram;
+struct Jit;
+struct Profile;
+struct TraceRecorder;
+struct Bus;
+struct InterruptController;
+struct TimingModel;
+struct CacheHierarchy;
+struct BranchPredictor;
+struct Mmu;
+
+typedef enum TrapKind {
+    TRAP_NONE,
+    TRAP_INVALID_INSTRUCTION_ADDRESS, // The program counter is misaligned or outside of memory
+    TRAP_UNUSED_OP_CODE,              // The fetched word uses op code 7
+    TRAP_INVALID_REGISTER,            // A register operand does not exist, value holds the register number
+    TRAP_INVALID_BYTE_MODE,           // ST / LD with byte mode 3
+    TRAP_INVALID_OPERATION,           // Unassigned arithmetic or bitwise operation, value holds the operation
+    TRAP_INVALID_MEMORY_LOCATION,     // ST / LD beyond the end of memory
+    TRAP_MEMORY_UNDERFLOW,            // A multi byte ST / LD would reach below address 0
+    TRAP_MISALIGNED_MEMORY_ACCESS,    // A multi byte ST / LD is not aligned to its width
+    TRAP_DIVISION_BY_ZERO,            // DIV / MOD with a zero divisor
+    TRAP_INTERRUPT_CONTROLLER,        // ST / LD of the interrupt controller, handled inside run_cpu and never returned
+    TRAP_PAGE_FAULT,                  // The MMU does not map the virtual address, value holds the MmuAccess
+} TrapKind;
+
+/* Describes why an instruction could not be executed, the instruction has no effect */
+typedef struct Trap {
+    TrapKind kind;
+    uint32_t program_counter; // Address of the instruction that trapped
+    uint32_t address;         // Memory location or instruction address involved, when there is one
+    uint32_t value;           // Extra detail for decoding traps
+} Trap;
 
 typedef struct Cpu {
     uint32_t program_counter;
 
     /* General Purpose Registers */
     uint32_t registers[8];
+
+    CpuBackend backend;
+
+    /* Set when the last instruction trapped, cleared whenever execution starts */
+    Trap trap;
+
+    /* Optional cache of predecoded instructions used by the interpreter backend, see decode_cache.h */
+    struct DecodeCache *decode_cache;
+
+    /* Predecoded program used by the threaded backend, allocated on first run */
+    struct ThreadedProgram *threaded_program;
+
+    /* Translated native code used by the JIT backend, allocated on first run, see jit.h */
+    struct Jit *jit;
+
+    /*
+     * Optional execution profile, see profile.h. While attached every backend runs on a recording copy of the
+     * interpreter, the CPU does not own it and free_cpu leaves it alone. Not recorded while an MMU is attached.
+     */
+    struct Profile *profile;
+
+    /*
+     * Optional execution trace, see trace.h. Recorded on the same copy of the interpreter and not owned either. Not
+     * recorded while an MMU is attached, as replay applies the stores to physical memory.
+     */
+    struct TraceRecorder *trace;
+
+    /* Optional devices, see bus.h. LD and ST past the end of memory go to the bus rather than trapping, not owned */
+    struct Bus *bus;
+
+    /* Optional interrupt controller and timer, see interrupts.h. Mapped in front of the bus, not owned */
+    struct InterruptController *interrupts;
+
+    /* Optional cycle timing model, see timing.h. Recorded on the same copy of the interpreter, not owned */
+    struct TimingModel *timing;
+
+    /*
+     * Optional data caches, see cache.h. They only count, memory is accessed as without them, not owned. Not recorded
+     * while an MMU is attached.
+     */
+    struct CacheHierarchy *cache;
+
+    /* Optional predictor of the conditional jumps, see branch_predictor.h. Also recorded there, not owned */
+    struct BranchPredictor *branch_predictor;
+
+    /*
+     * Optional address translation, see mmu.h. Every address is virtual while attached, not owned. Runs on a
+     * translating copy of the interpreter, which records the timing model and branch predictor only.
+     */
+    struct Mmu *mmu;
 } Cpu;
 
-Cpu init_cpu();
+/* The concrete operation a word decodes to, each one has its own handler */
+typedef enum InstructionId {
+    INSTRUCTION_JMP,
+    INSTRUCTION_JMPC,
+    INSTRUCTION_ST,
+    INSTRUCTION_LD,
+    INSTRUCTION_SET,
+    INSTRUCTION_SETU,
+    INSTRUCTION_ADD,
+    INSTRUCTION_SUB,
+    INSTRUCTION_MUL,
+    INSTRUCTION_DIV,
+    INSTRUCTION_MOD,
+    INSTRUCTION_AND,
+    INSTRUCTION_OR,
+    INSTRUCTION_XOR,
+    INSTRUCTION_BSR,
+    INSTRUCTION_BSRR,
+    INSTRUCTION_BSL,
+    INSTRUCTION_BSLR,
+    INSTRUCTION_INVALID_REGISTER,
+    INSTRUCTION_INVALID_BYTE_MODE,
+    INSTRUCTION_INVALID_ARITHMETIC_OPERATION,
+    INSTRUCTION_INVALID_BITWISE_OPERATION,
+    INSTRUCTION_UNUSED,
+    INSTRUCTION_COUNT,
+} InstructionId;
+
+typedef struct DecodedInstruction DecodedInstruction;
+
+typedef void (*InstructionHandler)(const DecodedInstruction *, Cpu *, Memory *);
+
+/* An instruction word with every field already extracted, so executing it only needs a call through the handler */
+struct DecodedInstruction {
+    InstructionHandler handler;
+    uint32_t value;                 // Immediate value or offset, unused when the operand is a register
+    uint8_t id;                     // InstructionId selecting the handler
+    uint8_t op_code;
+    uint8_t operation;              // Operation within the op code group, e.g. ADD vs SUB or store vs load
+    uint8_t destination_register;   // Also the source register of ST
+    uint8_t first_source_register;  // Also the base register of JMP, ST and LD
+    uint8_t second_source_register; // Also the offset register of JMP, ST and LD
+    uint8_t control_register;       // Register tested by JMPC and JMPIC
+    uint8_t byte_mode;
+    bool use_immediate;
+};
+
+/* Reason the run loop handed control back to the caller */
+typedef enum CpuStatus {
+    CPU_STATUS_STEP_LIMIT, // The step budget was used up
+    CPU_STATUS_HALTED,     // An instruction jumped to its own address
+    CPU_STATUS_FAULT,      // An instruction trapped, the program counter is left on it
+    CPU_STATUS_BLOCKED,    // The CPU waits for an interrupt with no line enabled, which nothing can ever end
+} CpuStatus;
+
+typedef struct RunResult {
+    CpuStatus status;
+    uint64_t steps; // Number of instructions executed, not counting one that trapped
+    Trap trap;      // Details of the fault when status is CPU_STATUS_FAULT
+} RunResult;
+
+Cpu init_cpu(CpuBackend backend);
+
+void free_cpu(Cpu *cpu);
+
+void decode_instruction(uint32_t word, DecodedInstruction *decoded);
+
+Trap execute_instruction(uint32_t word, Cpu *cpu, Memory *memory);
+
+/*
+ * Executes up to max_steps instructions. Idle loops are only fast-forwarded while an interrupt controller is attached,
+ * see run_interruptible. Without one every step is executed, counter loops included, so timing a run still measures
+ * the backend.
+ */
+RunResult run_cpu(Cpu *cpu, Memory *memory, uint64_t max_steps);
+
+/* Same as run_cpu but ignores the interrupt controller, run_cpu runs it between interrupts */
+RunResult run_cpu_backend(Cpu *cpu, Memory *memory, uint64_t max_steps);
+
+/* Drops every predecoded copy of the inclusive byte range so modified code is decoded again */
+void invalidate_decoded_instructions(Cpu *cpu, uint32_t first_location, uint32_t last_location);
+
+/*
+ * Translates (JIT backend) or predecodes (decode cache) the basic block spanning the inclusive byte range ahead of its
+ * first run, e.g. the hot loops write_analysis_hints lists, so they start out warm. Does nothing while an MMU is
+ * attached, as the addresses would be virtual.
+ */
+void prepare_basic_block(Cpu *cpu, Memory *memory, uint32_t first_location, uint32_t last_location);
 
-void execute_instruction(uint32_t word, Cpu *cpu, Memory *memory);
+/* Same as run_cpu but always uses the interpreter, the JIT backend uses it for instructions it cannot translate */
+RunResult run_interpreter(Cpu *cpu, Memory *memory, uint64_t max_steps);
 
 #endif
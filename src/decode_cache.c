@@ -0,0 +1,37 @@
+/*********************************************************************************************************************
+ * Direct mapped cache of predecoded instructions keyed by their address                                            *
+ *                                                                                                                   *
+ * Anything that writes to memory holding cached instructions must invalidate the written range, stores executed by *
+ * the CPU do this automatically                                                                                     *
+ *********************************************************************************************************************/
+
+#include "decode_cache.h"
+#include <stdlib.h>
+
+DecodeCache *init_decode_cache() {
+    DecodeCache *cache = malloc(sizeof(DecodeCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < DECODE_CACHE_ENTRIES; i++) {
+        cache->entries[i].address = DECODE_CACHE_EMPTY_ADDRESS;
+    }
+    return cache;
+}
+
+void free_decode_cache(DecodeCache *cache) {
+    free(cache);
+}
+
+/* Drops every cached instruction whose word overlaps the inclusive byte range */
+void invalidate_decode_cache(DecodeCache *cache, uint32_t first_location, uint32_t last_location) {
+    for (uint32_t address = first_location & ~UINT32_C(3); address <= last_location; address += 4) {
+        DecodeCacheEntry *entry = get_decode_cache_entry(cache, address);
+        if (entry->address == address) {
+            entry->address = DECODE_CACHE_EMPTY_ADDRESS;
+        }
+        if (address > UINT32_MAX - 4) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef _DECODE_CACHE_H_
+#define _DECODE_CACHE_H_
+
+#include "cpu.h"
+#include <inttypes.h>
+
+/* Number of direct mapped entries, must be a power of two */
+#define DECODE_CACHE_ENTRIES 8192
+
+/* Never a valid instruction address because instructions are word aligned */
+#define DECODE_CACHE_EMPTY_ADDRESS UINT32_MAX
+
+typedef struct DecodeCacheEntry {
+    uint32_t address;
+    DecodedInstruction instruction;
+} DecodeCacheEntry;
+
+typedef struct DecodeCache {
+    DecodeCacheEntry entries[DECODE_CACHE_ENTRIES];
+} DecodeCache;
+
+DecodeCache *init_decode_cache(void);
+
+void free_decode_cache(DecodeCache *cache);
+
+void invalidate_decode_cache(DecodeCache *cache, uint32_t first_location, uint32_t last_location);
+
+/* Returns the slot the address maps to, the caller compares the slot address to tell a hit from a miss */
+static inline DecodeCacheEntry *get_decode_cache_entry(DecodeCache *cache, uint32_t address) {
+    return &cache->entries[(address >> 2) & (DECODE_CACHE_ENTRIES - 1)];
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*********************************************************************************************************************
+ * Devices for the bus: a console UART, a free running timer and a file backed block device                         *
+ *                                                                                                                   *
+ * The bus serializes every access, so none of them lock. Host system calls are only made where the guest asks for  *
+ * them: polling the UART's input, and writing its output once a line is complete.                                   *
+ *********************************************************************************************************************/
+
+#include "devices.h"
+#include "bus.h"
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UART_BUFFER_BYTES 4096
+
+struct Uart {
+    int input_fd;
+    int output_fd;
+    bool input_closed; // End of input was read, it is not polled again
+    bool has_input;
+    uint8_t input;     // Received byte waiting in UART_DATA
+    bool failed;
+    uint32_t output_length;
+    uint8_t output[UART_BUFFER_BYTES];
+};
+
+struct Timer {
+    struct timespec start;
+    uint64_t latched;
+};
+
+struct BlockDevice {
+    uint8_t *data;
+    uint32_t sector_count;
+    uint32_t sector;
+    bool writable;
+};
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> UART >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+Uart *init_uart(int input_fd, int output_fd) {
+    Uart *uart = malloc(sizeof(Uart));
+    if (uart == NULL) {
+        return NULL;
+    }
+    uart->input_fd = input_fd;
+    uart->output_fd = output_fd;
+    uart->input_closed = input_fd == -1;
+    uart->has_input = false;
+    uart->failed = false;
+    uart->output_length = 0;
+    return uart;
+}
+
+bool flush_uart(Uart *uart) {
+    for (uint32_t written = 0; written < uart->output_length && !uart->failed;) {
+        ssize_t result = write(uart->output_fd, uart->output + written, uart->output_length - written);
+        if (result <= 0) {
+            uart->failed = true;
+        } else {
+            written += result;
+        }
+    }
+    uart->output_length = 0;
+    return !uart->failed;
+}
+
+void free_uart(Uart *uart) {
+    if (uart == NULL) {
+        return;
+    }
+    flush_uart(uart);
+    free(uart);
+}
+
+static bool poll_uart_input(Uart *uart) {
+    if (uart->has_input || uart->input_closed) {
+        return uart->has_input;
+    }
+    struct pollfd input = {uart->input_fd, POLLIN, 0};
+    if (poll(&input, 1, 0) == 1) {
+        ssize_t result = read(uart->input_fd, &uart->input, 1);
+        uart->has_input = result == 1;
+        uart->input_closed = result == 0 || (input.revents & (POLLERR | POLLNVAL)) != 0;
+    }
+    return uart->has_input;
+}
+
+uint32_t read_uart(void *device, uint32_t offset, uint32_t width) {
+    Uart *uart = device;
+    uint32_t value = 0;
+    switch (offset & ~UINT32_C(3)) {
+    case UART_DATA:
+        if (poll_uart_input(uart)) {
+            value = uart->input;
+            uart->has_input = false;
+        }
+        break;
+    case UART_STATUS:
+        value = (poll_uart_input(uart) ? UART_RX_READY : 0) | UART_TX_READY;
+        break;
+    }
+    return read_register_bytes(value, offset, width);
+}
+
+void write_uart(void *device, uint32_t offset, uint32_t width, uint32_t value) {
+    Uart *uart = device;
+    if ((offset & ~UINT32_C(3)) != UART_DATA) {
+        return;
+    }
+    uart->output[uart->output_length++] = value;
+    if ((uint8_t)value == '\n' || uart->output_length == UART_BUFFER_BYTES) {
+        flush_uart(uart);
+    }
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Timer >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+Timer *init_timer(void) {
+    Timer *timer = malloc(sizeof(Timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &timer->start);
+    timer->latched = 0;
+    return timer;
+}
+
+void free_timer(Timer *timer) {
+    free(timer);
+}
+
+uint32_t read_timer(void *device, uint32_t offset, uint32_t width) {
+    Timer *timer = device;
+    uint32_t value = 0;
+    switch (offset & ~UINT32_C(3)) {
+    case TIMER_TIME_LOW: {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timer->latched = (uint64_t)(now.tv_sec - timer->start.tv_sec) * 1000000 +
+                         (now.tv_nsec - timer->start.tv_nsec) / 1000;
+        value = timer->latched;
+        break;
+    }
+    case TIMER_TIME_HIGH:
+        value = timer->latched >> 32;
+        break;
+    }
+    return read_register_bytes(value, offset, width);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Block device >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+BlockDevice *init_block_device(int fd, bool writable) {
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < BLOCK_SECTOR_BYTES) {
+        return NULL;
+    }
+    uint64_t sector_count = status.st_size / BLOCK_SECTOR_BYTES;
+    if (sector_count > UINT32_MAX) {
+        sector_count = UINT32_MAX;
+    }
+    BlockDevice *block_device = malloc(sizeof(BlockDevice));
+    if (block_device == NULL) {
+        return NULL;
+    }
+    block_device->data = mmap(NULL, sector_count * BLOCK_SECTOR_BYTES, PROT_READ | (writable ? PROT_WRITE : 0),
+                              MAP_SHARED, fd, 0);
+    if (block_device->data == MAP_FAILED) {
+        free(block_device);
+        return NULL;
+    }
+    block_device->sector_count = sector_count;
+    block_device->sector = 0;
+    block_device->writable = writable;
+    return block_device;
+}
+
+static size_t get_block_device_bytes(const BlockDevice *block_device) {
+    return (size_t)block_device->sector_count * BLOCK_SECTOR_BYTES;
+}
+
+bool flush_block_device(BlockDevice *block_device) {
+    return !block_device->writable || msync(block_device->data, get_block_device_bytes(block_device), MS_SYNC) == 0;
+}
+
+void free_block_device(BlockDevice *block_device) {
+    if (block_device == NULL) {
+        return;
+    }
+    munmap(block_device->data, get_block_device_bytes(block_device));
+    free(block_device);
+}
+
+/* Returns NULL when the selected sector is past the end of the file */
+static uint8_t *get_window_bytes(const BlockDevice *block_device, uint32_t offset) {
+    if (block_device->sector >= block_device->sector_count) {
+        return NULL;
+    }
+    return block_device->data + (size_t)block_device->sector * BLOCK_SECTOR_BYTES + (offset - BLOCK_WINDOW);
+}
+
+uint32_t read_block_device(void *device, uint32_t offset, uint32_t width) {
+    BlockDevice *block_device = device;
+    if (offset >= BLOCK_WINDOW) {
+        const uint8_t *bytes = get_window_bytes(block_device, offset);
+        uint32_t value = 0;
+        for (uint32_t i = 0; bytes != NULL && i < width; i++) {
+            value = value << 8 | bytes[i];
+        }
+        return value;
+    }
+
+    uint32_t value = 0;
+    switch (offset & ~UINT32_C(3)) {
+    case BLOCK_SECTOR:
+        value = block_device->sector;
+        break;
+    case BLOCK_SECTOR_COUNT:
+        value = block_device->sector_count;
+        break;
+    }
+    return read_register_bytes(value, offset, width);
+}
+
+void write_block_device(void *device, uint32_t offset, uint32_t width, uint32_t value) {
+    BlockDevice *block_device = device;
+    if (offset < BLOCK_WINDOW) {
+        if ((offset & ~UINT32_C(3)) == BLOCK_SECTOR) {
+            block_device->sector = value;
+        }
+        return;
+    }
+
+    uint8_t *bytes = get_window_bytes(block_device, offset);
+    if (bytes == NULL || !block_device->writable) {
+        return;
+    }
+    for (uint32_t i = 0; i < width; i++) {
+        bytes[i] = value >> (8 * (width - 1 - i));
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef _DEVICES_H_
+#define _DEVICES_H_
+
+#include "bus.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * Devices to map on a Bus, pass the device with its read and write functions to map_bus_device. Registers are words
+ * at the offsets below, a store narrower than a word writes its zero extended value to the whole register.
+ */
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> UART >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+#define UART_BYTES    8
+#define UART_DATA     0x0 // Stores send the low byte, loads take the next received byte or 0 when there is none
+#define UART_STATUS   0x4 // UART_RX_READY and UART_TX_READY
+#define UART_RX_READY 0x1 // A received byte is waiting in UART_DATA
+#define UART_TX_READY 0x2 // Always set, sent bytes are buffered
+
+/* Console attached to two host file descriptors */
+typedef struct Uart Uart;
+
+/*
+ * Receives from input_fd without ever blocking, -1 for none, and sends to output_fd. Sent bytes are buffered and
+ * written at every newline, when the buffer fills and on flush.
+ */
+Uart *init_uart(int input_fd, int output_fd);
+
+/* Returns false if any write to output_fd failed so far */
+bool flush_uart(Uart *uart);
+
+/* Flushes and releases the UART, the file descriptors stay open */
+void free_uart(Uart *uart);
+
+uint32_t read_uart(void *uart, uint32_t offset, uint32_t width);
+
+void write_uart(void *uart, uint32_t offset, uint32_t width, uint32_t value);
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Timer >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+#define TIMER_BYTES     8
+#define TIMER_TIME_LOW  0x0 // Loads latch the microseconds since the timer was created and return their low word
+#define TIMER_TIME_HIGH 0x4 // High word of the value latched by the last load of TIMER_TIME_LOW
+
+/* Free running host clock, read only */
+typedef struct Timer Timer;
+
+Timer *init_timer(void);
+
+void free_timer(Timer *timer);
+
+uint32_t read_timer(void *timer, uint32_t offset, uint32_t width);
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Block device >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+#define BLOCK_SECTOR_BYTES  512
+#define BLOCK_DEVICE_BYTES  0x400
+#define BLOCK_SECTOR        0x000 // Sector shown in the window
+#define BLOCK_SECTOR_COUNT  0x004 // Whole sectors of the file, read only
+#define BLOCK_WINDOW        0x200 // The BLOCK_SECTOR_BYTES bytes of the selected sector, zero past the last one
+
+/*
+ * Disk backed by a host file mapped shared, so the window reads and writes the file's page cache directly and no
+ * sector is ever copied. Only whole sectors of the file are reachable.
+ */
+typedef struct BlockDevice BlockDevice;
+
+/* Returns NULL when the file holds no whole sector or cannot be mapped, stores are ignored unless writable */
+BlockDevice *init_block_device(int fd, bool writable);
+
+/* Writes the sectors stored to back to the file, returns false if that failed */
+bool flush_block_device(BlockDevice *block_device);
+
+/* Unmaps the file without flushing it, the file descriptor stays open */
+void free_block_device(BlockDevice *block_device);
+
+uint32_t read_block_device(void *block_device, uint32_t offset, uint32_t width);
+
+void write_block_device(void *block_device, uint32_t offset, uint32_t width, uint32_t value);
+
+#endif
@@ -0,0 +1,440 @@
+/*********************************************************************************************************************
+ * Interrupt controller and cycle counting timer                                                                     *
+ *                                                                                                                   *
+ * None of the backends know about interrupts. run_interruptible cuts a run into slices short enough that nothing     *
+ * can become pending in the middle of one without ending it: the timer's deadline caps the slice, an access to the  *
+ * controller ends it through a trap, and lines raised by other threads wait at most INTERRUPT_CHECK_STEPS.          *
+ *********************************************************************************************************************/
+
+#include "interrupts.h"
+#include "bus.h"
+#include "cpu.h"
+#include "memory.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+InterruptController *init_interrupt_controller(uint32_t base) {
+    if (base % 4 != 0 || base + (INTERRUPT_CONTROLLER_BYTES - 1) < base) {
+        return NULL;
+    }
+    InterruptController *interrupts = calloc(1, sizeof(InterruptController));
+    if (interrupts == NULL) {
+        return NULL;
+    }
+    if (pthread_mutex_init(&interrupts->lock, NULL) != 0) {
+        free(interrupts);
+        return NULL;
+    }
+    if (pthread_cond_init(&interrupts->raised, NULL) != 0) {
+        pthread_mutex_destroy(&interrupts->lock);
+        free(interrupts);
+        return NULL;
+    }
+    interrupts->base = base;
+    return interrupts;
+}
+
+void free_interrupt_controller(InterruptController *interrupts) {
+    if (interrupts == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&interrupts->raised);
+    pthread_mutex_destroy(&interrupts->lock);
+    free(interrupts);
+}
+
+static uint32_t get_pending(const InterruptController *interrupts) {
+    return __atomic_load_n(&interrupts->pending, __ATOMIC_ACQUIRE);
+}
+
+void raise_interrupt(InterruptController *interrupts, uint32_t line) {
+    __atomic_fetch_or(&interrupts->pending, UINT32_C(1) << (line % 32), __ATOMIC_RELEASE);
+    pthread_mutex_lock(&interrupts->lock);
+    pthread_cond_broadcast(&interrupts->raised);
+    pthread_mutex_unlock(&interrupts->lock);
+}
+
+uint32_t read_interrupt_controller(InterruptController *interrupts, uint32_t offset, uint32_t width) {
+    uint32_t value = 0;
+    switch (offset & ~UINT32_C(3)) {
+    case INTERRUPT_STATUS:
+        value = interrupts->status;
+        break;
+    case INTERRUPT_PENDING:
+        value = get_pending(interrupts);
+        break;
+    case INTERRUPT_ENABLE:
+        value = interrupts->enable;
+        break;
+    case INTERRUPT_VECTOR:
+        value = interrupts->vector;
+        break;
+    case INTERRUPT_SAVED_PC:
+        value = interrupts->saved_program_counter;
+        break;
+    case INTERRUPT_CAUSE:
+        value = interrupts->cause;
+        break;
+    case INTERRUPT_TIME_LOW:
+        interrupts->latched_cycles = interrupts->cycles;
+        value = interrupts->latched_cycles;
+        break;
+    case INTERRUPT_TIME_HIGH:
+        value = interrupts->latched_cycles >> 32;
+        break;
+    case INTERRUPT_COMPARE_LOW:
+        value = interrupts->compare;
+        break;
+    case INTERRUPT_COMPARE_HIGH:
+        value = interrupts->compare >> 32;
+        break;
+    }
+    return read_register_bytes(value, offset, width);
+}
+
+void write_interrupt_controller(InterruptController *interrupts, uint32_t offset, uint32_t width, uint32_t value) {
+    switch (offset & ~UINT32_C(3)) {
+    case INTERRUPT_STATUS:
+        interrupts->status = value & INTERRUPT_STATUS_ENABLED;
+        break;
+    case INTERRUPT_PENDING:
+        __atomic_fetch_and(&interrupts->pending, ~value, __ATOMIC_RELEASE);
+        break;
+    case INTERRUPT_ENABLE:
+        interrupts->enable = value;
+        break;
+    case INTERRUPT_VECTOR:
+        interrupts->vector = value;
+        break;
+    case INTERRUPT_SAVED_PC:
+        interrupts->saved_program_counter = value;
+        break;
+    case INTERRUPT_RETURN:
+        interrupts->returning = true;
+        break;
+    case INTERRUPT_WAIT:
+        interrupts->waiting = true;
+        break;
+    case INTERRUPT_COMPARE_LOW:
+        interrupts->compare = (interrupts->compare & ~(uint64_t)UINT32_MAX) | value;
+        interrupts->timer_armed = true;
+        break;
+    case INTERRUPT_COMPARE_HIGH:
+        interrupts->compare = (interrupts->compare & UINT32_MAX) | (uint64_t)value << 32;
+        break;
+    }
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> run >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static void fire_timer(InterruptController *interrupts) {
+    if (interrupts->timer_armed && interrupts->cycles >= interrupts->compare) {
+        interrupts->timer_armed = false;
+        __atomic_fetch_or(&interrupts->pending, UINT32_C(1) << INTERRUPT_LINE_TIMER, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * The armed timer ends the wait at its deadline, without it only another thread can. The host thread sleeps for at
+ * most INTERRUPT_WAIT_MILLISECONDS, returns false when the CPU is still waiting after that.
+ */
+static bool wait_for_interrupt(InterruptController *interrupts) {
+    if ((get_pending(interrupts) & interrupts->enable) == 0 && interrupts->timer_armed) {
+        if (interrupts->cycles < interrupts->compare) {
+            interrupts->cycles = interrupts->compare;
+        }
+        fire_timer(interrupts);
+    }
+    if ((get_pending(interrupts) & interrupts->enable) == 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += INTERRUPT_WAIT_MILLISECONDS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_mutex_lock(&interrupts->lock);
+        while ((get_pending(interrupts) & interrupts->enable) == 0 &&
+               pthread_cond_timedwait(&interrupts->raised, &interrupts->lock, &deadline) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&interrupts->lock);
+    }
+    interrupts->waiting = (get_pending(interrupts) & interrupts->enable) == 0;
+    return !interrupts->waiting;
+}
+
+/* Lower lines take priority */
+static void take_interrupt(Cpu *cpu, InterruptController *interrupts) {
+    uint32_t lines = get_pending(interrupts) & interrupts->enable;
+    if ((interrupts->status & INTERRUPT_STATUS_ENABLED) == 0 || lines == 0) {
+        return;
+    }
+    interrupts->cause = __builtin_ctz(lines);
+    interrupts->saved_program_counter = cpu->program_counter;
+    interrupts->status &= ~INTERRUPT_STATUS_ENABLED;
+    cpu->program_counter = interrupts->vector;
+}
+
+static uint64_t get_slice_steps(const InterruptController *interrupts, uint64_t remaining) {
+    uint64_t steps = remaining < INTERRUPT_CHECK_STEPS ? remaining : INTERRUPT_CHECK_STEPS;
+    if (interrupts->timer_armed && interrupts->compare - interrupts->cycles < steps) {
+        steps = interrupts->compare - interrupts->cycles;
+    }
+    return steps;
+}
+
+/* Adds the slice to the run, returns true when the run has to stop */
+static bool add_slice(RunResult *result, const RunResult *slice, InterruptController *interrupts) {
+    result->steps += slice->steps;
+    interrupts->cycles += slice->steps;
+    if (slice->status == CPU_STATUS_STEP_LIMIT) {
+        return false;
+    }
+    result->status = slice->status;
+    result->trap = slice->trap;
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> idle loops >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+#define NO_COUNTER UINT32_MAX
+
+/* One iteration of the loop the CPU is in, as observe_loop ran it */
+typedef struct IdleLoop {
+    DecodedInstruction body[INTERRUPT_LOOP_STEPS];
+    bool counter_tested[INTERRUPT_LOOP_STEPS]; // A JMPC on the counter ran while it was not zero
+    uint32_t length;                           // Steps of the iteration, 0 when the loop is not idle
+    uint32_t counter;                          // Register the iteration changed, or NO_COUNTER
+    uint32_t delta;                            // Added to the counter by each iteration, 1 or -1
+    bool loads;                                // Reads memory, which other threads may store to
+} IdleLoop;
+
+/* Steps which can neither trap nor change anything but registers, given the registers they run with */
+static bool is_repeatable(const DecodedInstruction *decoded, const Cpu *cpu, const Memory *memory) {
+    switch (decoded->id) {
+    case INSTRUCTION_JMP:
+    case INSTRUCTION_JMPC:
+    case INSTRUCTION_SET:
+    case INSTRUCTION_SETU:
+    case INSTRUCTION_ADD:
+    case INSTRUCTION_SUB:
+    case INSTRUCTION_MUL:
+    case INSTRUCTION_AND:
+    case INSTRUCTION_OR:
+    case INSTRUCTION_XOR:
+    case INSTRUCTION_BSR:
+    case INSTRUCTION_BSRR:
+    case INSTRUCTION_BSL:
+    case INSTRUCTION_BSLR:
+        return true;
+    case INSTRUCTION_LD: {
+        uint32_t offset = decoded->use_immediate ? decoded->value : cpu->registers[decoded->second_source_register];
+        uint32_t location = cpu->registers[decoded->first_source_register] + offset;
+        uint32_t last_byte_mask = (UINT32_C(1) << decoded->byte_mode) - 1;
+        return (location & last_byte_mask) == last_byte_mask && location < memory->size_bytes;
+    }
+    default:
+        return false;
+    }
+}
+
+/* Leaves out the control register of JMPC, which is_counter_loop looks at separately */
+static bool reads_register(const DecodedInstruction *decoded, uint32_t reg) {
+    switch (decoded->id) {
+    case INSTRUCTION_SET:
+        return false;
+    case INSTRUCTION_SETU:
+        return decoded->destination_register == reg;
+    default:
+        return decoded->first_source_register == reg ||
+               (!decoded->use_immediate && decoded->second_source_register == reg);
+    }
+}
+
+static bool writes_register(const DecodedInstruction *decoded, uint32_t reg) {
+    return decoded->id != INSTRUCTION_JMP && decoded->id != INSTRUCTION_JMPC && decoded->destination_register == reg;
+}
+
+/*
+ * Each iteration has to take the same path for every value the counter passes through before reaching zero: it is
+ * only changed by one ADDI or SUBI of 1 onto itself, and only read by that and by conditional jumps, none of which
+ * jumped in the observed iteration.
+ */
+static bool is_counter_loop(const IdleLoop *loop) {
+    uint32_t updates = 0;
+    for (uint32_t i = 0; i < loop->length; i++) {
+        const DecodedInstruction *decoded = &loop->body[i];
+        if (writes_register(decoded, loop->counter)) {
+            bool is_update = (decoded->id == INSTRUCTION_ADD || decoded->id == INSTRUCTION_SUB) &&
+                             decoded->use_immediate && decoded->first_source_register == loop->counter &&
+                             decoded->value == 1;
+            if (!is_update) {
+                return false;
+            }
+            updates++;
+        } else if (reads_register(decoded, loop->counter)) {
+            return false;
+        } else if (decoded->id == INSTRUCTION_JMPC && decoded->control_register == loop->counter &&
+                   !loop->counter_tested[i]) {
+            return false;
+        }
+    }
+    return updates == 1 && (loop->delta == 1 || loop->delta == UINT32_MAX);
+}
+
+/*
+ * Runs the CPU one step at a time until it is back at the instruction it started on, as long as every step is
+ * repeatable. Returns what ran, and fills in the loop, whose length is left 0 unless it turned out idle.
+ */
+static RunResult observe_loop(Cpu *cpu, Memory *memory, uint64_t max_steps, IdleLoop *loop) {
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    uint32_t start = cpu->program_counter;
+    uint32_t registers[8];
+    memcpy(registers, cpu->registers, sizeof(registers));
+    *loop = (IdleLoop){.counter = NO_COUNTER};
+
+    uint32_t length = 0;
+    do {
+        uint32_t address = cpu->program_counter;
+        if (length == INTERRUPT_LOOP_STEPS || result.steps == max_steps || address % 4 != 0 ||
+            address > memory->size_bytes - 4) {
+            return result;
+        }
+        DecodedInstruction *decoded = &loop->body[length];
+        decode_instruction(read_word(memory, address), decoded);
+        if (!is_repeatable(decoded, cpu, memory)) {
+            return result;
+        }
+        loop->loads |= decoded->id == INSTRUCTION_LD;
+        loop->counter_tested[length] =
+            decoded->id == INSTRUCTION_JMPC && cpu->registers[decoded->control_register] != 0;
+        length++;
+
+        RunResult step = run_cpu_backend(cpu, memory, 1);
+        result.steps += step.steps;
+        if (step.status != CPU_STATUS_STEP_LIMIT) {
+            result.status = step.status;
+            result.trap = step.trap;
+            return result;
+        }
+    } while (cpu->program_counter != start);
+
+    for (uint32_t reg = 0; reg < 8; reg++) {
+        if (cpu->registers[reg] == registers[reg]) {
+            continue;
+        }
+        if (loop->counter != NO_COUNTER) {
+            return result;
+        }
+        loop->counter = reg;
+        loop->delta = cpu->registers[reg] - registers[reg];
+    }
+    loop->length = length;
+    if (loop->counter != NO_COUNTER && !is_counter_loop(loop)) {
+        loop->length = 0;
+    }
+    return result;
+}
+
+/*
+ * Runs an iteration of the loop the CPU is in and skips the iterations after it which nothing could tell apart from
+ * running them, up to max_steps. Sets idle to whether it skipped any, the next call may skip further.
+ */
+static RunResult fast_forward_idle_loop(Cpu *cpu, Memory *memory, InterruptController *interrupts,
+                                        uint64_t max_steps, bool *idle) {
+    IdleLoop loop;
+    RunResult result = observe_loop(cpu, memory, get_slice_steps(interrupts, max_steps), &loop);
+    *idle = false;
+    if (loop.length == 0 || result.status != CPU_STATUS_STEP_LIMIT) {
+        return result;
+    }
+
+    uint64_t steps = max_steps - result.steps;
+    uint64_t cycles = interrupts->cycles + result.steps;
+    if (interrupts->timer_armed) {
+        uint64_t until_deadline = interrupts->compare > cycles ? interrupts->compare - cycles : 0;
+        steps = until_deadline < steps ? until_deadline : steps;
+    }
+    bool lines_may_be_raised = (interrupts->status & INTERRUPT_STATUS_ENABLED) && interrupts->enable != 0;
+    if ((loop.loads || lines_may_be_raised) && steps > INTERRUPT_CHECK_STEPS) {
+        steps = INTERRUPT_CHECK_STEPS;
+    }
+
+    uint64_t iterations = steps / loop.length;
+    if (loop.counter != NO_COUNTER) {
+        /* The counter is not zero now, it is after until_zero more iterations, so the last two of those run */
+        uint32_t counter = cpu->registers[loop.counter];
+        uint64_t until_zero = loop.delta == 1 ? (uint64_t)(UINT32_C(0) - counter) : counter;
+        if (counter == 0 || until_zero < 2) {
+            return result;
+        }
+        if (iterations > until_zero - 2) {
+            iterations = until_zero - 2;
+        }
+        cpu->registers[loop.counter] += (uint32_t)iterations * loop.delta;
+    }
+
+    result.steps += iterations * loop.length;
+    interrupts->idle_steps += iterations * loop.length;
+    *idle = iterations > 0;
+    return result;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Skipping iterations would leave them out of whatever the CPU records */
+static bool can_fast_forward(const Cpu *cpu) {
+    return cpu->profile == NULL && cpu->trace == NULL && cpu->timing == NULL && cpu->cache == NULL &&
+           cpu->branch_predictor == NULL && cpu->mmu == NULL;
+}
+
+RunResult run_interruptible(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    InterruptController *interrupts = cpu->interrupts;
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    bool idle = false;
+    while (result.steps < max_steps) {
+        fire_timer(interrupts);
+        if (interrupts->waiting && interrupts->enable == 0) {
+            result.status = CPU_STATUS_BLOCKED;
+            break;
+        }
+        if (interrupts->waiting && !wait_for_interrupt(interrupts)) {
+            break;
+        }
+        take_interrupt(cpu, interrupts);
+
+        if (idle) {
+            RunResult slice = fast_forward_idle_loop(cpu, memory, interrupts, max_steps - result.steps, &idle);
+            if (add_slice(&result, &slice, interrupts)) {
+                break;
+            }
+            continue;
+        }
+
+        interrupts->exit_on_access = true;
+        RunResult slice = run_cpu_backend(cpu, memory, get_slice_steps(interrupts, max_steps - result.steps));
+        interrupts->exit_on_access = false;
+        if (slice.status == CPU_STATUS_FAULT && slice.trap.kind == TRAP_INTERRUPT_CONTROLLER) {
+            /* The slice ended before the access, which leaves room in the budget for it */
+            slice.status = CPU_STATUS_STEP_LIMIT;
+            add_slice(&result, &slice, interrupts);
+
+            /* Now that cycles is up to date, the access itself runs as a slice of one */
+            slice = run_cpu_backend(cpu, memory, 1);
+            if (interrupts->returning) {
+                interrupts->returning = false;
+                interrupts->status |= INTERRUPT_STATUS_ENABLED;
+                cpu->program_counter = interrupts->saved_program_counter;
+            }
+        }
+        if (add_slice(&result, &slice, interrupts)) {
+            break;
+        }
+        idle = slice.steps == INTERRUPT_CHECK_STEPS && can_fast_forward(cpu);
+    }
+    return result;
+}
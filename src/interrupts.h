@@ -0,0 +1,89 @@
+#ifndef _INTERRUPTS_H_
+#define _INTERRUPTS_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+/* Register offsets of the interrupt controller, all of them words */
+#define INTERRUPT_CONTROLLER_BYTES 0x30
+#define INTERRUPT_STATUS           0x00 // INTERRUPT_STATUS_ENABLED while interrupts are taken
+#define INTERRUPT_PENDING          0x04 // Raised lines, storing ones acknowledges those lines
+#define INTERRUPT_ENABLE           0x08 // Lines allowed to interrupt and to end a wait
+#define INTERRUPT_VECTOR           0x0C // Address of the handler every interrupt jumps to
+#define INTERRUPT_SAVED_PC         0x10 // Address of the instruction the interrupt preempted
+#define INTERRUPT_CAUSE            0x14 // Line of the last interrupt taken, read only
+#define INTERRUPT_RETURN           0x18 // Any store resumes at INTERRUPT_SAVED_PC with interrupts enabled
+#define INTERRUPT_WAIT             0x1C // Any store waits until an enabled line is pending
+#define INTERRUPT_TIME_LOW         0x20 // Loads latch the cycle count and return its low word
+#define INTERRUPT_TIME_HIGH        0x24 // High word of the value latched by the last load of INTERRUPT_TIME_LOW
+#define INTERRUPT_COMPARE_LOW      0x28 // Stores arm the timer, it raises INTERRUPT_LINE_TIMER once the count
+#define INTERRUPT_COMPARE_HIGH     0x2C // reaches COMPARE_HIGH << 32 | COMPARE_LOW
+
+#define INTERRUPT_STATUS_ENABLED    0x1
+#define INTERRUPT_LINE_TIMER        0     // Lines 1 to 31 are free for devices
+#define INTERRUPT_CHECK_STEPS       16384 // Most steps a line raised by another thread waits for the CPU to notice it
+#define INTERRUPT_LOOP_STEPS        16    // Longest loop iteration run_cpu recognizes as idle
+#define INTERRUPT_WAIT_MILLISECONDS 100   // Longest a waiting CPU sleeps on the host before run_cpu returns
+
+/*
+ * Interrupt controller and cycle counting timer of one CPU, attached to Cpu.interrupts and mapped at base in the CPU's
+ * address space, past the end of its memory. Taking an interrupt saves the program counter, disables interrupts and
+ * jumps to the vector. Every instruction run_cpu executes counts as one cycle, and so does every cycle the CPU waits
+ * with the timer armed: waiting skips straight to the timer's deadline.
+ *
+ * Only pending may be changed from other threads, through raise_interrupt. Everything else belongs to the thread
+ * running the CPU.
+ */
+typedef struct InterruptController {
+    uint32_t base;
+    uint32_t status;
+    uint32_t pending;
+    uint32_t enable;
+    uint32_t vector;
+    uint32_t saved_program_counter;
+    uint32_t cause;
+    uint64_t cycles;
+    uint64_t latched_cycles;
+    uint64_t compare;
+    bool timer_armed;
+    bool waiting;        // WAIT was stored to and no enabled line has been pending since
+    bool returning;      // RETURN was stored to and run_cpu has not resumed yet
+    bool exit_on_access; // Set by run_cpu, accesses end the run so it can act on them between instructions
+    uint64_t idle_steps; // Steps of idle loops run_cpu skipped over rather than executed, counted in cycles too
+    pthread_mutex_t lock;
+    pthread_cond_t raised;
+} InterruptController;
+
+/* Returns NULL when the registers would wrap around the address space or the controller cannot be allocated */
+InterruptController *init_interrupt_controller(uint32_t base);
+
+void free_interrupt_controller(InterruptController *interrupts);
+
+/* Thread safe, wakes the CPU if it waits for the line */
+void raise_interrupt(InterruptController *interrupts, uint32_t line);
+
+uint32_t read_interrupt_controller(InterruptController *interrupts, uint32_t offset, uint32_t width);
+
+void write_interrupt_controller(InterruptController *interrupts, uint32_t offset, uint32_t width, uint32_t value);
+
+/*
+ * Called by run_cpu while a controller is attached. Runs the backend in slices which end at the timer's deadline,
+ * after INTERRUPT_CHECK_STEPS and at every access to the controller, and takes interrupts between them, so the
+ * backends themselves never check for interrupts. A waiting CPU sleeps on the host until another thread raises a line,
+ * unless the armed timer ends the wait first. After INTERRUPT_WAIT_MILLISECONDS of sleep the run returns with
+ * CPU_STATUS_STEP_LIMIT, short of max_steps and still waiting, so the next run resumes the wait. With no line enabled
+ * nothing can ever end the wait, and the run returns CPU_STATUS_BLOCKED right away.
+ *
+ * After a full slice the loop the CPU is in is run once more one step at a time. When an iteration neither stores nor
+ * reaches the bus and leaves every register as it was, or only changes a counter by one which nothing but conditional
+ * jumps reads, the iterations up to the next event that could change the outcome are counted as steps and cycles
+ * without running them: the timer's deadline, the counter reaching zero, or INTERRUPT_CHECK_STEPS when another thread
+ * could raise a line or store to the memory the loop reads. Not done while the CPU records a profile, trace, timing,
+ * cache accesses or branches, or translates addresses.
+ */
+RunResult run_interruptible(Cpu *cpu, Memory *memory, uint64_t max_steps);
+
+#endif
@@ -0,0 +1,806 @@
+/*********************************************************************************************************************
+ * Translates basic blocks of guest instructions into x86-64 machine code                                           *
+ *                                                                                                                   *
+ * A block runs from its start address up to and including the first JMP, stopping early in front of anything that   *
+ * is not translated (DIV, MOD and invalid encodings), which the interpreter executes instead. Guest registers live  *
+ * in the Cpu struct and are addressed through rbx, while r12 holds the Memory pointer, r13 the remaining step       *
+ * budget and r14 where to report the exit taken. LD and ST call back into the interpreter handlers.                 *
+ *                                                                                                                   *
+ * Every exit compares the next program counter against the block it was last linked to and jumps straight into     *
+ * that block's code on a match, so hot loops run without returning to the dispatcher.                              *
+ *                                                                                                                   *
+ * The code buffer is one file mapped twice, read and execute where blocks run and read and write where they are     *
+ * emitted and patched, so no page is ever writable and executable at once. Patching needs no mprotect either, which *
+ * matters as stores discard blocks from inside translated code.                                                    *
+ *********************************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "jit.h"
+#include "bit_utils.h"
+#include "cpu.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_CODE_BYTES              (8 * 1024 * 1024)
+#define JIT_MAX_BLOCKS              16384
+#define JIT_MAX_BLOCK_INSTRUCTIONS  64
+#define JIT_MAX_BLOCK_CODE_BYTES    8192
+#define JIT_MAX_MEMORY_INSTRUCTIONS 65536
+
+typedef struct JitBlock JitBlock;
+
+/* A way out of a block that can be patched to jump straight into the block it leads to */
+typedef struct JitExit {
+    JitBlock *block;
+    uint8_t *linked_address; // imm32 compared against the next program counter
+    uint8_t *linked_jump;    // rel32 of the jump into the linked block
+    uint32_t jump_address;   // Address of the JMP taking this exit, UINT32_MAX when falling through
+} JitExit;
+
+struct JitBlock {
+    uint32_t start_address;
+    uint32_t length; // Number of guest instructions
+    uint8_t *code;
+    uint8_t *entry_stub; // Leaves the block before executing anything, used when invalid or out of budget
+    bool valid;
+    JitExit exits[2];
+};
+
+typedef uint64_t (*JitEntry)(Cpu *cpu, Memory *memory, uint64_t budget, const uint8_t *code, JitExit **exit);
+
+struct Jit {
+    uint8_t *code;          // Executable view of the code buffer, every address in and into the code points here
+    uint8_t *writable_code; // Writable view of the same bytes
+    uint8_t *code_cursor;
+    uint8_t *first_block_code;
+    uint8_t *epilogue;
+    JitEntry enter;
+
+    JitBlock blocks[JIT_MAX_BLOCKS];
+    uint32_t block_count;
+
+    /* LD and ST call the interpreter handler, which needs the decoded instruction to outlive the translation */
+    DecodedInstruction memory_instructions[JIT_MAX_MEMORY_INSTRUCTIONS];
+    uint32_t memory_instruction_count;
+
+    /* Both sized to the memory the code was translated from */
+    uint32_t word_count;
+    JitBlock **blocks_by_address;
+    uint16_t *blocks_per_word; // Number of valid blocks translated from each word
+
+    uint32_t generation; // Bumped on every flush so exits from discarded code are never linked
+    bool code_modified;  // Set when a store discards translated code, the running block must stop
+};
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Emitter >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* The cursor is an executable address, the bytes are written at the same offset into the writable view */
+typedef struct Emitter {
+    uint8_t *cursor;
+    ptrdiff_t writable_offset;
+} Emitter;
+
+static Emitter init_emitter(const Jit *jit, uint8_t *cursor) {
+    return (Emitter){cursor, jit->writable_code - jit->code};
+}
+
+static uint8_t *get_writable(const Emitter *emitter, uint8_t *address) {
+    return address + emitter->writable_offset;
+}
+
+static void emit_bytes(Emitter *emitter, const void *bytes, size_t size) {
+    memcpy(get_writable(emitter, emitter->cursor), bytes, size);
+    emitter->cursor += size;
+}
+
+static void emit_byte(Emitter *emitter, uint8_t value) {
+    emit_bytes(emitter, &value, sizeof(value));
+}
+
+static void emit_u32(Emitter *emitter, uint32_t value) {
+    emit_bytes(emitter, &value, sizeof(value));
+}
+
+static void emit_u64(Emitter *emitter, uint64_t value) {
+    emit_bytes(emitter, &value, sizeof(value));
+}
+
+/* Emits a zero rel32 and returns where it lives so it can be patched once the target is known */
+static uint8_t *emit_rel32(Emitter *emitter) {
+    uint8_t *site = emitter->cursor;
+    emit_u32(emitter, 0);
+    return site;
+}
+
+static void patch_rel32(const Emitter *emitter, uint8_t *site, const uint8_t *target) {
+    int32_t displacement = (int32_t)(target - (site + 4));
+    memcpy(get_writable(emitter, site), &displacement, sizeof(displacement));
+}
+
+static void patch_u32(const Emitter *emitter, uint8_t *site, uint32_t value) {
+    memcpy(get_writable(emitter, site), &value, sizeof(value));
+}
+
+static uint8_t register_offset(uint8_t register_number) {
+    return offsetof(Cpu, registers) + register_number * sizeof(uint32_t);
+}
+
+static const uint8_t PROGRAM_COUNTER_OFFSET = offsetof(Cpu, program_counter);
+
+/* mov eax, [rbx + register] */
+static void emit_load_eax(Emitter *emitter, uint8_t register_number) {
+    emit_byte(emitter, 0x8B);
+    emit_byte(emitter, 0x43);
+    emit_byte(emitter, register_offset(register_number));
+}
+
+/* mov ecx, [rbx + register] */
+static void emit_load_ecx(Emitter *emitter, uint8_t register_number) {
+    emit_byte(emitter, 0x8B);
+    emit_byte(emitter, 0x4B);
+    emit_byte(emitter, register_offset(register_number));
+}
+
+/* mov [rbx + register], eax */
+static void emit_store_eax(Emitter *emitter, uint8_t register_number) {
+    emit_byte(emitter, 0x89);
+    emit_byte(emitter, 0x43);
+    emit_byte(emitter, register_offset(register_number));
+}
+
+/* mov dword [rbx + program counter], value */
+static void emit_set_program_counter(Emitter *emitter, uint32_t value) {
+    emit_byte(emitter, 0xC7);
+    emit_byte(emitter, 0x43);
+    emit_byte(emitter, PROGRAM_COUNTER_OFFSET);
+    emit_u32(emitter, value);
+}
+
+/* mov eax, value */
+static void emit_move_eax(Emitter *emitter, uint32_t value) {
+    emit_byte(emitter, 0xB8);
+    emit_u32(emitter, value);
+}
+
+/* jmp rel32 */
+static void emit_jump(Emitter *emitter, const uint8_t *target) {
+    emit_byte(emitter, 0xE9);
+    patch_rel32(emitter, emit_rel32(emitter), target);
+}
+
+/* add r13, value */
+static void emit_refund_budget(Emitter *emitter, uint32_t value) {
+    emit_byte(emitter, 0x49);
+    emit_byte(emitter, 0x81);
+    emit_byte(emitter, 0xC5);
+    emit_u32(emitter, value);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Trampoline >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/*
+ * Emits the JitEntry function, which saves the callee saved registers it pins and jumps into a block, and the
+ * epilogue every exit ends at, which reports the exit in rax and returns the remaining budget
+ */
+static void emit_trampoline(Jit *jit, Emitter *emitter) {
+    static const uint8_t entry[] = {
+        0x55,             // push rbp, also keeps the stack 16 byte aligned for calls made by blocks
+        0x53,             // push rbx
+        0x41, 0x54,       // push r12
+        0x41, 0x55,       // push r13
+        0x41, 0x56,       // push r14
+        0x48, 0x89, 0xFB, // mov rbx, rdi
+        0x49, 0x89, 0xF4, // mov r12, rsi
+        0x49, 0x89, 0xD5, // mov r13, rdx
+        0x4D, 0x89, 0xC6, // mov r14, r8
+        0xFF, 0xE1,       // jmp rcx
+    };
+    static const uint8_t epilogue[] = {
+        0x49, 0x89, 0x06, // mov [r14], rax
+        0x4C, 0x89, 0xE8, // mov rax, r13
+        0x41, 0x5E,       // pop r14
+        0x41, 0x5D,       // pop r13
+        0x41, 0x5C,       // pop r12
+        0x5B,             // pop rbx
+        0x5D,             // pop rbp
+        0xC3,             // ret
+    };
+
+    jit->enter = (JitEntry)emitter->cursor;
+    emit_bytes(emitter, entry, sizeof(entry));
+
+    jit->epilogue = emitter->cursor;
+    emit_bytes(emitter, epilogue, sizeof(epilogue));
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Instructions >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool is_translatable(uint8_t id) {
+    switch (id) {
+    case INSTRUCTION_JMP:
+    case INSTRUCTION_JMPC:
+    case INSTRUCTION_ST:
+    case INSTRUCTION_LD:
+    case INSTRUCTION_SET:
+    case INSTRUCTION_SETU:
+    case INSTRUCTION_ADD:
+    case INSTRUCTION_SUB:
+    case INSTRUCTION_MUL:
+    case INSTRUCTION_AND:
+    case INSTRUCTION_OR:
+    case INSTRUCTION_XOR:
+    case INSTRUCTION_BSR:
+    case INSTRUCTION_BSRR:
+    case INSTRUCTION_BSL:
+    case INSTRUCTION_BSLR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_jump(uint8_t id) {
+    return id == INSTRUCTION_JMP || id == INSTRUCTION_JMPC;
+}
+
+/* eax = first source <op> second source or immediate, using the `op eax, r/m32` and `op eax, imm32` encodings */
+static void emit_alu_instruction(Emitter *emitter, const DecodedInstruction *decoded, uint8_t register_op_code,
+                                 uint8_t immediate_op_code) {
+    emit_load_eax(emitter, decoded->first_source_register);
+    if (decoded->use_immediate) {
+        emit_byte(emitter, immediate_op_code);
+        emit_u32(emitter, decoded->value);
+    } else {
+        emit_byte(emitter, register_op_code);
+        emit_byte(emitter, 0x43);
+        emit_byte(emitter, register_offset(decoded->second_source_register));
+    }
+    emit_store_eax(emitter, decoded->destination_register);
+}
+
+static void emit_mul_instruction(Emitter *emitter, const DecodedInstruction *decoded) {
+    emit_load_eax(emitter, decoded->first_source_register);
+    if (decoded->use_immediate) {
+        emit_byte(emitter, 0x69); // imul eax, eax, imm32
+        emit_byte(emitter, 0xC0);
+        emit_u32(emitter, decoded->value);
+    } else {
+        emit_byte(emitter, 0x0F); // imul eax, [rbx + register]
+        emit_byte(emitter, 0xAF);
+        emit_byte(emitter, 0x43);
+        emit_byte(emitter, register_offset(decoded->second_source_register));
+    }
+    emit_store_eax(emitter, decoded->destination_register);
+}
+
+/*
+ * The x86 shift group masks the count to 5 bits, which is what the interpreter's C shifts compile to on this host, so
+ * both agree for counts of 32 and above
+ */
+static void emit_shift_instruction(Emitter *emitter, const DecodedInstruction *decoded, uint8_t extension) {
+    emit_load_eax(emitter, decoded->first_source_register);
+    if (decoded->use_immediate) {
+        emit_byte(emitter, 0xC1);
+        emit_byte(emitter, 0xC0 | extension << 3);
+        emit_byte(emitter, decoded->value);
+    } else {
+        emit_load_ecx(emitter, decoded->second_source_register);
+        emit_byte(emitter, 0xD3);
+        emit_byte(emitter, 0xC0 | extension << 3);
+    }
+    emit_store_eax(emitter, decoded->destination_register);
+}
+
+static void emit_set_instruction(Emitter *emitter, const DecodedInstruction *decoded) {
+    emit_byte(emitter, 0xC7); // mov dword [rbx + register], imm32
+    emit_byte(emitter, 0x43);
+    emit_byte(emitter, register_offset(decoded->destination_register));
+    emit_u32(emitter, decoded->value);
+}
+
+static void emit_setu_instruction(Emitter *emitter, const DecodedInstruction *decoded) {
+    const uint32_t clear_upper_bits_bitmask = BITMASK_32 | BITMASK_25 | BITMASK_24_TO_1;
+
+    emit_byte(emitter, 0x81); // and dword [rbx + register], imm32
+    emit_byte(emitter, 0x63);
+    emit_byte(emitter, register_offset(decoded->destination_register));
+    emit_u32(emitter, clear_upper_bits_bitmask);
+    emit_byte(emitter, 0x81); // or dword [rbx + register], imm32
+    emit_byte(emitter, 0x4B);
+    emit_byte(emitter, register_offset(decoded->destination_register));
+    emit_u32(emitter, decoded->value);
+}
+
+/* Runs the interpreter handler and reports whether the block has to stop, because it trapped or discarded its own code */
+static uint32_t execute_memory_instruction(const DecodedInstruction *decoded, Cpu *cpu, Memory *memory) {
+    decoded->handler(decoded, cpu, memory);
+    bool code_modified = cpu->jit->code_modified;
+    cpu->jit->code_modified = false;
+    return code_modified || cpu->trap.kind != TRAP_NONE;
+}
+
+/*
+ * Calls execute_memory_instruction with the program counter set as the interpreter would have it. The returned rel32
+ * must be patched to a stub leaving the block.
+ */
+static uint8_t *emit_memory_instruction(Emitter *emitter, const DecodedInstruction *decoded, uint32_t address) {
+    emit_set_program_counter(emitter, address + 4);
+    emit_byte(emitter, 0x48); // mov rdi, decoded
+    emit_byte(emitter, 0xBF);
+    emit_u64(emitter, (uint64_t)(uintptr_t)decoded);
+    emit_byte(emitter, 0x48); // mov rsi, rbx
+    emit_byte(emitter, 0x89);
+    emit_byte(emitter, 0xDE);
+    emit_byte(emitter, 0x4C); // mov rdx, r12
+    emit_byte(emitter, 0x89);
+    emit_byte(emitter, 0xE2);
+    emit_byte(emitter, 0x48); // mov rax, execute_memory_instruction
+    emit_byte(emitter, 0xB8);
+    emit_u64(emitter, (uint64_t)(uintptr_t)execute_memory_instruction);
+    emit_byte(emitter, 0xFF); // call rax
+    emit_byte(emitter, 0xD0);
+
+    emit_byte(emitter, 0x85); // test eax, eax
+    emit_byte(emitter, 0xC0);
+    emit_byte(emitter, 0x0F); // jnz rel32
+    emit_byte(emitter, 0x85);
+    return emit_rel32(emitter);
+}
+
+/* eax = base register + offset register or immediate */
+static void emit_jump_target(Emitter *emitter, const DecodedInstruction *decoded) {
+    emit_load_eax(emitter, decoded->first_source_register);
+    if (decoded->use_immediate) {
+        emit_byte(emitter, 0x05); // add eax, imm32
+        emit_u32(emitter, decoded->value);
+    } else {
+        emit_byte(emitter, 0x03); // add eax, [rbx + register]
+        emit_byte(emitter, 0x43);
+        emit_byte(emitter, register_offset(decoded->second_source_register));
+    }
+}
+
+/*
+ * Stores eax as the program counter and leaves the block. Until the exit is linked the compare never matches and the
+ * exit returns to the dispatcher with rax pointing at the JitExit.
+ */
+static void emit_exit(Jit *jit, Emitter *emitter, JitBlock *block, JitExit *block_exit, uint32_t jump_address) {
+    block_exit->block = block;
+    block_exit->jump_address = jump_address;
+
+    emit_byte(emitter, 0x89); // mov [rbx + program counter], eax
+    emit_byte(emitter, 0x43);
+    emit_byte(emitter, PROGRAM_COUNTER_OFFSET);
+    emit_byte(emitter, 0x3D); // cmp eax, imm32
+    block_exit->linked_address = emitter->cursor;
+    emit_u32(emitter, UINT32_MAX);
+    emit_byte(emitter, 0x0F); // jne over the linked jump
+    emit_byte(emitter, 0x85);
+    emit_u32(emitter, 5);
+    emit_byte(emitter, 0xE9); // jmp rel32, falls through until linked
+    block_exit->linked_jump = emit_rel32(emitter);
+    emit_byte(emitter, 0x48); // mov rax, block exit
+    emit_byte(emitter, 0xB8);
+    emit_u64(emitter, (uint64_t)(uintptr_t)block_exit);
+    emit_jump(emitter, jit->epilogue);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Blocks >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static void register_block(Jit *jit, JitBlock *block) {
+    jit->blocks_by_address[block->start_address / 4] = block;
+    for (uint32_t i = 0; i < block->length; i++) {
+        jit->blocks_per_word[block->start_address / 4 + i]++;
+    }
+}
+
+static void unregister_block(Jit *jit, JitBlock *block) {
+    block->valid = false;
+    jit->blocks_by_address[block->start_address / 4] = NULL;
+    for (uint32_t i = 0; i < block->length; i++) {
+        jit->blocks_per_word[block->start_address / 4 + i]--;
+    }
+}
+
+/* Discards all translated code, only called from the dispatcher so no block is running */
+static void flush_jit(Jit *jit) {
+    for (uint32_t i = 0; i < jit->block_count; i++) {
+        if (jit->blocks[i].valid) {
+            unregister_block(jit, &jit->blocks[i]);
+        }
+    }
+    jit->block_count = 0;
+    jit->memory_instruction_count = 0;
+    jit->code_cursor = jit->first_block_code;
+    jit->generation++;
+}
+
+static bool has_space_for_block(const Jit *jit) {
+    return jit->block_count < JIT_MAX_BLOCKS &&
+           jit->memory_instruction_count + JIT_MAX_BLOCK_INSTRUCTIONS <= JIT_MAX_MEMORY_INSTRUCTIONS &&
+           jit->code_cursor + JIT_MAX_BLOCK_CODE_BYTES <= jit->code + JIT_CODE_BYTES;
+}
+
+static void emit_block(Jit *jit, JitBlock *block, const DecodedInstruction *instructions) {
+    Emitter emitter = init_emitter(jit, jit->code_cursor);
+    uint8_t *memory_exits[JIT_MAX_BLOCK_INSTRUCTIONS] = {NULL};
+
+    /* Leave straight away unless the whole block fits in the remaining budget, then pay for it up front */
+    block->code = emitter.cursor;
+    emit_byte(&emitter, 0x49); // cmp r13, length
+    emit_byte(&emitter, 0x81);
+    emit_byte(&emitter, 0xFD);
+    emit_u32(&emitter, block->length);
+    emit_byte(&emitter, 0x0F); // jb entry stub
+    emit_byte(&emitter, 0x82);
+    uint8_t *out_of_budget = emit_rel32(&emitter);
+    emit_byte(&emitter, 0x49); // sub r13, length
+    emit_byte(&emitter, 0x81);
+    emit_byte(&emitter, 0xED);
+    emit_u32(&emitter, block->length);
+
+    uint32_t exit_count = 0;
+    for (uint32_t i = 0; i < block->length; i++) {
+        const DecodedInstruction *decoded = &instructions[i];
+        uint32_t address = block->start_address + i * 4;
+        switch (decoded->id) {
+        case INSTRUCTION_ST:
+        case INSTRUCTION_LD: {
+            DecodedInstruction *kept = &jit->memory_instructions[jit->memory_instruction_count++];
+            *kept = *decoded;
+            memory_exits[i] = emit_memory_instruction(&emitter, kept, address);
+            break;
+        }
+        case INSTRUCTION_SET:
+            emit_set_instruction(&emitter, decoded);
+            break;
+        case INSTRUCTION_SETU:
+            emit_setu_instruction(&emitter, decoded);
+            break;
+        case INSTRUCTION_ADD:
+            emit_alu_instruction(&emitter, decoded, 0x03, 0x05);
+            break;
+        case INSTRUCTION_SUB:
+            emit_alu_instruction(&emitter, decoded, 0x2B, 0x2D);
+            break;
+        case INSTRUCTION_AND:
+            emit_alu_instruction(&emitter, decoded, 0x23, 0x25);
+            break;
+        case INSTRUCTION_OR:
+            emit_alu_instruction(&emitter, decoded, 0x0B, 0x0D);
+            break;
+        case INSTRUCTION_XOR:
+            emit_alu_instruction(&emitter, decoded, 0x33, 0x35);
+            break;
+        case INSTRUCTION_MUL:
+            emit_mul_instruction(&emitter, decoded);
+            break;
+        case INSTRUCTION_BSR:
+            emit_shift_instruction(&emitter, decoded, 5);
+            break;
+        case INSTRUCTION_BSRR:
+            emit_shift_instruction(&emitter, decoded, 1);
+            break;
+        case INSTRUCTION_BSL:
+            emit_shift_instruction(&emitter, decoded, 4);
+            break;
+        case INSTRUCTION_BSLR:
+            emit_shift_instruction(&emitter, decoded, 0);
+            break;
+        case INSTRUCTION_JMP:
+            emit_jump_target(&emitter, decoded);
+            emit_exit(jit, &emitter, block, &block->exits[exit_count++], address);
+            break;
+        case INSTRUCTION_JMPC: {
+            /* The jump is skipped when the control register holds a non zero value */
+            emit_byte(&emitter, 0x83); // cmp dword [rbx + register], 0
+            emit_byte(&emitter, 0x7B);
+            emit_byte(&emitter, register_offset(decoded->control_register));
+            emit_byte(&emitter, 0x00);
+            emit_byte(&emitter, 0x0F); // jne rel32
+            emit_byte(&emitter, 0x85);
+            uint8_t *skip = emit_rel32(&emitter);
+            emit_jump_target(&emitter, decoded);
+            emit_exit(jit, &emitter, block, &block->exits[exit_count++], address);
+            patch_rel32(&emitter, skip, emitter.cursor);
+            break;
+        }
+        }
+    }
+
+    /* Fall through to the next instruction, either after a skipped JMPC or because the block was cut short */
+    if (instructions[block->length - 1].id != INSTRUCTION_JMP) {
+        emit_move_eax(&emitter, block->start_address + block->length * 4);
+        emit_exit(jit, &emitter, block, &block->exits[exit_count++], UINT32_MAX);
+    }
+
+    /*
+     * A memory instruction that trapped or discarded translated code leaves right after itself, refunding what it did
+     * not execute. The dispatcher takes a trap back off the step count and the program counter.
+     */
+    for (uint32_t i = 0; i < block->length; i++) {
+        if (memory_exits[i] != NULL) {
+            patch_rel32(&emitter, memory_exits[i], emitter.cursor);
+            emit_refund_budget(&emitter, block->length - i - 1);
+            emit_set_program_counter(&emitter, block->start_address + (i + 1) * 4);
+            emit_byte(&emitter, 0x31); // xor eax, eax
+            emit_byte(&emitter, 0xC0);
+            emit_jump(&emitter, jit->epilogue);
+        }
+    }
+
+    block->entry_stub = emitter.cursor;
+    patch_rel32(&emitter, out_of_budget, emitter.cursor);
+    emit_set_program_counter(&emitter, block->start_address);
+    emit_byte(&emitter, 0x31); // xor eax, eax
+    emit_byte(&emitter, 0xC0);
+    emit_jump(&emitter, jit->epilogue);
+
+    jit->code_cursor = emitter.cursor;
+}
+
+/* Returns NULL when the first instruction cannot be translated */
+static JitBlock *translate_block(Jit *jit, uint32_t start_address, Memory *memory) {
+    DecodedInstruction instructions[JIT_MAX_BLOCK_INSTRUCTIONS];
+    uint32_t length = 0;
+    for (uint32_t address = start_address; length < JIT_MAX_BLOCK_INSTRUCTIONS && address <= memory->size_bytes - 4;
+         address += 4) {
+        decode_instruction(read_word(memory, address), &instructions[length]);
+        if (!is_translatable(instructions[length].id)) {
+            break;
+        }
+        if (is_jump(instructions[length++].id)) {
+            break;
+        }
+    }
+    if (length == 0) {
+        return NULL;
+    }
+
+    if (!has_space_for_block(jit)) {
+        flush_jit(jit);
+    }
+    JitBlock *block = &jit->blocks[jit->block_count++];
+    *block = (JitBlock){0};
+    block->start_address = start_address;
+    block->length = length;
+    block->valid = true;
+    emit_block(jit, block, instructions);
+    register_block(jit, block);
+    return block;
+}
+
+/* Makes the block unreachable, any exit still linked to it lands on its entry stub and returns to the dispatcher */
+static void discard_block(Jit *jit, JitBlock *block) {
+    unregister_block(jit, block);
+    Emitter emitter = init_emitter(jit, block->code);
+    emit_jump(&emitter, block->entry_stub);
+}
+
+static void link_exit(const Jit *jit, JitExit *block_exit, const JitBlock *block) {
+    Emitter emitter = init_emitter(jit, NULL);
+    patch_u32(&emitter, block_exit->linked_address, block->start_address);
+    patch_rel32(&emitter, block_exit->linked_jump, block->code);
+}
+
+/* Translated code is thrown away when the CPU moves onto a memory of another size, returns false if out of memory */
+static bool fit_jit_to_memory(Jit *jit, const Memory *memory) {
+    uint32_t word_count = memory->size_bytes / 4;
+    if (jit->word_count == word_count) {
+        return true;
+    }
+
+    flush_jit(jit);
+    free(jit->blocks_by_address);
+    free(jit->blocks_per_word);
+    jit->blocks_by_address = calloc(word_count, sizeof(JitBlock *));
+    jit->blocks_per_word = calloc(word_count, sizeof(uint16_t));
+    if (jit->blocks_by_address == NULL || jit->blocks_per_word == NULL) {
+        free(jit->blocks_by_address);
+        free(jit->blocks_per_word);
+        jit->blocks_by_address = NULL;
+        jit->blocks_per_word = NULL;
+        jit->word_count = 0;
+        return false;
+    }
+    jit->word_count = word_count;
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static int create_code_file() {
+#if defined(__linux__)
+    return memfd_create("jit_code", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/jit_code_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1) {
+        unlink(path);
+    }
+    return fd;
+#endif
+}
+
+/* Maps the code buffer at two addresses, returns false if the file or either mapping cannot be created */
+static bool map_code(Jit *jit) {
+    int fd = create_code_file();
+    if (fd == -1) {
+        return false;
+    }
+    jit->code = MAP_FAILED;
+    jit->writable_code = MAP_FAILED;
+    if (ftruncate(fd, JIT_CODE_BYTES) == 0) {
+        jit->code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        jit->writable_code = mmap(NULL, JIT_CODE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (jit->code == MAP_FAILED || jit->writable_code == MAP_FAILED) {
+        if (jit->code != MAP_FAILED) {
+            munmap(jit->code, JIT_CODE_BYTES);
+        }
+        if (jit->writable_code != MAP_FAILED) {
+            munmap(jit->writable_code, JIT_CODE_BYTES);
+        }
+        return false;
+    }
+    return true;
+}
+
+Jit *init_jit() {
+    Jit *jit = calloc(1, sizeof(Jit));
+    if (jit == NULL) {
+        return NULL;
+    }
+    if (!map_code(jit)) {
+        free(jit);
+        return NULL;
+    }
+
+    Emitter emitter = init_emitter(jit, jit->code);
+    emit_trampoline(jit, &emitter);
+    jit->first_block_code = emitter.cursor;
+    jit->code_cursor = emitter.cursor;
+    return jit;
+}
+
+void free_jit(Jit *jit) {
+    if (jit == NULL) {
+        return;
+    }
+    munmap(jit->code, JIT_CODE_BYTES);
+    munmap(jit->writable_code, JIT_CODE_BYTES);
+    free(jit->blocks_by_address);
+    free(jit->blocks_per_word);
+    free(jit);
+}
+
+bool invalidate_jit(Jit *jit, uint32_t first_location, uint32_t last_location) {
+    bool invalidated = false;
+    for (uint32_t word = first_location / 4;
+         word <= last_location / 4 && word < jit->word_count && first_location <= last_location; word++) {
+        if (jit->blocks_per_word[word] == 0) {
+            continue;
+        }
+
+        /* Blocks are contiguous, so any block covering this word starts at most one block length before it */
+        uint32_t first_start = word >= JIT_MAX_BLOCK_INSTRUCTIONS ? word - JIT_MAX_BLOCK_INSTRUCTIONS + 1 : 0;
+        for (uint32_t start = first_start; start <= word; start++) {
+            JitBlock *block = jit->blocks_by_address[start];
+            if (block != NULL && start + block->length > word) {
+                discard_block(jit, block);
+                invalidated = true;
+            }
+        }
+    }
+    jit->code_modified |= invalidated;
+    return invalidated;
+}
+
+bool translate_jit_block(Jit *jit, Memory *memory, uint32_t address) {
+    if (!fit_jit_to_memory(jit, memory) || address % 4 != 0 || address > memory->size_bytes - 4) {
+        return false;
+    }
+    if (jit->blocks_by_address[address / 4] == NULL) {
+        translate_block(jit, address, memory);
+    }
+    return jit->blocks_by_address[address / 4] != NULL;
+}
+
+/*
+ * Enters translated code at the program counter and keeps going until the budget is used up or an exit returns to
+ * this loop. Exits returning here are linked to the block they lead to, unless doing so would turn a jump onto its
+ * own address, which halts, into a native infinite loop. Anything that cannot be translated runs one instruction at a
+ * time on the interpreter.
+ */
+RunResult run_jit(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    Jit *jit = cpu->jit;
+    if (!fit_jit_to_memory(jit, memory)) {
+        return run_interpreter(cpu, memory, max_steps);
+    }
+    RunResult result = {CPU_STATUS_STEP_LIMIT, 0};
+    JitExit *previous_exit = NULL;
+    cpu->trap.kind = TRAP_NONE;
+    uint32_t previous_generation = jit->generation;
+
+    while (result.steps < max_steps) {
+        uint64_t budget = max_steps - result.steps;
+        uint32_t address = cpu->program_counter;
+        JitBlock *block = NULL;
+        if (address % 4 == 0 && address <= memory->size_bytes - 4) {
+            block = jit->blocks_by_address[address / 4];
+            if (block == NULL) {
+                block = translate_block(jit, address, memory);
+            }
+        }
+
+        if (block == NULL || block->length > budget) {
+            RunResult step = run_interpreter(cpu, memory, 1);
+            result.steps += step.steps;
+            if (step.status != CPU_STATUS_STEP_LIMIT) {
+                result.status = step.status;
+                result.trap = step.trap;
+                break;
+            }
+            previous_exit = NULL;
+            continue;
+        }
+
+        if (previous_exit != NULL && previous_generation == jit->generation && previous_exit->block->valid) {
+            link_exit(jit, previous_exit, block);
+        }
+
+        JitExit *taken_exit = NULL;
+        jit->code_modified = false;
+        uint64_t remaining = jit->enter(cpu, memory, budget, block->code, &taken_exit);
+        result.steps += budget - remaining;
+        if (cpu->trap.kind != TRAP_NONE) {
+            result.steps--;
+            cpu->program_counter -= 4;
+            cpu->trap.program_counter = cpu->program_counter;
+            result.status = CPU_STATUS_FAULT;
+            result.trap = cpu->trap;
+            break;
+        }
+        if (taken_exit != NULL && taken_exit->jump_address == cpu->program_counter) {
+            result.status = CPU_STATUS_HALTED;
+            break;
+        }
+        previous_exit = taken_exit;
+        previous_generation = jit->generation;
+    }
+    return result;
+}
+
+#else
+
+Jit *init_jit() {
+    return NULL;
+}
+
+void free_jit(Jit *jit) {
+}
+
+RunResult run_jit(Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    return run_interpreter(cpu, memory, max_steps);
+}
+
+bool invalidate_jit(Jit *jit, uint32_t first_location, uint32_t last_location) {
+    return false;
+}
+
+bool translate_jit_block(Jit *jit, Memory *memory, uint32_t address) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct Jit Jit;
+
+/* Returns NULL when the host is not x86-64 or executable memory cannot be mapped */
+Jit *init_jit(void);
+
+void free_jit(Jit *jit);
+
+RunResult run_jit(Cpu *cpu, Memory *memory, uint64_t max_steps);
+
+/* Discards every translated block overlapping the inclusive byte range, returns true if any block was discarded */
+bool invalidate_jit(Jit *jit, uint32_t first_location, uint32_t last_location);
+
+/* Translates the block starting at the address ahead of its first run, returns true if a block now starts there */
+bool translate_jit_block(Jit *jit, Memory *memory, uint32_t address);
+
+#endif
@@ -0,0 +1,33 @@
+/*********************************************************************************************************************
+ * Puts programs into memory                                                                                         *
+ *                                                                                                                   *
+ * Images on disk are the raw big endian memory contents from address 0, so loading one is a single mapping of the   *
+ * file over the memory's data rather than a copy.                                                                   *
+ *********************************************************************************************************************/
+
+#include "loader.h"
+#include "assembler.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+Memory *load_program_image(int fd, uint32_t size_bytes) {
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size > size_bytes) {
+        return NULL;
+    }
+    return init_memory_from_file(fd, status.st_size, size_bytes);
+}
+
+bool load_program(Memory *memory, const Program *program) {
+    if (program->word_count > memory->size_bytes / 4) {
+        return false;
+    }
+    for (uint32_t i = 0; i < program->word_count; i++) {
+        mark_memory_dirty(memory, i * 4);
+        store_memory_word(memory, i * 4, program->words[i]);
+    }
+    return true;
+}
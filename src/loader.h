@@ -0,0 +1,19 @@
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include "assembler.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * Maps a program image, as written by write_program_image, to address 0 of a new memory of size_bytes. Nothing is
+ * copied up front: pages are read from the file on first touch and stay shared with every other memory loaded from
+ * the same file until written. Returns NULL when the file cannot be mapped or is larger than size_bytes.
+ */
+Memory *load_program_image(int fd, uint32_t size_bytes);
+
+/* Copies the program to address 0, returns false when it does not fit */
+bool load_program(Memory *memory, const Program *program);
+
+#endif
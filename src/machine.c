@@ -0,0 +1,75 @@
+/*********************************************************************************************************************
+ * Runs several cores against one shared memory                                                                      *
+ *                                                                                                                   *
+ * Cores share nothing but the memory, each keeps its own registers, decode cache, threaded program and JIT, so the  *
+ * host threads driving them only ever meet in guest memory                                                          *
+ *********************************************************************************************************************/
+
+#include "machine.h"
+#include "cpu.h"
+#include "memory.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct CoreRun {
+    Machine *machine;
+    uint32_t core;
+    uint64_t max_steps;
+} CoreRun;
+
+Machine *init_machine(uint32_t core_count, CpuBackend backend, Memory *memory) {
+    if (core_count == 0 || core_count > MACHINE_MAX_CORES) {
+        return NULL;
+    }
+    Machine *machine = calloc(1, sizeof(Machine));
+    if (machine == NULL) {
+        return NULL;
+    }
+    machine->memory = memory;
+    machine->core_count = core_count;
+    for (uint32_t i = 0; i < core_count; i++) {
+        machine->cores[i] = init_cpu(backend);
+    }
+    return machine;
+}
+
+void free_machine(Machine *machine) {
+    if (machine == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < machine->core_count; i++) {
+        free_cpu(&machine->cores[i]);
+    }
+    free(machine);
+}
+
+static void *run_core(void *argument) {
+    CoreRun *run = argument;
+    Machine *machine = run->machine;
+    machine->results[run->core] = run_cpu(&machine->cores[run->core], machine->memory, run->max_steps);
+    return NULL;
+}
+
+/* The calling thread runs the first core itself, a core whose thread cannot be started runs on it afterwards */
+void run_machine(Machine *machine, uint64_t max_steps) {
+    CoreRun runs[MACHINE_MAX_CORES];
+    pthread_t threads[MACHINE_MAX_CORES];
+    bool started[MACHINE_MAX_CORES] = {false};
+
+    for (uint32_t i = 0; i < machine->core_count; i++) {
+        runs[i] = (CoreRun){machine, i, max_steps};
+        if (i > 0) {
+            started[i] = pthread_create(&threads[i], NULL, run_core, &runs[i]) == 0;
+        }
+    }
+    run_core(&runs[0]);
+    for (uint32_t i = 1; i < machine->core_count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            run_core(&runs[i]);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+
+#define MACHINE_MAX_CORES 64
+
+/*
+ * Several cores sharing one memory, each run on its own host thread. Memory accesses follow the ordering model in
+ * memory.h. Instruction fetch is not coherent between cores: stores only drop the storing core's predecoded copies,
+ * so a core running code another core wrote must call invalidate_decoded_instructions first.
+ */
+typedef struct Machine {
+    Memory *memory; // Not owned, free it after the machine
+    uint32_t core_count;
+    Cpu cores[MACHINE_MAX_CORES];
+    RunResult results[MACHINE_MAX_CORES]; // Of each core's last run
+} Machine;
+
+/* Returns NULL when the core count is zero or above MACHINE_MAX_CORES, or the machine cannot be allocated */
+Machine *init_machine(uint32_t core_count, CpuBackend backend, Memory *memory);
+
+void free_machine(Machine *machine);
+
+/* Runs every core for up to max_steps on its own thread and returns once all of them have stopped */
+void run_machine(Machine *machine, uint64_t max_steps);
+
+#endif
@@ -1,14 +1,73 @@
 /*********************************************************************************************************************
  * Simulates a DRAM device                                                                                           *
+ *                                                                                                                   *
+ * The struct, its dirty bits and its data share one anonymous mapping, the kernel hands out zeroed pages on first   *
+ * touch so a fresh memory costs a single system call no matter how large it is                                      *
  *********************************************************************************************************************/
 
 #include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-Memory init_memory() {
-    Memory memory;
-    for (uint32_t i = 0; i < MEMORY_SIZE_BYTES; i++) {
-        memory.data[i] = 0;
+/* Rounded up to whole host pages so the data can be remapped on its own, as forks of a snapshot do */
+static uint32_t memory_header_bytes(uint32_t size_bytes) {
+    uint32_t page_count = (size_bytes + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES;
+    uint32_t bytes = sizeof(Memory) + (page_count + 63) / 64 * sizeof(uint64_t);
+    uint32_t host_page_bytes = sysconf(_SC_PAGESIZE);
+    return (bytes + host_page_bytes - 1) / host_page_bytes * host_page_bytes;
+}
+
+static bool is_valid_memory_size(uint32_t size_bytes) {
+    return size_bytes != 0 && size_bytes % 4 == 0 && size_bytes <= MEMORY_MAX_SIZE_BYTES;
+}
+
+Memory *init_memory(uint32_t size_bytes) {
+    if (!is_valid_memory_size(size_bytes)) {
+        return NULL;
+    }
+
+    uint32_t header_bytes = memory_header_bytes(size_bytes);
+    /* Pages are only backed once touched, so a large memory used sparsely costs what it uses */
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    void *mapping = mmap(NULL, header_bytes + size_bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+    Memory *memory = mapping;
+    memory->size_bytes = size_bytes;
+    memory->header_bytes = header_bytes;
+    memory->dirty_pages = (uint64_t *)((uint8_t *)mapping + sizeof(Memory));
+    memory->data = (uint8_t *)mapping + header_bytes;
+    return memory;
+}
+
+Memory *init_memory_from_file(int fd, uint32_t file_bytes, uint32_t size_bytes) {
+    if (file_bytes > size_bytes) {
+        return NULL;
+    }
+    Memory *memory = init_memory(size_bytes);
+    if (memory == NULL || file_bytes == 0) {
+        return memory;
+    }
+
+    /*
+     * Replaces the anonymous data pages in place, the header stays where init_memory put it. Only the pages holding
+     * the file are replaced, touching a page wholly past its end would fault while the anonymous ones read as zero.
+     */
+    void *data = mmap(memory->data, file_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (data == MAP_FAILED) {
+        free_memory(memory);
+        return NULL;
     }
     return memory;
 }
+
+void free_memory(Memory *memory) {
+    if (memory == NULL) {
+        return;
+    }
+    munmap(memory, memory->header_bytes + memory->size_bytes);
+}
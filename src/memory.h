@@ -4,12 +4,130 @@
 #include <inttypes.h>
 
 /* Memory sizes */
-#define MEMORY_SIZE_BYTES 1048576 // 1MB
+#define MEMORY_SIZE_BYTES     1048576  // 1MB, the default size
+#define MEMORY_MAX_SIZE_BYTES 67108864 // 64MB, as far as an LD/ST immediate offset reaches
+#define MEMORY_PAGE_BYTES     4096     // Granularity of dirty tracking and copy on write sharing
 
 typedef struct Memory {
-    uint8_t data[MEMORY_SIZE_BYTES]; 
+    uint32_t size_bytes;
+    uint32_t header_bytes; // Bytes mapped in front of the data, holding this struct and the dirty bits
+    uint64_t *dirty_pages; // One bit per page written since the memory was created, snapshotted or restored
+    uint64_t snapshot_id;  // Snapshot the dirty bits are relative to, 0 for none
+    uint8_t *data;         // Page aligned, inside the same mapping as the struct
 } Memory;
 
-Memory init_memory(void);
+/* Returns NULL when the size is zero, not a whole number of words, above the maximum or cannot be mapped */
+Memory *init_memory(uint32_t size_bytes);
+
+/*
+ * Maps the first file_bytes of the file copy on write to the start of the memory, pages are only copied once the memory
+ * writes to them and the rest of the memory reads as zero. Returns NULL when the file does not fit into size_bytes.
+ */
+Memory *init_memory_from_file(int fd, uint32_t file_bytes, uint32_t size_bytes);
+
+void free_memory(Memory *memory);
+
+/*
+ * Memory ordering: every aligned access is single copy atomic, so a core never observes half of another core's store.
+ * Loads have acquire and stores release semantics: a core which loads a value another core stored also sees every
+ * store that core made before it. That does not make all cores agree on the order of stores to different locations,
+ * only an x86 host adds that, as it compiles both to plain moves which are ordered by total store order there.
+ */
+#if defined(__GNUC__)
+#define MEMORY_LOAD(pointer)         __atomic_load_n(pointer, __ATOMIC_ACQUIRE)
+#define MEMORY_STORE(pointer, value) __atomic_store_n(pointer, value, __ATOMIC_RELEASE)
+#define MEMORY_FETCH(pointer)        __atomic_load_n(pointer, __ATOMIC_RELAXED)
+#else
+#define MEMORY_LOAD(pointer)         (*(pointer))
+#define MEMORY_STORE(pointer, value) (*(pointer) = (value))
+#define MEMORY_FETCH(pointer)        (*(pointer))
+#endif
+
+/* Memory is big endian, the most significant byte sits at the lowest address */
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MEMORY_SWAP_32(value) __builtin_bswap32(value)
+#define MEMORY_SWAP_16(value) __builtin_bswap16(value)
+#elif defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MEMORY_SWAP_32(value) (value)
+#define MEMORY_SWAP_16(value) (value)
+#endif
+
+/* Stores executed by the CPU mark their page, anything else writing to data must do the same */
+static inline void mark_memory_dirty(Memory *memory, uint32_t location) {
+    uint32_t page = location / MEMORY_PAGE_BYTES;
+    uint64_t bit = UINT64_C(1) << (page % 64);
+    uint64_t *dirty_pages = &memory->dirty_pages[page / 64];
+
+    /* Only the first store to a page writes the shared word, so cores storing to one page do not fight over it */
+    if ((MEMORY_FETCH(dirty_pages) & bit) == 0) {
+#if defined(__GNUC__)
+        __atomic_fetch_or(dirty_pages, bit, __ATOMIC_RELAXED);
+#else
+        *dirty_pages |= bit;
+#endif
+    }
+}
+
+#if defined(MEMORY_SWAP_32)
+
+/* The address is that of the first byte and must be aligned to the access size */
+static inline uint32_t load_memory_word(const Memory *memory, uint32_t address) {
+    return MEMORY_SWAP_32(MEMORY_LOAD((const uint32_t *)&memory->data[address]));
+}
+
+static inline uint16_t load_memory_half_word(const Memory *memory, uint32_t address) {
+    return MEMORY_SWAP_16(MEMORY_LOAD((const uint16_t *)&memory->data[address]));
+}
+
+static inline void store_memory_word(Memory *memory, uint32_t address, uint32_t value) {
+    MEMORY_STORE((uint32_t *)&memory->data[address], MEMORY_SWAP_32(value));
+}
+
+static inline void store_memory_half_word(Memory *memory, uint32_t address, uint16_t value) {
+    MEMORY_STORE((uint16_t *)&memory->data[address], MEMORY_SWAP_16(value));
+}
+
+/* Instruction fetch only needs the word to be read whole, it is not ordered against other cores */
+static inline uint32_t read_word(const Memory *memory, uint32_t location) {
+    return MEMORY_SWAP_32(MEMORY_FETCH((const uint32_t *)&memory->data[location]));
+}
+
+#else
+
+/* Without a known byte order words are assembled a byte at a time, which is only atomic on a single core */
+static inline uint32_t load_memory_word(const Memory *memory, uint32_t address) {
+    return (uint32_t)memory->data[address] << 24 | (uint32_t)memory->data[address + 1] << 16 |
+           (uint32_t)memory->data[address + 2] << 8 | memory->data[address + 3];
+}
+
+static inline uint16_t load_memory_half_word(const Memory *memory, uint32_t address) {
+    return (uint16_t)(memory->data[address] << 8 | memory->data[address + 1]);
+}
+
+static inline void store_memory_word(Memory *memory, uint32_t address, uint32_t value) {
+    memory->data[address] = value >> 24;
+    memory->data[address + 1] = value >> 16;
+    memory->data[address + 2] = value >> 8;
+    memory->data[address + 3] = value;
+}
+
+static inline void store_memory_half_word(Memory *memory, uint32_t address, uint16_t value) {
+    memory->data[address] = value >> 8;
+    memory->data[address + 1] = value;
+}
+
+static inline uint32_t read_word(const Memory *memory, uint32_t location) {
+    return load_memory_word(memory, location);
+}
+
+#endif
+
+static inline uint8_t load_memory_byte(const Memory *memory, uint32_t address) {
+    return MEMORY_LOAD(&memory->data[address]);
+}
+
+static inline void store_memory_byte(Memory *memory, uint32_t address, uint8_t value) {
+    MEMORY_STORE(&memory->data[address], value);
+}
 
 #endif
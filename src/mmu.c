@@ -0,0 +1,87 @@
+/*********************************************************************************************************************
+ * Memory management unit                                                                                            *
+ *                                                                                                                   *
+ * Translation is inlined into the run loop as a single TLB compare, everything here is the slow path behind it: the *
+ * page table walk on a miss and the registers the guest changes the page tables through.                           *
+ *********************************************************************************************************************/
+
+#include "mmu.h"
+#include "bus.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+Mmu *init_mmu(uint32_t root) {
+    if (root % MMU_PAGE_BYTES != 0) {
+        return NULL;
+    }
+    Mmu *mmu = malloc(sizeof(Mmu));
+    if (mmu == NULL) {
+        return NULL;
+    }
+    mmu->root = root;
+    mmu->tlb_misses = 0;
+    mmu->page_faults = 0;
+    flush_mmu(mmu);
+    return mmu;
+}
+
+void free_mmu(Mmu *mmu) {
+    free(mmu);
+}
+
+void flush_mmu(Mmu *mmu) {
+    for (uint32_t i = 0; i < MMU_TLB_ENTRIES; i++) {
+        mmu->tlb[i] = (TlbEntry){MMU_TLB_INVALID, MMU_TLB_INVALID, MMU_TLB_INVALID, 0};
+    }
+}
+
+uint32_t read_mmu(void *device, uint32_t offset, uint32_t width) {
+    Mmu *mmu = device;
+    return read_register_bytes((offset & ~UINT32_C(3)) == MMU_ROOT ? mmu->root : 0, offset, width);
+}
+
+void write_mmu(void *device, uint32_t offset, uint32_t width, uint32_t value) {
+    Mmu *mmu = device;
+    switch (offset & ~UINT32_C(3)) {
+    case MMU_ROOT:
+        mmu->root = value & MMU_ENTRY_ADDRESS;
+        flush_mmu(mmu);
+        break;
+    case MMU_FLUSH:
+        flush_mmu(mmu);
+        break;
+    }
+}
+
+/* Entries outside of memory read as invalid */
+static uint32_t load_entry(const Memory *memory, uint32_t table, uint32_t index) {
+    uint32_t address = table + index * 4;
+    return address >= table && address < memory->size_bytes ? load_memory_word(memory, address) : 0;
+}
+
+bool walk_page_tables(Mmu *mmu, const Memory *memory, uint32_t address, MmuAccess access, uint32_t *physical_address) {
+    mmu->tlb_misses++;
+    uint32_t page = address >> MMU_PAGE_SHIFT;
+    uint32_t directory_entry = load_entry(memory, mmu->root, page >> 10);
+    uint32_t table_entry = 0;
+    if ((directory_entry & MMU_ENTRY_VALID) != 0) {
+        table_entry = load_entry(memory, directory_entry & MMU_ENTRY_ADDRESS, page & 0x3FF);
+    }
+    uint32_t required = access == MMU_ACCESS_WRITE     ? MMU_ENTRY_WRITABLE
+                        : access == MMU_ACCESS_EXECUTE ? MMU_ENTRY_EXECUTE
+                                                       : 0;
+    if ((table_entry & (MMU_ENTRY_VALID | required)) != (MMU_ENTRY_VALID | required)) {
+        mmu->page_faults++;
+        return false;
+    }
+
+    TlbEntry *entry = &mmu->tlb[page % MMU_TLB_ENTRIES];
+    entry->read_tag = page;
+    entry->write_tag = (table_entry & MMU_ENTRY_WRITABLE) != 0 ? page : MMU_TLB_INVALID;
+    entry->execute_tag = (table_entry & MMU_ENTRY_EXECUTE) != 0 ? page : MMU_TLB_INVALID;
+    entry->physical_base = table_entry & MMU_ENTRY_ADDRESS;
+    *physical_address = entry->physical_base | (address & (MMU_PAGE_BYTES - 1));
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef _MMU_H_
+#define _MMU_H_
+
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * Two level page tables in guest memory, 4KB pages. The page directory at the root holds 1024 big endian words, one
+ * for each 4MB of the virtual address space, and each valid one points at a page table of 1024 words, one for each
+ * page. Both kinds of entries hold a page aligned physical address in their upper 20 bits and flags in the lower 12.
+ */
+#define MMU_PAGE_BYTES     4096
+#define MMU_PAGE_SHIFT     12
+#define MMU_ENTRY_VALID    0x1 // Directory and table entries, every other flag only applies to table entries
+#define MMU_ENTRY_WRITABLE 0x2 // ST may use the page
+#define MMU_ENTRY_EXECUTE  0x4 // Instructions may be fetched from the page
+#define MMU_ENTRY_ADDRESS  0xFFFFF000
+
+#define MMU_TLB_ENTRIES 256
+#define MMU_TLB_INVALID UINT32_MAX // Tag no virtual page number can match
+
+/* Register offsets of the MMU, all of them words */
+#define MMU_BYTES 0x8
+#define MMU_ROOT  0x0 // Physical address of the page directory, storing it flushes the TLB
+#define MMU_FLUSH 0x4 // Any store flushes the TLB, needed after changing an entry which may be cached
+
+typedef enum MmuAccess {
+    MMU_ACCESS_READ,
+    MMU_ACCESS_WRITE,
+    MMU_ACCESS_EXECUTE,
+} MmuAccess;
+
+/* One tag per kind of access, so checking the permission is part of the single compare of a hit */
+typedef struct TlbEntry {
+    uint32_t read_tag;      // Virtual page number, or MMU_TLB_INVALID
+    uint32_t write_tag;     // Virtual page number if the page is writable, or MMU_TLB_INVALID
+    uint32_t execute_tag;   // Virtual page number if the page is executable, or MMU_TLB_INVALID
+    uint32_t physical_base; // Physical address of the page
+} TlbEntry;
+
+/*
+ * Memory management unit of one CPU, attached to Cpu.mmu. While attached, every address the CPU uses is virtual:
+ * instruction fetch and LD / ST translate through a direct mapped software TLB, and walk the page tables on a miss. An
+ * address the page tables do not map, or not for that kind of access, raises TRAP_PAGE_FAULT.
+ *
+ * Memory is the physical memory. Its pages only take up host memory once touched, so a sparse guest mapping a few
+ * pages here and there across its 4GB virtual address space costs no more than those pages. Physical addresses past
+ * the end of memory go to the bus, which is also where the MMU's own registers can be mapped with read_mmu and
+ * write_mmu.
+ */
+typedef struct Mmu {
+    uint32_t root;
+    TlbEntry tlb[MMU_TLB_ENTRIES];
+    uint64_t tlb_misses;
+    uint64_t page_faults;
+} Mmu;
+
+/* Returns NULL when the root is not page aligned or the MMU cannot be allocated */
+Mmu *init_mmu(uint32_t root);
+
+void free_mmu(Mmu *mmu);
+
+void flush_mmu(Mmu *mmu);
+
+uint32_t read_mmu(void *mmu, uint32_t offset, uint32_t width);
+
+void write_mmu(void *mmu, uint32_t offset, uint32_t width, uint32_t value);
+
+/* Slow path of translate_address, walks the page tables and fills the TLB. Counts a page fault when it returns false */
+bool walk_page_tables(Mmu *mmu, const Memory *memory, uint32_t address, MmuAccess access, uint32_t *physical_address);
+
+/* Access is a constant everywhere this is inlined, which leaves one load and compare of the tag on a hit */
+static inline bool translate_address(Mmu *mmu, const Memory *memory, uint32_t address, MmuAccess access,
+                                     uint32_t *physical_address) {
+    uint32_t page = address >> MMU_PAGE_SHIFT;
+    const TlbEntry *entry = &mmu->tlb[page % MMU_TLB_ENTRIES];
+    uint32_t tag = access == MMU_ACCESS_READ    ? entry->read_tag
+                   : access == MMU_ACCESS_WRITE ? entry->write_tag
+                                                : entry->execute_tag;
+    if (tag == page) {
+        *physical_address = entry->physical_base | (address & (MMU_PAGE_BYTES - 1));
+        return true;
+    }
+    return walk_page_tables(mmu, memory, address, access, physical_address);
+}
+
+#endif
@@ -0,0 +1,351 @@
+/*********************************************************************************************************************
+ * Lock step execution of many guests on the host's vector units                                                     *
+ *                                                                                                                   *
+ * Lane masks hold all ones for lanes taking part in a step and zero otherwise. SET, SETU, ADD, SUB, MUL, AND, OR,    *
+ * XOR, the shifts and both jumps run as vector operations blended into the registers under the mask. LD, ST, DIV,   *
+ * MOD and the invalid encodings run lane by lane through the interpreter handlers, which also raise their traps.   *
+ *********************************************************************************************************************/
+
+#include "pack.h"
+#include "bit_utils.h"
+#include "cpu.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__)
+
+#define PACK_DECODE_ENTRIES 1024 // Must be a power of two
+
+typedef uint32_t PackVector __attribute__((vector_size(PACK_LANES * sizeof(uint32_t))));
+typedef uint64_t PackSteps __attribute__((vector_size(PACK_LANES * sizeof(uint64_t))));
+
+/* Vectors are only passed by pointer, wider than SSE they would otherwise depend on the AVX calling convention */
+#define BROADCAST(value)                 ((PackVector){0} + (uint32_t)(value))
+#define SELECT_LANES(mask, set, clear)   (((mask) & (set)) | (~(mask) & (clear)))
+#define SECOND_OPERAND(pack, decoded)                                                                                  \
+    ((decoded)->use_immediate ? BROADCAST((decoded)->value) : (pack)->registers[(decoded)->second_source_register])
+
+/*
+ * Decoded from the leading lane's memory. The other lanes are checked to hold the same word the first time they step
+ * through it, stores drop the entry for the word they write so a lane whose code changed is checked again.
+ */
+typedef struct PackDecodeEntry {
+    uint32_t address;
+    uint32_t word;
+    uint32_t checked_lanes; // One bit per lane
+    DecodedInstruction instruction;
+} PackDecodeEntry;
+
+struct Pack {
+    PackVector program_counter;
+    PackVector registers[8];
+    uint32_t lane_count;
+    Memory *memories[PACK_LANES];
+    struct Bus *buses[PACK_LANES];
+    PackDecodeEntry decoded[PACK_DECODE_ENTRIES];
+};
+
+static bool any_lane(const PackVector *mask) {
+    uint32_t any = 0;
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        any |= (*mask)[lane];
+    }
+    return any != 0;
+}
+
+/* Every lane must have a memory of the same size, lanes may share one */
+Pack *init_pack(uint32_t lane_count, Memory *const *memories) {
+    if (lane_count == 0 || lane_count > PACK_LANES) {
+        return NULL;
+    }
+    for (uint32_t lane = 1; lane < lane_count; lane++) {
+        if (memories[lane]->size_bytes != memories[0]->size_bytes) {
+            return NULL;
+        }
+    }
+    size_t size = (sizeof(Pack) + sizeof(PackVector) - 1) / sizeof(PackVector) * sizeof(PackVector);
+    Pack *pack = aligned_alloc(sizeof(PackVector), size);
+    if (pack == NULL) {
+        return NULL;
+    }
+    memset(pack, 0, sizeof(Pack));
+    pack->lane_count = lane_count;
+    for (uint32_t lane = 0; lane < lane_count; lane++) {
+        pack->memories[lane] = memories[lane];
+    }
+    return pack;
+}
+
+void free_pack(Pack *pack) {
+    free(pack);
+}
+
+void set_pack_lane(Pack *pack, uint32_t lane, const Cpu *cpu) {
+    pack->buses[lane] = cpu->bus;
+    pack->program_counter[lane] = cpu->program_counter;
+    for (uint32_t i = 0; i < 8; i++) {
+        pack->registers[i][lane] = cpu->registers[i];
+    }
+}
+
+void get_pack_lane(const Pack *pack, uint32_t lane, Cpu *cpu) {
+    cpu->program_counter = pack->program_counter[lane];
+    for (uint32_t i = 0; i < 8; i++) {
+        cpu->registers[i] = pack->registers[i][lane];
+    }
+}
+
+static uint32_t lane_bits(const PackVector *mask) {
+    uint32_t bits = 0;
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        bits |= ((*mask)[lane] & 1) << lane;
+    }
+    return bits;
+}
+
+static PackDecodeEntry *get_pack_decode_entry(Pack *pack, uint32_t address) {
+    return &pack->decoded[(address >> 2) & (PACK_DECODE_ENTRIES - 1)];
+}
+
+static void invalidate_pack_decode_entries(Pack *pack) {
+    for (uint32_t i = 0; i < PACK_DECODE_ENTRIES; i++) {
+        pack->decoded[i].address = UINT32_MAX;
+    }
+}
+
+/* Lanes holding different code at the address wait for a later step, where they get to lead themselves */
+static const DecodedInstruction *decode_pack_instruction(Pack *pack, uint32_t leader, uint32_t address,
+                                                         PackVector *lanes) {
+    PackDecodeEntry *entry = get_pack_decode_entry(pack, address);
+    if (entry->address != address || (entry->checked_lanes & 1u << leader) == 0) {
+        entry->address = address;
+        entry->word = read_word(pack->memories[leader], address);
+        entry->checked_lanes = 1u << leader;
+        decode_instruction(entry->word, &entry->instruction);
+    }
+
+    uint32_t unchecked_lanes = lane_bits(lanes) & ~entry->checked_lanes;
+    for (uint32_t lane = 0; unchecked_lanes != 0; lane++, unchecked_lanes >>= 1) {
+        if ((unchecked_lanes & 1) == 0) {
+            continue;
+        }
+        if (read_word(pack->memories[lane], address) == entry->word) {
+            entry->checked_lanes |= 1u << lane;
+        } else {
+            (*lanes)[lane] = 0;
+        }
+    }
+    return &entry->instruction;
+}
+
+static void stop_lanes(const PackVector *lanes, PackVector *active, RunResult *results, CpuStatus status,
+                       const Trap *trap) {
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        if ((*lanes)[lane] != 0) {
+            results[lane].status = status;
+            results[lane].trap = trap != NULL ? *trap : (Trap){TRAP_NONE, 0, 0, 0};
+        }
+    }
+    *active &= ~*lanes;
+}
+
+/*
+ * Picks the running lane with the lowest program counter and every running lane sitting on the same address. While
+ * the lanes run in lock step they all sit on the previous leader's address and there is nothing to search for.
+ */
+static uint32_t select_step_lanes(const Pack *pack, const PackVector *active, uint32_t leader, PackVector *lanes) {
+    if ((*active)[leader] != 0) {
+        *lanes = *active & (PackVector)(pack->program_counter == BROADCAST(pack->program_counter[leader]));
+        PackVector behind = *lanes ^ *active;
+        if (!any_lane(&behind)) {
+            return leader;
+        }
+    }
+
+    leader = 0;
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        if ((*active)[lane] != 0 &&
+            ((*active)[leader] == 0 || pack->program_counter[lane] < pack->program_counter[leader])) {
+            leader = lane;
+        }
+    }
+    *lanes = *active & (PackVector)(pack->program_counter == BROADCAST(pack->program_counter[leader]));
+    return leader;
+}
+
+/* Runs the interpreter handler for each lane in turn, lanes that trap are stopped and taken off the mask */
+static void execute_lanes_in_turn(Pack *pack, const DecodedInstruction *decoded, PackVector *lanes,
+                                  PackVector *active, RunResult *results) {
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        if ((*lanes)[lane] == 0) {
+            continue;
+        }
+        Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+        get_pack_lane(pack, lane, &cpu);
+        cpu.bus = pack->buses[lane];
+        uint32_t address = cpu.program_counter;
+        cpu.program_counter += 4;
+        decoded->handler(decoded, &cpu, pack->memories[lane]);
+        if (decoded->id == INSTRUCTION_ST && cpu.trap.kind == TRAP_NONE) {
+            /* Any store fits inside the word holding its last byte */
+            uint32_t offset = decoded->use_immediate ? decoded->value : cpu.registers[decoded->second_source_register];
+            uint32_t word_address = (cpu.registers[decoded->first_source_register] + offset) & ~UINT32_C(3);
+            PackDecodeEntry *entry = get_pack_decode_entry(pack, word_address);
+            if (entry->address == word_address) {
+                entry->address = UINT32_MAX;
+            }
+        }
+        if (cpu.trap.kind != TRAP_NONE) {
+            cpu.trap.program_counter = address;
+            PackVector trapped = {0};
+            trapped[lane] = UINT32_MAX;
+            stop_lanes(&trapped, active, results, CPU_STATUS_FAULT, &cpu.trap);
+            (*lanes)[lane] = 0;
+            continue;
+        }
+        set_pack_lane(pack, lane, &cpu);
+    }
+}
+
+void run_pack(Pack *pack, uint64_t max_steps, RunResult *results) {
+    PackVector active = {0};
+    for (uint32_t lane = 0; lane < pack->lane_count; lane++) {
+        active[lane] = UINT32_MAX;
+        results[lane] = (RunResult){CPU_STATUS_STEP_LIMIT, 0};
+    }
+    PackSteps steps = {0};
+    if (max_steps == 0) {
+        return;
+    }
+    /* The memories may have been written since the last run */
+    invalidate_pack_decode_entries(pack);
+
+    uint32_t leader = 0;
+    uint64_t iterations = 0;
+    while (any_lane(&active)) {
+        PackVector lanes;
+        leader = select_step_lanes(pack, &active, leader, &lanes);
+        uint32_t address = pack->program_counter[leader];
+        if (address % 4 != 0 || address > pack->memories[leader]->size_bytes - 4) {
+            Trap trap = {TRAP_INVALID_INSTRUCTION_ADDRESS, address, address, 0};
+            stop_lanes(&lanes, &active, results, CPU_STATUS_FAULT, &trap);
+            continue;
+        }
+        const DecodedInstruction *decoded = decode_pack_instruction(pack, leader, address, &lanes);
+        if (decoded->id == INSTRUCTION_UNUSED) {
+            Trap trap = {TRAP_UNUSED_OP_CODE, address, address, decoded->op_code};
+            stop_lanes(&lanes, &active, results, CPU_STATUS_FAULT, &trap);
+            continue;
+        }
+
+        PackVector next = BROADCAST(address + 4);
+        PackVector *destination = &pack->registers[decoded->destination_register];
+        PackVector first = pack->registers[decoded->first_source_register];
+        switch (decoded->id) {
+        case INSTRUCTION_SET:
+            *destination = SELECT_LANES(lanes, BROADCAST(decoded->value), *destination);
+            break;
+        case INSTRUCTION_SETU: {
+            const uint32_t clear_upper_bits_bitmask = BITMASK_32 | BITMASK_25 | BITMASK_24_TO_1;
+            PackVector value = (*destination & clear_upper_bits_bitmask) | decoded->value;
+            *destination = SELECT_LANES(lanes, value, *destination);
+            break;
+        }
+        case INSTRUCTION_ADD:
+            *destination = SELECT_LANES(lanes, first + SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        case INSTRUCTION_SUB:
+            *destination = SELECT_LANES(lanes, first - SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        case INSTRUCTION_MUL:
+            *destination = SELECT_LANES(lanes, first * SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        case INSTRUCTION_AND:
+            *destination = SELECT_LANES(lanes, first & SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        case INSTRUCTION_OR:
+            *destination = SELECT_LANES(lanes, first | SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        case INSTRUCTION_XOR:
+            *destination = SELECT_LANES(lanes, first ^ SECOND_OPERAND(pack, decoded), *destination);
+            break;
+        /* Shift counts wrap at 32 the way the x86 shift instructions the scalar backends compile to do */
+        case INSTRUCTION_BSR:
+            *destination = SELECT_LANES(lanes, first >> (SECOND_OPERAND(pack, decoded) & 31), *destination);
+            break;
+        case INSTRUCTION_BSL:
+            *destination = SELECT_LANES(lanes, first << (SECOND_OPERAND(pack, decoded) & 31), *destination);
+            break;
+        case INSTRUCTION_BSRR: {
+            PackVector count = SECOND_OPERAND(pack, decoded) & 31;
+            *destination = SELECT_LANES(lanes, first >> count | first << ((32 - count) & 31), *destination);
+            break;
+        }
+        case INSTRUCTION_BSLR: {
+            PackVector count = SECOND_OPERAND(pack, decoded) & 31;
+            *destination = SELECT_LANES(lanes, first << count | first >> ((32 - count) & 31), *destination);
+            break;
+        }
+        case INSTRUCTION_JMP:
+        case INSTRUCTION_JMPC: {
+            /* The jump is skipped in lanes whose control register holds a non zero value */
+            PackVector taken = decoded->id == INSTRUCTION_JMP
+                                   ? BROADCAST(UINT32_MAX)
+                                   : (PackVector)(pack->registers[decoded->control_register] == 0);
+            next = SELECT_LANES(taken, first + SECOND_OPERAND(pack, decoded), next);
+
+            PackVector halted = lanes & taken & (PackVector)(next == BROADCAST(address));
+            if (any_lane(&halted)) {
+                pack->program_counter = SELECT_LANES(lanes, next, pack->program_counter);
+                steps += __builtin_convertvector(lanes & 1, PackSteps);
+                stop_lanes(&halted, &active, results, CPU_STATUS_HALTED, NULL);
+                lanes = (PackVector){0};
+            }
+            break;
+        }
+        default:
+            execute_lanes_in_turn(pack, decoded, &lanes, &active, results);
+            next = pack->program_counter;
+            break;
+        }
+
+        pack->program_counter = SELECT_LANES(lanes, next, pack->program_counter);
+        steps += __builtin_convertvector(lanes & 1, PackSteps);
+
+        /* No lane executes more than one instruction per iteration, so none can run out of budget before this */
+        if (++iterations >= max_steps) {
+            PackVector exhausted = active & __builtin_convertvector(steps >= max_steps, PackVector);
+            if (any_lane(&exhausted)) {
+                stop_lanes(&exhausted, &active, results, CPU_STATUS_STEP_LIMIT, NULL);
+            }
+        }
+    }
+
+    for (uint32_t lane = 0; lane < pack->lane_count; lane++) {
+        results[lane].steps = steps[lane];
+    }
+}
+
+#else
+
+Pack *init_pack(uint32_t lane_count, Memory *const *memories) {
+    return NULL;
+}
+
+void free_pack(Pack *pack) {
+}
+
+void set_pack_lane(Pack *pack, uint32_t lane, const Cpu *cpu) {
+}
+
+void get_pack_lane(const Pack *pack, uint32_t lane, Cpu *cpu) {
+}
+
+void run_pack(Pack *pack, uint64_t max_steps, RunResult *results) {
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+
+/* Guests per pack, one per 32 bit lane of the widest vector register the build targets */
+#if defined(__AVX512F__)
+#define PACK_LANES 16
+#else
+#define PACK_LANES 8
+#endif
+
+/*
+ * Up to PACK_LANES guests running in lock step, their program counters and registers stored as structure of arrays so
+ * one host vector instruction executes an ALU instruction for every guest at once. Each guest has its own memory.
+ */
+typedef struct Pack Pack;
+
+/*
+ * Returns NULL when the lane count is zero or above PACK_LANES, the memories differ in size or the compiler has no
+ * vector support. The memories are not owned by the pack.
+ */
+Pack *init_pack(uint32_t lane_count, Memory *const *memories);
+
+void free_pack(Pack *pack);
+
+/*
+ * Copies the program counter and registers of a guest in and out of its lane. Setting a lane also attaches the guest's
+ * bus, so its LD and ST past the end of memory reach its devices. Cpu.interrupts is ignored, packs take no interrupts.
+ */
+void set_pack_lane(Pack *pack, uint32_t lane, const Cpu *cpu);
+
+void get_pack_lane(const Pack *pack, uint32_t lane, Cpu *cpu);
+
+/*
+ * Runs every lane until it halts, faults or has executed max_steps instructions, filling one result per lane. Each
+ * step executes the instruction at the lowest program counter of any running lane, for every lane that is there, so
+ * lanes which diverged at a conditional jump come back together where their paths meet.
+ */
+void run_pack(Pack *pack, uint64_t max_steps, RunResult *results);
+
+#endif
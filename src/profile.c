@@ -0,0 +1,177 @@
+/*********************************************************************************************************************
+ * Execution profile of a CPU                                                                                        *
+ *                                                                                                                   *
+ * A CPU with a profile attached runs on a copy of the interpreter loop which records every executed instruction,    *
+ * every other run loop is compiled without any trace of it. The per address counters are one zeroed allocation per  *
+ * kind, so only the pages holding executed addresses are ever backed.                                              *
+ *********************************************************************************************************************/
+
+#include "profile.h"
+#include "cpu.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *const MNEMONIC_NAMES[PROFILE_MNEMONIC_COUNT] = {
+    [PROFILE_JMP] = "JMP",     [PROFILE_JMPI] = "JMPI",   [PROFILE_JMPC] = "JMPC",   [PROFILE_JMPIC] = "JMPIC",
+    [PROFILE_STB] = "STB",     [PROFILE_STH] = "STH",     [PROFILE_STW] = "STW",     [PROFILE_STBI] = "STBI",
+    [PROFILE_STHI] = "STHI",   [PROFILE_STWI] = "STWI",   [PROFILE_LDB] = "LDB",     [PROFILE_LDH] = "LDH",
+    [PROFILE_LDW] = "LDW",     [PROFILE_LDBI] = "LDBI",   [PROFILE_LDHI] = "LDHI",   [PROFILE_LDWI] = "LDWI",
+    [PROFILE_SET] = "SET",     [PROFILE_SETN] = "SETN",   [PROFILE_SETU] = "SETU",   [PROFILE_ADD] = "ADD",
+    [PROFILE_ADDI] = "ADDI",   [PROFILE_SUB] = "SUB",     [PROFILE_SUBI] = "SUBI",   [PROFILE_MUL] = "MUL",
+    [PROFILE_MULI] = "MULI",   [PROFILE_DIV] = "DIV",     [PROFILE_DIVI] = "DIVI",   [PROFILE_MOD] = "MOD",
+    [PROFILE_MODI] = "MODI",   [PROFILE_AND] = "AND",     [PROFILE_ANDI] = "ANDI",   [PROFILE_OR] = "OR",
+    [PROFILE_ORI] = "ORI",     [PROFILE_XOR] = "XOR",     [PROFILE_XORI] = "XORI",   [PROFILE_BSR] = "BSR",
+    [PROFILE_BSRI] = "BSRI",   [PROFILE_BSRR] = "BSRR",   [PROFILE_BSRRI] = "BSRRI", [PROFILE_BSL] = "BSL",
+    [PROFILE_BSLI] = "BSLI",   [PROFILE_BSLR] = "BSLR",   [PROFILE_BSLRI] = "BSLRI",
+};
+
+Profile *init_profile(void) {
+    return calloc(1, sizeof(Profile));
+}
+
+static void free_address_counts(Profile *profile) {
+    free(profile->address_counts);
+    free(profile->taken_counts);
+    free(profile->not_taken_counts);
+    profile->address_counts = NULL;
+    profile->taken_counts = NULL;
+    profile->not_taken_counts = NULL;
+    profile->word_count = 0;
+}
+
+void free_profile(Profile *profile) {
+    if (profile == NULL) {
+        return;
+    }
+    free_address_counts(profile);
+    free(profile);
+}
+
+void reset_profile(Profile *profile) {
+    free_address_counts(profile);
+    *profile = (Profile){0};
+}
+
+/* Counts collected against a memory of another size are dropped, their addresses would not line up */
+bool fit_profile_to_memory(Profile *profile, const Memory *memory) {
+    uint32_t word_count = memory->size_bytes / 4;
+    if (profile->word_count == word_count) {
+        return true;
+    }
+
+    free_address_counts(profile);
+    profile->address_counts = calloc(word_count, sizeof(uint64_t));
+    profile->taken_counts = calloc(word_count, sizeof(uint64_t));
+    profile->not_taken_counts = calloc(word_count, sizeof(uint64_t));
+    if (profile->address_counts == NULL || profile->taken_counts == NULL || profile->not_taken_counts == NULL) {
+        free_address_counts(profile);
+        return false;
+    }
+    profile->word_count = word_count;
+    return true;
+}
+
+const char *get_profile_mnemonic_name(ProfileMnemonic mnemonic) {
+    return mnemonic < PROFILE_MNEMONIC_COUNT ? MNEMONIC_NAMES[mnemonic] : "INVALID";
+}
+
+/* Code may have changed since it was counted, so what sits at the address now is only a best guess */
+static const char *get_address_mnemonic_name(const Memory *memory, uint32_t index) {
+    if (index >= memory->size_bytes / 4) {
+        return "INVALID";
+    }
+    DecodedInstruction decoded;
+    decode_instruction(read_word(memory, index * 4), &decoded);
+    return get_profile_mnemonic_name(get_profile_mnemonic(&decoded));
+}
+
+bool write_profile_folded(const Profile *profile, const Memory *memory, FILE *file) {
+    for (uint32_t index = 0; index < profile->word_count; index++) {
+        if (profile->address_counts[index] != 0) {
+            fprintf(file, "%s;0x%08" PRIx32 " %" PRIu64 "\n", get_address_mnemonic_name(memory, index), index * 4,
+                    profile->address_counts[index]);
+        }
+    }
+    return !ferror(file);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> report >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+typedef struct AddressCount {
+    uint32_t index;
+    uint64_t count;
+} AddressCount;
+
+/* Highest count first, lower address first on a tie */
+static int compare_address_counts(const void *left, const void *right) {
+    const AddressCount *a = left;
+    const AddressCount *b = right;
+    if (a->count != b->count) {
+        return a->count < b->count ? 1 : -1;
+    }
+    return a->index < b->index ? -1 : a->index > b->index;
+}
+
+static double percent(uint64_t count, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * count / total;
+}
+
+static bool write_hottest_addresses(const Profile *profile, const Memory *memory, FILE *file, uint64_t total,
+                                    uint32_t top_addresses) {
+    uint32_t executed = 0;
+    for (uint32_t index = 0; index < profile->word_count; index++) {
+        executed += profile->address_counts[index] != 0;
+    }
+    AddressCount *counts = malloc((executed > 0 ? executed : 1) * sizeof(AddressCount));
+    if (counts == NULL) {
+        return false;
+    }
+    for (uint32_t index = 0, i = 0; index < profile->word_count; index++) {
+        if (profile->address_counts[index] != 0) {
+            counts[i++] = (AddressCount){index, profile->address_counts[index]};
+        }
+    }
+    qsort(counts, executed, sizeof(AddressCount), compare_address_counts);
+
+    fprintf(file, "\nhottest addresses\n");
+    for (uint32_t i = 0; i < executed && i < top_addresses; i++) {
+        fprintf(file, "  0x%08" PRIx32 " %-6s %14" PRIu64 " %6.2f%%\n", counts[i].index * 4,
+                get_address_mnemonic_name(memory, counts[i].index), counts[i].count, percent(counts[i].count, total));
+    }
+    free(counts);
+    return true;
+}
+
+bool write_profile_report(const Profile *profile, const Memory *memory, FILE *file, uint32_t top_addresses) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < PROFILE_MNEMONIC_COUNT; i++) {
+        total += profile->mnemonic_counts[i];
+    }
+
+    fprintf(file, "instructions %" PRIu64 "\n\nmnemonics\n", total);
+    for (uint32_t i = 0; i < PROFILE_MNEMONIC_COUNT; i++) {
+        if (profile->mnemonic_counts[i] != 0) {
+            fprintf(file, "  %-6s %14" PRIu64 " %6.2f%%\n", MNEMONIC_NAMES[i], profile->mnemonic_counts[i],
+                    percent(profile->mnemonic_counts[i], total));
+        }
+    }
+
+    if (!write_hottest_addresses(profile, memory, file, total, top_addresses)) {
+        return false;
+    }
+
+    fprintf(file, "\nconditional jumps\n");
+    for (uint32_t index = 0; index < profile->word_count; index++) {
+        uint64_t taken = profile->taken_counts[index];
+        uint64_t not_taken = profile->not_taken_counts[index];
+        if (taken + not_taken != 0) {
+            fprintf(file, "  0x%08" PRIx32 " %-6s taken %14" PRIu64 " not taken %14" PRIu64 " %6.2f%% taken\n",
+                    index * 4, get_address_mnemonic_name(memory, index), taken, not_taken,
+                    percent(taken, taken + not_taken));
+        }
+    }
+    return !ferror(file);
+}
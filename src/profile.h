@@ -0,0 +1,138 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Mnemonics of ARCHITECTURE_SPECIFICATIONS.md, ANDF / ORF / XORF execute as and are counted with their I form */
+typedef enum ProfileMnemonic {
+    PROFILE_JMP,
+    PROFILE_JMPI,
+    PROFILE_JMPC,
+    PROFILE_JMPIC,
+    PROFILE_STB,
+    PROFILE_STH,
+    PROFILE_STW,
+    PROFILE_STBI,
+    PROFILE_STHI,
+    PROFILE_STWI,
+    PROFILE_LDB,
+    PROFILE_LDH,
+    PROFILE_LDW,
+    PROFILE_LDBI,
+    PROFILE_LDHI,
+    PROFILE_LDWI,
+    PROFILE_SET,
+    PROFILE_SETN,
+    PROFILE_SETU,
+    PROFILE_ADD,
+    PROFILE_ADDI,
+    PROFILE_SUB,
+    PROFILE_SUBI,
+    PROFILE_MUL,
+    PROFILE_MULI,
+    PROFILE_DIV,
+    PROFILE_DIVI,
+    PROFILE_MOD,
+    PROFILE_MODI,
+    PROFILE_AND,
+    PROFILE_ANDI,
+    PROFILE_OR,
+    PROFILE_ORI,
+    PROFILE_XOR,
+    PROFILE_XORI,
+    PROFILE_BSR,
+    PROFILE_BSRI,
+    PROFILE_BSRR,
+    PROFILE_BSRRI,
+    PROFILE_BSL,
+    PROFILE_BSLI,
+    PROFILE_BSLR,
+    PROFILE_BSLRI,
+    PROFILE_MNEMONIC_COUNT,
+} ProfileMnemonic;
+
+/*
+ * Execution counts of a CPU, collected while the profile is attached to Cpu.profile. Instructions which trap are not
+ * counted, just as they are not counted as steps.
+ */
+typedef struct Profile {
+    uint64_t mnemonic_counts[PROFILE_MNEMONIC_COUNT];
+
+    /* Indexed by instruction address / 4, sized to the memory of the first profiled run */
+    uint32_t word_count;
+    uint64_t *address_counts;
+    uint64_t *taken_counts;     // Conditional jumps whose control register was zero
+    uint64_t *not_taken_counts; // Conditional jumps skipped because their control register was not zero
+} Profile;
+
+Profile *init_profile(void);
+
+void free_profile(Profile *profile);
+
+/* Clears every count, the per address counters are given back to the system */
+void reset_profile(Profile *profile);
+
+/* Sizes the per address counters to the memory, returns false if they cannot be allocated */
+bool fit_profile_to_memory(Profile *profile, const Memory *memory);
+
+/* Only meaningful for instructions which execute, the invalid ones map to PROFILE_MNEMONIC_COUNT */
+static inline ProfileMnemonic get_profile_mnemonic(const DecodedInstruction *decoded) {
+    switch (decoded->id) {
+    case INSTRUCTION_JMP:
+        return decoded->use_immediate ? PROFILE_JMPI : PROFILE_JMP;
+    case INSTRUCTION_JMPC:
+        return decoded->use_immediate ? PROFILE_JMPIC : PROFILE_JMPC;
+    case INSTRUCTION_ST:
+        return (ProfileMnemonic)(PROFILE_STB + 3 * decoded->use_immediate + decoded->byte_mode);
+    case INSTRUCTION_LD:
+        return (ProfileMnemonic)(PROFILE_LDB + 3 * decoded->use_immediate + decoded->byte_mode);
+    case INSTRUCTION_SET:
+        return decoded->operation ? PROFILE_SETN : PROFILE_SET;
+    case INSTRUCTION_SETU:
+        return PROFILE_SETU;
+    case INSTRUCTION_ADD:
+    case INSTRUCTION_SUB:
+    case INSTRUCTION_MUL:
+    case INSTRUCTION_DIV:
+    case INSTRUCTION_MOD:
+        return (ProfileMnemonic)(PROFILE_ADD + 2 * (decoded->id - INSTRUCTION_ADD) + decoded->use_immediate);
+    case INSTRUCTION_AND:
+    case INSTRUCTION_OR:
+    case INSTRUCTION_XOR:
+        return (ProfileMnemonic)(PROFILE_AND + 2 * (decoded->id - INSTRUCTION_AND) + decoded->use_immediate);
+    case INSTRUCTION_BSR:
+    case INSTRUCTION_BSRR:
+    case INSTRUCTION_BSL:
+    case INSTRUCTION_BSLR:
+        return (ProfileMnemonic)(PROFILE_BSR + 2 * (decoded->id - INSTRUCTION_BSR) + decoded->use_immediate);
+    default:
+        return PROFILE_MNEMONIC_COUNT;
+    }
+}
+
+const char *get_profile_mnemonic_name(ProfileMnemonic mnemonic);
+
+/* Called by the run loop after an instruction executed without trapping, taken only matters for JMPC and JMPIC */
+static inline void record_profile(Profile *profile, const DecodedInstruction *decoded, uint32_t address, bool taken) {
+    uint32_t index = address / 4;
+    profile->mnemonic_counts[get_profile_mnemonic(decoded)]++;
+    profile->address_counts[index]++;
+    if (decoded->id == INSTRUCTION_JMPC) {
+        (taken ? profile->taken_counts : profile->not_taken_counts)[index]++;
+    }
+}
+
+/*
+ * Writes one "<mnemonic>;<address> <count>" line per executed address, the folded stack format flamegraph.pl and
+ * speedscope read. Mnemonics are decoded from the memory as it is now.
+ */
+bool write_profile_folded(const Profile *profile, const Memory *memory, FILE *file);
+
+/* Writes a readable summary: counts per mnemonic, the hottest addresses and every conditional jump */
+bool write_profile_report(const Profile *profile, const Memory *memory, FILE *file, uint32_t top_addresses);
+
+#endif
@@ -0,0 +1,167 @@
+/*********************************************************************************************************************
+ * Snapshots, forks and restores of a whole machine                                                                  *
+ *                                                                                                                   *
+ * A snapshot writes the memory image into an anonymous file once. Forks map that file privately, so the kernel      *
+ * shares every page until a fork writes to it. Stores mark the pages they write in the memory's dirty bits, which   *
+ * lets a restore read back only those pages instead of the whole image. The bits only tell what changed since the  *
+ * snapshot the memory was last snapshotted, forked or restored from, restoring any other one reads back every page.  *
+ *********************************************************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "snapshot.h"
+#include "cpu.h"
+#include "memory.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static int create_image_file() {
+#if defined(__linux__)
+    return memfd_create("memory_snapshot", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/memory_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd != -1) {
+        unlink(path);
+    }
+    return fd;
+#endif
+}
+
+static uint32_t page_length(uint32_t offset, uint32_t size_bytes) {
+    return size_bytes - offset < MEMORY_PAGE_BYTES ? size_bytes - offset : MEMORY_PAGE_BYTES;
+}
+
+static bool is_zero_page(const uint8_t *page, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        if (page[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void clear_dirty_pages(Memory *memory) {
+    uint32_t page_count = (memory->size_bytes + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES;
+    memset(memory->dirty_pages, 0, (page_count + 63) / 64 * sizeof(uint64_t));
+}
+
+/* Snapshots may be taken from several threads at once */
+static uint64_t next_snapshot_id() {
+    static uint64_t last_id;
+#if defined(__GNUC__)
+    return __atomic_add_fetch(&last_id, 1, __ATOMIC_RELAXED);
+#else
+    return ++last_id;
+#endif
+}
+
+Snapshot *take_snapshot(const Cpu *cpu, Memory *memory) {
+    Snapshot *snapshot = malloc(sizeof(Snapshot));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    snapshot->memory_fd = create_image_file();
+    if (snapshot->memory_fd == -1 || ftruncate(snapshot->memory_fd, memory->size_bytes) != 0) {
+        free_snapshot(snapshot);
+        return NULL;
+    }
+
+    /* The file starts out as a hole reading as zero, leaving zero pages out keeps it sparse */
+    for (uint32_t offset = 0; offset < memory->size_bytes; offset += MEMORY_PAGE_BYTES) {
+        uint32_t length = page_length(offset, memory->size_bytes);
+        if (is_zero_page(&memory->data[offset], length)) {
+            continue;
+        }
+        if (pwrite(snapshot->memory_fd, &memory->data[offset], length, offset) != length) {
+            free_snapshot(snapshot);
+            return NULL;
+        }
+    }
+
+    snapshot->program_counter = cpu->program_counter;
+    memcpy(snapshot->registers, cpu->registers, sizeof(snapshot->registers));
+    snapshot->memory_size_bytes = memory->size_bytes;
+    snapshot->id = next_snapshot_id();
+    clear_dirty_pages(memory);
+    memory->snapshot_id = snapshot->id;
+    return snapshot;
+}
+
+void free_snapshot(Snapshot *snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    if (snapshot->memory_fd != -1) {
+        close(snapshot->memory_fd);
+    }
+    free(snapshot);
+}
+
+Cpu fork_cpu(const Snapshot *snapshot, CpuBackend backend) {
+    Cpu cpu = init_cpu(backend);
+    cpu.program_counter = snapshot->program_counter;
+    memcpy(cpu.registers, snapshot->registers, sizeof(cpu.registers));
+    return cpu;
+}
+
+Memory *fork_memory(const Snapshot *snapshot) {
+    Memory *memory = init_memory_from_file(snapshot->memory_fd, snapshot->memory_size_bytes,
+                                           snapshot->memory_size_bytes);
+    if (memory != NULL) {
+        memory->snapshot_id = snapshot->id;
+    }
+    return memory;
+}
+
+/* Reads back the whole image, the pages past the written ones read as the zeros they held */
+static bool restore_every_page(const Snapshot *snapshot, Cpu *cpu, Memory *memory) {
+    if (pread(snapshot->memory_fd, memory->data, memory->size_bytes, 0) != memory->size_bytes) {
+        return false;
+    }
+    invalidate_decoded_instructions(cpu, 0, memory->size_bytes - 1);
+    clear_dirty_pages(memory);
+    return true;
+}
+
+bool restore_snapshot(const Snapshot *snapshot, Cpu *cpu, Memory *memory) {
+    if (memory->size_bytes != snapshot->memory_size_bytes) {
+        return false;
+    }
+    if (memory->snapshot_id != snapshot->id) {
+        if (!restore_every_page(snapshot, cpu, memory)) {
+            return false;
+        }
+        memory->snapshot_id = snapshot->id;
+    }
+
+    uint32_t page_count = (memory->size_bytes + MEMORY_PAGE_BYTES - 1) / MEMORY_PAGE_BYTES;
+    for (uint32_t page = 0; page < page_count; page++) {
+        /* Skips a whole word of clean pages at a time */
+        if (memory->dirty_pages[page / 64] == 0) {
+            page |= 63;
+            continue;
+        }
+        uint64_t bit = UINT64_C(1) << (page % 64);
+        if ((memory->dirty_pages[page / 64] & bit) == 0) {
+            continue;
+        }
+
+        uint32_t offset = page * MEMORY_PAGE_BYTES;
+        uint32_t length = page_length(offset, memory->size_bytes);
+        if (pread(snapshot->memory_fd, &memory->data[offset], length, offset) != length) {
+            return false;
+        }
+        invalidate_decoded_instructions(cpu, offset, offset + length - 1);
+        memory->dirty_pages[page / 64] &= ~bit;
+    }
+
+    cpu->program_counter = snapshot->program_counter;
+    memcpy(cpu->registers, snapshot->registers, sizeof(cpu->registers));
+    cpu->trap.kind = TRAP_NONE;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/* Architectural state of a machine, its memory image lives in a file which every fork maps copy on write */
+typedef struct Snapshot {
+    uint32_t program_counter;
+    uint32_t registers[8];
+    uint32_t memory_size_bytes;
+    uint64_t id; // Unique within the process, never 0
+    int memory_fd;
+} Snapshot;
+
+/* Copies the memory image once and clears its dirty bits, returns NULL when the image cannot be written */
+Snapshot *take_snapshot(const Cpu *cpu, Memory *memory);
+
+/* Forks taken from the snapshot stay valid, they keep the image alive through their own mappings */
+void free_snapshot(Snapshot *snapshot);
+
+/* Starts from the snapshot's registers with empty predecode state, attach a decode cache afterwards if wanted */
+Cpu fork_cpu(const Snapshot *snapshot, CpuBackend backend);
+
+/* Costs a mapping rather than a copy, a page is only duplicated once the fork writes to it */
+Memory *fork_memory(const Snapshot *snapshot);
+
+/*
+ * Puts the CPU and memory back to the snapshot. When the memory was last snapshotted, forked or restored from this
+ * snapshot only the pages dirtied since are read back, otherwise the dirty bits say nothing about it and every page is.
+ * Returns false if the memory size does not match or the image cannot be read.
+ */
+bool restore_snapshot(const Snapshot *snapshot, Cpu *cpu, Memory *memory);
+
+#endif
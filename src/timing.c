@@ -0,0 +1,85 @@
+/*********************************************************************************************************************
+ * In order pipeline timing model                                                                                    *
+ *                                                                                                                   *
+ * A scoreboard of the cycle each register becomes ready is all the state an in order single issue pipeline needs,   *
+ * so recording an instruction is a handful of compares and no simulation of the individual stages.                 *
+ *********************************************************************************************************************/
+
+#include "timing.h"
+#include "cpu.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const CLASS_NAMES[TIMING_CLASS_COUNT] = {
+    [TIMING_ALU] = "alu",     [TIMING_MUL] = "mul",     [TIMING_DIV] = "div",
+    [TIMING_LOAD] = "load",   [TIMING_STORE] = "store", [TIMING_JUMP] = "jump",
+};
+
+void get_default_timing_config(TimingConfig *config) {
+    *config = (TimingConfig){
+        .latencies =
+            {
+                [TIMING_ALU] = 1,
+                [TIMING_MUL] = 3,
+                [TIMING_DIV] = 20,
+                [TIMING_LOAD] = 2,
+                [TIMING_STORE] = 1,
+                [TIMING_JUMP] = 1,
+            },
+        .jump_penalty = 2,
+        .pipelined_divider = false,
+    };
+}
+
+TimingModel *init_timing_model(const TimingConfig *config) {
+    TimingModel *timing = calloc(1, sizeof(TimingModel));
+    if (timing == NULL) {
+        return NULL;
+    }
+    if (config != NULL) {
+        timing->config = *config;
+    } else {
+        get_default_timing_config(&timing->config);
+    }
+    return timing;
+}
+
+void free_timing_model(TimingModel *timing) {
+    free(timing);
+}
+
+void reset_timing_model(TimingModel *timing) {
+    TimingConfig config = timing->config;
+    memset(timing, 0, sizeof(TimingModel));
+    timing->config = config;
+}
+
+static double percent(uint64_t count, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * count / total;
+}
+
+static void write_count(FILE *file, const char *name, uint64_t count, uint64_t total) {
+    fprintf(file, "  %-8s %14" PRIu64 " %6.2f%%\n", name, count, percent(count, total));
+}
+
+bool write_timing_report(const TimingModel *timing, FILE *file) {
+    uint64_t cycles = timing->cycles;
+    fprintf(file, "cycles       %14" PRIu64 "\ninstructions %14" PRIu64 "\nCPI          %14.3f\n", cycles,
+            timing->instructions, timing->instructions == 0 ? 0 : (double)cycles / timing->instructions);
+
+    fprintf(file, "\nstall cycles\n");
+    write_count(file, "load use", timing->load_use_stalls, cycles);
+    write_count(file, "execute", timing->execute_stalls, cycles);
+    write_count(file, "divider", timing->divider_stalls, cycles);
+    write_count(file, "jump", timing->jump_stalls, cycles);
+
+    fprintf(file, "\ninstruction classes\n");
+    for (uint32_t i = 0; i < TIMING_CLASS_COUNT; i++) {
+        write_count(file, CLASS_NAMES[i], timing->class_counts[i], timing->instructions);
+    }
+    return !ferror(file);
+}
@@ -0,0 +1,141 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+#include "cpu.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* Instructions sharing a functional unit and a latency */
+typedef enum TimingClass {
+    TIMING_ALU,   // SET, SETU, ADD, SUB, AND, OR, XOR and the shifts
+    TIMING_MUL,   // MUL
+    TIMING_DIV,   // DIV and MOD
+    TIMING_LOAD,  // LD
+    TIMING_STORE, // ST
+    TIMING_JUMP,  // JMP and JMPC
+    TIMING_CLASS_COUNT,
+} TimingClass;
+
+/*
+ * Single issue in order pipeline. An instruction issues one cycle after the previous one unless a register it reads is
+ * not ready yet, its result is ready latency cycles after it issued. So a load latency of 2 is the classic load use
+ * bubble of a five stage pipeline.
+ */
+typedef struct TimingConfig {
+    uint32_t latencies[TIMING_CLASS_COUNT]; // At least 1
+    uint32_t jump_penalty;                  // Bubbles after a jump which redirected fetch, see record_timing
+    bool pipelined_divider;                 // Otherwise a DIV or MOD waits until the previous one finished
+} TimingConfig;
+
+/*
+ * Cycle counts of a CPU, collected while the model is attached to Cpu.timing. Like the profile it runs on the
+ * recording copy of the interpreter, and instructions which trap take no cycles.
+ */
+typedef struct TimingModel {
+    TimingConfig config;
+    uint64_t cycles;        // Cycle the last instruction issued in
+    uint64_t ready[8];      // Cycle each register's value is available in
+    bool loaded[8];         // Whether each register's value comes from a load
+    uint64_t divider_ready; // Cycle the divider takes the next DIV or MOD
+
+    uint64_t instructions;
+    uint64_t class_counts[TIMING_CLASS_COUNT];
+    uint64_t load_use_stalls; // Cycles waiting for a load's result
+    uint64_t execute_stalls;  // Cycles waiting for any other result, MUL, DIV and MOD in the default configuration
+    uint64_t divider_stalls;  // Cycles waiting for the divider
+    uint64_t jump_stalls;     // Bubbles after jumps
+} TimingModel;
+
+/* Fills in a five stage pipeline: ALU, store and jump 1, load 2, MUL 3, unpipelined DIV 20 and a jump penalty of 2 */
+void get_default_timing_config(TimingConfig *config);
+
+/* Starts at cycle 0 with every register ready, uses the default configuration when config is NULL */
+TimingModel *init_timing_model(const TimingConfig *config);
+
+void free_timing_model(TimingModel *timing);
+
+/* Clears the counts and the pipeline, the configuration is kept */
+void reset_timing_model(TimingModel *timing);
+
+/* Only meaningful for instructions which execute */
+static inline TimingClass get_timing_class(const DecodedInstruction *decoded) {
+    switch (decoded->id) {
+    case INSTRUCTION_JMP:
+    case INSTRUCTION_JMPC:
+        return TIMING_JUMP;
+    case INSTRUCTION_ST:
+        return TIMING_STORE;
+    case INSTRUCTION_LD:
+        return TIMING_LOAD;
+    case INSTRUCTION_MUL:
+        return TIMING_MUL;
+    case INSTRUCTION_DIV:
+    case INSTRUCTION_MOD:
+        return TIMING_DIV;
+    default:
+        return TIMING_ALU;
+    }
+}
+
+/* Waits for the register and remembers which kind of result held the instruction up last */
+static inline uint64_t wait_for_register(const TimingModel *timing, uint8_t register_index, uint64_t issue,
+                                         bool *waited_for_load) {
+    if (timing->ready[register_index] > issue) {
+        *waited_for_load = timing->loaded[register_index];
+        return timing->ready[register_index];
+    }
+    return issue;
+}
+
+/*
+ * Called by the run loop after an instruction executed without trapping. Redirected is whether fetch had to be
+ * redirected after it: any jump which changed the program counter, or with a branch predictor attached, an
+ * unconditional jump which did or a conditional jump which was mispredicted.
+ */
+static inline void record_timing(TimingModel *timing, const DecodedInstruction *decoded, bool redirected) {
+    TimingClass timing_class = get_timing_class(decoded);
+    uint64_t earliest = timing->cycles + 1;
+    uint64_t issue = earliest;
+    bool waited_for_load = false;
+
+    /* Registers read, SET is the only instruction reading none and SETU merges into its destination */
+    if (decoded->id != INSTRUCTION_SET && decoded->id != INSTRUCTION_SETU) {
+        issue = wait_for_register(timing, decoded->first_source_register, issue, &waited_for_load);
+        if (!decoded->use_immediate) {
+            issue = wait_for_register(timing, decoded->second_source_register, issue, &waited_for_load);
+        }
+    }
+    if (decoded->id == INSTRUCTION_ST || decoded->id == INSTRUCTION_SETU) {
+        issue = wait_for_register(timing, decoded->destination_register, issue, &waited_for_load);
+    } else if (decoded->id == INSTRUCTION_JMPC) {
+        issue = wait_for_register(timing, decoded->control_register, issue, &waited_for_load);
+    }
+    *(waited_for_load ? &timing->load_use_stalls : &timing->execute_stalls) += issue - earliest;
+
+    uint32_t latency = timing->config.latencies[timing_class];
+    if (timing_class == TIMING_DIV && !timing->config.pipelined_divider) {
+        if (timing->divider_ready > issue) {
+            timing->divider_stalls += timing->divider_ready - issue;
+            issue = timing->divider_ready;
+        }
+        timing->divider_ready = issue + latency;
+    }
+    if (timing_class != TIMING_STORE && timing_class != TIMING_JUMP) {
+        timing->ready[decoded->destination_register] = issue + latency;
+        timing->loaded[decoded->destination_register] = timing_class == TIMING_LOAD;
+    }
+    if (redirected) {
+        timing->jump_stalls += timing->config.jump_penalty;
+        issue += timing->config.jump_penalty;
+    }
+
+    timing->cycles = issue;
+    timing->instructions++;
+    timing->class_counts[timing_class]++;
+}
+
+/* Writes cycles, CPI, the stall breakdown and the instruction mix */
+bool write_timing_report(const TimingModel *timing, FILE *file);
+
+#endif
@@ -0,0 +1,593 @@
+/*********************************************************************************************************************
+ * Binary execution traces                                                                                           *
+ *                                                                                                                   *
+ * The recording thread encodes records straight into the block it owns. A full block is handed to the writer       *
+ * thread through a ring of blocks with one atomic counter per side, the recording thread advances the number of     *
+ * published blocks and the writer the number of written ones, so recording a step never takes a lock. A side which  *
+ * has to wait for the other sleeps on a condition variable, which each side signals once per block.                 *
+ *                                                                                                                   *
+ * Block layout, all fields little endian:                                                                           *
+ *     0  magic "ETRC"                  4  bytes used         8  first step                                          *
+ *     16 program counter              20 registers R1 - R8  52 record count          56 records                     *
+ *                                                                                                                   *
+ * A record is a tag byte followed by the fields its bits announce:                                                  *
+ *     0x01 the next program counter is not address + 4, zigzag varint distance from it follows                      *
+ *     0x02 the word differs from the one last recorded at the address, the word follows                             *
+ *     0x04 a register changed, its index is in bits 4 - 6 and the varint of new XOR old value follows               *
+ *     0x08 a store, varint of zigzag(location - last store location) << 2 | byte mode and varint value follow       *
+ *********************************************************************************************************************/
+
+#include "trace.h"
+#include "cpu.h"
+#include "memory.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC              UINT32_C(0x43525445) // "ETRC" in little endian
+#define TRACE_HEADER_BYTES       56
+#define TRACE_MAX_RECORD_BYTES   32 // Tag, jump, word, register and store at their longest
+#define TRACE_RING_BLOCKS        8
+#define TRACE_WORD_CACHE_ENTRIES 256
+
+#define TRACE_TAG_JUMP     0x01
+#define TRACE_TAG_WORD     0x02
+#define TRACE_TAG_REGISTER 0x04
+#define TRACE_TAG_STORE    0x08
+
+typedef struct TraceWordCacheEntry {
+    uint32_t address;
+    uint32_t word;
+} TraceWordCacheEntry;
+
+/* Kept identically by the recorder and the reader while they go through the records of a block */
+typedef struct TraceState {
+    uint64_t step;
+    uint32_t program_counter;
+    uint32_t registers[8];
+    uint32_t store_location;
+    TraceWordCacheEntry words[TRACE_WORD_CACHE_ENTRIES];
+} TraceState;
+
+struct TraceRecorder {
+    int fd;
+    pthread_t writer;
+    uint8_t *blocks; // TRACE_RING_BLOCKS blocks, block n of the trace lives in slot n % TRACE_RING_BLOCKS
+
+    uint64_t published; // Only stored by the recording thread
+    uint64_t written;   // Only stored by the writer thread
+    bool stopping;
+    bool failed;
+
+    /* Only held to sleep on progress and to signal it, so a wake up cannot slip in between a check and the wait */
+    pthread_mutex_t lock;
+    pthread_cond_t progress; // Broadcast after published, written or stopping changed
+
+    /* Owned by the recording thread */
+    bool block_open;
+    uint32_t block_length;
+    uint32_t record_count;
+    TraceState state;
+};
+
+struct TraceReader {
+    int fd;
+    uint64_t block_count;
+    uint64_t block_index;
+    uint32_t cursor;
+    uint32_t length;
+    uint32_t records_left;
+    TraceState state;
+    uint8_t block[TRACE_BLOCK_BYTES];
+};
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> utils >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static void put_u32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = value;
+    bytes[1] = value >> 8;
+    bytes[2] = value >> 16;
+    bytes[3] = value >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+static void put_u64(uint8_t *bytes, uint64_t value) {
+    put_u32(bytes, value);
+    put_u32(bytes + 4, value >> 32);
+}
+
+static uint64_t get_u64(const uint8_t *bytes) {
+    return get_u32(bytes) | (uint64_t)get_u32(bytes + 4) << 32;
+}
+
+static uint8_t *put_varint(uint8_t *cursor, uint64_t value) {
+    while (value >= 0x80) {
+        *cursor++ = value | 0x80;
+        value >>= 7;
+    }
+    *cursor++ = value;
+    return cursor;
+}
+
+/* Returns false when the varint runs past the end or is longer than any the recorder writes */
+static bool get_varint(const uint8_t *bytes, uint32_t length, uint32_t *cursor, uint64_t *value) {
+    *value = 0;
+    for (uint32_t shift = 0; shift < 40 && *cursor < length; shift += 7) {
+        uint8_t byte = bytes[(*cursor)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t zigzag(uint32_t difference) {
+    return difference << 1 ^ (uint32_t)((int32_t)difference >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value) {
+    return value >> 1 ^ -(value & 1);
+}
+
+static uint32_t width_mask(uint32_t byte_mode) {
+    return byte_mode == 2 ? UINT32_MAX : (UINT32_C(1) << (8 << byte_mode)) - 1;
+}
+
+static void reset_trace_state(TraceState *state, uint64_t step, uint32_t program_counter, const uint32_t *registers) {
+    state->step = step;
+    state->program_counter = program_counter;
+    memcpy(state->registers, registers, sizeof(state->registers));
+    state->store_location = 0;
+    for (uint32_t i = 0; i < TRACE_WORD_CACHE_ENTRIES; i++) {
+        state->words[i].address = UINT32_MAX;
+    }
+}
+
+/* Only instructions writing their destination register, ST reads it */
+static bool writes_register(const DecodedInstruction *decoded) {
+    return decoded->id >= INSTRUCTION_LD && decoded->id <= INSTRUCTION_BSLR;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> writer >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool write_all(int fd, const uint8_t *bytes, uint32_t length) {
+    for (uint32_t written = 0; written < length;) {
+        ssize_t result = write(fd, bytes + written, length - written);
+        if (result <= 0) {
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+static void signal_progress(TraceRecorder *recorder) {
+    pthread_mutex_lock(&recorder->lock);
+    pthread_cond_broadcast(&recorder->progress);
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+/* Blocks keep being taken off the ring after a failed write, so the recording thread never waits forever */
+static void *write_blocks(void *argument) {
+    TraceRecorder *recorder = argument;
+    for (;;) {
+        uint64_t written = recorder->written;
+        if (written < __atomic_load_n(&recorder->published, __ATOMIC_ACQUIRE)) {
+            const uint8_t *block = recorder->blocks + written % TRACE_RING_BLOCKS * TRACE_BLOCK_BYTES;
+            if (!__atomic_load_n(&recorder->failed, __ATOMIC_RELAXED) &&
+                !write_all(recorder->fd, block, TRACE_BLOCK_BYTES)) {
+                __atomic_store_n(&recorder->failed, true, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&recorder->written, written + 1, __ATOMIC_RELEASE);
+            signal_progress(recorder);
+        } else if (__atomic_load_n(&recorder->stopping, __ATOMIC_ACQUIRE)) {
+            /* The last block may have been published just before stopping was seen */
+            if (written == __atomic_load_n(&recorder->published, __ATOMIC_ACQUIRE)) {
+                return NULL;
+            }
+        } else {
+            pthread_mutex_lock(&recorder->lock);
+            while (written == __atomic_load_n(&recorder->published, __ATOMIC_ACQUIRE) &&
+                   !__atomic_load_n(&recorder->stopping, __ATOMIC_ACQUIRE)) {
+                pthread_cond_wait(&recorder->progress, &recorder->lock);
+            }
+            pthread_mutex_unlock(&recorder->lock);
+        }
+    }
+}
+
+TraceRecorder *init_trace_recorder(int fd) {
+    TraceRecorder *recorder = calloc(1, sizeof(TraceRecorder));
+    if (recorder == NULL) {
+        return NULL;
+    }
+    recorder->fd = fd;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->progress, NULL);
+    recorder->blocks = malloc(TRACE_RING_BLOCKS * TRACE_BLOCK_BYTES);
+    if (recorder->blocks == NULL || pthread_create(&recorder->writer, NULL, write_blocks, recorder) != 0) {
+        pthread_cond_destroy(&recorder->progress);
+        pthread_mutex_destroy(&recorder->lock);
+        free(recorder->blocks);
+        free(recorder);
+        return NULL;
+    }
+    return recorder;
+}
+
+static uint8_t *get_current_block(TraceRecorder *recorder) {
+    return recorder->blocks + recorder->published % TRACE_RING_BLOCKS * TRACE_BLOCK_BYTES;
+}
+
+/* Waits until the writer has written all but the given number of published blocks */
+static void wait_for_writer(TraceRecorder *recorder, uint64_t pending_blocks) {
+    if (recorder->published - __atomic_load_n(&recorder->written, __ATOMIC_ACQUIRE) <= pending_blocks) {
+        return;
+    }
+    pthread_mutex_lock(&recorder->lock);
+    while (recorder->published - __atomic_load_n(&recorder->written, __ATOMIC_ACQUIRE) > pending_blocks) {
+        pthread_cond_wait(&recorder->progress, &recorder->lock);
+    }
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+/* Waits for a free slot only when the writer is a whole ring behind */
+static void start_block(TraceRecorder *recorder, uint32_t program_counter) {
+    wait_for_writer(recorder, TRACE_RING_BLOCKS - 1);
+
+    uint8_t *block = get_current_block(recorder);
+    reset_trace_state(&recorder->state, recorder->state.step, program_counter, recorder->state.registers);
+    put_u32(block, TRACE_MAGIC);
+    put_u64(block + 8, recorder->state.step);
+    put_u32(block + 16, program_counter);
+    for (uint32_t i = 0; i < 8; i++) {
+        put_u32(block + 20 + i * 4, recorder->state.registers[i]);
+    }
+    recorder->block_open = true;
+    recorder->block_length = TRACE_HEADER_BYTES;
+    recorder->record_count = 0;
+}
+
+static void publish_block(TraceRecorder *recorder) {
+    uint8_t *block = get_current_block(recorder);
+    put_u32(block + 4, recorder->block_length);
+    put_u32(block + 52, recorder->record_count);
+    memset(block + recorder->block_length, 0, TRACE_BLOCK_BYTES - recorder->block_length);
+    __atomic_store_n(&recorder->published, recorder->published + 1, __ATOMIC_RELEASE);
+    recorder->block_open = false;
+    signal_progress(recorder);
+}
+
+bool flush_trace_recorder(TraceRecorder *recorder) {
+    if (recorder->block_open) {
+        publish_block(recorder);
+    }
+    wait_for_writer(recorder, 0);
+    return !__atomic_load_n(&recorder->failed, __ATOMIC_RELAXED);
+}
+
+void free_trace_recorder(TraceRecorder *recorder) {
+    if (recorder == NULL) {
+        return;
+    }
+    flush_trace_recorder(recorder);
+    __atomic_store_n(&recorder->stopping, true, __ATOMIC_RELEASE);
+    signal_progress(recorder);
+    pthread_join(recorder->writer, NULL);
+    pthread_cond_destroy(&recorder->progress);
+    pthread_mutex_destroy(&recorder->lock);
+    free(recorder->blocks);
+    free(recorder);
+}
+
+/* The records only describe what instructions change, anything else changing the CPU needs a fresh checkpoint */
+void begin_trace_run(TraceRecorder *recorder, const Cpu *cpu) {
+    if (recorder->block_open && (cpu->program_counter != recorder->state.program_counter ||
+                                 memcmp(cpu->registers, recorder->state.registers, sizeof(cpu->registers)) != 0)) {
+        publish_block(recorder);
+    }
+    recorder->state.program_counter = cpu->program_counter;
+    memcpy(recorder->state.registers, cpu->registers, sizeof(cpu->registers));
+}
+
+void record_trace(TraceRecorder *recorder, const Cpu *cpu, const Memory *memory, const DecodedInstruction *decoded,
+                  uint32_t address, uint32_t word) {
+    if (!recorder->block_open || recorder->block_length > TRACE_BLOCK_BYTES - TRACE_MAX_RECORD_BYTES) {
+        if (recorder->block_open) {
+            publish_block(recorder);
+        }
+        start_block(recorder, address);
+    }
+
+    TraceState *state = &recorder->state;
+    uint8_t *tag = get_current_block(recorder) + recorder->block_length;
+    uint8_t *cursor = tag + 1;
+    *tag = 0;
+
+    uint32_t next_program_counter = cpu->program_counter;
+    if (next_program_counter != address + 4) {
+        *tag |= TRACE_TAG_JUMP;
+        cursor = put_varint(cursor, zigzag(next_program_counter - (address + 4)));
+    }
+
+    TraceWordCacheEntry *cached = &state->words[address / 4 % TRACE_WORD_CACHE_ENTRIES];
+    if (cached->address != address || cached->word != word) {
+        *tag |= TRACE_TAG_WORD;
+        put_u32(cursor, word);
+        cursor += 4;
+        *cached = (TraceWordCacheEntry){address, word};
+    }
+
+    if (writes_register(decoded)) {
+        uint32_t index = decoded->destination_register;
+        uint32_t value = cpu->registers[index];
+        if (value != state->registers[index]) {
+            *tag |= TRACE_TAG_REGISTER | index << 4;
+            cursor = put_varint(cursor, value ^ state->registers[index]);
+            state->registers[index] = value;
+        }
+    }
+
+    uint32_t location = 0;
+    if (decoded->id == INSTRUCTION_ST) {
+        uint32_t offset = decoded->use_immediate ? decoded->value : cpu->registers[decoded->second_source_register];
+        location = cpu->registers[decoded->first_source_register] + offset;
+    }
+    /* A store past the end of memory went to a device, applying it to memory would corrupt a replay or seek */
+    if (decoded->id == INSTRUCTION_ST && location < memory->size_bytes) {
+        *tag |= TRACE_TAG_STORE;
+        cursor = put_varint(cursor, (uint64_t)zigzag(location - state->store_location) << 2 | decoded->byte_mode);
+        cursor = put_varint(cursor, cpu->registers[decoded->destination_register] & width_mask(decoded->byte_mode));
+        state->store_location = location;
+    }
+
+    recorder->block_length = cursor - get_current_block(recorder);
+    recorder->record_count++;
+    state->step++;
+    state->program_counter = next_program_counter;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> reader >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static bool read_block_header(const TraceReader *reader, uint64_t index, uint8_t *header) {
+    return pread(reader->fd, header, TRACE_HEADER_BYTES, index * TRACE_BLOCK_BYTES) == TRACE_HEADER_BYTES &&
+           get_u32(header) == TRACE_MAGIC;
+}
+
+static bool load_block(TraceReader *reader, uint64_t index) {
+    if (index >= reader->block_count ||
+        pread(reader->fd, reader->block, TRACE_BLOCK_BYTES, index * TRACE_BLOCK_BYTES) != TRACE_BLOCK_BYTES ||
+        get_u32(reader->block) != TRACE_MAGIC) {
+        return false;
+    }
+    uint32_t length = get_u32(reader->block + 4);
+    if (length < TRACE_HEADER_BYTES || length > TRACE_BLOCK_BYTES) {
+        return false;
+    }
+
+    uint32_t registers[8];
+    for (uint32_t i = 0; i < 8; i++) {
+        registers[i] = get_u32(reader->block + 20 + i * 4);
+    }
+    reset_trace_state(&reader->state, get_u64(reader->block + 8), get_u32(reader->block + 16), registers);
+    reader->block_index = index;
+    reader->cursor = TRACE_HEADER_BYTES;
+    reader->length = length;
+    reader->records_left = get_u32(reader->block + 52);
+    return true;
+}
+
+TraceReader *init_trace_reader(int fd) {
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < TRACE_BLOCK_BYTES) {
+        return NULL;
+    }
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    if (reader == NULL) {
+        return NULL;
+    }
+    reader->fd = fd;
+    reader->block_count = status.st_size / TRACE_BLOCK_BYTES;
+    if (!load_block(reader, 0)) {
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+void free_trace_reader(TraceReader *reader) {
+    free(reader);
+}
+
+static bool decode_record(TraceReader *reader, TraceRecord *record) {
+    TraceState *state = &reader->state;
+    const uint8_t *block = reader->block;
+    if (reader->cursor >= reader->length) {
+        return false;
+    }
+    uint8_t tag = block[reader->cursor++];
+    uint64_t value;
+
+    *record = (TraceRecord){0};
+    record->step = state->step;
+    record->program_counter = state->program_counter;
+    record->next_program_counter = state->program_counter + 4;
+    if (tag & TRACE_TAG_JUMP) {
+        if (!get_varint(block, reader->length, &reader->cursor, &value)) {
+            return false;
+        }
+        record->next_program_counter += unzigzag(value);
+    }
+
+    TraceWordCacheEntry *cached = &state->words[record->program_counter / 4 % TRACE_WORD_CACHE_ENTRIES];
+    if (tag & TRACE_TAG_WORD) {
+        if (reader->cursor + 4 > reader->length) {
+            return false;
+        }
+        *cached = (TraceWordCacheEntry){record->program_counter, get_u32(block + reader->cursor)};
+        reader->cursor += 4;
+    } else if (cached->address != record->program_counter) {
+        return false;
+    }
+    record->word = cached->word;
+
+    if (tag & TRACE_TAG_REGISTER) {
+        if (!get_varint(block, reader->length, &reader->cursor, &value)) {
+            return false;
+        }
+        record->writes_register = true;
+        record->register_index = tag >> 4 & 7;
+        record->register_value = state->registers[record->register_index] ^ value;
+        state->registers[record->register_index] = record->register_value;
+    }
+
+    if (tag & TRACE_TAG_STORE) {
+        uint64_t stored;
+        if (!get_varint(block, reader->length, &reader->cursor, &value) ||
+            !get_varint(block, reader->length, &reader->cursor, &stored) || (value & 3) == 3) {
+            return false;
+        }
+        record->writes_memory = true;
+        record->byte_mode = value & 3;
+        record->memory_location = state->store_location + unzigzag(value >> 2);
+        record->memory_value = stored;
+        state->store_location = record->memory_location;
+    }
+
+    reader->records_left--;
+    state->step++;
+    state->program_counter = record->next_program_counter;
+    return true;
+}
+
+bool read_trace_record(TraceReader *reader, TraceRecord *record) {
+    while (reader->records_left == 0) {
+        if (!load_block(reader, reader->block_index + 1)) {
+            return false;
+        }
+    }
+    return decode_record(reader, record);
+}
+
+/* Whether all bytes of the recorded store are in memory, which a damaged trace does not guarantee */
+static bool is_trace_store_in_memory(const TraceRecord *record, const Memory *memory) {
+    uint32_t width = UINT32_C(1) << record->byte_mode;
+    return record->memory_location >= width - 1 && record->memory_location < memory->size_bytes;
+}
+
+static bool apply_trace_store(const TraceRecord *record, Cpu *cpu, Memory *memory) {
+    if (!is_trace_store_in_memory(record, memory)) {
+        return false;
+    }
+    uint32_t width = UINT32_C(1) << record->byte_mode;
+    uint32_t first_location = record->memory_location - (width - 1);
+    mark_memory_dirty(memory, record->memory_location);
+    if (width == 4) {
+        store_memory_word(memory, first_location, record->memory_value);
+    } else if (width == 2) {
+        store_memory_half_word(memory, first_location, record->memory_value);
+    } else {
+        store_memory_byte(memory, first_location, record->memory_value);
+    }
+    invalidate_decoded_instructions(cpu, first_location, record->memory_location);
+    return true;
+}
+
+/* Finds the last block whose checkpoint is not past the step */
+static uint64_t find_block(const TraceReader *reader, uint64_t step) {
+    uint64_t low = 0;
+    uint64_t high = reader->block_count;
+    while (high - low > 1) {
+        uint64_t middle = low + (high - low) / 2;
+        uint8_t header[TRACE_HEADER_BYTES];
+        if (read_block_header(reader, middle, header) && get_u64(header + 8) <= step) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+bool seek_trace(TraceReader *reader, uint64_t step, Cpu *cpu, Memory *memory) {
+    if (!load_block(reader, memory != NULL ? 0 : find_block(reader, step)) || reader->state.step > step) {
+        return false;
+    }
+
+    TraceRecord record;
+    while (reader->state.step < step) {
+        if (!read_trace_record(reader, &record)) {
+            return false;
+        }
+        if (memory != NULL && record.writes_memory && !apply_trace_store(&record, cpu, memory)) {
+            return false;
+        }
+    }
+    cpu->program_counter = reader->state.program_counter;
+    memcpy(cpu->registers, reader->state.registers, sizeof(cpu->registers));
+    return true;
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> replay >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static uint32_t load_stored_value(const Memory *memory, uint32_t location, uint32_t byte_mode) {
+    switch (byte_mode) {
+    case 2:
+        return load_memory_word(memory, location - 3);
+    case 1:
+        return load_memory_half_word(memory, location - 1);
+    default:
+        return load_memory_byte(memory, location);
+    }
+}
+
+/* Runs the instruction the way run_cpu does: the program counter is advanced past it before it executes */
+static bool replay_record(const TraceRecord *record, Cpu *cpu, Memory *memory) {
+    uint32_t address = record->program_counter;
+    if (cpu->program_counter != address || address % 4 != 0 || address > memory->size_bytes - 4 ||
+        read_word(memory, address) != record->word) {
+        return false;
+    }
+    /* Registers without a record must keep their value, the recorder leaves out writes which changed nothing */
+    uint32_t registers[8];
+    memcpy(registers, cpu->registers, sizeof(registers));
+    if (record->writes_register) {
+        registers[record->register_index] = record->register_value;
+    }
+    cpu->program_counter = address + 4;
+    if (execute_instruction(record->word, cpu, memory).kind != TRAP_NONE ||
+        cpu->program_counter != record->next_program_counter ||
+        memcmp(cpu->registers, registers, sizeof(registers)) != 0) {
+        return false;
+    }
+    return !record->writes_memory || (is_trace_store_in_memory(record, memory) &&
+                                      load_stored_value(memory, record->memory_location, record->byte_mode) ==
+                                          record->memory_value);
+}
+
+ReplayResult replay_trace(TraceReader *reader, Cpu *cpu, Memory *memory, uint64_t max_steps) {
+    ReplayResult result = {REPLAY_STEP_LIMIT, 0};
+    TraceRecord record;
+    while (result.steps < max_steps) {
+        if (!read_trace_record(reader, &record)) {
+            result.status = REPLAY_END;
+            break;
+        }
+        if (!replay_record(&record, cpu, memory)) {
+            result.status = REPLAY_DIVERGED;
+            result.expected = record;
+            break;
+        }
+        result.steps++;
+    }
+    return result;
+}
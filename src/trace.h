@@ -0,0 +1,93 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "cpu.h"
+#include "memory.h"
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * A trace file is a sequence of fixed size blocks. Every block starts with a checkpoint, the step number, program
+ * counter and registers before its first record, followed by delta encoded records which only refer back to earlier
+ * records of the same block. So any block can be decoded on its own, and finding the block holding a step is a binary
+ * search over the checkpoints.
+ */
+#define TRACE_BLOCK_BYTES 65536
+
+/* What one executed instruction did */
+typedef struct TraceRecord {
+    uint64_t step; // Counted from the first instruction the recorder saw
+    uint32_t program_counter;
+    uint32_t word;
+    uint32_t next_program_counter;
+
+    /* Only set when the written register changed */
+    bool writes_register;
+    uint8_t register_index;
+    uint32_t register_value;
+
+    bool writes_memory;
+    uint8_t byte_mode;
+    uint32_t memory_location; // Address of the last byte, like the location of ST
+    uint32_t memory_value;
+} TraceRecord;
+
+typedef struct TraceRecorder TraceRecorder;
+
+/*
+ * Records every instruction run_cpu executes while the recorder is attached to Cpu.trace, execute_instruction is not
+ * recorded. Blocks are handed to a writer thread which writes them to fd, so recording never waits on the file unless
+ * the writer falls a whole ring of blocks behind. Returns NULL if the thread or its buffers cannot be created.
+ */
+TraceRecorder *init_trace_recorder(int fd);
+
+/* Writes the partially filled block and waits for it, returns false if any write so far failed */
+bool flush_trace_recorder(TraceRecorder *recorder);
+
+/* Flushes, stops the writer thread and releases the recorder */
+void free_trace_recorder(TraceRecorder *recorder);
+
+/* Called by run_cpu before the first step of a run, starts a new block if the CPU was changed behind the recorder */
+void begin_trace_run(TraceRecorder *recorder, const Cpu *cpu);
+
+/* Called by run_cpu after an instruction executed without trapping. Stores to devices are not recorded */
+void record_trace(TraceRecorder *recorder, const Cpu *cpu, const Memory *memory, const DecodedInstruction *decoded,
+                  uint32_t address, uint32_t word);
+
+typedef struct TraceReader TraceReader;
+
+/* Reads the trace from fd, returns NULL when it is not a trace */
+TraceReader *init_trace_reader(int fd);
+
+void free_trace_reader(TraceReader *reader);
+
+/* Returns false at the end of the trace or on a damaged block */
+bool read_trace_record(TraceReader *reader, TraceRecord *record);
+
+/*
+ * Positions the reader on the step and puts the program counter and registers the CPU had before it into cpu, decoding
+ * only the block holding the step. Memory is only brought to that point when given, which applies the stores of every
+ * earlier record. Returns false when the trace has no such step, or records a store memory does not hold.
+ */
+bool seek_trace(TraceReader *reader, uint64_t step, Cpu *cpu, Memory *memory);
+
+typedef enum ReplayStatus {
+    REPLAY_END,        // Every record of the trace was reproduced
+    REPLAY_STEP_LIMIT, // The step budget was used up
+    REPLAY_DIVERGED,   // An instruction did something other than the trace says, see expected
+} ReplayStatus;
+
+typedef struct ReplayResult {
+    ReplayStatus status;
+    uint64_t steps;       // Records reproduced, not counting the one which diverged
+    TraceRecord expected; // The record which was not reproduced when status is REPLAY_DIVERGED
+} ReplayResult;
+
+/*
+ * Executes the recorded instructions one by one with execute_instruction, from the state of cpu and memory, and
+ * checks each one against its record. Starting from the state the recording started from, or the state seek_trace
+ * restored, a deterministic machine reproduces the whole trace.
+ */
+ReplayResult replay_trace(TraceReader *reader, Cpu *cpu, Memory *memory, uint64_t max_steps);
+
+#endif
@@ -1,15 +1,35 @@
 extern "C" {
+#include "../src/analyzer.h"
+#include "../src/assembler.h"
+#include "../src/batch.h"
 #include "../src/bit_utils.h"
+#include "../src/branch_predictor.h"
+#include "../src/bus.h"
+#include "../src/cache.h"
 #include "../src/cpu.h"
+#include "../src/decode_cache.h"
+#include "../src/devices.h"
+#include "../src/interrupts.h"
+#include "../src/loader.h"
+#include "../src/machine.h"
 #include "../src/memory.h"
+#include "../src/mmu.h"
+#include "../src/pack.h"
+#include "../src/profile.h"
+#include "../src/snapshot.h"
+#include "../src/timing.h"
+#include "../src/trace.h"
 }
 #include <gtest/gtest.h>
 #include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> utils >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-static Cpu init_cpu_with_state(const uint32_t registers[8]) {
-    Cpu cpu = init_cpu();
+static Cpu init_cpu_with_state(CpuBackend backend, const uint32_t registers[8]) {
+    Cpu cpu = init_cpu(backend);
     cpu.program_counter = 0;
     for (int i = 0; i < 8; i++) {
         cpu.registers[i] = registers[i];
@@ -17,459 +37,2818 @@ static Cpu init_cpu_with_state(const uint32_t registers[8]) {
     return cpu;
 }
 
-static Memory init_memory_with_state(const uint8_t *data, int size) {
-    Memory memory = init_memory();
+static Memory *init_memory_with_state(const uint8_t *data, int size) {
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
     for (int i = 0; i < size; i++) {
-        memory.data[i] = data[i];
+        memory->data[i] = data[i];
     }
     return memory;
 }
 
+/* Writes instruction words into memory the same way STW would, starting at address 0 */
+static void store_program(Memory *memory, const uint32_t *program, int size) {
+    for (int i = 0; i < size; i++) {
+        memory->data[i * 4] = program[i] >> 24;
+        memory->data[i * 4 + 1] = program[i] >> 16;
+        memory->data[i * 4 + 2] = program[i] >> 8;
+        memory->data[i * 4 + 3] = program[i];
+    }
+}
+
+/* Every test runs once against each backend */
+class CpuTest : public testing::TestWithParam<CpuBackend> {};
+
+static std::string backend_name(const testing::TestParamInfo<CpuBackend> &info) {
+    static const char *names[] = {"Interpreter", "Threaded", "Jit"};
+    return names[info.param];
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, CpuTest,
+                         testing::Values(CPU_BACKEND_INTERPRETER, CPU_BACKEND_THREADED, CPU_BACKEND_JIT),
+                         backend_name);
+
+/* Tests of execute_instruction alone, which the JIT has no path for and leaves to the interpreter */
+class InstructionTest : public testing::TestWithParam<CpuBackend> {};
+
+INSTANTIATE_TEST_SUITE_P(Backends, InstructionTest, testing::Values(CPU_BACKEND_INTERPRETER, CPU_BACKEND_THREADED),
+                         backend_name);
+
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> JMP >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* When we execute the jump instruction with offset 1 then the program counter should be set to 1 */
-TEST(Cpu, test_jmp_intruction_with_offset_value) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_jmp_intruction_with_offset_value) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t jmp_instruction = BITMASK_12 | BITMASK_5 | JMP_BITMASK;
-    execute_instruction(jmp_instruction, &cpu, &memory);
+    execute_instruction(jmp_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.program_counter, 1);
+    free_memory(memory);
 }
 
 /*
  * When we execute a jump instruction with an offset of 1 but the "maybe skip instruction" flag is enabled and the
  * "maybe skip instruction" register is true then the program counter should not be set to 1
  */
-TEST(Cpu, test_jmp_instruction_skips) {
+TEST_P(InstructionTest, test_jmp_instruction_skips) {
     const uint32_t registers[8] = {0, 1, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t jmp_instruction = BITMASK_12 | BITMASK_6 | BITMASK_5 | BITMASK_4 | JMP_BITMASK;
-    execute_instruction(jmp_instruction, &cpu, &memory);
+    execute_instruction(jmp_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.program_counter, 0);
+    free_memory(memory);
 }
 
 /*
  * Attempts to set the program counter to 1 and succeeds because while "maybe skip instruction" flag is enabled our
  * "maybe skip instruction" register is false
  */
-TEST(Cpu, test_jmp_instruction_does_not_skip) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_jmp_instruction_does_not_skip) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t jmp_instruction = BITMASK_12 | BITMASK_5 | BITMASK_4 | JMP_BITMASK;
-    execute_instruction(jmp_instruction, &cpu, &memory);
+    execute_instruction(jmp_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.program_counter, 1);
+    free_memory(memory);
 }
 
 /* Sets program counter to the value of register 0 plus an offset of 1 */
-TEST(Cpu, test_jmp_instruction_works_with_base_register) {
+TEST_P(InstructionTest, test_jmp_instruction_works_with_base_register) {
     const uint32_t registers[8] = {2, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t jmp_instruction = BITMASK_12 | BITMASK_5 | JMP_BITMASK;
-    execute_instruction(jmp_instruction, &cpu, &memory);
+    execute_instruction(jmp_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.program_counter, 3);
+    free_memory(memory);
 }
 
 /* Sets program counter to the value of 1 using a 0 base register plus a 1 offset register */
-TEST(Cpu, test_jmp_instruction_works_with_offset_register) {
+TEST_P(InstructionTest, test_jmp_instruction_works_with_offset_register) {
     const uint32_t registers[8] = {1, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t jmp_instruction = BITMASK_12 | JMP_BITMASK;
-    execute_instruction(jmp_instruction, &cpu, &memory);
+    execute_instruction(jmp_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.program_counter, 1);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> ST >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-TEST(Cpu, test_st_byte_instruction) {
+TEST_P(InstructionTest, test_st_byte_instruction) {
     const uint32_t registers[8] = {0, 1, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     /* Puts the lower order 8 bits of register 1 into memory address 0 */
     uint32_t store_instruction = BITMASK_8 | STB_BITMASK;
-    execute_instruction(store_instruction, &cpu, &memory);
+    execute_instruction(store_instruction, &cpu, memory);
 
-    EXPECT_EQ((int) memory.data[0], 1);
+    EXPECT_EQ((int) memory->data[0], 1);
+    free_memory(memory);
 }
 
-TEST(Cpu, test_st_4_byte_instruction) {
+TEST_P(InstructionTest, test_st_4_byte_instruction) {
     const uint32_t registers[8] = {0, 0x87654321, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     /* Puts register 1 into memory address 0 to 3 */
     uint32_t store_instruction = BITMASK_15 | BITMASK_14 | BITMASK_8 | BITMASK_7 | STW_BITMASK;
-    execute_instruction(store_instruction, &cpu, &memory);
+    execute_instruction(store_instruction, &cpu, memory);
 
-    EXPECT_EQ((int) memory.data[3], 0x21);
-    EXPECT_EQ((int) memory.data[2], 0x43);
-    EXPECT_EQ((int) memory.data[1], 0x65);
-    EXPECT_EQ((int) memory.data[0], 0x87);
+    EXPECT_EQ((int) memory->data[3], 0x21);
+    EXPECT_EQ((int) memory->data[2], 0x43);
+    EXPECT_EQ((int) memory->data[1], 0x65);
+    EXPECT_EQ((int) memory->data[0], 0x87);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> LD >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-TEST(Cpu, test_ld_byte_instruction) {
-    Cpu cpu = init_cpu();
+TEST_P(InstructionTest, test_ld_byte_instruction) {
+    Cpu cpu = init_cpu(GetParam());
     const uint8_t data[4] = {0, 0, 0, 1};
-    Memory memory = init_memory_with_state(data, 4);
+    Memory *memory = init_memory_with_state(data, 4);
 
     uint32_t instruction = BITMASK_15 | BITMASK_14 | BITMASK_8 | BITMASK_7 | LDB_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[1], 1);
+    free_memory(memory);
 }
 
-TEST(Cpu, test_ld_4_byte_instruction) {
-    Cpu cpu = init_cpu();
+TEST_P(InstructionTest, test_ld_4_byte_instruction) {
+    Cpu cpu = init_cpu(GetParam());
     const uint8_t data[4] = {0x87, 0x65, 0x43, 0x21};
-    Memory memory = init_memory_with_state(data, 4);
+    Memory *memory = init_memory_with_state(data, 4);
 
     uint32_t instruction = BITMASK_15 | BITMASK_14 | BITMASK_8 | BITMASK_7 | LDW_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[1], 0x87654321);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> SET >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-TEST(Cpu, test_set_instruction) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_set_instruction) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_8 | SET_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 1);
+    free_memory(memory);
 }
 
-TEST(Cpu, test_set_instruction_with_negative_value) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_set_instruction_with_negative_value) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_8 | SETN_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], UINT32_C(4261412865));
+    free_memory(memory);
 }
 
-TEST(Cpu, test_set_instruction_with_different_register) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_set_instruction_with_different_register) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_8 | BITMASK_5 | SET_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[1], 1);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> SETU >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-TEST(Cpu, test_setu_instruction) {
-    Cpu cpu = init_cpu();
-    Memory memory = init_memory();
+TEST_P(InstructionTest, test_setu_instruction) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_7 | SETU_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 33554432);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> ADD >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
-TEST(Cpu, test_add_instruction) {
+TEST_P(InstructionTest, test_add_instruction) {
     const uint32_t registers[8] = {1, 2, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_11 | ADD_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /* Adds 2 to register 0 and stores the result in register 0 */
-TEST(Cpu, test_add_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_add_instruction_with_control_bit) {
     const uint32_t registers[8] = {1, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_15 | BITMASK_7 | ADD_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> SUB >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Subtracts register 1 from register 0 and stores the result in register 0 */
-TEST(Cpu, test_sub_instruction) {
+TEST_P(InstructionTest, test_sub_instruction) {
     const uint32_t registers[8] = {4, 1, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_14 | SUB_BITMASK;
 
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /* Subtracts 1 from register 0 and stores the result in register 0 */
-TEST(Cpu, test_sub_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_sub_instruction_with_control_bit) {
     const uint32_t registers[8] = {4, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t instruction = BITMASK_14 | SUBI_BITMASK;
-    execute_instruction(instruction, &cpu, &memory);
+    execute_instruction(instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> MUL >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Multiplies register 0 and register 1 and stores the result in register 0 */
-TEST(Cpu, test_mul_instruction) {
+TEST_P(InstructionTest, test_mul_instruction) {
     const uint32_t registers[8] = {2, 3, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t mul_instruction = BITMASK_14 | MUL_BITMASK;
-    execute_instruction(mul_instruction, &cpu, &memory);
+    execute_instruction(mul_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 6);
+    free_memory(memory);
 }
 
 /* Multiplies register 0 by 5 and stores the result in register 0 */
-TEST(Cpu, test_mul_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_mul_instruction_with_control_bit) {
     const uint32_t registers[8] = {2, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t mul_instruction = BITMASK_16 | BITMASK_14 | MULI_BITMASK;
-    execute_instruction(mul_instruction, &cpu, &memory);
+    execute_instruction(mul_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 10);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> DIV >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Divides register 0 by register 1 and stores the result in register 0 */
-TEST(Cpu, test_div_instruction) {
+TEST_P(InstructionTest, test_div_instruction) {
     const uint32_t registers[8] = {6, 2, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t div_instruction = BITMASK_14 | DIV_BITMASK;
-    execute_instruction(div_instruction, &cpu, &memory);
+    execute_instruction(div_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /* Divides register 0 by 2 and stores the result in register 0 */
-TEST(Cpu, test_div_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_div_instruction_with_control_bit) {
     const uint32_t registers[8] = {6, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t div_instruction = BITMASK_15 | DIVI_BITMASK;
-    execute_instruction(div_instruction, &cpu, &memory);
+    execute_instruction(div_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 3);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> MOD >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Performs the modulo operation on register 0 using register 1 and stores the remainder in register 0 */
-TEST(Cpu, test_mod_instruction) {
+TEST_P(InstructionTest, test_mod_instruction) {
     const uint32_t registers[8] = {6, 5, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t mod_instruction = BITMASK_14 | MOD_BITMASK;
-    execute_instruction(mod_instruction, &cpu, &memory);
+    execute_instruction(mod_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 1);
+    free_memory(memory);
 }
 
 /* Performs the modulo operation on register 0 using a value of 5 and stores the remainder in register 0 */
-TEST(Cpu, test_mod_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_mod_instruction_with_control_bit) {
     const uint32_t registers[8] = {6, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t mod_instruction = BITMASK_16 | BITMASK_14 | MODI_BITMASK;
-    execute_instruction(mod_instruction, &cpu, &memory);
+    execute_instruction(mod_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 1);
+    free_memory(memory);
 }
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> AND >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Performs an AND operation on register 0 and register 1 */
-TEST(Cpu, test_and_instruction) {
+TEST_P(InstructionTest, test_and_instruction) {
     const uint32_t registers[8] = {0b0011, 0b0101, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t and_instruction = BITMASK_11 | AND_BITMASK;
-    execute_instruction(and_instruction, &cpu, &memory);
+    execute_instruction(and_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0001);
+    free_memory(memory);
 }
 
 /* Performs an AND operation on register 0 and value 101 */
-TEST(Cpu, test_and_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_and_instruction_with_control_bit) {
     const uint32_t registers[8] = {0b0110, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t and_instruction = BITMASK_16 | BITMASK_14 | ANDI_BITMASK;
-    execute_instruction(and_instruction, &cpu, &memory);
+    execute_instruction(and_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0100);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> OR >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Performs an OR operation on register 0 and register 1 */
-TEST(Cpu, test_or_instruction) {
+TEST_P(InstructionTest, test_or_instruction) {
     const uint32_t registers[8] = {0b0011, 0b0101, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t or_instruction = BITMASK_11 | OR_BITMASK;
-    execute_instruction(or_instruction, &cpu, &memory);
+    execute_instruction(or_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0111);
+    free_memory(memory);
 }
 
 /* Performs an OR operation on register 0 and value 0b100 */
-TEST(Cpu, test_or_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_or_instruction_with_control_bit) {
     const uint32_t registers[8] = {0b1010, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t or_instruction = BITMASK_16 | ORI_BITMASK;
-    execute_instruction(or_instruction, &cpu, &memory);
+    execute_instruction(or_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b1110);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> XOR >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Performs an XOR operation on register 0 and register 1 */
-TEST(Cpu, test_xor_instruction) {
+TEST_P(InstructionTest, test_xor_instruction) {
     const uint32_t registers[8] = {0b011, 0b0101, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t xor_instruction = BITMASK_11 | XOR_BITMASK;
-    execute_instruction(xor_instruction, &cpu, &memory);
+    execute_instruction(xor_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0110);
+    free_memory(memory);
 }
 
 /* Performs an XOR operation on register 0 and value 0b0010 */
-TEST(Cpu, test_xor_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_xor_instruction_with_control_bit) {
     const uint32_t registers[8] = {0b1010, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t xor_instruction = BITMASK_15 | XORI_BITMASK;
-    execute_instruction(xor_instruction, &cpu, &memory);
+    execute_instruction(xor_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b1000);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BSR >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Bit shifts register 0 by register 1 and stores the value in register 0 */
-TEST(Cpu, test_bsr_instruction) {
+TEST_P(InstructionTest, test_bsr_instruction) {
     const uint32_t registers[8] = {0b0100, 2, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsr_instruction = BITMASK_13 | BSR_BITMASK;
-    execute_instruction(bsr_instruction, &cpu, &memory);
+    execute_instruction(bsr_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0001);
+    free_memory(memory);
 }
 
 /* Bit shifts register 0 twice resulting in a value of 1 */
-TEST(Cpu, test_bsr_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_bsr_instruction_with_control_bit) {
     const uint32_t registers[8] = {0b0100, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsr_instruction = BITMASK_14 | BSRI_BITMASK;
-    execute_instruction(bsr_instruction, &cpu, &memory);
+    execute_instruction(bsr_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0001);
+    free_memory(memory);
 }
 
 /* 
  * Bit shifts register 0 twice while letting it overflow back onto the higher order bits resulting in a value of
  * -1073741823 
  */
-TEST(Cpu, test_bsr_instruction_with_control_bit_and_overflow) {
+TEST_P(InstructionTest, test_bsr_instruction_with_control_bit_and_overflow) {
     const uint32_t registers[8] = {0b0101, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsr_instruction = BITMASK_14 | BSRRI_BITMASK;
-    execute_instruction(bsr_instruction, &cpu, &memory);
+    execute_instruction(bsr_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], BITMASK_31 | BITMASK_1);
+    free_memory(memory);
 }
 
 /*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> BSL >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
 
 /* Bit shifts register 0 by register 1 and stores the value in register 0 */
-TEST(Cpu, test_bsl_instruction) {
+TEST_P(InstructionTest, test_bsl_instruction) {
     const uint32_t registers[8] = {0b0010, 2, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsl_instruction = BITMASK_13 | BSL_BITMASK;
-    execute_instruction(bsl_instruction, &cpu, &memory);
+    execute_instruction(bsl_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b1000);
+    free_memory(memory);
 }
 
 /* Bit shifts register 0 left twice resulting in a value of 0b1000 */
-TEST(Cpu, test_bsl_instruction_with_control_bit) {
+TEST_P(InstructionTest, test_bsl_instruction_with_control_bit) {
     const uint32_t registers[8] = {0b0010, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsl_instruction = BITMASK_14 | BSLI_BITMASK;
-    execute_instruction(bsl_instruction, &cpu, &memory);
+    execute_instruction(bsl_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b1000);
+    free_memory(memory);
 }
 
 /* Bit shifts register 0 once while letting it overflow back onto the lower order bits resulting in a value of 3 */
-TEST(Cpu, test_bsl_instruction_with_control_bit_and_overflow) {
+TEST_P(InstructionTest, test_bsl_instruction_with_control_bit_and_overflow) {
     const uint32_t registers[8] = {BITMASK_32 | BITMASK_1, 0, 0, 0, 0, 0, 0, 0};
-    Cpu cpu = init_cpu_with_state(registers);
-    Memory memory = init_memory();
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
 
     uint32_t bsl_instruction = BITMASK_13 | BSLRI_BITMASK;
-    execute_instruction(bsl_instruction, &cpu, &memory);
+    execute_instruction(bsl_instruction, &cpu, memory);
 
     EXPECT_EQ(cpu.registers[0], 0b0011);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Run loop >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Increments register 0 and jumps back to address 0 forever, so the run stops once the step budget is used */
+TEST_P(CpuTest, test_run_cpu_stops_at_step_limit) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[2] = {
+        BITMASK_14 | ADDI_BITMASK,           // ADDI R1 R1 1
+        BITMASK_9 | BITMASK_5 | JMP_BITMASK, // JMPI R2 0
+    };
+    store_program(memory, program, 2);
+
+    RunResult result = run_cpu(&cpu, memory, 10);
+
+    EXPECT_EQ(result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(result.steps, 10);
+    EXPECT_EQ(cpu.registers[0], 5);
+    EXPECT_EQ(cpu.program_counter, 0);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Sets register 0 and then jumps onto its own address, which halts the run */
+TEST_P(CpuTest, test_run_cpu_halts_on_jump_to_self) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[2] = {
+        BITMASK_8 | SET_BITMASK,                          // SET R1 1
+        BITMASK_14 | BITMASK_9 | BITMASK_5 | JMP_BITMASK, // JMPI R2 4
+    };
+    store_program(memory, program, 2);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 2);
+    EXPECT_EQ(cpu.registers[0], 1);
+    EXPECT_EQ(cpu.program_counter, 4);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* The unused op code faults without being executed and leaves the program counter on it */
+TEST_P(CpuTest, test_run_cpu_faults_on_unused_op_code) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[1] = {OP_CODE_BITMASK};
+    store_program(memory, program, 1);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 0);
+    EXPECT_EQ(result.trap.kind, TRAP_UNUSED_OP_CODE);
+    EXPECT_EQ(cpu.program_counter, 0);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Jumps to the end of memory, the next fetch is out of range and faults */
+TEST_P(CpuTest, test_run_cpu_faults_when_program_counter_leaves_memory) {
+    const uint32_t registers[8] = {MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[1] = {BITMASK_5 | JMP_BITMASK}; // JMPI R1 0
+    store_program(memory, program, 1);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 1);
+    EXPECT_EQ(result.trap.kind, TRAP_INVALID_INSTRUCTION_ADDRESS);
+    EXPECT_EQ(result.trap.address, MEMORY_SIZE_BYTES);
+    EXPECT_EQ(cpu.program_counter, MEMORY_SIZE_BYTES);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Sums 10 down to 1 into register 1 and halts once register 0 reaches zero */
+static const uint32_t SUM_PROGRAM[5] = {
+    ADD_BITMASK | 1 << 7 | 1 << 10 | 0 << 13,                         // ADD   R2 R2 R1
+    SUBI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,                        // SUBI  R1 R1 1
+    JMP_BITMASK | BITMASK_5 | BITMASK_4 | 0 << 5 | 2 << 8 | 16 << 11, // JMPIC R3 16 R1
+    JMP_BITMASK | BITMASK_5 | 2 << 8 | 0 << 11,                       // JMPI  R3 0
+    JMP_BITMASK | BITMASK_5 | 2 << 8 | 16 << 11,                      // JMPI  R3 16
+};
+
+TEST_P(CpuTest, test_run_cpu_loops_until_halt) {
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 40);
+    EXPECT_EQ(cpu.registers[1], 55);
+    EXPECT_EQ(cpu.program_counter, 16);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Running the same loop a few steps at a time must reach the same state as running it in one go */
+TEST_P(CpuTest, test_run_cpu_resumes_across_calls) {
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+
+    uint64_t steps = 0;
+    RunResult result;
+    do {
+        result = run_cpu(&cpu, memory, 3);
+        steps += result.steps;
+    } while (result.status == CPU_STATUS_STEP_LIMIT);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(steps, 40);
+    EXPECT_EQ(cpu.registers[1], 55);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Runs one of most instruction kinds in a single straight line block */
+TEST_P(CpuTest, test_run_cpu_straight_line_program) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[9] = {
+        SET_BITMASK | 0 << 4 | 3 << 7,               // SET   R1 3
+        MULI_BITMASK | 1 << 7 | 0 << 10 | 7 << 13,   // MULI  R2 R1 7
+        BSLI_BITMASK | 2 << 6 | 1 << 9 | 4 << 12,    // BSLI  R3 R2 4
+        BSRRI_BITMASK | 3 << 6 | 0 << 9 | 1 << 12,   // BSRRI R4 R1 1
+        XORI_BITMASK | 4 << 7 | 2 << 10 | 255 << 13, // XORI  R5 R3 255
+        SETU_BITMASK | 5 << 3 | 1 << 6,              // SETU  R6 1
+        STWI_BITMASK | 2 << 7 | 7 << 10 | 103 << 13, // STWI  R3 R8 103
+        LDHI_BITMASK | 6 << 7 | 7 << 10 | 103 << 13, // LDHI  R7 R8 103
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 32 << 11, // JMPI  R8 32
+    };
+    store_program(memory, program, 9);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 9);
+    EXPECT_EQ(cpu.registers[0], 3);
+    EXPECT_EQ(cpu.registers[1], 21);
+    EXPECT_EQ(cpu.registers[2], 336);
+    EXPECT_EQ(cpu.registers[3], BITMASK_32 | BITMASK_1);
+    EXPECT_EQ(cpu.registers[4], 431);
+    EXPECT_EQ(cpu.registers[5], BITMASK_26);
+    EXPECT_EQ(cpu.registers[6], 336);
+    EXPECT_EQ((int) memory->data[102], 0x01);
+    EXPECT_EQ((int) memory->data[103], 0x50);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* The first instruction overwrites the third one, which must run in its new form */
+TEST_P(CpuTest, test_store_modifies_later_instruction) {
+    const uint32_t registers[8] = {0, SET_BITMASK | 2 << 7, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[4] = {
+        STWI_BITMASK | 1 << 7 | 7 << 10 | 11 << 13,  // STWI R2 R8 11
+        ADDI_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,   // ADDI R3 R3 1
+        SET_BITMASK | 0 << 4 | 1 << 7,               // SET  R1 1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11, // JMPI R8 12
+    };
+    store_program(memory, program, 4);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 4);
+    EXPECT_EQ(cpu.registers[0], 2);
+    EXPECT_EQ(cpu.registers[2], 1);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Adds the constant in register 1 to the 4 words at 1024, every idiom the threaded backend fuses is in the loop */
+static const uint32_t FUSED_IDIOMS_PROGRAM[10] = {
+    SET_BITMASK | 1 << 4 | 3 << 7,                                    // SET   R2 3
+    SETU_BITMASK | 1 << 3 | 1 << 6,                                   // SETU  R2 1
+    LDWI_BITMASK | 2 << 7 | 0 << 10 | 1027 << 13,                     // LDWI  R3 R1 1027
+    ADD_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,                         // ADD   R3 R3 R2
+    STWI_BITMASK | 2 << 7 | 0 << 10 | 1027 << 13,                     // STWI  R3 R1 1027
+    ADDI_BITMASK | 0 << 7 | 0 << 10 | 4 << 13,                        // ADDI  R1 R1 4
+    SUBI_BITMASK | 3 << 7 | 0 << 10 | 16 << 13,                       // SUBI  R4 R1 16
+    JMP_BITMASK | BITMASK_5 | BITMASK_4 | 3 << 5 | 7 << 8 | 36 << 11, // JMPIC R8 36 R4
+    JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11,                       // JMPI  R8 0
+    JMP_BITMASK | BITMASK_5 | 7 << 8 | 36 << 11,                      // JMPI  R8 36
+};
+
+/* Whatever the step budget of each call, running the idioms fused or not must give the same result */
+TEST_P(CpuTest, test_run_cpu_fused_idioms) {
+    for (uint64_t max_steps : {1, 2, 3, 1000}) {
+        Cpu cpu = init_cpu(GetParam());
+        Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+        store_program(memory, FUSED_IDIOMS_PROGRAM, 10);
+
+        uint64_t steps = 0;
+        RunResult result;
+        do {
+            result = run_cpu(&cpu, memory, max_steps);
+            steps += result.steps;
+        } while (result.status == CPU_STATUS_STEP_LIMIT);
+
+        EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+        EXPECT_EQ(steps, 36);
+        EXPECT_EQ(cpu.registers[0], 16);
+        EXPECT_EQ(cpu.registers[1], BITMASK_26 | 3);
+        EXPECT_EQ(cpu.program_counter, 36);
+        for (int address = 1024; address < 1040; address += 4) {
+            EXPECT_EQ((int) memory->data[address], 0x02);
+            EXPECT_EQ((int) memory->data[address + 3], 0x03);
+        }
+        free_cpu(&cpu);
+        free_memory(memory);
+    }
+}
+
+/* The fused LD and ADD loads the last byte of a word, which an out of budget run must not load the whole word for */
+TEST_P(CpuTest, test_run_cpu_fused_byte_load) {
+    const uint32_t program[6] = {
+        LDBI_BITMASK | 2 << 7 | 7 << 10 | 1027 << 13,                     // LDBI  R3 R8 1027
+        ADDI_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,                        // ADDI  R3 R3 1
+        SUBI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,                        // SUBI  R1 R1 1
+        JMP_BITMASK | BITMASK_5 | BITMASK_4 | 0 << 5 | 7 << 8 | 20 << 11, // JMPIC R8 20 R1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11,                       // JMPI  R8 0
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 20 << 11,                      // JMPI  R8 20
+    };
+    for (uint64_t max_steps : {1, 1000}) {
+        const uint32_t registers[8] = {3, 0, 0, 0, 0, 0, 0, 0};
+        Cpu cpu = init_cpu_with_state(GetParam(), registers);
+        Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+        store_program(memory, program, 6);
+        memory->data[1024] = 0x11;
+        memory->data[1027] = 0x7F;
+
+        uint64_t steps = 0;
+        RunResult result;
+        do {
+            result = run_cpu(&cpu, memory, max_steps);
+            steps += result.steps;
+        } while (result.status == CPU_STATUS_STEP_LIMIT);
+
+        EXPECT_EQ(result.status, CPU_STATUS_HALTED) << "budget " << max_steps;
+        EXPECT_EQ(steps, 15) << "budget " << max_steps;
+        EXPECT_EQ(cpu.registers[2], 0x80) << "budget " << max_steps;
+        free_cpu(&cpu);
+        free_memory(memory);
+    }
+}
+
+/* The store replaces the SETU after the first iteration ran it, the second iteration must run the new one */
+TEST_P(CpuTest, test_store_modifies_second_word_of_idiom) {
+    const uint32_t registers[8] = {0, 0, 0, 0, SETU_BITMASK | 1 << 3 | 2 << 6, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[8] = {
+        SET_BITMASK | 1 << 4 | 3 << 7,                                    // SET   R2 3
+        SETU_BITMASK | 1 << 3 | 1 << 6,                                   // SETU  R2 1
+        STWI_BITMASK | 4 << 7 | 7 << 10 | 7 << 13,                        // STWI  R5 R8 7
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,                        // ADDI  R1 R1 1
+        SUBI_BITMASK | 3 << 7 | 0 << 10 | 2 << 13,                        // SUBI  R4 R1 2
+        JMP_BITMASK | BITMASK_5 | BITMASK_4 | 3 << 5 | 7 << 8 | 28 << 11, // JMPIC R8 28 R4
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11,                       // JMPI  R8 0
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 28 << 11,                      // JMPI  R8 28
+    };
+    store_program(memory, program, 8);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 14);
+    EXPECT_EQ(cpu.registers[1], BITMASK_27 | 3);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* The load and add of the load-modify-store count as steps when its store faults, and the trap reports the store */
+TEST_P(CpuTest, test_run_cpu_faults_inside_idiom) {
+    const uint32_t registers[8] = {MEMORY_SIZE_BYTES - 12, 1, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[5] = {
+        LDWI_BITMASK | 2 << 7 | 0 << 10 | 3 << 13,  // LDWI R3 R1 3
+        ADD_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,   // ADD  R3 R3 R2
+        STWI_BITMASK | 2 << 7 | 0 << 10 | 7 << 13,  // STWI R3 R1 7
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 4 << 13,  // ADDI R1 R1 4
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11, // JMPI R8 0
+    };
+    store_program(memory, program, 5);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 12);
+    EXPECT_EQ(result.trap.kind, TRAP_INVALID_MEMORY_LOCATION);
+    EXPECT_EQ(result.trap.program_counter, 8);
+    EXPECT_EQ(cpu.program_counter, 8);
+    EXPECT_EQ(cpu.registers[2], 3);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Traps >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Divides register 0 by the zeroed register 1, the destination must be left untouched */
+TEST_P(InstructionTest, test_div_by_zero_raises_trap) {
+    const uint32_t registers[8] = {6, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+
+    uint32_t div_instruction = BITMASK_14 | DIV_BITMASK;
+    Trap trap = execute_instruction(div_instruction, &cpu, memory);
+
+    EXPECT_EQ(trap.kind, TRAP_DIVISION_BY_ZERO);
+    EXPECT_EQ(cpu.registers[0], 6);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Loads a word from address 5, which is not the last byte of an aligned word */
+TEST_P(InstructionTest, test_misaligned_load_raises_trap) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+
+    uint32_t instruction = BITMASK_16 | BITMASK_14 | BITMASK_8 | LDWI_BITMASK; // LDWI R2 R1 5
+    Trap trap = execute_instruction(instruction, &cpu, memory);
+
+    EXPECT_EQ(trap.kind, TRAP_MISALIGNED_MEMORY_ACCESS);
+    EXPECT_EQ(trap.address, 5);
+    EXPECT_EQ(trap.value, 2);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Executing op code 7 directly traps on every backend rather than doing nothing, and leaves the registers alone */
+TEST_P(InstructionTest, test_unused_op_code_raises_trap) {
+    const uint32_t registers[8] = {6, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    cpu.program_counter = 8;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+
+    uint32_t instruction = 7; // Op code 7, every other bit clear
+    Trap trap = execute_instruction(instruction, &cpu, memory);
+
+    EXPECT_EQ(trap.kind, TRAP_UNUSED_OP_CODE);
+    EXPECT_EQ(trap.address, 8);
+    EXPECT_EQ(trap.value, 7);
+    EXPECT_EQ(cpu.program_counter, 8);
+    EXPECT_EQ(cpu.registers[0], 6);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Stores a half word at address 0, its first byte would be below address 0 */
+TEST_P(InstructionTest, test_store_below_address_zero_raises_underflow) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+
+    uint32_t instruction = STHI_BITMASK | 0 << 7 | 7 << 10 | 0 << 13; // STHI R1 R8 0
+    Trap trap = execute_instruction(instruction, &cpu, memory);
+
+    EXPECT_EQ(trap.kind, TRAP_MEMORY_UNDERFLOW);
+    EXPECT_EQ(trap.address, 0);
+    EXPECT_EQ(trap.value, 1);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* The store in the middle of the program is out of range, nothing after it may run */
+TEST_P(CpuTest, test_run_cpu_faults_on_store_outside_memory) {
+    const uint32_t registers[8] = {MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[4] = {
+        ADDI_BITMASK | 1 << 7 | 1 << 10 | 1 << 13,   // ADDI R2 R2 1
+        STBI_BITMASK | 1 << 7 | 0 << 10 | 0 << 13,   // STBI R2 R1 0
+        ADDI_BITMASK | 1 << 7 | 1 << 10 | 1 << 13,   // ADDI R2 R2 1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11, // JMPI R8 12
+    };
+    store_program(memory, program, 4);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 1);
+    EXPECT_EQ(result.trap.kind, TRAP_INVALID_MEMORY_LOCATION);
+    EXPECT_EQ(result.trap.program_counter, 4);
+    EXPECT_EQ(result.trap.address, MEMORY_SIZE_BYTES);
+    EXPECT_EQ(cpu.program_counter, 4);
+    EXPECT_EQ(cpu.registers[1], 1);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Divides by a register which the loop counts down to zero, the trap reports the DIV and the run can be resumed */
+TEST_P(CpuTest, test_run_cpu_faults_on_division_by_zero) {
+    const uint32_t registers[8] = {3, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[3] = {
+        SUBI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,  // SUBI R1 R1 1
+        DIV_BITMASK | 1 << 7 | 1 << 10 | 0 << 13,   // DIV  R2 R2 R1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11, // JMPI R8 0
+    };
+    store_program(memory, program, 3);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 7);
+    EXPECT_EQ(result.trap.kind, TRAP_DIVISION_BY_ZERO);
+    EXPECT_EQ(result.trap.program_counter, 4);
+    EXPECT_EQ(cpu.program_counter, 4);
+
+    cpu.registers[0] = 1;
+    result = run_cpu(&cpu, memory, 2);
+
+    EXPECT_EQ(result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(result.trap.kind, TRAP_NONE);
+    EXPECT_EQ(cpu.program_counter, 0);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Memory >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+TEST(MemoryTest, test_init_memory_rejects_invalid_sizes) {
+    EXPECT_EQ(init_memory(0), nullptr);
+    EXPECT_EQ(init_memory(6), nullptr);
+    EXPECT_EQ(init_memory(MEMORY_MAX_SIZE_BYTES + 4), nullptr);
+}
+
+/* Fresh memory reads as zero everywhere, even at the top of the largest size */
+TEST(MemoryTest, test_init_memory_is_zeroed) {
+    Memory *memory = init_memory(MEMORY_MAX_SIZE_BYTES);
+    ASSERT_NE(memory, nullptr);
+
+    EXPECT_EQ(memory->size_bytes, MEMORY_MAX_SIZE_BYTES);
+    EXPECT_EQ(read_word(memory, 0), 0);
+    EXPECT_EQ(read_word(memory, MEMORY_MAX_SIZE_BYTES - 4), 0);
+    free_memory(memory);
+}
+
+/* Stores and loads back a word in the last four bytes of a 64MB memory */
+TEST_P(InstructionTest, test_st_and_ld_at_top_of_largest_memory) {
+    const uint32_t registers[8] = {MEMORY_MAX_SIZE_BYTES - 1, 0x87654321, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_MAX_SIZE_BYTES);
+
+    execute_instruction(STWI_BITMASK | 1 << 7 | 0 << 10, &cpu, memory); // STWI R2 R1 0
+    execute_instruction(LDWI_BITMASK | 2 << 7 | 0 << 10, &cpu, memory); // LDWI R3 R1 0
+
+    EXPECT_EQ(cpu.registers[2], 0x87654321);
+    EXPECT_EQ((int) memory->data[MEMORY_MAX_SIZE_BYTES - 4], 0x87);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Runs off the end of a 16 byte memory, which only has room for four instructions */
+TEST_P(CpuTest, test_run_cpu_faults_at_end_of_small_memory) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(16);
+    const uint32_t program[4] = {
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13, // ADDI R1 R1 1
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13, // ADDI R1 R1 1
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13, // ADDI R1 R1 1
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13, // ADDI R1 R1 1
+    };
+    store_program(memory, program, 4);
+
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 4);
+    EXPECT_EQ(result.trap.kind, TRAP_INVALID_INSTRUCTION_ADDRESS);
+    EXPECT_EQ(cpu.registers[0], 4);
+    EXPECT_EQ(cpu.program_counter, 16);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Decode cache >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Runs the counting loop with a decode cache attached, the result must match the uncached run */
+TEST_P(CpuTest, test_run_cpu_with_decode_cache) {
+    Cpu cpu = init_cpu(GetParam());
+    cpu.decode_cache = init_decode_cache();
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[2] = {
+        BITMASK_14 | ADDI_BITMASK,           // ADDI R1 R1 1
+        BITMASK_9 | BITMASK_5 | JMP_BITMASK, // JMPI R2 0
+    };
+    store_program(memory, program, 2);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(cpu.registers[0], 500);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Overwrites a cached SET instruction with a store, the next run must execute the newly stored instruction */
+TEST_P(CpuTest, test_store_invalidates_decode_cache) {
+    const uint32_t registers[8] = {0, BITMASK_9 | SET_BITMASK, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    cpu.decode_cache = init_decode_cache();
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[2] = {
+        BITMASK_8 | SET_BITMASK,                          // SET R1 1
+        BITMASK_14 | BITMASK_9 | BITMASK_5 | JMP_BITMASK, // JMPI R2 4
+    };
+    store_program(memory, program, 2);
+    run_cpu(&cpu, memory, 100);
+    EXPECT_EQ(cpu.registers[0], 1);
+
+    /* Puts register 1, which holds SET R1 2, into memory address 0 to 3 using the zeroed register 2 as the base */
+    uint32_t store_instruction = BITMASK_15 | BITMASK_14 | BITMASK_12 | BITMASK_8 | BITMASK_7 | STW_BITMASK;
+    execute_instruction(store_instruction, &cpu, memory);
+    cpu.program_counter = 0;
+    run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(cpu.registers[0], 2);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Snapshots >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Stores register 1 at address 103 and halts, the first instruction also rewrites the third */
+static const uint32_t SNAPSHOT_PROGRAM[4] = {
+    STWI_BITMASK | 1 << 7 | 7 << 10 | 11 << 13,  // STWI R2 R8 11
+    STWI_BITMASK | 1 << 7 | 7 << 10 | 103 << 13, // STWI R2 R8 103
+    SET_BITMASK | 0 << 4 | 1 << 7,               // SET  R1 1
+    JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11, // JMPI R8 12
+};
+
+/* Two forks of the same snapshot run the program with different values, neither sees the other's writes */
+TEST_P(CpuTest, test_forks_diverge) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SNAPSHOT_PROGRAM, 4);
+    Snapshot *snapshot = take_snapshot(&cpu, memory);
+    ASSERT_NE(snapshot, nullptr);
+
+    Cpu first_cpu = fork_cpu(snapshot, GetParam());
+    Memory *first_memory = fork_memory(snapshot);
+    Cpu second_cpu = fork_cpu(snapshot, GetParam());
+    Memory *second_memory = fork_memory(snapshot);
+    ASSERT_NE(first_memory, nullptr);
+    ASSERT_NE(second_memory, nullptr);
+    first_cpu.registers[1] = SET_BITMASK | 2 << 7;
+    second_cpu.registers[1] = SET_BITMASK | 3 << 7;
+    run_cpu(&first_cpu, first_memory, 100);
+    run_cpu(&second_cpu, second_memory, 100);
+
+    EXPECT_EQ(first_cpu.registers[0], 2);
+    EXPECT_EQ(second_cpu.registers[0], 3);
+    EXPECT_EQ(read_word(first_memory, 100), SET_BITMASK | 2 << 7);
+    EXPECT_EQ(read_word(second_memory, 100), SET_BITMASK | 3 << 7);
+    EXPECT_EQ(read_word(memory, 8), SET_BITMASK | 1 << 7);
+    EXPECT_EQ(read_word(memory, 100), 0);
+    free_cpu(&first_cpu);
+    free_cpu(&second_cpu);
+    free_memory(first_memory);
+    free_memory(second_memory);
+    free_snapshot(snapshot);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Runs the self modifying program, restores and runs it again, the restored code must not come from stale decodes */
+TEST_P(CpuTest, test_restore_snapshot_rewinds_registers_and_dirty_pages) {
+    const uint32_t registers[8] = {0, SET_BITMASK | 2 << 7, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SNAPSHOT_PROGRAM, 4);
+    Snapshot *snapshot = take_snapshot(&cpu, memory);
+    ASSERT_NE(snapshot, nullptr);
+
+    run_cpu(&cpu, memory, 100);
+    EXPECT_EQ(cpu.registers[0], 2);
+    EXPECT_EQ(memory->dirty_pages[0], 1);
+
+    ASSERT_TRUE(restore_snapshot(snapshot, &cpu, memory));
+    EXPECT_EQ(memory->dirty_pages[0], 0);
+    EXPECT_EQ(cpu.registers[0], 0);
+    EXPECT_EQ(cpu.program_counter, 0);
+    EXPECT_EQ(read_word(memory, 8), SET_BITMASK | 1 << 7);
+    EXPECT_EQ(read_word(memory, 100), 0);
+
+    cpu.registers[1] = SET_BITMASK | 3 << 7;
+    RunResult result = run_cpu(&cpu, memory, 100);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[0], 3);
+    free_snapshot(snapshot);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Restoring a fork puts back the shared image, other pages of the fork are left alone */
+TEST_P(CpuTest, test_restore_fork) {
+    Cpu cpu = init_cpu(GetParam());
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SNAPSHOT_PROGRAM, 4);
+    Snapshot *snapshot = take_snapshot(&cpu, memory);
+    ASSERT_NE(snapshot, nullptr);
+    Cpu fork = fork_cpu(snapshot, GetParam());
+    Memory *fork_data = fork_memory(snapshot);
+    fork.registers[1] = SET_BITMASK | 2 << 7;
+
+    run_cpu(&fork, fork_data, 100);
+    ASSERT_TRUE(restore_snapshot(snapshot, &fork, fork_data));
+
+    EXPECT_EQ(read_word(fork_data, 8), SET_BITMASK | 1 << 7);
+    EXPECT_EQ(read_word(fork_data, 100), 0);
+    EXPECT_EQ(fork.registers[1], 0);
+    free_cpu(&fork);
+    free_memory(fork_data);
+    free_snapshot(snapshot);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* The newer snapshot cleared the dirty bits, so they no longer tell which pages differ from the older one */
+TEST(SnapshotTest, test_restore_older_snapshot) {
+    const uint32_t registers[8] = {0xDEADBEEF, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SNAPSHOT_PROGRAM, 4);
+    Snapshot *older = take_snapshot(&cpu, memory);
+    ASSERT_NE(older, nullptr);
+    uint32_t word = STWI_BITMASK | 0 << 7 | 7 << 10 | 0x1003 << 13; // STWI  R1 R8 0x1003
+    execute_instruction(word, &cpu, memory);
+    Snapshot *newer = take_snapshot(&cpu, memory);
+    ASSERT_NE(newer, nullptr);
+    Memory *fork_data = fork_memory(newer);
+    ASSERT_NE(fork_data, nullptr);
+
+    ASSERT_TRUE(restore_snapshot(older, &cpu, memory));
+    ASSERT_TRUE(restore_snapshot(older, &cpu, fork_data));
+
+    EXPECT_EQ(read_word(memory, 0x1000), 0);
+    EXPECT_EQ(read_word(memory, 8), SET_BITMASK | 1 << 7);
+    EXPECT_EQ(read_word(fork_data, 0x1000), 0);
+    ASSERT_TRUE(restore_snapshot(newer, &cpu, memory));
+    EXPECT_EQ(read_word(memory, 0x1000), 0xDEADBEEF);
+    free_memory(fork_data);
+    free_snapshot(newer);
+    free_snapshot(older);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+TEST(SnapshotTest, test_restore_snapshot_rejects_other_memory_size) {
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    Memory *small_memory = init_memory(4096);
+    Snapshot *snapshot = take_snapshot(&cpu, memory);
+    ASSERT_NE(snapshot, nullptr);
+
+    EXPECT_FALSE(restore_snapshot(snapshot, &cpu, small_memory));
+    free_snapshot(snapshot);
+    free_memory(small_memory);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Multi-core >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Each core counts the word its register 2 points at up to register 4, then halts */
+static const uint32_t COUNTER_PROGRAM[7] = {
+    LDWI_BITMASK | 2 << 7 | 1 << 10 | 0 << 13,                         // LDWI  R3 R2 0
+    ADDI_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,                         // ADDI  R3 R3 1
+    STWI_BITMASK | 2 << 7 | 1 << 10 | 0 << 13,                         // STWI  R3 R2 0
+    SUBI_BITMASK | 3 << 7 | 3 << 10 | 1 << 13,                         // SUBI  R4 R4 1
+    JMP_BITMASK | BITMASK_5 | BITMASK_4 | 3 << 5 | 7 << 8 | 24 << 11, // JMPIC R8 24 R4
+    JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11,                        // JMPI  R8 0
+    JMP_BITMASK | BITMASK_5 | 7 << 8 | 24 << 11,                       // JMPI  R8 24
+};
+
+TEST_P(CpuTest, test_run_machine_runs_every_core) {
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, COUNTER_PROGRAM, 7);
+    Machine *machine = init_machine(4, GetParam(), memory);
+    ASSERT_NE(machine, nullptr);
+    for (uint32_t i = 0; i < 4; i++) {
+        machine->cores[i].registers[1] = 4096 + i * 4 + 3;
+        machine->cores[i].registers[3] = 1000 + i;
+    }
+
+    run_machine(machine, 1000000);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(machine->results[i].status, CPU_STATUS_HALTED);
+        EXPECT_EQ(read_word(memory, 4096 + i * 4), 1000 + i);
+    }
+    free_machine(machine);
+    free_memory(memory);
+}
+
+/* Core 1 spins until core 0 publishes a flag, the data stored before the flag must then be visible to it */
+TEST_P(CpuTest, test_run_machine_orders_stores) {
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t program[7] = {
+        STWI_BITMASK | 0 << 7 | 7 << 10 | 2003 << 13,                     // STWI  R1 R8 2003
+        STWI_BITMASK | 0 << 7 | 7 << 10 | 1003 << 13,                     // STWI  R1 R8 1003
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 8 << 11,                       // JMPI  R8 8
+        LDWI_BITMASK | 1 << 7 | 7 << 10 | 1003 << 13,                     // LDWI  R2 R8 1003
+        JMP_BITMASK | BITMASK_5 | BITMASK_4 | 1 << 5 | 7 << 8 | 12 << 11, // JMPIC R8 12 R2
+        LDWI_BITMASK | 2 << 7 | 7 << 10 | 2003 << 13,                     // LDWI  R3 R8 2003
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 24 << 11,                      // JMPI  R8 24
+    };
+    store_program(memory, program, 7);
+    Machine *machine = init_machine(2, GetParam(), memory);
+    ASSERT_NE(machine, nullptr);
+    machine->cores[0].registers[0] = 0x12345678;
+    machine->cores[1].program_counter = 12;
+
+    run_machine(machine, UINT64_MAX);
+
+    EXPECT_EQ(machine->results[0].status, CPU_STATUS_HALTED);
+    EXPECT_EQ(machine->results[1].status, CPU_STATUS_HALTED);
+    EXPECT_EQ(machine->cores[1].registers[2], 0x12345678);
+    free_machine(machine);
+    free_memory(memory);
+}
+
+TEST(MachineTest, test_init_machine_rejects_invalid_core_counts) {
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+
+    EXPECT_EQ(init_machine(0, CPU_BACKEND_INTERPRETER, memory), nullptr);
+    EXPECT_EQ(init_machine(MACHINE_MAX_CORES + 1, CPU_BACKEND_INTERPRETER, memory), nullptr);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Batch >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/*
+ * Sums a different count on every machine with a tiny slice, so most jobs are put back on the queue several times.
+ * The last job is a straggler running far longer than the rest and the one before it runs out of budget.
+ */
+TEST_P(CpuTest, test_run_batch) {
+    const uint32_t job_count = 64;
+    Cpu cpus[job_count];
+    Memory *memories[job_count];
+    BatchJob jobs[job_count];
+    for (uint32_t i = 0; i < job_count; i++) {
+        const uint32_t registers[8] = {i == job_count - 1 ? 100000 : i + 1, 0, 0, 0, 0, 0, 0, 0};
+        cpus[i] = init_cpu_with_state(GetParam(), registers);
+        memories[i] = init_memory(4096);
+        store_program(memories[i], SUM_PROGRAM, 5);
+        jobs[i] = {&cpus[i], memories[i], i == job_count - 2 ? 100 : UINT64_MAX};
+    }
+
+    run_batch(jobs, job_count, 4, 50);
+
+    for (uint32_t i = 0; i < job_count; i++) {
+        if (i == job_count - 2) {
+            EXPECT_EQ(jobs[i].result.status, CPU_STATUS_STEP_LIMIT);
+            EXPECT_EQ(jobs[i].result.steps, 100);
+            continue;
+        }
+        uint32_t n = i == job_count - 1 ? 100000 : i + 1;
+        EXPECT_EQ(jobs[i].result.status, CPU_STATUS_HALTED);
+        EXPECT_EQ(jobs[i].result.steps, 4 * (uint64_t)n);
+        EXPECT_EQ(cpus[i].registers[0], 0);
+        EXPECT_EQ(cpus[i].registers[1], (uint32_t)((uint64_t)n * (n + 1) / 2));
+    }
+    for (uint32_t i = 0; i < job_count; i++) {
+        free_cpu(&cpus[i]);
+        free_memory(memories[i]);
+    }
+}
+
+/* A faulting job reports its trap, and asking for more threads than jobs or host cores still runs everything */
+TEST_P(CpuTest, test_run_batch_reports_traps) {
+    Cpu cpus[2] = {init_cpu(GetParam()), init_cpu(GetParam())};
+    Memory *memories[2] = {init_memory(4096), init_memory(4096)};
+    const uint32_t program[1] = {OP_CODE_BITMASK};
+    store_program(memories[1], program, 1);
+    cpus[0].registers[0] = 10;
+    store_program(memories[0], SUM_PROGRAM, 5);
+    BatchJob jobs[2] = {{&cpus[0], memories[0], 1000}, {&cpus[1], memories[1], 1000}};
+
+    run_batch(jobs, 2, 0, 0);
+
+    EXPECT_EQ(jobs[0].result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(jobs[0].result.steps, 40);
+    EXPECT_EQ(jobs[1].result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(jobs[1].result.trap.kind, TRAP_UNUSED_OP_CODE);
+    for (uint32_t i = 0; i < 2; i++) {
+        free_cpu(&cpus[i]);
+        free_memory(memories[i]);
+    }
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Pack >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Runs the program on every lane of a pack and once more per lane on the interpreter, both must end the same way */
+static void expect_pack_matches_interpreter(const uint32_t *program, int size, const uint32_t (*registers)[8],
+                                            uint64_t max_steps) {
+    Memory *memories[PACK_LANES];
+    Memory *reference_memories[PACK_LANES];
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        memories[lane] = init_memory(4096);
+        reference_memories[lane] = init_memory(4096);
+        store_program(memories[lane], program, size);
+        store_program(reference_memories[lane], program, size);
+    }
+    Pack *pack = init_pack(PACK_LANES, memories);
+    ASSERT_NE(pack, nullptr);
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers[lane]);
+        set_pack_lane(pack, lane, &cpu);
+    }
+
+    RunResult results[PACK_LANES];
+    run_pack(pack, max_steps, results);
+
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        Cpu reference = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers[lane]);
+        RunResult expected = run_cpu(&reference, reference_memories[lane], max_steps);
+        Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+        get_pack_lane(pack, lane, &cpu);
+
+        EXPECT_EQ(results[lane].status, expected.status) << "lane " << lane;
+        EXPECT_EQ(results[lane].steps, expected.steps) << "lane " << lane;
+        EXPECT_EQ(results[lane].trap.kind, expected.trap.kind) << "lane " << lane;
+        EXPECT_EQ(cpu.program_counter, reference.program_counter) << "lane " << lane;
+        for (int i = 0; i < 8; i++) {
+            EXPECT_EQ(cpu.registers[i], reference.registers[i]) << "lane " << lane << " register " << i;
+        }
+        EXPECT_EQ(memcmp(memories[lane]->data, reference_memories[lane]->data, 4096), 0) << "lane " << lane;
+        free_memory(memories[lane]);
+        free_memory(reference_memories[lane]);
+    }
+    free_pack(pack);
+}
+
+/* Every lane sums a different count, so the lanes leave the loop one by one */
+TEST(PackTest, test_run_pack_diverging_loop) {
+    uint32_t registers[PACK_LANES][8] = {};
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        registers[lane][0] = lane * 3 + 1;
+    }
+
+    expect_pack_matches_interpreter(SUM_PROGRAM, 5, registers, 1000);
+}
+
+/* Lanes run out of budget at the same step no matter where they are */
+TEST(PackTest, test_run_pack_step_limit) {
+    uint32_t registers[PACK_LANES][8] = {};
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        registers[lane][0] = lane * 5 + 1;
+    }
+
+    expect_pack_matches_interpreter(SUM_PROGRAM, 5, registers, 37);
+}
+
+/* Mixes vector and lane by lane instructions, the lane dividing by zero traps while the others carry on */
+TEST(PackTest, test_run_pack_mixed_instructions) {
+    const uint32_t program[12] = {
+        SET_BITMASK | 3 << 4 | 1000 << 7,                         // SET   R4 1000
+        SETU_BITMASK | 3 << 3 | 5 << 6,                           // SETU  R4 5
+        MUL_BITMASK | 3 << 7 | 3 << 10 | 0 << 13,                 // MUL   R4 R4 R1
+        XORI_BITMASK | 4 << 7 | 3 << 10 | 0x1234 << 13,           // XORI  R5 R4 0x1234
+        BSLRI_BITMASK | 5 << 6 | 4 << 9 | 7 << 12,                // BSLRI R6 R5 7
+        BSRI_BITMASK | 6 << 6 | 5 << 9 | 3 << 12,                 // BSRI  R7 R6 3
+        STWI_BITMASK | 6 << 7 | 7 << 10 | 2003 << 13,             // STWI  R7 R8 2003
+        LDHI_BITMASK | 1 << 7 | 7 << 10 | 2001 << 13,             // LDHI  R2 R8 2001
+        DIV_BITMASK | 2 << 7 | 1 << 10 | 0 << 13,                 // DIV   R3 R2 R1
+        ANDI_BITMASK | 2 << 7 | 2 << 10 | 0xFF << 13,             // ANDI  R3 R3 0xFF
+        SUB_BITMASK | 2 << 7 | 2 << 10 | 3 << 13,                 // SUB   R3 R3 R4
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 44 << 11,              // JMPI  R8 44
+    };
+    uint32_t registers[PACK_LANES][8] = {};
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        registers[lane][0] = lane * 7;
+    }
+
+    expect_pack_matches_interpreter(program, 12, registers, 1000);
+}
+
+/* Odd lanes overwrite the first instruction of the loop with a halt after running it once */
+TEST(PackTest, test_run_pack_self_modifying_lanes) {
+    const uint32_t halt = JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11;
+    const uint32_t program[3] = {
+        ADDI_BITMASK | 2 << 7 | 2 << 10 | 1 << 13,  // ADDI  R3 R3 1
+        STWI_BITMASK | 1 << 7 | 0 << 10 | 0 << 13,  // STWI  R2 R1 0
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11, // JMPI  R8 0
+    };
+    uint32_t registers[PACK_LANES][8] = {};
+    for (uint32_t lane = 0; lane < PACK_LANES; lane++) {
+        registers[lane][0] = lane % 2 == 1 ? 3 : 2003;
+        registers[lane][1] = halt;
+    }
+
+    expect_pack_matches_interpreter(program, 3, registers, 100);
+}
+
+TEST(PackTest, test_init_pack_rejects_invalid_lanes) {
+    Memory *memories[2] = {init_memory(4096), init_memory(8192)};
+
+    EXPECT_EQ(init_pack(0, memories), nullptr);
+    EXPECT_EQ(init_pack(PACK_LANES + 1, memories), nullptr);
+    EXPECT_EQ(init_pack(2, memories), nullptr);
+    free_memory(memories[0]);
+    free_memory(memories[1]);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Assembler >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static const char SUM_SOURCE[] = "loop:  ADD   R2 R2 R1\n"
+                                 "       SUBI  R1 R1 1\n"
+                                 "       JMPIC R3 done R1   ; leave once R1 reaches zero\n"
+                                 "       JMPI  R3 loop\n"
+                                 "done:  JMPI  R3 done      // halt\n";
+
+TEST(AssemblerTest, test_assemble_program_matches_hand_encoding) {
+    AssemblyError error;
+    Program *program = assemble_program(SUM_SOURCE, &error);
+
+    ASSERT_NE(program, nullptr) << error.line << ": " << error.message;
+    ASSERT_EQ(program->word_count, 5);
+    for (int i = 0; i < 5; i++) {
+        EXPECT_EQ(program->words[i], SUM_PROGRAM[i]) << "word " << i;
+    }
+    free_program(program);
+}
+
+/* Each mnemonic decodes back to the operation and operands it was written with */
+TEST(AssemblerTest, test_assemble_program_encodes_operands) {
+    AssemblyError error;
+    Program *program = assemble_program("JMPC R2, R3, R4\n"
+                                        "LDHI R5 R6 0x3FF\n"
+                                        "SETN R7 -2\n"
+                                        "SETU R8 63\n"
+                                        "MODI R1 R2 524287\n"
+                                        "XOR R3 R4 R5\n"
+                                        "BSLRI R6 R7 31\n"
+                                        ".word 0b101\n",
+                                        &error);
+    ASSERT_NE(program, nullptr) << error.line << ": " << error.message;
+    DecodedInstruction decoded[8];
+    for (int i = 0; i < 8; i++) {
+        decode_instruction(program->words[i], &decoded[i]);
+    }
+
+    EXPECT_EQ(decoded[0].id, INSTRUCTION_JMPC);
+    EXPECT_EQ(decoded[0].first_source_register, 1);
+    EXPECT_EQ(decoded[0].second_source_register, 2);
+    EXPECT_EQ(decoded[0].control_register, 3);
+    EXPECT_EQ(decoded[1].id, INSTRUCTION_LD);
+    EXPECT_EQ(decoded[1].byte_mode, 1);
+    EXPECT_EQ(decoded[1].destination_register, 4);
+    EXPECT_EQ(decoded[1].first_source_register, 5);
+    EXPECT_EQ(decoded[1].value, 0x3FF);
+    EXPECT_EQ(decoded[2].id, INSTRUCTION_SET);
+    EXPECT_EQ(decoded[2].destination_register, 6);
+    EXPECT_EQ(decoded[2].value, UINT32_C(0xFFFFFFFE));
+    EXPECT_EQ(decoded[3].id, INSTRUCTION_SETU);
+    EXPECT_EQ(decoded[3].destination_register, 7);
+    EXPECT_EQ(decoded[3].value, UINT32_C(63) << 25);
+    EXPECT_EQ(decoded[4].id, INSTRUCTION_MOD);
+    EXPECT_EQ(decoded[4].value, 524287);
+    EXPECT_EQ(decoded[5].id, INSTRUCTION_XOR);
+    EXPECT_EQ(decoded[5].second_source_register, 4);
+    EXPECT_EQ(decoded[6].id, INSTRUCTION_BSLR);
+    EXPECT_EQ(decoded[6].value, 31);
+    EXPECT_EQ(program->words[7], 5);
+    free_program(program);
+}
+
+TEST(AssemblerTest, test_assemble_program_reports_first_error) {
+    const struct {
+        const char *source;
+        uint32_t line;
+    } cases[] = {
+        {"ADD R1 R2 R3\nFOO R1\n", 2},
+        {"ADDI R1 R2 524288\n", 1},
+        {"\n\nJMPI R8 nowhere\n", 3},
+        {"SUB R1 R2\n", 1},
+        {"LDW R9 R1 R2\n", 1},
+        {"SETN R1 5\n", 1},
+        {"a: SET R1 1\na: SET R1 2\n", 2},
+    };
+    for (const auto &test : cases) {
+        AssemblyError error;
+        EXPECT_EQ(assemble_program(test.source, &error), nullptr) << test.source;
+        EXPECT_EQ(error.line, test.line) << test.source;
+        EXPECT_NE(error.message[0], '\0') << test.source;
+    }
+}
+
+TEST(AssemblerTest, test_load_program_runs) {
+    AssemblyError error;
+    Program *program = assemble_program(SUM_SOURCE, &error);
+    ASSERT_NE(program, nullptr);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+
+    ASSERT_TRUE(load_program(memory, program));
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[1], 55);
+    free_program(program);
+    free_memory(memory);
+}
+
+/* Machines loaded from one image share its pages, a store only changes the memory that made it */
+TEST(AssemblerTest, test_load_program_image_maps_copy_on_write) {
+    AssemblyError error;
+    Program *program = assemble_program(SUM_SOURCE, &error);
+    ASSERT_NE(program, nullptr);
+    FILE *file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    ASSERT_TRUE(write_program_image(program, fileno(file)));
+
+    Memory *first = load_program_image(fileno(file), MEMORY_SIZE_BYTES);
+    Memory *second = load_program_image(fileno(file), MEMORY_SIZE_BYTES);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(read_word(first, 0), SUM_PROGRAM[0]);
+    EXPECT_EQ(read_word(first, 16), SUM_PROGRAM[4]);
+    EXPECT_EQ(read_word(first, 20), 0);
+    EXPECT_EQ(first->data[MEMORY_SIZE_BYTES - 1], 0);
+
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    execute_instruction(STWI_BITMASK | 1 << 7 | 7 << 10 | 3 << 13, &cpu, first); // STWI R2 R8 3
+    EXPECT_EQ(read_word(first, 0), 0);
+    EXPECT_EQ(read_word(second, 0), SUM_PROGRAM[0]);
+
+    RunResult result = run_cpu(&cpu, second, 1000);
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[1], 55);
+    free_memory(first);
+    free_memory(second);
+    EXPECT_EQ(load_program_image(fileno(file), 16), nullptr);
+    fclose(file);
+    free_program(program);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Analyzer >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static const char NESTED_LOOPS_SOURCE[] = "        SET   R1 3\n"
+                                          "outer:  SET   R2 4\n"
+                                          "inner:  SUBI  R2 R2 1\n"
+                                          "        JMPIC R8 next R2\n"
+                                          "        JMPI  R8 inner\n"
+                                          "next:   SUBI  R1 R1 1\n"
+                                          "        JMPIC R8 done R1\n"
+                                          "        JMPI  R8 outer\n"
+                                          "done:   JMPI  R8 done\n"
+                                          "        .word 0\n";
+
+TEST(AnalyzerTest, test_analyze_program_finds_nested_loops) {
+    AssemblyError error;
+    Program *program = assemble_program(NESTED_LOOPS_SOURCE, &error);
+    ASSERT_NE(program, nullptr);
+
+    ProgramAnalysis *analysis = analyze_program(program, NULL, 0);
+
+    ASSERT_NE(analysis, nullptr);
+    ASSERT_EQ(analysis->block_count, 7);
+    EXPECT_EQ(analysis->blocks[2].first_address, 8);
+    EXPECT_EQ(analysis->blocks[2].last_address, 12);
+    EXPECT_EQ(analysis->blocks[2].successors[0], 20);
+    EXPECT_EQ(analysis->blocks[2].successors[1], 16);
+    EXPECT_EQ(analysis->blocks[2].loop_depth, 2);
+    EXPECT_EQ(analysis->blocks[6].successors[0], ANALYSIS_NO_ADDRESS);
+    EXPECT_EQ(analysis->blocks[6].loop_depth, 0);
+    ASSERT_EQ(analysis->loop_count, 2);
+    EXPECT_EQ(analysis->loops[0].header, 4);
+    EXPECT_EQ(analysis->loops[0].last_address, 28);
+    EXPECT_EQ(analysis->loops[0].depth, 1);
+    EXPECT_EQ(analysis->loops[0].instruction_count, 7);
+    EXPECT_EQ(analysis->loops[1].header, 8);
+    EXPECT_EQ(analysis->loops[1].depth, 2);
+    EXPECT_EQ(analysis->loops[1].block_count, 2);
+    EXPECT_EQ(analysis->indirect_jumps, 0);
+    ASSERT_EQ(analysis->issue_count, 1);
+    EXPECT_EQ(analysis->issues[0].kind, ANALYSIS_UNREACHABLE);
+    EXPECT_EQ(analysis->issues[0].address, 36);
+    free_program_analysis(analysis);
+    free_program(program);
+}
+
+/* Entered at 0 and at 16, the LDHI with an even offset only might trap as its base register is written */
+TEST(AnalyzerTest, test_analyze_program_reports_faults) {
+    AssemblyError error;
+    Program *program = assemble_program("SET   R2 16\n"
+                                        "LDHI  R1 R2 2\n"
+                                        "DIVI  R3 R1 0\n"
+                                        "SET   R1 1\n"
+                                        "JMPIC R8 6 R1\n"
+                                        "JMPIC R8 400 R1\n"
+                                        ".word 7\n"
+                                        "ADDI  R1 R1 1\n",
+                                        &error);
+    ASSERT_NE(program, nullptr);
+    const uint32_t entries[2] = {16, 28};
+
+    ProgramAnalysis *analysis = analyze_program(program, entries, 2);
+
+    ASSERT_NE(analysis, nullptr);
+    const struct {
+        AnalysisIssueKind kind;
+        uint32_t address;
+        uint32_t value;
+    } expected[] = {
+        {ANALYSIS_MISALIGNED_OFFSET, 4, 2},
+        {ANALYSIS_DIVISION_BY_ZERO, 8, 0},
+        {ANALYSIS_UNREACHABLE, 12, 0},
+        {ANALYSIS_INVALID_JUMP_TARGET, 16, 6},
+        {ANALYSIS_INVALID_JUMP_TARGET, 20, 400},
+        {ANALYSIS_INVALID_INSTRUCTION, 24, TRAP_UNUSED_OP_CODE},
+        {ANALYSIS_FALLS_OFF_END, 28, 0},
+    };
+    ASSERT_EQ(analysis->issue_count, 7);
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(analysis->issues[i].kind, expected[i].kind) << "issue " << i;
+        EXPECT_EQ(analysis->issues[i].address, expected[i].address) << "issue " << i;
+        EXPECT_EQ(analysis->issues[i].value, expected[i].value) << "issue " << i;
+    }
+    free_program_analysis(analysis);
+    free_program(program);
+}
+
+/* Locations address the last byte of an access, so STWI off R8 at 3 is aligned while the one at 0 always traps */
+TEST(AnalyzerTest, test_analyze_program_keeps_aligned_accesses_reachable) {
+    AssemblyError error;
+    Program *program = assemble_program("        SET   R2 77\n"
+                                        "loop:   STWI  R2 R8 3\n"
+                                        "        LDWI  R3 R8 7\n"
+                                        "        LDHI  R3 R8 5\n"
+                                        "        SUBI  R2 R2 1\n"
+                                        "        JMPIC R8 end R2\n"
+                                        "        JMPI  R8 loop\n"
+                                        "end:    STWI  R2 R8 0\n"
+                                        "        JMPI  R8 end\n",
+                                        &error);
+    ASSERT_NE(program, nullptr);
+
+    ProgramAnalysis *analysis = analyze_program(program, NULL, 0);
+
+    ASSERT_NE(analysis, nullptr);
+    EXPECT_EQ(analysis->loop_count, 1);
+    ASSERT_EQ(analysis->issue_count, 2);
+    EXPECT_EQ(analysis->issues[0].kind, ANALYSIS_MISALIGNED_OFFSET);
+    EXPECT_EQ(analysis->issues[0].address, 28);
+    EXPECT_EQ(analysis->issues[0].value, 0);
+    EXPECT_EQ(analysis->issues[1].kind, ANALYSIS_UNREACHABLE);
+    EXPECT_EQ(analysis->issues[1].address, 32);
+    free_program_analysis(analysis);
+    free_program(program);
+}
+
+/* Once R8 is written the jump off it is indirect, and the code it really leads to is not known to be reachable */
+TEST(AnalyzerTest, test_analyze_program_counts_indirect_jumps) {
+    AssemblyError error;
+    Program *program = assemble_program("SET  R8 4\n"
+                                        "JMPI R8 4\n"
+                                        "JMPI R8 0\n",
+                                        &error);
+    ASSERT_NE(program, nullptr);
+
+    ProgramAnalysis *analysis = analyze_program(program, NULL, 0);
+
+    ASSERT_NE(analysis, nullptr);
+    EXPECT_EQ(analysis->indirect_jumps, 1);
+    EXPECT_EQ(analysis->block_count, 1);
+    EXPECT_EQ(analysis->loop_count, 0);
+    ASSERT_EQ(analysis->issue_count, 1);
+    EXPECT_EQ(analysis->issues[0].kind, ANALYSIS_UNREACHABLE);
+    EXPECT_EQ(analysis->issues[0].address, 8);
+    free_program_analysis(analysis);
+    free_program(program);
+}
+
+/* The hinted loop blocks are predecoded before the first run, which still gives the same result */
+TEST_P(CpuTest, test_apply_analysis_hints_prepares_loops) {
+    AssemblyError error;
+    Program *program = assemble_program(NESTED_LOOPS_SOURCE, &error);
+    ASSERT_NE(program, nullptr);
+    ProgramAnalysis *analysis = analyze_program(program, NULL, 0);
+    ASSERT_NE(analysis, nullptr);
+    FILE *file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    ASSERT_TRUE(write_analysis_hints(analysis, file));
+    rewind(file);
+
+    Cpu cpu = init_cpu(GetParam());
+    cpu.decode_cache = init_decode_cache();
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    ASSERT_TRUE(load_program(memory, program));
+    EXPECT_TRUE(apply_analysis_hints(&cpu, memory, file));
+
+    EXPECT_EQ(get_decode_cache_entry(cpu.decode_cache, 12)->address, 12);
+    EXPECT_EQ(get_decode_cache_entry(cpu.decode_cache, 28)->address, 28);
+    EXPECT_EQ(get_decode_cache_entry(cpu.decode_cache, 0)->address, DECODE_CACHE_EMPTY_ADDRESS);
+    RunResult result = run_cpu(&cpu, memory, 1000);
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[0], 0);
+    EXPECT_EQ(result.steps, 1 + 15 + 15 + 14 + 1);
+
+    fputs("0x8 nowhere\n", file);
+    rewind(file);
+    EXPECT_FALSE(apply_analysis_hints(&cpu, memory, file));
+    fclose(file);
+    free_cpu(&cpu);
+    free_memory(memory);
+    free_program_analysis(analysis);
+    free_program(program);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Profile >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Whatever the backend, an attached profile sees every instruction of the run */
+TEST_P(CpuTest, test_run_cpu_records_profile) {
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    cpu.profile = init_profile();
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.steps, 40);
+    EXPECT_EQ(cpu.registers[1], 55);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_ADD], 10);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_SUBI], 10);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_JMPIC], 10);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_JMPI], 10);
+    EXPECT_EQ(cpu.profile->address_counts[0], 10);
+    EXPECT_EQ(cpu.profile->address_counts[4], 1);
+    EXPECT_EQ(cpu.profile->taken_counts[2], 1);
+    EXPECT_EQ(cpu.profile->not_taken_counts[2], 9);
+    free_profile(cpu.profile);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+TEST(ProfileTest, test_profile_skips_trapping_instruction) {
+    const uint32_t program[2] = {
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13, // ADDI R1 R1 1
+        DIV_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,  // DIV  R1 R1 R2
+    };
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 2);
+    cpu.profile = init_profile();
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_ADDI], 1);
+    EXPECT_EQ(cpu.profile->mnemonic_counts[PROFILE_DIV], 0);
+    EXPECT_EQ(cpu.profile->address_counts[1], 0);
+    free_profile(cpu.profile);
+    free_memory(memory);
+}
+
+TEST(ProfileTest, test_write_profile_folded) {
+    const uint32_t registers[8] = {3, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    cpu.profile = init_profile();
+    run_cpu(&cpu, memory, 1000);
+
+    char buffer[512] = {};
+    FILE *file = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_TRUE(write_profile_folded(cpu.profile, memory, file));
+    fclose(file);
+
+    EXPECT_STREQ(buffer, "ADD;0x00000000 3\n"
+                         "SUBI;0x00000004 3\n"
+                         "JMPIC;0x00000008 3\n"
+                         "JMPI;0x0000000c 2\n"
+                         "JMPI;0x00000010 1\n");
+    free_profile(cpu.profile);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Trace >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Records the sum loop over many blocks, run in slices so runs are stitched together, and returns the trace file */
+static FILE *record_sum_trace(const uint32_t registers[8], uint64_t *steps) {
+    FILE *file = tmpfile();
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    cpu.trace = init_trace_recorder(fileno(file));
+
+    *steps = 0;
+    RunResult result;
+    do {
+        result = run_cpu(&cpu, memory, 77777);
+        *steps += result.steps;
+    } while (result.status == CPU_STATUS_STEP_LIMIT);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_TRUE(flush_trace_recorder(cpu.trace));
+    free_trace_recorder(cpu.trace);
+    free_cpu(&cpu);
+    free_memory(memory);
+    return file;
+}
+
+TEST(TraceTest, test_replay_trace_reproduces_run) {
+    const uint32_t registers[8] = {100000, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t steps;
+    FILE *file = record_sum_trace(registers, &steps);
+    TraceReader *reader = init_trace_reader(fileno(file));
+    ASSERT_NE(reader, nullptr);
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+
+    ReplayResult result = replay_trace(reader, &cpu, memory, UINT64_MAX);
+
+    EXPECT_EQ(steps, 400000);
+    EXPECT_EQ(result.status, REPLAY_END);
+    EXPECT_EQ(result.steps, steps);
+    EXPECT_EQ(cpu.registers[1], (uint32_t)5000050000);
+    EXPECT_EQ(cpu.program_counter, 16);
+    free_trace_reader(reader);
+    free_memory(memory);
+    fclose(file);
+}
+
+TEST(TraceTest, test_seek_trace_restores_state) {
+    const uint32_t registers[8] = {100000, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t steps;
+    FILE *file = record_sum_trace(registers, &steps);
+    TraceReader *reader = init_trace_reader(fileno(file));
+    ASSERT_NE(reader, nullptr);
+    Cpu expected = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    run_cpu(&expected, memory, 250001);
+
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    ASSERT_TRUE(seek_trace(reader, 250001, &cpu, nullptr));
+
+    EXPECT_EQ(cpu.program_counter, expected.program_counter);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(cpu.registers[i], expected.registers[i]) << "register " << i;
+    }
+    TraceRecord record;
+    ASSERT_TRUE(read_trace_record(reader, &record));
+    EXPECT_EQ(record.step, 250001);
+    EXPECT_EQ(record.program_counter, expected.program_counter);
+    ASSERT_TRUE(seek_trace(reader, 250001, &cpu, nullptr));
+    ReplayResult result = replay_trace(reader, &expected, memory, UINT64_MAX);
+    EXPECT_EQ(result.status, REPLAY_END);
+    EXPECT_EQ(result.steps, steps - 250001);
+    EXPECT_FALSE(seek_trace(reader, steps + 1, &cpu, nullptr));
+    free_trace_reader(reader);
+    free_memory(memory);
+    fclose(file);
+}
+
+TEST(TraceTest, test_replay_trace_detects_divergence) {
+    const uint32_t program[4] = {
+        ADDI_BITMASK | 0 << 7 | 0 << 10 | 7 << 13,   // ADDI R1 R1 7
+        STWI_BITMASK | 0 << 7 | 7 << 10 | 103 << 13, // STWI R1 R8 103
+        LDWI_BITMASK | 1 << 7 | 7 << 10 | 103 << 13, // LDWI R2 R8 103
+        JMP_BITMASK | BITMASK_5 | 2 << 8 | 12 << 11, // JMPI R3 12
+    };
+    FILE *file = tmpfile();
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 4);
+    cpu.trace = init_trace_recorder(fileno(file));
+    EXPECT_EQ(run_cpu(&cpu, memory, 1000).status, CPU_STATUS_HALTED);
+    free_trace_recorder(cpu.trace);
+
+    TraceReader *reader = init_trace_reader(fileno(file));
+    ASSERT_NE(reader, nullptr);
+    TraceRecord record;
+    ASSERT_TRUE(seek_trace(reader, 1, &cpu, nullptr));
+    ASSERT_TRUE(read_trace_record(reader, &record));
+    EXPECT_TRUE(record.writes_memory);
+    EXPECT_EQ(record.byte_mode, 2);
+    EXPECT_EQ(record.memory_location, 103);
+    EXPECT_EQ(record.memory_value, 7);
+
+    const uint32_t registers[8] = {5, 0, 0, 0, 0, 0, 0, 0};
+    Cpu replayed = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    ASSERT_TRUE(seek_trace(reader, 0, &cpu, nullptr));
+    ReplayResult result = replay_trace(reader, &replayed, memory, 1000);
+
+    EXPECT_EQ(result.status, REPLAY_DIVERGED);
+    EXPECT_EQ(result.steps, 0);
+    EXPECT_EQ(result.expected.register_index, 0);
+    EXPECT_EQ(result.expected.register_value, 7);
+    free_trace_reader(reader);
+    free_memory(memory);
+    fclose(file);
+}
+
+/* The load left R2 at 0 while recording, so its record has no register, a replay loading anything else diverges */
+TEST(TraceTest, test_replay_trace_detects_unrecorded_register_change) {
+    const uint32_t program[2] = {
+        LDWI_BITMASK | 1 << 7 | 7 << 10 | 103 << 13, // LDWI R2 R8 103
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 4 << 11,  // JMPI R8 4
+    };
+    FILE *file = tmpfile();
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 2);
+    cpu.trace = init_trace_recorder(fileno(file));
+    EXPECT_EQ(run_cpu(&cpu, memory, 1000).status, CPU_STATUS_HALTED);
+    free_trace_recorder(cpu.trace);
+
+    TraceReader *reader = init_trace_reader(fileno(file));
+    ASSERT_NE(reader, nullptr);
+    Cpu replayed = init_cpu(CPU_BACKEND_INTERPRETER);
+    store_memory_word(memory, 100, 5);
+    ReplayResult result = replay_trace(reader, &replayed, memory, 1000);
+
+    EXPECT_EQ(result.status, REPLAY_DIVERGED);
+    EXPECT_EQ(result.steps, 0);
+    EXPECT_FALSE(result.expected.writes_register);
+    free_trace_reader(reader);
+    free_memory(memory);
+    fclose(file);
+}
+
+/* The store to the interrupt controller is not a memory effect, and a store memory cannot hold fails the seek */
+TEST(TraceTest, test_seek_trace_applies_only_memory_stores) {
+    const uint32_t program[3] = {
+        STWI_BITMASK | 0 << 7 | 2 << 10 | 11 << 13,  // STWI R1 R3 11   enable
+        STWI_BITMASK | 0 << 7 | 7 << 10 | 103 << 13, // STWI R1 R8 103
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 8 << 11,  // JMPI R8 8
+    };
+    const uint32_t registers[8] = {7, 0, MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0};
+    FILE *file = tmpfile();
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 3);
+    cpu.trace = init_trace_recorder(fileno(file));
+    EXPECT_EQ(run_cpu(&cpu, memory, 1000).status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.interrupts->enable, 7);
+    free_trace_recorder(cpu.trace);
+    free_interrupt_controller(cpu.interrupts);
+    free_memory(memory);
+
+    TraceReader *reader = init_trace_reader(fileno(file));
+    ASSERT_NE(reader, nullptr);
+    TraceRecord record;
+    ASSERT_TRUE(read_trace_record(reader, &record));
+    EXPECT_FALSE(record.writes_memory);
+    Cpu sought = init_cpu(CPU_BACKEND_INTERPRETER);
+    memory = init_memory(MEMORY_SIZE_BYTES);
+    ASSERT_TRUE(seek_trace(reader, 2, &sought, memory));
+    EXPECT_EQ(load_memory_word(memory, 100), 7);
+    EXPECT_EQ(sought.program_counter, 8);
+    free_memory(memory);
+
+    memory = init_memory(64);
+    EXPECT_FALSE(seek_trace(reader, 2, &sought, memory));
+    free_trace_reader(reader);
+    free_cpu(&sought);
+    free_cpu(&cpu);
+    free_memory(memory);
+    fclose(file);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Bus >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+static uint32_t read_constant(void *device, uint32_t offset, uint32_t width) {
+    return read_register_bytes(*(const uint32_t *)device, offset, width);
+}
+
+TEST(BusTest, test_map_bus_device_rejects_overlap) {
+    uint32_t value = 0x11223344;
+    Bus *bus = init_bus();
+
+    EXPECT_TRUE(map_bus_device(bus, 0x2000, 16, &value, read_constant, NULL));
+    EXPECT_TRUE(map_bus_device(bus, 0x1000, 0x1000, &value, read_constant, NULL));
+    EXPECT_FALSE(map_bus_device(bus, 0x200C, 8, &value, read_constant, NULL));
+    EXPECT_FALSE(map_bus_device(bus, 0x0FFC, 8, &value, read_constant, NULL));
+    EXPECT_FALSE(map_bus_device(bus, 0x3002, 8, &value, read_constant, NULL));
+    EXPECT_FALSE(map_bus_device(bus, 0xFFFFFFF0, 32, &value, read_constant, NULL));
+
+    uint32_t read = 0;
+    EXPECT_TRUE(read_bus(bus, 0x200C, 4, &read));
+    EXPECT_EQ(read, 0x11223344);
+    EXPECT_TRUE(read_bus(bus, 0x2002, 2, &read));
+    EXPECT_EQ(read, 0x3344);
+    EXPECT_TRUE(read_bus(bus, 0x2001, 1, &read));
+    EXPECT_EQ(read, 0x22);
+    EXPECT_FALSE(read_bus(bus, 0x2010, 4, &read));
+    EXPECT_TRUE(write_bus(bus, 0x2000, 4, 1));
+    EXPECT_EQ(value, 0x11223344);
+    free_bus(bus);
+}
+
+/* Each lane of a pack reads the device on its own bus, the lane without one faults like a CPU without one */
+TEST(BusTest, test_run_pack_reaches_lane_buses) {
+    const uint32_t program[2] = {
+        LDWI_BITMASK | 1 << 7 | 0 << 10 | 3 << 13,  // LDWI R2 R1 3
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 4 << 11, // JMPI R8 4
+    };
+    uint32_t values[2] = {5, 9};
+    Bus *buses[3] = {init_bus(), init_bus(), NULL};
+    Memory *memories[3];
+    for (uint32_t lane = 0; lane < 3; lane++) {
+        memories[lane] = init_memory(4096);
+        store_program(memories[lane], program, 2);
+    }
+    Pack *pack = init_pack(3, memories);
+    ASSERT_NE(pack, nullptr);
+    for (uint32_t lane = 0; lane < 3; lane++) {
+        if (buses[lane] != NULL) {
+            ASSERT_TRUE(map_bus_device(buses[lane], 4096, 4, &values[lane], read_constant, NULL));
+        }
+        Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+        cpu.registers[0] = 4096;
+        cpu.bus = buses[lane];
+        set_pack_lane(pack, lane, &cpu);
+    }
+
+    RunResult results[3];
+    run_pack(pack, 100, results);
+
+    for (uint32_t lane = 0; lane < 2; lane++) {
+        Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+        get_pack_lane(pack, lane, &cpu);
+        EXPECT_EQ(results[lane].status, CPU_STATUS_HALTED) << "lane " << lane;
+        EXPECT_EQ(cpu.registers[1], values[lane]) << "lane " << lane;
+    }
+    EXPECT_EQ(results[2].status, CPU_STATUS_FAULT);
+    EXPECT_EQ(results[2].trap.kind, TRAP_INVALID_MEMORY_LOCATION);
+    free_pack(pack);
+    for (uint32_t lane = 0; lane < 3; lane++) {
+        if (buses[lane] != NULL) {
+            free_bus(buses[lane]);
+        }
+        free_memory(memories[lane]);
+    }
+}
+
+/* Every backend reaches devices through the same LD and ST handlers */
+TEST_P(CpuTest, test_run_cpu_writes_to_uart) {
+    const uint32_t program[6] = {
+        STBI_BITMASK | 0 << 7 | 2 << 10 | 3 << 13,     // STBI R1 R3 3
+        STBI_BITMASK | 1 << 7 | 2 << 10 | 3 << 13,     // STBI R2 R3 3
+        STWI_BITMASK | 3 << 7 | 2 << 10 | 3 << 13,     // STWI R4 R3 3
+        LDWI_BITMASK | 4 << 7 | 2 << 10 | 7 << 13,     // LDWI R5 R3 7
+        LDWI_BITMASK | 5 << 7 | 2 << 10 | 0x13 << 13,  // LDWI R6 R3 19
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 20 << 11,   // JMPI R8 20
+    };
+    const uint32_t registers[8] = {'h', 'i', MEMORY_SIZE_BYTES, 0x1000 | '\n', 0, 0, 0, 0};
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    Uart *uart = init_uart(-1, fds[1]);
+    Bus *bus = init_bus();
+    ASSERT_TRUE(map_bus_device(bus, MEMORY_SIZE_BYTES, UART_BYTES, uart, read_uart, write_uart));
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    cpu.bus = bus;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 6);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 4);
+    EXPECT_EQ(result.trap.kind, TRAP_INVALID_MEMORY_LOCATION);
+    EXPECT_EQ(result.trap.address, MEMORY_SIZE_BYTES + 0x13);
+    EXPECT_EQ(cpu.registers[4], UART_TX_READY);
+    char output[8] = {};
+    EXPECT_EQ(read(fds[0], output, sizeof(output)), 3);
+    EXPECT_STREQ(output, "hi\n");
+    free_cpu(&cpu);
+    free_memory(memory);
+    free_bus(bus);
+    free_uart(uart);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST(BusTest, test_uart_receives_input) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    Uart *uart = init_uart(fds[0], -1);
+
+    EXPECT_EQ(read_uart(uart, UART_STATUS, 4), UART_TX_READY);
+    EXPECT_EQ(read_uart(uart, UART_DATA, 4), 0);
+    ASSERT_EQ(write(fds[1], "ok", 2), 2);
+    EXPECT_EQ(read_uart(uart, UART_STATUS + 3, 1), UART_RX_READY | UART_TX_READY);
+    EXPECT_EQ(read_uart(uart, UART_DATA + 3, 1), 'o');
+    EXPECT_EQ(read_uart(uart, UART_DATA, 4), 'k');
+    EXPECT_EQ(read_uart(uart, UART_STATUS, 4), UART_TX_READY);
+    free_uart(uart);
+    close(fds[0]);
+    close(fds[1]);
+
+    Timer *timer = init_timer();
+    uint32_t first = read_timer(timer, TIMER_TIME_LOW, 4);
+    usleep(2000);
+    EXPECT_GE(read_timer(timer, TIMER_TIME_LOW, 4) - first, 2000);
+    EXPECT_EQ(read_timer(timer, TIMER_TIME_HIGH, 4), 0);
+    free_timer(timer);
+}
+
+TEST(BusTest, test_block_device_maps_file) {
+    const uint32_t program[5] = {
+        STWI_BITMASK | 0 << 7 | 2 << 10 | 3 << 13,     // STWI R1 R3 3
+        LDWI_BITMASK | 1 << 7 | 2 << 10 | 0x203 << 13, // LDWI R2 R3 515
+        LDWI_BITMASK | 4 << 7 | 2 << 10 | 7 << 13,     // LDWI R5 R3 7
+        STHI_BITMASK | 3 << 7 | 2 << 10 | 0x205 << 13, // STHI R4 R3 517
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 16 << 11,   // JMPI R8 16
+    };
+    const uint32_t registers[8] = {1, 0, MEMORY_SIZE_BYTES, 0xBEEF, 0, 0, 0, 0};
+    FILE *file = tmpfile();
+    ASSERT_EQ(ftruncate(fileno(file), 2 * BLOCK_SECTOR_BYTES + 100), 0);
+    ASSERT_EQ(pwrite(fileno(file), "ABCD", 4, BLOCK_SECTOR_BYTES), 4);
+    BlockDevice *block_device = init_block_device(fileno(file), true);
+    ASSERT_NE(block_device, nullptr);
+    Bus *bus = init_bus();
+    ASSERT_TRUE(map_bus_device(bus, MEMORY_SIZE_BYTES, BLOCK_DEVICE_BYTES, block_device, read_block_device,
+                               write_block_device));
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.bus = bus;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 5);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[1], 0x41424344);
+    EXPECT_EQ(cpu.registers[4], 2);
+    EXPECT_TRUE(flush_block_device(block_device));
+    uint8_t bytes[2] = {};
+    ASSERT_EQ(pread(fileno(file), bytes, 2, BLOCK_SECTOR_BYTES + 4), 2);
+    EXPECT_EQ(bytes[0], 0xBE);
+    EXPECT_EQ(bytes[1], 0xEF);
+    free_memory(memory);
+    free_bus(bus);
+    free_block_device(block_device);
+    fclose(file);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Interrupts >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* The timer preempts an endless loop, whose state the handler returns to */
+TEST_P(CpuTest, test_timer_interrupt_preempts_loop) {
+    const uint32_t program[11] = {
+        STWI_BITMASK | 0 << 7 | 2 << 10 | 0x0F << 13, // STWI  R1 R3 15       vector
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x0B << 13, // STWI  R2 R3 11       enable the timer line
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x03 << 13, // STWI  R2 R3 3        enable interrupts
+        STWI_BITMASK | 3 << 7 | 2 << 10 | 0x2B << 13, // STWI  R4 R3 43       arm the timer
+        ADDI_BITMASK | 4 << 7 | 4 << 10 | 1 << 13,    // ADDI  R5 R5 1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 16 << 11,  // JMPI  R8 16
+        0,
+        0,
+        ADDI_BITMASK | 5 << 7 | 5 << 10 | 1 << 13,    // ADDI  R6 R6 1
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x07 << 13, // STWI  R2 R3 7        acknowledge
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1B << 13, // STWI  R2 R3 27       return
+    };
+    const uint32_t registers[8] = {32, 1, MEMORY_SIZE_BYTES, 100, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 11);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(result.steps, 1000);
+    EXPECT_EQ(cpu.registers[5], 1);
+    EXPECT_EQ(cpu.registers[4], (1000 - 4 - 3 + 1) / 2);
+    EXPECT_EQ(cpu.interrupts->saved_program_counter, 16);
+    EXPECT_EQ(cpu.interrupts->cause, INTERRUPT_LINE_TIMER);
+    EXPECT_EQ(cpu.interrupts->status, INTERRUPT_STATUS_ENABLED);
+    EXPECT_EQ(cpu.interrupts->pending, 0);
+    EXPECT_EQ(cpu.interrupts->cycles, 1000);
+    free_interrupt_controller(cpu.interrupts);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Final state of a run with an interrupt controller at the end of memory */
+typedef struct IdleRun {
+    RunResult result;
+    uint32_t program_counter;
+    uint32_t registers[8];
+    uint64_t cycles;
+    uint64_t idle_steps;
+} IdleRun;
+
+/* An attached profile keeps run_cpu from skipping idle loops, which gives the state of running every step */
+static IdleRun run_idle_program(CpuBackend backend, const uint32_t *program, int size, const uint32_t registers[8],
+                                bool profiled, uint64_t max_steps) {
+    Cpu cpu = init_cpu_with_state(backend, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    cpu.profile = profiled ? init_profile() : NULL;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, size);
+
+    IdleRun run = {};
+    run.result = run_cpu(&cpu, memory, max_steps);
+    run.program_counter = cpu.program_counter;
+    memcpy(run.registers, cpu.registers, sizeof(run.registers));
+    run.cycles = cpu.interrupts->cycles;
+    run.idle_steps = cpu.interrupts->idle_steps;
+    free_profile(cpu.profile);
+    free_interrupt_controller(cpu.interrupts);
+    free_cpu(&cpu);
+    free_memory(memory);
+    return run;
+}
+
+static void expect_same_run(const IdleRun &run, const IdleRun &reference) {
+    EXPECT_EQ(run.result.status, reference.result.status);
+    EXPECT_EQ(run.result.steps, reference.result.steps);
+    EXPECT_EQ(run.program_counter, reference.program_counter);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(run.registers[i], reference.registers[i]);
+    }
+    EXPECT_EQ(run.cycles, reference.cycles);
+    EXPECT_EQ(reference.idle_steps, 0);
+}
+
+/* Polls a flag the timer interrupt sets, the poll loop is skipped up to the timer's deadline */
+TEST_P(CpuTest, test_idle_loop_skips_to_timer_deadline) {
+    const uint32_t program[10] = {
+        STWI_BITMASK | 0 << 7 | 2 << 10 | 0x0F << 13,                     // STWI  R1 R3 15       vector
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x0B << 13,                     // STWI  R2 R3 11       enable the timer line
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x03 << 13,                     // STWI  R2 R3 3        enable interrupts
+        STWI_BITMASK | 3 << 7 | 2 << 10 | 0x2B << 13,                     // STWI  R4 R3 43       arm the timer
+        LDWI_BITMASK | 5 << 7 | 7 << 10 | 1023 << 13,                     // LDWI  R6 R8 1023     poll the flag
+        JMP_BITMASK | BITMASK_5 | BITMASK_4 | 5 << 5 | 7 << 8 | 16 << 11, // JMPIC R8 16 R6
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 24 << 11,                      // JMPI  R8 24
+        STWI_BITMASK | 1 << 7 | 7 << 10 | 1023 << 13,                     // STWI  R2 R8 1023     set the flag
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x07 << 13,                     // STWI  R2 R3 7        acknowledge
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1B << 13,                     // STWI  R2 R3 27       return
+    };
+    const uint32_t registers[8] = {28, 1, MEMORY_SIZE_BYTES, 1000000, 0, 0, 0, 0};
+
+    IdleRun run = run_idle_program(GetParam(), program, 10, registers, false, 10000000);
+    IdleRun reference = run_idle_program(GetParam(), program, 10, registers, true, 10000000);
+
+    EXPECT_EQ(run.result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(run.registers[5], 1);
+    EXPECT_GT(run.idle_steps, 900000);
+    expect_same_run(run, reference);
+}
+
+/* Counts a register down to zero, all but the last iterations are skipped in one go */
+TEST_P(CpuTest, test_delay_loop_skips_to_counter_reaching_zero) {
+    const uint32_t program[4] = {
+        SUBI_BITMASK | 0 << 7 | 0 << 10 | 1 << 13,                        // SUBI  R1 R1 1
+        JMP_BITMASK | BITMASK_5 | BITMASK_4 | 0 << 5 | 7 << 8 | 12 << 11, // JMPIC R8 12 R1
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11,                       // JMPI  R8 0
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11,                      // JMPI  R8 12
+    };
+    const uint32_t registers[8] = {3000000, 0, 0, 0, 0, 0, 0, 0};
+
+    IdleRun run = run_idle_program(GetParam(), program, 4, registers, false, 100000000);
+    IdleRun reference = run_idle_program(GetParam(), program, 4, registers, true, 100000000);
+
+    EXPECT_EQ(run.result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(run.result.steps, 3 * 3000000 - 1 + 1);
+    EXPECT_GT(run.idle_steps, 8900000);
+    expect_same_run(run, reference);
+}
+
+/* With interrupts disabled nothing can end the loop, the whole budget is skipped and the step limit still holds */
+TEST_P(CpuTest, test_idle_loop_uses_up_step_limit) {
+    const uint32_t program[2] = {
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 4 << 11, // JMPI R8 4
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 0 << 11, // JMPI R8 0
+    };
+    const uint32_t registers[8] = {};
+
+    IdleRun run = run_idle_program(GetParam(), program, 2, registers, false, 5000001);
+    IdleRun reference = run_idle_program(GetParam(), program, 2, registers, true, 5000001);
+
+    EXPECT_EQ(run.result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(run.result.steps, 5000001);
+    EXPECT_EQ(run.program_counter, 4);
+    EXPECT_GT(run.idle_steps, 4900000);
+    expect_same_run(run, reference);
+}
+
+/* Waiting with interrupts disabled resumes after the wait, at the timer's deadline without running up to it */
+TEST(InterruptTest, test_wait_skips_to_timer_deadline) {
+    const uint32_t program[6] = {
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x0B << 13, // STWI  R2 R3 11       enable the timer line
+        STWI_BITMASK | 3 << 7 | 2 << 10 | 0x2B << 13, // STWI  R4 R3 43       arm the timer
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1F << 13, // STWI  R2 R3 31       wait
+        LDWI_BITMASK | 4 << 7 | 2 << 10 | 0x23 << 13, // LDWI  R5 R3 35       time
+        LDWI_BITMASK | 5 << 7 | 2 << 10 | 0x07 << 13, // LDWI  R6 R3 7        pending
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 20 << 11,  // JMPI  R8 20
+    };
+    const uint32_t registers[8] = {0, 1, MEMORY_SIZE_BYTES, 50000000, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 6);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 6);
+    EXPECT_EQ(cpu.registers[4], 50000000);
+    EXPECT_EQ(cpu.registers[5], 1 << INTERRUPT_LINE_TIMER);
+    free_interrupt_controller(cpu.interrupts);
+    free_memory(memory);
+}
+
+TEST(InterruptTest, test_wait_sleeps_until_raised) {
+    const uint32_t program[4] = {
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x0B << 13, // STWI  R2 R3 11       enable line 3
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1F << 13, // STWI  R2 R3 31       wait
+        LDWI_BITMASK | 4 << 7 | 2 << 10 | 0x07 << 13, // LDWI  R5 R3 7        pending
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11,  // JMPI  R8 12
+    };
+    const uint32_t registers[8] = {0, 1 << 3, MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 4);
+
+    std::thread device([&cpu] {
+        usleep(10000);
+        raise_interrupt(cpu.interrupts, 3);
+    });
+    RunResult result = run_cpu(&cpu, memory, 1000);
+    device.join();
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[4], 1 << 3);
+    EXPECT_EQ(cpu.interrupts->cycles, 4);
+    free_interrupt_controller(cpu.interrupts);
+    free_memory(memory);
+}
+
+/* Nothing can raise a line that is not enabled, the run gives up on the wait rather than sleeping forever */
+TEST(InterruptTest, test_wait_with_no_line_enabled_blocks) {
+    const uint32_t program[2] = {
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1F << 13, // STWI  R2 R3 31       wait
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 4 << 11,   // JMPI  R8 4
+    };
+    const uint32_t registers[8] = {0, 1, MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 2);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_BLOCKED);
+    EXPECT_EQ(result.steps, 1);
+    EXPECT_EQ(cpu.program_counter, 4);
+    EXPECT_EQ(run_cpu(&cpu, memory, 1000).status, CPU_STATUS_BLOCKED);
+    free_interrupt_controller(cpu.interrupts);
+    free_memory(memory);
+}
+
+/* A wait nobody ends returns short of the budget, and the next run picks the wait up again */
+TEST(InterruptTest, test_wait_returns_after_sleeping) {
+    const uint32_t program[4] = {
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x0B << 13, // STWI  R2 R3 11       enable line 3
+        STWI_BITMASK | 1 << 7 | 2 << 10 | 0x1F << 13, // STWI  R2 R3 31       wait
+        LDWI_BITMASK | 4 << 7 | 2 << 10 | 0x07 << 13, // LDWI  R5 R3 7        pending
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11,  // JMPI  R8 12
+    };
+    const uint32_t registers[8] = {0, 1 << 3, MEMORY_SIZE_BYTES, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.interrupts = init_interrupt_controller(MEMORY_SIZE_BYTES);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 4);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+    EXPECT_EQ(result.status, CPU_STATUS_STEP_LIMIT);
+    EXPECT_EQ(result.steps, 2);
+    EXPECT_TRUE(cpu.interrupts->waiting);
+
+    raise_interrupt(cpu.interrupts, 3);
+    result = run_cpu(&cpu, memory, 1000);
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[4], 1 << 3);
+    free_interrupt_controller(cpu.interrupts);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Timing >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Every iteration issues four instructions and pays for one jump, the last one pays for two */
+TEST_P(CpuTest, test_run_cpu_records_timing) {
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    cpu.timing = init_timing_model(NULL);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.steps, 40);
+    EXPECT_EQ(cpu.registers[1], 55);
+    EXPECT_EQ(cpu.timing->instructions, 40);
+    EXPECT_EQ(cpu.timing->cycles, 62);
+    EXPECT_EQ(cpu.timing->jump_stalls, 22);
+    EXPECT_EQ(cpu.timing->execute_stalls, 0);
+    EXPECT_EQ(cpu.timing->class_counts[TIMING_ALU], 20);
+    EXPECT_EQ(cpu.timing->class_counts[TIMING_JUMP], 20);
+    free_timing_model(cpu.timing);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+TEST(TimingTest, test_load_use_stall) {
+    const uint32_t program[3] = {
+        LDWI_BITMASK | 2 << 7 | 0 << 10 | 0 << 13,  // LDWI R3 R1 0
+        ADD_BITMASK | 3 << 7 | 3 << 10 | 2 << 13,   // ADD  R4 R4 R3
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 8 << 11, // JMPI R8 8
+    };
+    const uint32_t registers[8] = {103, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 3);
+    cpu.timing = init_timing_model(NULL);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.timing->load_use_stalls, 1);
+    EXPECT_EQ(cpu.timing->execute_stalls, 0);
+    EXPECT_EQ(cpu.timing->cycles, 6);
+    free_timing_model(cpu.timing);
+    free_memory(memory);
+}
+
+/* The second division waits for the divider, the ADD for the second division's result */
+TEST(TimingTest, test_divider_stall) {
+    const uint32_t program[4] = {
+        DIVI_BITMASK | 2 << 7 | 1 << 10 | 1 << 13,   // DIVI R3 R2 1
+        DIVI_BITMASK | 3 << 7 | 1 << 10 | 1 << 13,   // DIVI R4 R2 1
+        ADD_BITMASK | 4 << 7 | 4 << 10 | 3 << 13,    // ADD  R5 R5 R4
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 12 << 11, // JMPI R8 12
+    };
+    const uint32_t registers[8] = {0, 100, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 4);
+    cpu.timing = init_timing_model(NULL);
+
+    run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(cpu.timing->divider_stalls, 19);
+    EXPECT_EQ(cpu.timing->execute_stalls, 19);
+    EXPECT_EQ(cpu.timing->cycles, 44);
+
+    char buffer[1024] = {};
+    FILE *file = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_TRUE(write_timing_report(cpu.timing, file));
+    fclose(file);
+    EXPECT_NE(strstr(buffer, "cycles                   44\n"), nullptr);
+    EXPECT_NE(strstr(buffer, "  div                   2  50.00%\n"), nullptr);
+    free_timing_model(cpu.timing);
+    free_memory(memory);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Cache >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* The store allocates the first line, the loads hit it except for the one reaching into the next line */
+TEST_P(CpuTest, test_run_cpu_records_cache_accesses) {
+    const uint32_t program[5] = {
+        STWI_BITMASK | 0 << 7 | 1 << 10 | 3 << 13,   // STWI R1 R2 3
+        LDWI_BITMASK | 2 << 7 | 1 << 10 | 3 << 13,   // LDWI R3 R2 3
+        LDWI_BITMASK | 3 << 7 | 1 << 10 | 67 << 13,  // LDWI R4 R2 67
+        LDBI_BITMASK | 4 << 7 | 1 << 10 | 0 << 13,   // LDBI R5 R2 0
+        JMP_BITMASK | BITMASK_5 | 7 << 8 | 16 << 11, // JMPI R8 16
+    };
+    const uint32_t registers[8] = {0x12345678, 0x1000, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, program, 5);
+    cpu.cache = init_cache_hierarchy(NULL, 0);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(cpu.registers[2], 0x12345678);
+    EXPECT_EQ(cpu.registers[4], 0x12);
+    const CacheStats *l1 = &cpu.cache->levels[0].stats;
+    EXPECT_EQ(l1->reads, 3);
+    EXPECT_EQ(l1->writes, 1);
+    EXPECT_EQ(l1->read_misses, 1);
+    EXPECT_EQ(l1->write_misses, 1);
+    EXPECT_EQ(cpu.cache->levels[1].stats.reads, 2);
+    EXPECT_EQ(cpu.cache->levels[1].stats.read_misses, 2);
+    EXPECT_EQ(cpu.cache->memory_reads, 2);
+    EXPECT_EQ(cpu.cache->memory_writes, 0);
+    free_cache_hierarchy(cpu.cache);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+TEST(CacheTest, test_init_cache_hierarchy_rejects_invalid_configs) {
+    CacheConfig config = {96, 2, 32, CACHE_REPLACEMENT_LRU, CACHE_WRITE_BACK};
+    EXPECT_EQ(init_cache_hierarchy(&config, 1), nullptr);
+    config = {128, 8, 32, CACHE_REPLACEMENT_LRU, CACHE_WRITE_BACK};
+    EXPECT_EQ(init_cache_hierarchy(&config, 1), nullptr);
+    config = {128, 2, 2, CACHE_REPLACEMENT_LRU, CACHE_WRITE_BACK};
+    EXPECT_EQ(init_cache_hierarchy(&config, 1), nullptr);
+    EXPECT_EQ(init_cache_hierarchy(&config, 0), nullptr);
+}
+
+/* Two sets of two ways, every address lands in set 0 */
+TEST(CacheTest, test_replacement_policies) {
+    const uint32_t addresses[6] = {0x00, 0x40, 0x00, 0x80, 0x00, 0x40};
+    const CacheReplacement replacements[2] = {CACHE_REPLACEMENT_LRU, CACHE_REPLACEMENT_FIFO};
+    const uint64_t expected_misses[2] = {4, 5};
+    for (int i = 0; i < 2; i++) {
+        CacheConfig config = {128, 2, 32, replacements[i], CACHE_WRITE_BACK};
+        CacheHierarchy *cache = init_cache_hierarchy(&config, 1);
+        ASSERT_NE(cache, nullptr);
+        for (uint32_t address : addresses) {
+            access_cache(cache, address, false);
+        }
+        EXPECT_EQ(cache->levels[0].stats.read_misses, expected_misses[i]);
+        EXPECT_EQ(cache->levels[0].stats.evictions, expected_misses[i] - 2);
+        EXPECT_EQ(cache->memory_reads, expected_misses[i]);
+        free_cache_hierarchy(cache);
+    }
+}
+
+/* A single line L1: write back holds both stores until an eviction, write through passes them on */
+TEST(CacheTest, test_write_policies) {
+    CacheConfig configs[2] = {
+        {64, 1, 64, CACHE_REPLACEMENT_LRU, CACHE_WRITE_BACK},
+        {1024, 2, 64, CACHE_REPLACEMENT_LRU, CACHE_WRITE_BACK},
+    };
+    CacheHierarchy *cache = init_cache_hierarchy(configs, 2);
+    access_cache(cache, 0x00, true);
+    access_cache(cache, 0x04, true);
+    access_cache(cache, 0x40, true);
+    EXPECT_EQ(cache->levels[0].stats.write_misses, 2);
+    EXPECT_EQ(cache->levels[0].stats.writebacks, 1);
+    EXPECT_EQ(cache->levels[1].stats.writes, 1);
+    EXPECT_EQ(cache->levels[1].stats.write_misses, 0);
+    free_cache_hierarchy(cache);
+
+    configs[0].write_policy = CACHE_WRITE_THROUGH;
+    cache = init_cache_hierarchy(configs, 2);
+    access_cache(cache, 0x00, true);
+    access_cache(cache, 0x04, true);
+    access_cache(cache, 0x40, true);
+    EXPECT_EQ(cache->levels[0].stats.write_misses, 3);
+    EXPECT_EQ(cache->levels[0].stats.evictions, 0);
+    EXPECT_EQ(cache->levels[1].stats.writes, 3);
+    EXPECT_EQ(cache->levels[1].stats.write_misses, 2);
+
+    char buffer[1024] = {};
+    FILE *file = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_TRUE(write_cache_report(cache, file));
+    fclose(file);
+    EXPECT_NE(strstr(buffer, "L1 64 bytes 1 way 64 byte lines LRU write through\n"), nullptr);
+    EXPECT_NE(strstr(buffer, "memory reads               2\n"), nullptr);
+    free_cache_hierarchy(cache);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> Branch predictors >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+/* Weakly not taken counters only miss the final exit of the loop, which is all the timing model charges for */
+TEST_P(CpuTest, test_run_cpu_records_branch_predictions) {
+    const uint32_t registers[8] = {10, 0, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_program(memory, SUM_PROGRAM, 5);
+    cpu.branch_predictor = init_branch_predictor(BRANCH_PREDICTOR_BIMODAL, 8);
+    cpu.timing = init_timing_model(NULL);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.steps, 40);
+    EXPECT_EQ(cpu.registers[1], 55);
+    EXPECT_EQ(cpu.branch_predictor->predictions, 10);
+    EXPECT_EQ(cpu.branch_predictor->mispredictions, 1);
+    EXPECT_EQ(cpu.branch_predictor->branch_count, 1);
+    EXPECT_EQ(cpu.timing->jump_stalls, 22);
+    free_timing_model(cpu.timing);
+    free_branch_predictor(cpu.branch_predictor);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+/* Feeds a jump at address 64 back to 0 with the outcomes pattern, period long, returns the mispredictions */
+static uint64_t count_mispredictions(BranchPredictor *predictor, const bool *pattern, int period, int count) {
+    Cpu cpu = init_cpu(CPU_BACKEND_INTERPRETER);
+    DecodedInstruction decoded = {};
+    decoded.id = INSTRUCTION_JMPC;
+    decoded.use_immediate = true;
+    decoded.value = 0;
+    for (int i = 0; i < count; i++) {
+        record_branch(predictor, &decoded, &cpu, 64, pattern[i % period]);
+    }
+    return predictor->mispredictions;
+}
+
+TEST(BranchPredictorTest, test_predictors_learn_patterns) {
+    const bool alternating[2] = {true, false};
+    const bool loop[6] = {true, true, true, true, true, false};
+    BranchPredictor *predictors[BRANCH_PREDICTOR_KIND_COUNT];
+    uint64_t alternating_misses[BRANCH_PREDICTOR_KIND_COUNT];
+    uint64_t loop_misses[BRANCH_PREDICTOR_KIND_COUNT];
+    for (int kind = 0; kind < BRANCH_PREDICTOR_KIND_COUNT; kind++) {
+        predictors[kind] = init_branch_predictor((BranchPredictorKind)kind, 10);
+        ASSERT_NE(predictors[kind], nullptr);
+        alternating_misses[kind] = count_mispredictions(predictors[kind], alternating, 2, 600);
+        free_branch_predictor(predictors[kind]);
+        predictors[kind] = init_branch_predictor((BranchPredictorKind)kind, 10);
+        loop_misses[kind] = count_mispredictions(predictors[kind], loop, 6, 600);
+        free_branch_predictor(predictors[kind]);
+    }
+
+    /* Backward, so always predicted taken */
+    EXPECT_EQ(alternating_misses[BRANCH_PREDICTOR_STATIC], 300);
+    EXPECT_EQ(loop_misses[BRANCH_PREDICTOR_STATIC], 100);
+    EXPECT_GE(alternating_misses[BRANCH_PREDICTOR_BIMODAL], 300);
+    EXPECT_GE(loop_misses[BRANCH_PREDICTOR_BIMODAL], 100);
+    EXPECT_LT(alternating_misses[BRANCH_PREDICTOR_GSHARE], 20);
+    EXPECT_LT(loop_misses[BRANCH_PREDICTOR_GSHARE], 20);
+    EXPECT_LT(alternating_misses[BRANCH_PREDICTOR_TAGE], 20);
+    EXPECT_LT(loop_misses[BRANCH_PREDICTOR_TAGE], 20);
+}
+
+TEST(BranchPredictorTest, test_init_branch_predictor_rejects_invalid_sizes) {
+    EXPECT_EQ(init_branch_predictor(BRANCH_PREDICTOR_GSHARE, 0), nullptr);
+    EXPECT_EQ(init_branch_predictor(BRANCH_PREDICTOR_GSHARE, 25), nullptr);
+    EXPECT_EQ(init_branch_predictor(BRANCH_PREDICTOR_KIND_COUNT, 10), nullptr);
+}
+
+TEST(BranchPredictorTest, test_write_branch_report) {
+    const bool alternating[2] = {true, false};
+    BranchPredictor *predictor = init_branch_predictor(BRANCH_PREDICTOR_STATIC, 4);
+    count_mispredictions(predictor, alternating, 2, 10);
+
+    char buffer[512] = {};
+    FILE *file = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    ASSERT_TRUE(write_branch_report(predictor, file, 10));
+    fclose(file);
+
+    EXPECT_STREQ(buffer, "predictor      static, 16 entries\n"
+                         "predictions                10\n"
+                         "mispredictions              5\n"
+                         "accuracy               50.00%\n"
+                         "\n"
+                         "most mispredicted conditional jumps\n"
+                         "  0x00000040 executed             10  50.00% taken  50.00% accuracy\n");
+    free_branch_predictor(predictor);
+}
+
+/*>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> MMU >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>*/
+
+#define MMU_TEST_DIRECTORY 0x1000
+#define MMU_TEST_TABLE     0x2000
+#define MMU_TEST_CODE      0x40000000 // Mapped to 0x3000, executable
+#define MMU_TEST_DATA      0x40001000 // Mapped to 0x4000, writable
+
+/* Maps MMU_TEST_CODE and MMU_TEST_DATA, data_flags are the flags of the data page */
+static Mmu *init_test_mmu(Memory *memory, uint32_t data_flags) {
+    store_memory_word(memory, MMU_TEST_DIRECTORY + (MMU_TEST_CODE >> 22) * 4, MMU_TEST_TABLE | MMU_ENTRY_VALID);
+    store_memory_word(memory, MMU_TEST_TABLE, 0x3000 | MMU_ENTRY_VALID | MMU_ENTRY_EXECUTE);
+    store_memory_word(memory, MMU_TEST_TABLE + 4, 0x4000 | data_flags);
+    return init_mmu(MMU_TEST_DIRECTORY);
+}
+
+TEST_P(CpuTest, test_run_cpu_translates_addresses) {
+    const uint32_t program[3] = {
+        STWI_BITMASK | 1 << 7 | 0 << 10 | 3 << 13,  // STWI R2 R1 3
+        LDWI_BITMASK | 2 << 7 | 0 << 10 | 3 << 13,  // LDWI R3 R1 3
+        JMP_BITMASK | BITMASK_5 | 3 << 8 | 8 << 11, // JMPI R4 8
+    };
+    const uint32_t registers[8] = {MMU_TEST_DATA, 0xCAFEF00D, 0, MMU_TEST_CODE, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(GetParam(), registers);
+    cpu.program_counter = MMU_TEST_CODE;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    for (int i = 0; i < 3; i++) {
+        store_memory_word(memory, 0x3000 + i * 4, program[i]);
+    }
+    cpu.mmu = init_test_mmu(memory, MMU_ENTRY_VALID | MMU_ENTRY_WRITABLE);
+
+    RunResult result = run_cpu(&cpu, memory, 1000);
+
+    EXPECT_EQ(result.status, CPU_STATUS_HALTED);
+    EXPECT_EQ(result.steps, 3);
+    EXPECT_EQ(cpu.program_counter, MMU_TEST_CODE + 8);
+    EXPECT_EQ(cpu.registers[2], 0xCAFEF00D);
+    EXPECT_EQ(load_memory_word(memory, 0x4000), 0xCAFEF00D);
+    EXPECT_EQ(cpu.mmu->tlb_misses, 2);
+    EXPECT_EQ(cpu.mmu->page_faults, 0);
+    free_mmu(cpu.mmu);
+    free_cpu(&cpu);
+    free_memory(memory);
+}
+
+TEST(MmuTest, test_page_faults) {
+    const uint32_t program[2] = {
+        LDWI_BITMASK | 2 << 7 | 0 << 10 | 3 << 13, // LDWI R3 R1 3
+        STWI_BITMASK | 1 << 7 | 0 << 10 | 3 << 13, // STWI R2 R1 3
+    };
+    const uint32_t registers[8] = {MMU_TEST_DATA, 1, 0, 0, 0, 0, 0, 0};
+    Cpu cpu = init_cpu_with_state(CPU_BACKEND_INTERPRETER, registers);
+    cpu.program_counter = MMU_TEST_CODE;
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    store_memory_word(memory, 0x3000, program[0]);
+    store_memory_word(memory, 0x3004, program[1]);
+    cpu.mmu = init_test_mmu(memory, MMU_ENTRY_VALID);
+
+    /* The data page is read only */
+    RunResult result = run_cpu(&cpu, memory, 1000);
+    EXPECT_EQ(result.status, CPU_STATUS_FAULT);
+    EXPECT_EQ(result.steps, 1);
+    EXPECT_EQ(result.trap.kind, TRAP_PAGE_FAULT);
+    EXPECT_EQ(result.trap.address, MMU_TEST_DATA + 3);
+    EXPECT_EQ(result.trap.value, MMU_ACCESS_WRITE);
+    EXPECT_EQ(cpu.program_counter, MMU_TEST_CODE + 4);
+    EXPECT_EQ(load_memory_word(memory, 0x4000), 0);
+
+    /* Nothing is mapped past the code page */
+    cpu.program_counter = MMU_TEST_CODE + MMU_PAGE_BYTES * 2;
+    result = run_cpu(&cpu, memory, 1000);
+    EXPECT_EQ(result.trap.kind, TRAP_PAGE_FAULT);
+    EXPECT_EQ(result.trap.value, MMU_ACCESS_EXECUTE);
+    EXPECT_EQ(cpu.mmu->page_faults, 2);
+    free_mmu(cpu.mmu);
+    free_memory(memory);
+}
+
+/* A single instruction is translated too, an unmapped store must not reach the physical address it names */
+TEST(MmuTest, test_execute_instruction_translates_addresses) {
+    for (CpuBackend backend : {CPU_BACKEND_INTERPRETER, CPU_BACKEND_THREADED}) {
+        const uint32_t registers[8] = {0x1000, 0xCAFEF00D, 0, 0, 0, 0, 0, 0};
+        Cpu cpu = init_cpu_with_state(backend, registers);
+        Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+        cpu.mmu = init_mmu(MMU_TEST_DIRECTORY);
+
+        Trap trap = execute_instruction(STWI_BITMASK | 1 << 7 | 0 << 10 | 3 << 13, &cpu, memory); // STWI R2 R1 3
+        EXPECT_EQ(trap.kind, TRAP_PAGE_FAULT) << "backend " << backend;
+        EXPECT_EQ(trap.address, 0x1003) << "backend " << backend;
+        EXPECT_EQ(load_memory_word(memory, 0x1000), 0) << "backend " << backend;
+
+        free_mmu(cpu.mmu);
+        cpu.mmu = init_test_mmu(memory, MMU_ENTRY_VALID | MMU_ENTRY_WRITABLE);
+        cpu.registers[0] = MMU_TEST_DATA;
+        trap = execute_instruction(STWI_BITMASK | 1 << 7 | 0 << 10 | 3 << 13, &cpu, memory);
+        EXPECT_EQ(trap.kind, TRAP_NONE) << "backend " << backend;
+        trap = execute_instruction(LDWI_BITMASK | 2 << 7 | 0 << 10 | 3 << 13, &cpu, memory); // LDWI R3 R1 3
+        EXPECT_EQ(trap.kind, TRAP_NONE) << "backend " << backend;
+        EXPECT_EQ(load_memory_word(memory, 0x4000), 0xCAFEF00D) << "backend " << backend;
+        EXPECT_EQ(cpu.registers[2], 0xCAFEF00D) << "backend " << backend;
+        free_mmu(cpu.mmu);
+        free_cpu(&cpu);
+        free_memory(memory);
+    }
+}
+
+/* The TLB keeps using the old entry until the guest flushes it */
+TEST(MmuTest, test_flush_mmu) {
+    Memory *memory = init_memory(MEMORY_SIZE_BYTES);
+    Mmu *mmu = init_test_mmu(memory, MMU_ENTRY_VALID);
+    uint32_t physical_address = 0;
+    ASSERT_TRUE(translate_address(mmu, memory, MMU_TEST_DATA + 8, MMU_ACCESS_READ, &physical_address));
+    EXPECT_EQ(physical_address, 0x4008);
+
+    store_memory_word(memory, MMU_TEST_TABLE + 4, 0x5000 | MMU_ENTRY_VALID);
+    ASSERT_TRUE(translate_address(mmu, memory, MMU_TEST_DATA + 8, MMU_ACCESS_READ, &physical_address));
+    EXPECT_EQ(physical_address, 0x4008);
+
+    write_mmu(mmu, MMU_FLUSH, 4, 0);
+    ASSERT_TRUE(translate_address(mmu, memory, MMU_TEST_DATA + 8, MMU_ACCESS_READ, &physical_address));
+    EXPECT_EQ(physical_address, 0x5008);
+    EXPECT_EQ(read_mmu(mmu, MMU_ROOT, 4), MMU_TEST_DIRECTORY);
+    EXPECT_EQ(mmu->tlb_misses, 2);
+    free_mmu(mmu);
+    free_memory(memory);
 }
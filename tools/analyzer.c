@@ -0,0 +1,104 @@
+/*********************************************************************************************************************
+ * Command line front end of the static analyzer                                                                     *
+ *                                                                                                                   *
+ *     analyzer [--entry <address>]... [--hints <file>] <image>                                                      *
+ *                                                                                                                   *
+ * Prints the basic blocks, loops and issues of an image as write_program_image writes it. Entries add addresses    *
+ * execution starts at besides 0, e.g. interrupt handlers, and hints are written for apply_analysis_hints.           *
+ *********************************************************************************************************************/
+
+#include "../src/analyzer.h"
+#include "../src/assembler.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ENTRIES 64
+
+/* Returns the big endian words of the image, or NULL when it cannot be read or is not a whole number of words */
+static Program *read_program_image(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    Program *program = NULL;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (size >= 0 && size % 4 == 0 && size / 4 <= UINT32_MAX && fseek(file, 0, SEEK_SET) == 0) {
+        program = malloc(sizeof(Program) + size);
+    }
+    if (program != NULL) {
+        program->word_count = size / 4;
+        for (uint32_t i = 0; i < program->word_count; i++) {
+            uint8_t bytes[4];
+            if (fread(bytes, 1, 4, file) != 4) {
+                free(program);
+                program = NULL;
+                break;
+            }
+            program->words[i] =
+                (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+        }
+    }
+    fclose(file);
+    return program;
+}
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "usage: %s [--entry <address>]... [--hints <file>] <image>\n", name);
+}
+
+int main(int argc, char **argv) {
+    uint32_t entries[MAX_ENTRIES];
+    uint32_t entry_count = 0;
+    const char *hints_path = NULL;
+    const char *image_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        char *end;
+        if (strcmp(argv[i], "--entry") == 0 && i + 1 < argc && entry_count < MAX_ENTRIES) {
+            unsigned long address = strtoul(argv[++i], &end, 0);
+            if (*end != '\0' || address > UINT32_MAX) {
+                print_usage(argv[0]);
+                return 2;
+            }
+            entries[entry_count++] = address;
+        } else if (strcmp(argv[i], "--hints") == 0 && i + 1 < argc) {
+            hints_path = argv[++i];
+        } else if (image_path == NULL && argv[i][0] != '-') {
+            image_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (image_path == NULL) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    Program *program = read_program_image(image_path);
+    if (program == NULL) {
+        fprintf(stderr, "%s: cannot read a program image\n", image_path);
+        return 1;
+    }
+    ProgramAnalysis *analysis = analyze_program(program, entries, entry_count);
+    free_program(program);
+    if (analysis == NULL) {
+        fprintf(stderr, "%s: out of memory\n", image_path);
+        return 1;
+    }
+
+    bool written = write_analysis_report(analysis, stdout);
+    if (written && hints_path != NULL) {
+        FILE *hints = fopen(hints_path, "w");
+        written = hints != NULL && write_analysis_hints(analysis, hints);
+        if (hints != NULL && fclose(hints) != 0) {
+            written = false;
+        }
+        if (!written) {
+            perror(hints_path);
+        }
+    }
+    free_program_analysis(analysis);
+    return written ? 0 : 1;
+}
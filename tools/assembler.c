@@ -0,0 +1,77 @@
+/*********************************************************************************************************************
+ * Command line front end of the assembler                                                                           *
+ *                                                                                                                   *
+ *     assembler <source> <image>                                                                                     *
+ *                                                                                                                   *
+ * Writes the image load_program_image maps, errors are printed as <source>:<line>: <message>                        *
+ *********************************************************************************************************************/
+
+#include "../src/assembler.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Returns the NUL terminated contents of the file, or NULL when it cannot be read */
+static char *read_source(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *source = malloc(capacity);
+    while (source != NULL) {
+        length += fread(source + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = realloc(source, capacity);
+        if (grown == NULL) {
+            free(source);
+        }
+        source = grown;
+    }
+    if (source != NULL && ferror(file)) {
+        free(source);
+        source = NULL;
+    }
+    if (source != NULL) {
+        source[length] = '\0';
+    }
+    fclose(file);
+    return source;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <source> <image>\n", argv[0]);
+        return 2;
+    }
+
+    char *source = read_source(argv[1]);
+    if (source == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    AssemblyError error;
+    Program *program = assemble_program(source, &error);
+    free(source);
+    if (program == NULL) {
+        fprintf(stderr, "%s:%" PRIu32 ": %s\n", argv[1], error.line, error.message);
+        return 1;
+    }
+
+    int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool written = fd != -1 && write_program_image(program, fd);
+    if (fd != -1 && close(fd) != 0) {
+        written = false;
+    }
+    free_program(program);
+    if (!written) {
+        perror(argv[2]);
+        return 1;
+    }
+    return 0;
+}